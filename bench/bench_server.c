@@ -0,0 +1,592 @@
+#include "bench_server.h"
+#include <libssh/libssh.h>
+#include <libssh/server.h>
+#include <libssh/callbacks.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define BULK_PATTERN 65536
+#define BULK_CHUNK 32768
+#define RELAY_CHUNK 65536
+#define SFTP_CHUNK 65536
+// Room for a few pipelined 32 KiB writes each way before sftp-server blocks
+#define SFTP_SOCKET_BUFFER (1 << 20)
+// Sessions still open after this long are left behind by bench_server_stop
+#define STOP_WAIT_S 5
+
+struct BenchServer {
+    ssh_bind bind;
+    int port;
+    pthread_t accept_thread;
+
+    int latency_us;
+    char *sftp_server;      // NULL when none was found
+    int relay_fd;           // -1 without latency
+    int relay_port;
+    pthread_t relay_thread;
+
+    atomic_bool stopping;
+    int active;             // Session and relay threads still running
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+
+    char bulk[BULK_PATTERN];
+};
+
+static int64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void thread_started(BenchServer *server) {
+    pthread_mutex_lock(&server->lock);
+    server->active++;
+    pthread_mutex_unlock(&server->lock);
+}
+
+static void thread_done(BenchServer *server) {
+    pthread_mutex_lock(&server->lock);
+    if (--server->active == 0) pthread_cond_broadcast(&server->idle);
+    pthread_mutex_unlock(&server->lock);
+}
+
+// Colored, numbered lines, like the output of a build or a log tail
+static void fill_bulk_pattern(char *buf, size_t len) {
+    static const char *colors[] = { "\033[32m", "\033[33m", "\033[36m", "\033[1;31m" };
+    size_t used = 0;
+    for (int line = 0; used < len; line++) {
+        char text[128];
+        int n = snprintf(text, sizeof(text), "%s%06d\033[0m the quick brown fox jumps over the lazy dog %08x\r\n",
+                         colors[line % 4], line, (unsigned)line * 2654435761u);
+        size_t copy = (size_t)n < len - used ? (size_t)n : len - used;
+        memcpy(buf + used, text, copy);
+        used += copy;
+    }
+}
+
+// --- Shell workloads ---
+
+static bool write_all(ssh_channel channel, const char *data, size_t len) {
+    while (len > 0) {
+        int n = ssh_channel_write(channel, data, len);
+        if (n <= 0) return false;
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Reads one command line, false when the channel closed first
+static bool read_line(ssh_channel channel, char *line, size_t len) {
+    size_t used = 0;
+    while (used + 1 < len) {
+        char c;
+        if (ssh_channel_read(channel, &c, 1, 0) != 1) return false;
+        if (c == '\n' || c == '\r') {
+            if (used == 0) continue;
+            break;
+        }
+        line[used++] = c;
+    }
+    line[used] = '\0';
+    return true;
+}
+
+static void run_shell(BenchServer *server, ssh_channel channel) {
+    char line[64];
+    while (read_line(channel, line, sizeof(line))) {
+        long long bytes;
+        if (sscanf(line, "bulk %lld", &bytes) == 1) {
+            while (bytes > 0) {
+                size_t chunk = bytes < BULK_CHUNK ? (size_t)bytes : BULK_CHUNK;
+                if (!write_all(channel, server->bulk, chunk)) return;
+                bytes -= (long long)chunk;
+            }
+        } else if (strcmp(line, "echo") == 0) {
+            char buf[4096];
+            int n;
+            while ((n = ssh_channel_read(channel, buf, sizeof(buf), 0)) > 0) {
+                if (!write_all(channel, buf, (size_t)n)) return;
+            }
+            return;
+        } else if (strcmp(line, "idle") == 0) {
+            char buf[256];
+            while (ssh_channel_read(channel, buf, sizeof(buf), 0) > 0) {
+            }
+            return;
+        }
+    }
+}
+
+// --- SFTP subsystem ---
+
+static const char *sftp_server_paths[] = {
+    "/usr/lib/openssh/sftp-server",
+    "/usr/libexec/openssh/sftp-server",
+    "/usr/lib/ssh/sftp-server",
+    "/usr/libexec/sftp-server",
+    "/usr/lib/sftp-server"
+};
+
+static char* find_sftp_server(const char *configured) {
+    if (configured) return access(configured, X_OK) == 0 ? strdup(configured) : NULL;
+    for (size_t i = 0; i < sizeof(sftp_server_paths) / sizeof(sftp_server_paths[0]); i++) {
+        if (access(sftp_server_paths[i], X_OK) == 0) return strdup(sftp_server_paths[i]);
+    }
+    return NULL;
+}
+
+typedef struct {
+    ssh_channel channel;
+    int fd;                 // Our end of the socketpair to sftp-server
+    bool done;
+} SftpRelay;
+
+static int on_client_data(ssh_session session, ssh_channel channel, void *data, uint32_t len,
+                          int is_stderr, void *userdata) {
+    (void)session;
+    (void)channel;
+    (void)is_stderr;
+    SftpRelay *relay = (SftpRelay *)userdata;
+    if (!send_all(relay->fd, data, len)) relay->done = true;
+    return (int)len;
+}
+
+// The client is done: sftp-server sees EOF, exits, and its output ends
+static void on_client_eof(ssh_session session, ssh_channel channel, void *userdata) {
+    (void)session;
+    (void)channel;
+    shutdown(((SftpRelay *)userdata)->fd, SHUT_WR);
+}
+
+static void on_client_close(ssh_session session, ssh_channel channel, void *userdata) {
+    (void)session;
+    (void)channel;
+    ((SftpRelay *)userdata)->done = true;
+}
+
+static int on_server_output(socket_t fd, int revents, void *userdata) {
+    SftpRelay *relay = (SftpRelay *)userdata;
+    if (!(revents & (POLLIN | POLLHUP | POLLERR))) return 0;
+    char buf[SFTP_CHUNK];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n > 0) {
+        if (!write_all(relay->channel, buf, (size_t)n)) relay->done = true;
+    } else if (n == 0 || errno != EINTR) {
+        ssh_channel_send_eof(relay->channel);
+        relay->done = true;
+    }
+    return 0;
+}
+
+// The system sftp-server on a socketpair, its stdin and stdout relayed to the channel
+static void run_sftp(BenchServer *server, ssh_session session, ssh_channel channel) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) return;
+    int size = SFTP_SOCKET_BUFFER;
+    for (int i = 0; i < 2; i++) {
+        setsockopt(sv[i], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        setsockopt(sv[i], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // dup2 clears close-on-exec on the copies
+        dup2(sv[1], STDIN_FILENO);
+        dup2(sv[1], STDOUT_FILENO);
+        execl(server->sftp_server, server->sftp_server, (char *)NULL);
+        _exit(127);
+    }
+    close(sv[1]);
+    if (pid < 0) {
+        close(sv[0]);
+        return;
+    }
+
+    SftpRelay relay = { channel, sv[0], false };
+    struct ssh_channel_callbacks_struct callbacks = {
+        .userdata = &relay,
+        .channel_data_function = on_client_data,
+        .channel_eof_function = on_client_eof,
+        .channel_close_function = on_client_close
+    };
+    ssh_callbacks_init(&callbacks);
+    ssh_set_channel_callbacks(channel, &callbacks);
+
+    ssh_event event = ssh_event_new();
+    if (event && ssh_event_add_session(event, session) == SSH_OK &&
+        ssh_event_add_fd(event, relay.fd, POLLIN, on_server_output, &relay) == SSH_OK) {
+        while (!relay.done && !server->stopping) {
+            if (ssh_event_dopoll(event, 1000) == SSH_ERROR) break;
+        }
+        ssh_event_remove_fd(event, relay.fd);
+        ssh_event_remove_session(event, session);
+    }
+    if (event) ssh_event_free(event);
+    ssh_remove_channel_callbacks(channel, &callbacks);
+
+    close(relay.fd);
+    waitpid(pid, NULL, 0);
+}
+
+// --- Sessions ---
+
+typedef struct {
+    BenchServer *server;
+    ssh_session session;
+} SessionArgs;
+
+// Password auth, one session channel, then its requests until the shell or the sftp subsystem
+static ssh_channel accept_channel(BenchServer *server, ssh_session session, bool *sftp) {
+    ssh_channel channel = NULL;
+    ssh_message msg;
+    while ((msg = ssh_message_get(session)) != NULL) {
+        int type = ssh_message_type(msg);
+        int subtype = ssh_message_subtype(msg);
+        bool ready = false;
+
+        if (type == SSH_REQUEST_AUTH && subtype == SSH_AUTH_METHOD_PASSWORD) {
+            ssh_message_auth_reply_success(msg, 0);
+        } else if (type == SSH_REQUEST_AUTH) {
+            ssh_message_auth_set_methods(msg, SSH_AUTH_METHOD_PASSWORD);
+            ssh_message_reply_default(msg);
+        } else if (type == SSH_REQUEST_CHANNEL_OPEN && subtype == SSH_CHANNEL_SESSION && !channel) {
+            channel = ssh_message_channel_request_open_reply_accept(msg);
+        } else if (type == SSH_REQUEST_CHANNEL && channel &&
+                   (subtype == SSH_CHANNEL_REQUEST_PTY || subtype == SSH_CHANNEL_REQUEST_ENV ||
+                    subtype == SSH_CHANNEL_REQUEST_WINDOW_CHANGE)) {
+            ssh_message_channel_request_reply_success(msg);
+        } else if (type == SSH_REQUEST_CHANNEL && channel && subtype == SSH_CHANNEL_REQUEST_SHELL) {
+            ssh_message_channel_request_reply_success(msg);
+            ready = true;
+        } else if (type == SSH_REQUEST_CHANNEL && channel && subtype == SSH_CHANNEL_REQUEST_SUBSYSTEM &&
+                   server->sftp_server && strcmp(ssh_message_channel_request_subsystem(msg), "sftp") == 0) {
+            ssh_message_channel_request_reply_success(msg);
+            ready = true;
+            *sftp = true;
+        } else {
+            ssh_message_reply_default(msg);
+        }
+        ssh_message_free(msg);
+        if (ready) return channel;
+    }
+    if (channel) ssh_channel_free(channel);
+    return NULL;
+}
+
+static void* session_thread(void *arg) {
+    SessionArgs *args = (SessionArgs *)arg;
+    BenchServer *server = args->server;
+    ssh_session session = args->session;
+    free(args);
+
+    if (ssh_handle_key_exchange(session) == SSH_OK) {
+        bool sftp = false;
+        ssh_channel channel = accept_channel(server, session, &sftp);
+        if (channel) {
+            if (sftp) run_sftp(server, session, channel);
+            else run_shell(server, channel);
+            ssh_channel_send_eof(channel);
+            ssh_channel_close(channel);
+            ssh_channel_free(channel);
+        }
+    }
+    ssh_disconnect(session);
+    ssh_free(session);
+    thread_done(server);
+    return NULL;
+}
+
+static void* accept_thread(void *arg) {
+    BenchServer *server = (BenchServer *)arg;
+    for (;;) {
+        ssh_session session = ssh_new();
+        if (!session) break;
+        if (ssh_bind_accept(server->bind, session) != SSH_OK) {
+            ssh_free(session);
+            if (server->stopping) break;
+            continue;
+        }
+
+        SessionArgs *args = malloc(sizeof(SessionArgs));
+        args->server = server;
+        args->session = session;
+        thread_started(server);
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, session_thread, args) != 0) {
+            ssh_free(session);
+            free(args);
+            thread_done(server);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+// --- Latency relay ---
+
+typedef struct Chunk {
+    struct Chunk *next;
+    int64_t due_us;
+    size_t len;
+    char data[];
+} Chunk;
+
+typedef struct {
+    BenchServer *server;
+    int fds[2];             // Client side, server side
+    int pumps;              // Directions still running, the last one closes both
+    pthread_mutex_t lock;
+} RelayConn;
+
+typedef struct {
+    RelayConn *conn;
+    int src;
+    int dst;
+} Pump;
+
+// Holds what src sends for latency_us before passing it on to dst
+static void* pump_thread(void *arg) {
+    Pump *pump = (Pump *)arg;
+    RelayConn *conn = pump->conn;
+    int latency_us = conn->server->latency_us;
+    Chunk *head = NULL, **tail = &head;
+    bool src_open = true, dst_ok = true;
+    char *buf = malloc(RELAY_CHUNK);
+
+    while (dst_ok && (src_open || head)) {
+        int timeout = -1;
+        if (head) {
+            int64_t wait = head->due_us - now_us();
+            timeout = wait > 0 ? (int)((wait + 999) / 1000) : 0;
+        }
+        int ready = 0;
+        if (src_open) {
+            struct pollfd pfd = { .fd = pump->src, .events = POLLIN };
+            ready = poll(&pfd, 1, timeout);
+        } else if (timeout > 0) {
+            usleep((useconds_t)timeout * 1000);
+        }
+        if (ready > 0) {
+            ssize_t n = recv(pump->src, buf, RELAY_CHUNK, 0);
+            if (n > 0) {
+                Chunk *c = malloc(sizeof(Chunk) + (size_t)n);
+                c->next = NULL;
+                c->due_us = now_us() + latency_us;
+                c->len = (size_t)n;
+                memcpy(c->data, buf, (size_t)n);
+                *tail = c;
+                tail = &c->next;
+            } else if (n == 0 || errno != EINTR) {
+                src_open = false;
+            }
+        }
+
+        int64_t now = now_us();
+        while (head && head->due_us <= now) {
+            Chunk *c = head;
+            dst_ok = send_all(pump->dst, c->data, c->len);
+            head = c->next;
+            if (!head) tail = &head;
+            free(c);
+            if (!dst_ok) break;
+        }
+    }
+    shutdown(pump->dst, SHUT_WR);
+
+    while (head) {
+        Chunk *c = head;
+        head = c->next;
+        free(c);
+    }
+    free(buf);
+    free(pump);
+
+    pthread_mutex_lock(&conn->lock);
+    bool last = --conn->pumps == 0;
+    pthread_mutex_unlock(&conn->lock);
+    BenchServer *server = conn->server;
+    if (last) {
+        close(conn->fds[0]);
+        close(conn->fds[1]);
+        pthread_mutex_destroy(&conn->lock);
+        free(conn);
+    }
+    thread_done(server);
+    return NULL;
+}
+
+static int listen_loopback(int *port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &len) != 0) {
+        close(fd);
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static int connect_loopback(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void start_pump(RelayConn *conn, int src, int dst) {
+    Pump *pump = malloc(sizeof(Pump));
+    pump->conn = conn;
+    pump->src = src;
+    pump->dst = dst;
+    thread_started(conn->server);
+    pthread_t thread;
+    pthread_create(&thread, NULL, pump_thread, pump);
+    pthread_detach(thread);
+}
+
+static void* relay_thread(void *arg) {
+    BenchServer *server = (BenchServer *)arg;
+    int one = 1;
+    for (;;) {
+        int client = accept(server->relay_fd, NULL, NULL);
+        if (client < 0) {
+            if (server->stopping) break;
+            continue;
+        }
+        int upstream = connect_loopback(server->port);
+        if (upstream < 0) {
+            close(client);
+            continue;
+        }
+        // The relay adds the latency, Nagle must not add more
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(upstream, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        RelayConn *conn = calloc(1, sizeof(RelayConn));
+        conn->server = server;
+        conn->fds[0] = client;
+        conn->fds[1] = upstream;
+        conn->pumps = 2;
+        pthread_mutex_init(&conn->lock, NULL);
+        start_pump(conn, client, upstream);
+        start_pump(conn, upstream, client);
+    }
+    return NULL;
+}
+
+// --- Server ---
+
+BenchServer* bench_server_start(const BenchServerConfig *config) {
+    BenchServer *server = calloc(1, sizeof(BenchServer));
+    if (!server) return NULL;
+    server->latency_us = config ? config->latency_us : 0;
+    server->sftp_server = find_sftp_server(config ? config->sftp_server : NULL);
+    server->relay_fd = -1;
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->idle, NULL);
+    fill_bulk_pattern(server->bulk, sizeof(server->bulk));
+
+    ssh_key key = NULL;
+    unsigned int port = 0;
+    server->bind = ssh_bind_new();
+    if (!server->bind || ssh_pki_generate(SSH_KEYTYPE_ED25519, 0, &key) != SSH_OK) goto fail;
+    // The bind owns the key from here
+    ssh_bind_options_set(server->bind, SSH_BIND_OPTIONS_IMPORT_KEY, key);
+    ssh_bind_options_set(server->bind, SSH_BIND_OPTIONS_BINDADDR, "127.0.0.1");
+    ssh_bind_options_set(server->bind, SSH_BIND_OPTIONS_BINDPORT, &port);
+    if (ssh_bind_listen(server->bind) != SSH_OK) {
+        fprintf(stderr, "bench server: %s\n", ssh_get_error(server->bind));
+        goto fail;
+    }
+
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(ssh_bind_get_fd(server->bind), (struct sockaddr *)&addr, &len) != 0) goto fail;
+    server->port = ntohs(addr.sin_port);
+
+    if (server->latency_us > 0) {
+        server->relay_fd = listen_loopback(&server->relay_port);
+        if (server->relay_fd < 0) goto fail;
+    }
+
+    pthread_create(&server->accept_thread, NULL, accept_thread, server);
+    if (server->relay_fd >= 0) pthread_create(&server->relay_thread, NULL, relay_thread, server);
+    return server;
+
+fail:
+    if (server->bind) ssh_bind_free(server->bind);
+    free(server->sftp_server);
+    pthread_cond_destroy(&server->idle);
+    pthread_mutex_destroy(&server->lock);
+    free(server);
+    return NULL;
+}
+
+int bench_server_port(BenchServer *server) {
+    return server->relay_fd >= 0 ? server->relay_port : server->port;
+}
+
+void bench_server_stop(BenchServer *server) {
+    if (!server) return;
+    server->stopping = true;
+    // Wakes the blocked accepts
+    shutdown(ssh_bind_get_fd(server->bind), SHUT_RDWR);
+    pthread_join(server->accept_thread, NULL);
+    if (server->relay_fd >= 0) {
+        shutdown(server->relay_fd, SHUT_RDWR);
+        pthread_join(server->relay_thread, NULL);
+        close(server->relay_fd);
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += STOP_WAIT_S;
+    pthread_mutex_lock(&server->lock);
+    int rc = 0;
+    while (server->active > 0 && rc == 0) rc = pthread_cond_timedwait(&server->idle, &server->lock, &deadline);
+    bool leftover = server->active > 0;
+    pthread_mutex_unlock(&server->lock);
+
+    ssh_bind_free(server->bind);
+    // Threads still running would use it, leak it instead
+    if (leftover) return;
+    free(server->sftp_server);
+    pthread_cond_destroy(&server->idle);
+    pthread_mutex_destroy(&server->lock);
+    free(server);
+}
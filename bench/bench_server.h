@@ -0,0 +1,29 @@
+#ifndef BENCH_SERVER_H
+#define BENCH_SERVER_H
+
+// Loopback SSH server stand-in for the benchmarks, built on libssh's server
+// mode. It accepts any password and runs a scripted shell: the first line the
+// client sends picks the workload.
+//   bulk <bytes>   writes that much terminal-like output, then waits for the next line
+//   echo           sends every byte received straight back
+//   idle           does nothing until the channel closes
+// The "sftp" subsystem runs the system sftp-server, so SFTP sessions see the
+// real file system.
+// With a latency, clients reach it through a relay that holds every chunk
+// for that long in each direction, as a distant server would.
+typedef struct BenchServer BenchServer;
+
+typedef struct {
+    int latency_us;         // One way, 0 for none
+    const char *sftp_server; // NULL looks in the usual places
+} BenchServerConfig;
+
+BenchServer* bench_server_start(const BenchServerConfig *config);
+
+// Port clients connect to on 127.0.0.1
+int bench_server_port(BenchServer *server);
+
+// Waits for the sessions still open to end
+void bench_server_stop(BenchServer *server);
+
+#endif
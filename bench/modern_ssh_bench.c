@@ -0,0 +1,203 @@
+#include "bench_server.h"
+#include "ssh_backend.h"
+#include "latency_histogram.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <time.h>
+
+// Same read size as the terminal tabs
+#define READ_SIZE 4096
+#define READ_WAIT_MS 100
+
+typedef struct {
+    int latency_ms;
+    int bulk_mb;
+    int keys;
+    int sessions;
+    int sweeps;
+    const char *only;       // NULL runs every workload
+} BenchOptions;
+
+static int port;
+
+// CPU time of the calling thread, the server runs on others
+static int64_t thread_cpu_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static SSHContext* open_session() {
+    SSHContext *ctx = ssh_context_new();
+    if (!ctx) return NULL;
+    if (ssh_connect_to_server(ctx, "127.0.0.1", port, "bench", "bench", NULL, NULL, 0, NULL, NULL, NULL, true) != 0) {
+        fprintf(stderr, "connect: %s\n", ssh_get_error_msg(ctx));
+        ssh_context_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+static bool send_line(SSHContext *ctx, const char *line) {
+    return ssh_write_data(ctx, line, strlen(line)) == (int)strlen(line);
+}
+
+// Like the terminal poll, but waits on the socket instead of a timer when there's nothing to read
+static int read_some(SSHContext *ctx, char *buf) {
+    for (;;) {
+        int n = ssh_read_nonblocking(ctx, buf, READ_SIZE);
+        if (n != 0) return n;
+        if (!ssh_is_channel_open(ctx)) return -1;
+        struct pollfd pfd = { .fd = ssh_get_fd(ctx->session), .events = POLLIN };
+        if (poll(&pfd, 1, READ_WAIT_MS) < 0) return -1;
+    }
+}
+
+static void format_us(int64_t us, char *buf, size_t len) {
+    if (us < 0) snprintf(buf, len, "-");
+    else if (us < 10000) snprintf(buf, len, "%.3f ms", us / 1000.0);
+    else snprintf(buf, len, "%.1f ms", us / 1000.0);
+}
+
+// Terminal output as fast as the server can write it
+static bool bench_bulk(const BenchOptions *opt) {
+    SSHContext *ctx = open_session();
+    if (!ctx) return false;
+
+    long long total = (long long)opt->bulk_mb << 20;
+    char line[64], buf[READ_SIZE];
+    snprintf(line, sizeof(line), "bulk %lld\n", total);
+
+    int64_t start = trace_now_us(), cpu = thread_cpu_us();
+    bool ok = send_line(ctx, line);
+    long long got = 0;
+    while (ok && got < total) {
+        int n = read_some(ctx, buf);
+        if (n < 0) ok = false;
+        else got += n;
+    }
+    double seconds = (trace_now_us() - start) / 1e6;
+    double cpu_ms = (thread_cpu_us() - cpu) / 1e3;
+
+    SSHStatsSnapshot s;
+    ssh_stats_snapshot(ctx, &s);
+    double mb = got / 1048576.0;
+    printf("bulk    %6.0f MiB  %8.1f MB/s  %7.3f ms CPU/MB  %.1f KiB/read  %.0f%% of polls read data\n",
+           mb, mb / seconds, cpu_ms / (mb > 0 ? mb : 1), s.reads ? s.bytes_in / 1024.0 / s.reads : 0,
+           s.polls ? 100.0 * s.reads / s.polls : 0);
+    ssh_context_free(ctx);
+    return ok;
+}
+
+// One key at a time, each waiting for its echo
+static bool bench_echo(const BenchOptions *opt) {
+    SSHContext *ctx = open_session();
+    if (!ctx) return false;
+
+    char buf[READ_SIZE];
+    bool ok = send_line(ctx, "echo\n");
+    int64_t cpu = thread_cpu_us();
+    for (int i = 0; ok && i < opt->keys; i++) {
+        ssh_stats_keystroke(ctx);
+        ok = ssh_write_data(ctx, "x", 1) == 1 && read_some(ctx, buf) > 0;
+    }
+    double cpu_ms = (thread_cpu_us() - cpu) / 1e3;
+
+    LatencyHistogram h;
+    ssh_stats_echo_histogram(ctx, &h);
+    char p50[32], p99[32], max[32];
+    format_us(latency_histogram_percentile(&h, 50), p50, sizeof(p50));
+    format_us(latency_histogram_percentile(&h, 99), p99, sizeof(p99));
+    format_us(h.samples ? h.max_us : -1, max, sizeof(max));
+    printf("echo    %6llu keys  p50 %s  p99 %s  max %s  %.1f us CPU/key\n",
+           (unsigned long long)h.samples, p50, p99, max, h.samples ? cpu_ms * 1000 / h.samples : 0);
+    ssh_context_free(ctx);
+    return ok;
+}
+
+// Connection setup, then the cost of polling sessions that have nothing to say
+static bool bench_idle(const BenchOptions *opt) {
+    SSHContext **ctxs = calloc(opt->sessions, sizeof(SSHContext *));
+    LatencyHistogram connect;
+    latency_histogram_reset(&connect);
+
+    bool ok = true;
+    int opened = 0;
+    for (; opened < opt->sessions; opened++) {
+        ctxs[opened] = open_session();
+        if (!ctxs[opened] || !send_line(ctxs[opened], "idle\n")) {
+            ok = false;
+            break;
+        }
+        latency_histogram_record(&connect, ctxs[opened]->timing.total_us);
+    }
+
+    char buf[READ_SIZE];
+    int64_t start = trace_now_us(), cpu = thread_cpu_us();
+    for (int sweep = 0; ok && sweep < opt->sweeps; sweep++) {
+        for (int i = 0; i < opened; i++) ssh_read_nonblocking(ctxs[i], buf, sizeof(buf));
+    }
+    int64_t polls = (int64_t)opt->sweeps * opened;
+    double wall_us = (double)(trace_now_us() - start);
+    double cpu_us = (double)(thread_cpu_us() - cpu);
+
+    char p50[32], p99[32];
+    format_us(latency_histogram_percentile(&connect, 50), p50, sizeof(p50));
+    format_us(latency_histogram_percentile(&connect, 99), p99, sizeof(p99));
+    printf("idle    %6d sessions  connect p50 %s  p99 %s  %.2f us/poll  %.2f us CPU/poll\n",
+           opened, p50, p99, polls ? wall_us / polls : 0, polls ? cpu_us / polls : 0);
+
+    for (int i = 0; i < opened; i++) ssh_context_free(ctxs[i]);
+    free(ctxs);
+    return ok;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --latency-ms N   one-way delay added between client and server (0)\n"
+            "  --bulk-mb N      output of the bulk workload (64)\n"
+            "  --keys N         keystrokes of the echo workload (2000)\n"
+            "  --sessions N     sessions of the idle workload (32)\n"
+            "  --sweeps N       polls of every idle session (10000)\n"
+            "  --only NAME      bulk, echo or idle\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    BenchOptions opt = { 0, 64, 2000, 32, 10000, NULL };
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value && strcmp(argv[i], "--latency-ms") == 0) opt.latency_ms = atoi(value);
+        else if (value && strcmp(argv[i], "--bulk-mb") == 0) opt.bulk_mb = atoi(value);
+        else if (value && strcmp(argv[i], "--keys") == 0) opt.keys = atoi(value);
+        else if (value && strcmp(argv[i], "--sessions") == 0) opt.sessions = atoi(value);
+        else if (value && strcmp(argv[i], "--sweeps") == 0) opt.sweeps = atoi(value);
+        else if (value && strcmp(argv[i], "--only") == 0) opt.only = value;
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+
+    trace_set_level(TRACE_LEVEL_WARN);
+    BenchServerConfig config = { opt.latency_ms * 1000, NULL };
+    BenchServer *server = bench_server_start(&config);
+    if (!server) {
+        fprintf(stderr, "Cannot start the loopback server\n");
+        return 1;
+    }
+    port = bench_server_port(server);
+    printf("loopback server on port %d, %d ms one way\n", port, opt.latency_ms);
+
+    bool ok = true;
+    if (!opt.only || strcmp(opt.only, "bulk") == 0) ok = bench_bulk(&opt) && ok;
+    if (!opt.only || strcmp(opt.only, "echo") == 0) ok = bench_echo(&opt) && ok;
+    if (!opt.only || strcmp(opt.only, "idle") == 0) ok = bench_idle(&opt) && ok;
+
+    bench_server_stop(server);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,435 @@
+#define _GNU_SOURCE
+#include "bench_server.h"
+#include "ssh_sftp.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define WRITE_CHUNK 65536
+
+typedef struct {
+    int latency_ms;
+    int file_mb;
+    int small_files;
+    int small_kb;
+    int entries;
+    int tree_dirs;
+    int tree_files;
+    int tree_kb;
+    const char *sftp_server;
+    const char *only;       // NULL runs every workload
+} BenchOptions;
+
+static int port;
+static char work[64];
+
+// --- Allocation counting ---
+
+// Every allocation of the process goes through these: libssh, its crypto
+// library and ssh_sftp.c alike. The server runs in another process.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static atomic_llong allocations;
+
+void *malloc(size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+// --- Measurements ---
+
+typedef struct {
+    int64_t wall_us;
+    int64_t cpu_us;
+    long long syscalls;     // Reads and writes of any kind, from /proc/self/io
+    long long allocs;
+} Probe;
+
+// Without stdio, which would allocate
+static long long io_syscalls() {
+    char buf[512];
+    int fd = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return 0;
+    buf[n] = '\0';
+
+    long long total = 0;
+    const char *keys[] = { "syscr: ", "syscw: " };
+    for (int i = 0; i < 2; i++) {
+        const char *p = strstr(buf, keys[i]);
+        if (p) total += atoll(p + strlen(keys[i]));
+    }
+    return total;
+}
+
+static void probe(Probe *p) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    p->cpu_us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    p->syscalls = io_syscalls();
+    p->allocs = atomic_load(&allocations);
+    p->wall_us = trace_now_us();
+}
+
+// Throughput, then the costs per item when there are several, per MB otherwise
+static void report(const char *name, long long items, const char *unit, const char *each, long long bytes,
+                   const Probe *start, bool ok) {
+    Probe end;
+    probe(&end);
+    double seconds = (end.wall_us - start->wall_us) / 1e6;
+    double mb = bytes / 1048576.0;
+    double per = items > 1 ? (double)items : (mb > 0 ? mb : 1);
+    const char *per_unit = items > 1 ? each : "MB";
+
+    printf("%-10s %7lld %-7s %8.2f s", name, items, unit, seconds);
+    if (bytes > 0) printf("  %8.1f MB/s", mb / seconds);
+    if (items > 1) printf("  %8.0f %s/s", items / seconds, unit);
+    printf("  %7.1f syscalls/%s  %8.1f allocs/%s  %7.3f ms CPU/%s%s\n",
+           (end.syscalls - start->syscalls) / per, per_unit,
+           (end.allocs - start->allocs) / per, per_unit,
+           (end.cpu_us - start->cpu_us) / 1e3 / per, per_unit, ok ? "" : "  FAILED");
+}
+
+// --- Files ---
+
+// Not zeros: the engine skips zero runs and holes
+static bool write_file(const char *path, long long size, unsigned seed) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    static char buf[WRITE_CHUNK];
+    uint32_t x = seed * 2654435761u | 1;
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        buf[i] = (char)(x | 1);
+    }
+    bool ok = true;
+    while (ok && size > 0) {
+        size_t chunk = size < (long long)sizeof(buf) ? (size_t)size : sizeof(buf);
+        ok = write(fd, buf, chunk) == (ssize_t)chunk;
+        size -= (long long)chunk;
+    }
+    return close(fd) == 0 && ok;
+}
+
+static long long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long long)st.st_size : -1;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    remove(path);
+    return 0;
+}
+
+static void path_join(char *out, size_t len, const char *dir, const char *name) {
+    snprintf(out, len, "%s/%s", dir, name);
+}
+
+// --- Sessions ---
+
+static SFTPContext* open_sftp() {
+    SSHContext *ssh = ssh_context_new();
+    if (!ssh) return NULL;
+    if (ssh_connect_to_server(ssh, "127.0.0.1", port, "bench", "bench", NULL, NULL, 0, NULL, NULL, NULL, false) != 0) {
+        fprintf(stderr, "connect: %s\n", ssh_get_error_msg(ssh));
+        ssh_context_free(ssh);
+        return NULL;
+    }
+    SFTPContext *ctx = sftp_context_new(ssh);
+    // The exec fallbacks would measure something else
+    if (!ctx || sftp_init_session(ctx) != 0 || ctx->transport != SFTP_TRANSPORT_SFTP) {
+        fprintf(stderr, "No SFTP subsystem, is sftp-server installed? (--sftp-server)\n");
+        if (ctx) sftp_context_free(ctx);
+        ssh_context_free(ssh);
+        return NULL;
+    }
+    return ctx;
+}
+
+static void close_sftp(SFTPContext *ctx) {
+    if (!ctx) return;
+    SSHContext *ssh = ctx->ssh_ctx;
+    sftp_context_free(ctx);
+    ssh_context_free(ssh);
+}
+
+// --- Workloads ---
+
+static bool bench_download(SFTPContext *ctx, const BenchOptions *opt) {
+    char src[128], dst[128];
+    path_join(src, sizeof(src), work, "big");
+    path_join(dst, sizeof(dst), work, "big.down");
+    long long size = (long long)opt->file_mb << 20;
+    if (!write_file(src, size, 1)) return false;
+
+    Probe start;
+    probe(&start);
+    bool ok = sftp_download_file(ctx, src, dst) == 0;
+    report("download", 1, "file", "file", size, &start, ok && file_size(dst) == size);
+    unlink(dst);
+    return ok;
+}
+
+static bool bench_upload(SFTPContext *ctx, const BenchOptions *opt) {
+    char src[128], dst[128];
+    path_join(src, sizeof(src), work, "big");
+    path_join(dst, sizeof(dst), work, "big.up");
+    long long size = (long long)opt->file_mb << 20;
+    if (file_size(src) != size && !write_file(src, size, 1)) return false;
+
+    Probe start;
+    probe(&start);
+    bool ok = sftp_upload_file(ctx, src, dst) == 0;
+    report("upload", 1, "file", "file", size, &start, ok && file_size(dst) == size);
+    unlink(dst);
+    return ok;
+}
+
+// One round trip or more per file: where latency hurts the most
+static bool bench_small(SFTPContext *ctx, const BenchOptions *opt) {
+    char src[128], up[128], down[128], a[192], b[192];
+    path_join(src, sizeof(src), work, "small");
+    path_join(up, sizeof(up), work, "small.up");
+    path_join(down, sizeof(down), work, "small.down");
+    if (mkdir(src, 0755) != 0 || mkdir(up, 0755) != 0 || mkdir(down, 0755) != 0) return false;
+    long long size = (long long)opt->small_kb << 10;
+    for (int i = 0; i < opt->small_files; i++) {
+        snprintf(a, sizeof(a), "%s/f%06d", src, i);
+        if (!write_file(a, size, (unsigned)i + 2)) return false;
+    }
+
+    Probe start;
+    probe(&start);
+    bool ok = true;
+    for (int i = 0; ok && i < opt->small_files; i++) {
+        snprintf(a, sizeof(a), "%s/f%06d", src, i);
+        snprintf(b, sizeof(b), "%s/f%06d", up, i);
+        ok = sftp_upload_file(ctx, a, b) == 0;
+    }
+    report("small up", opt->small_files, "files", "file", size * opt->small_files, &start, ok);
+
+    probe(&start);
+    for (int i = 0; ok && i < opt->small_files; i++) {
+        snprintf(a, sizeof(a), "%s/f%06d", src, i);
+        snprintf(b, sizeof(b), "%s/f%06d", down, i);
+        ok = sftp_download_file(ctx, a, b) == 0;
+    }
+    report("small down", opt->small_files, "files", "file", size * opt->small_files, &start, ok);
+    return ok;
+}
+
+static bool bench_list(SFTPContext *ctx, const BenchOptions *opt) {
+    char dir[128], path[192];
+    path_join(dir, sizeof(dir), work, "list");
+    if (mkdir(dir, 0755) != 0) return false;
+    for (int i = 0; i < opt->entries; i++) {
+        snprintf(path, sizeof(path), "%s/entry-with-a-longish-name-%07d.txt", dir, i);
+        int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) return false;
+        close(fd);
+    }
+
+    Probe start;
+    probe(&start);
+    int count = 0;
+    SFTPFile **files = sftp_list_directory(ctx, dir, &count);
+    // The listing includes . and ..
+    bool ok = files && count >= opt->entries;
+    report("list", count, "entries", "entry", 0, &start, ok);
+    if (files) sftp_free_file_list(files, count);
+    return ok;
+}
+
+typedef struct {
+    long long files;
+    long long bytes;
+} TreeTotals;
+
+// Walks src_dir on one session and recreates it on the other, files streamed host to host
+static bool copy_tree(SFTPContext *src, const char *src_dir, SFTPContext *dst, const char *dst_dir, TreeTotals *totals) {
+    if (sftp_create_directory(dst, dst_dir) != 0) return false;
+    int count = 0;
+    SFTPFile **files = sftp_list_directory(src, src_dir, &count);
+    if (!files) return false;
+
+    bool ok = true;
+    for (int i = 0; ok && i < count; i++) {
+        const SFTPFile *f = files[i];
+        if (strcmp(f->name, ".") == 0 || strcmp(f->name, "..") == 0) continue;
+        char from[512], to[512];
+        path_join(from, sizeof(from), src_dir, f->name);
+        path_join(to, sizeof(to), dst_dir, f->name);
+        if (f->type == SFTP_TYPE_DIRECTORY) {
+            ok = copy_tree(src, from, dst, to, totals);
+        } else if (f->type == SFTP_TYPE_REGULAR) {
+            ok = sftp_copy_remote(src, from, dst, to) == 0;
+            totals->files++;
+            totals->bytes += (long long)f->size;
+        }
+    }
+    sftp_free_file_list(files, count);
+    return ok;
+}
+
+static bool bench_tree(SFTPContext *ctx, const BenchOptions *opt) {
+    char root[128], copy[128], path[192];
+    path_join(root, sizeof(root), work, "tree");
+    path_join(copy, sizeof(copy), work, "tree.copy");
+    if (mkdir(root, 0755) != 0) return false;
+    for (int d = 0; d < opt->tree_dirs; d++) {
+        snprintf(path, sizeof(path), "%s/d%04d", root, d);
+        if (mkdir(path, 0755) != 0) return false;
+        for (int f = 0; f < opt->tree_files; f++) {
+            snprintf(path, sizeof(path), "%s/d%04d/f%04d", root, d, f);
+            if (!write_file(path, (long long)opt->tree_kb << 10, (unsigned)(d * opt->tree_files + f))) return false;
+        }
+    }
+
+    // sftp_copy_remote wants two sessions, as between two hosts
+    SFTPContext *other = open_sftp();
+    if (!other) return false;
+    TreeTotals totals = { 0, 0 };
+    Probe start;
+    probe(&start);
+    bool ok = copy_tree(ctx, root, other, copy, &totals);
+    report("tree copy", totals.files, "files", "file", totals.bytes, &start, ok);
+    close_sftp(other);
+    return ok;
+}
+
+// --- Server process ---
+
+// The server gets its own process, so the counters above only see the client
+static pid_t spawn_server(const BenchOptions *opt) {
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+    pid_t pid = fork();
+    if (pid != 0) {
+        close(fds[1]);
+        if (pid > 0 && read(fds[0], &port, sizeof(port)) != (ssize_t)sizeof(port)) {
+            waitpid(pid, NULL, 0);
+            pid = -1;
+        }
+        close(fds[0]);
+        return pid;
+    }
+
+    close(fds[0]);
+    // Blocked before the server threads start, they inherit the mask
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    BenchServerConfig config = { opt->latency_ms * 1000, opt->sftp_server };
+    BenchServer *server = bench_server_start(&config);
+    if (!server) _exit(1);
+    int server_port = bench_server_port(server);
+    if (write(fds[1], &server_port, sizeof(server_port)) != (ssize_t)sizeof(server_port)) _exit(1);
+    close(fds[1]);
+
+    // Until the benchmark is done
+    int sig;
+    sigwait(&set, &sig);
+    bench_server_stop(server);
+    _exit(0);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --latency-ms N     one-way delay added between client and server (0)\n"
+            "  --file-mb N        size of the download and upload file (256)\n"
+            "  --small-files N    files of the small workload (1000)\n"
+            "  --small-kb N       size of each of them (4)\n"
+            "  --entries N        entries of the listed directory (20000)\n"
+            "  --tree-dirs N      directories of the copied tree (20)\n"
+            "  --tree-files N     files in each of them (50)\n"
+            "  --tree-kb N        size of each file (16)\n"
+            "  --sftp-server PATH sftp-server the stand-in runs (searched for)\n"
+            "  --only NAME        download, upload, small, list or tree\n", argv0);
+}
+
+static bool selected(const BenchOptions *opt, const char *name) {
+    return !opt->only || strcmp(opt->only, name) == 0;
+}
+
+int main(int argc, char **argv) {
+    BenchOptions opt = { 0, 256, 1000, 4, 20000, 20, 50, 16, NULL, NULL };
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value && strcmp(argv[i], "--latency-ms") == 0) opt.latency_ms = atoi(value);
+        else if (value && strcmp(argv[i], "--file-mb") == 0) opt.file_mb = atoi(value);
+        else if (value && strcmp(argv[i], "--small-files") == 0) opt.small_files = atoi(value);
+        else if (value && strcmp(argv[i], "--small-kb") == 0) opt.small_kb = atoi(value);
+        else if (value && strcmp(argv[i], "--entries") == 0) opt.entries = atoi(value);
+        else if (value && strcmp(argv[i], "--tree-dirs") == 0) opt.tree_dirs = atoi(value);
+        else if (value && strcmp(argv[i], "--tree-files") == 0) opt.tree_files = atoi(value);
+        else if (value && strcmp(argv[i], "--tree-kb") == 0) opt.tree_kb = atoi(value);
+        else if (value && strcmp(argv[i], "--sftp-server") == 0) opt.sftp_server = value;
+        else if (value && strcmp(argv[i], "--only") == 0) opt.only = value;
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+
+    trace_set_level(TRACE_LEVEL_WARN);
+    pid_t server = spawn_server(&opt);
+    if (server < 0) {
+        fprintf(stderr, "Cannot start the loopback server\n");
+        return 1;
+    }
+
+    bool ok = false;
+    SFTPContext *ctx = NULL;
+    snprintf(work, sizeof(work), "/tmp/modern_ssh_sftp_bench.XXXXXX");
+    bool have_work = mkdtemp(work) != NULL;
+    if (!have_work) {
+        perror("mkdtemp");
+    } else if ((ctx = open_sftp()) != NULL) {
+        printf("loopback server on port %d, %d ms one way, files in %s\n", port, opt.latency_ms, work);
+        ok = true;
+        if (selected(&opt, "download")) ok = bench_download(ctx, &opt) && ok;
+        if (selected(&opt, "upload")) ok = bench_upload(ctx, &opt) && ok;
+        if (selected(&opt, "small")) ok = bench_small(ctx, &opt) && ok;
+        if (selected(&opt, "list")) ok = bench_list(ctx, &opt) && ok;
+        if (selected(&opt, "tree")) ok = bench_tree(ctx, &opt) && ok;
+        close_sftp(ctx);
+    }
+
+    if (have_work) nftw(work, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,39 @@
+#ifndef CONNECT_TIMING_H
+#define CONNECT_TIMING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Phases of ssh_connect_to_server, in order. Through a jump host, DNS and TCP
+// are those of the jump host: the target is reached from there, in PROXY.
+typedef enum {
+    CONNECT_PHASE_DNS,
+    CONNECT_PHASE_TCP,
+    CONNECT_PHASE_PROXY,     // Jump host key exchange and auth, then the forward channel
+    CONNECT_PHASE_KEX,       // Banner and key exchange with the target
+    CONNECT_PHASE_AUTH,
+    CONNECT_PHASE_CHANNEL,   // Session channel, pty and shell
+    CONNECT_PHASE_COUNT
+} ConnectPhase;
+
+// Durations from the monotonic clock, in microseconds. -1 for a phase that was
+// skipped or never reached.
+typedef struct {
+    int64_t started_at;                     // Wall clock, seconds since the epoch
+    int64_t phase_us[CONNECT_PHASE_COUNT];
+    int64_t total_us;
+    int64_t publickey_us;                   // Part of AUTH spent trying the keys
+    char auth_method[16];                   // "publickey", "password", "" if none succeeded
+    int failed_phase;                       // -1 if the connection succeeded
+} ConnectTiming;
+
+// Every phase unknown, nothing failed
+void connect_timing_reset(ConnectTiming *t);
+
+const char* connect_phase_name(ConnectPhase phase);
+
+// "dns 2 ms, tcp 31 ms, ..." over the phases that ran
+void connect_timing_format(const ConnectTiming *t, char *buf, size_t len);
+
+#endif
@@ -3,6 +3,8 @@
 
 #include <sqlite3.h>
 #include <stdbool.h>
+#include "connect_timing.h"
+#include "latency_histogram.h"
 
 typedef struct {
     int id;
@@ -10,7 +12,8 @@ typedef struct {
     char *hostname;
     int port;
     char *username;
-    char *password;
+    char *password;     // NULL in query results, see db_get_host_password
+    bool has_password;
     char *key_path;
     char *protocol;
     int group_id;
@@ -27,9 +30,21 @@ typedef struct {
     char *hostname;
     char *username;
     char *protocol;
-    long timestamp;
+    long timestamp;     // Last use
+    int use_count;
 } HistoryEntry;
 
+// One host of a bulk import. Missing strings may be NULL.
+typedef struct {
+    char *name;
+    char *hostname;
+    int port;
+    char *username;
+    char *key_path;
+    char *group;        // Group name, created when missing
+    char *proxy;        // Name of the jump host, imported or already saved
+} HostImport;
+
 // Initialise database
 bool db_init();
 
@@ -37,8 +52,10 @@ bool db_init();
 void db_close();
 
 // --- HOSTS ---
-bool db_add_host(const char* name, const char* hostname, int port, const char* user, const char* password, const char* key_path, const char* protocol, int group_id, int proxy_host_id);
+// Returns the id of the new host, or -1 on failure
+int db_add_host(const char* name, const char* hostname, int port, const char* user, const char* password, const char* key_path, const char* protocol, int group_id, int proxy_host_id);
 
+// A NULL password keeps the stored one, "" removes it
 bool db_update_host(int id, const char* name, const char* hostname, int port, const char* user, const char* password, const char* key_path, const char* protocol, int group_id, int proxy_host_id);
 
 Host** db_get_all_hosts(int *count);
@@ -47,14 +64,29 @@ Host* db_get_host_by_id(int id);
 
 bool db_host_exists(const char* name);
 
+// Decrypted password of a host, read from the keyring or the database only when
+// connecting. NULL if it has none. Free with db_free_password.
+char* db_get_host_password(int id);
+
+// Wipes the password before freeing it
+void db_free_password(char* password);
+
 bool db_delete_host(int id);
 
+// Inserts the hosts in one transaction, skipping names that are already saved.
+// Returns the number of hosts added, or -1 if nothing was written.
+int db_import_hosts(const HostImport *hosts, int count);
+
 void db_free_hosts(Host** hosts, int count);
 
+// Deep copy, free with db_free_host
+Host* db_dup_host(const Host* host);
+
 void db_free_host(Host* host);
 
 // --- GROUPS ---
-bool db_add_group(const char* name);
+// Returns the id of the new group, or -1 on failure
+int db_add_group(const char* name);
 
 bool db_delete_group(int id);
 
@@ -65,8 +97,26 @@ void db_free_groups(Group** groups, int count);
 // --- HISTORY ---
 bool db_add_history(const char* hostname, const char* username, const char* protocol);
 
+// Most used targets first, weighing recent uses more (frecency)
 HistoryEntry** db_get_recent_history(int limit, int *count);
 
 void db_free_history(HistoryEntry** entries, int count);
 
+// --- CONNECTION STATS ---
+// Connections kept per host, older ones are dropped as new ones come in
+#define CONNECTION_STATS_KEEP 200
+
+// Records the phase timings of a connection to a saved host (proxy_host_id 0 without a jump host)
+bool db_add_connection_stats(int host_id, int proxy_host_id, const ConnectTiming *timing);
+
+// Latest connections of a host first. Free with free().
+ConnectTiming* db_get_connection_stats(int host_id, int limit, int *count);
+
+// --- ECHO LATENCY ---
+// Adds the keystroke echoes of a session to those of the host through that jump host
+bool db_merge_echo_latency(int host_id, int proxy_host_id, const LatencyHistogram *session);
+
+// All the echoes recorded for the host through that jump host, empty if none
+bool db_get_echo_latency(int host_id, int proxy_host_id, LatencyHistogram *out);
+
 #endif
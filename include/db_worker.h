@@ -0,0 +1,70 @@
+#ifndef DB_WORKER_H
+#define DB_WORKER_H
+
+#include <glib.h>
+#include "db.h"
+
+// Asynchronous front end of the storage layer. Requests run in order on one
+// background thread and their callbacks are invoked on the main loop. Results
+// passed to callbacks belong to the callback (free with the db_free_* calls).
+
+typedef void (*DbDoneFunc)(bool ok, gpointer user_data);
+// host/group is NULL if the write failed
+typedef void (*DbHostFunc)(Host *host, gpointer user_data);
+typedef void (*DbGroupFunc)(Group *group, gpointer user_data);
+typedef void (*DbHostsFunc)(Host **hosts, int host_count, Group **groups, int group_count, gpointer user_data);
+typedef void (*DbHistoryFunc)(HistoryEntry **entries, int count, gpointer user_data);
+// Free both with db_free_password, NULL when there is no password
+typedef void (*DbPasswordFunc)(char *password, char *proxy_password, gpointer user_data);
+// count is -1 if the request failed
+typedef void (*DbCountFunc)(int count, gpointer user_data);
+// Latest first, free stats with free()
+typedef void (*DbStatsFunc)(ConnectTiming *stats, int count, gpointer user_data);
+// latency is only valid during the call, empty if nothing was recorded
+typedef void (*DbLatencyFunc)(const LatencyHistogram *latency, gpointer user_data);
+
+// Call after db_init. Without a worker, requests run synchronously.
+bool db_worker_start();
+
+// Finishes the queued requests, call before db_close.
+void db_worker_stop();
+
+// done may be NULL for all write requests
+void db_async_add_host(const char* name, const char* hostname, int port, const char* user, const char* password, const char* key_path, const char* protocol, int group_id, int proxy_host_id,
+                       DbHostFunc done, gpointer user_data);
+
+void db_async_update_host(int id, const char* name, const char* hostname, int port, const char* user, const char* password, const char* key_path, const char* protocol, int group_id, int proxy_host_id,
+                          DbHostFunc done, gpointer user_data);
+
+void db_async_delete_host(int id, DbDoneFunc done, gpointer user_data);
+
+void db_async_add_group(const char* name, DbGroupFunc done, gpointer user_data);
+
+void db_async_delete_group(int id, DbDoneFunc done, gpointer user_data);
+
+// Parses the file (or ~/.ssh/config and known_hosts if path is NULL) on the
+// worker and imports its hosts in one transaction, see host_import.h
+void db_async_import_hosts(const char *path, DbCountFunc done, gpointer user_data);
+
+void db_async_add_history(const char* hostname, const char* username, const char* protocol);
+
+// Passwords of a host and of its jump host (0 for none), fetched at connect
+// time only: query results never carry them
+void db_async_get_passwords(int host_id, int proxy_host_id, DbPasswordFunc done, gpointer user_data);
+
+// All hosts and groups in one consistent read
+void db_async_load_hosts(DbHostsFunc done, gpointer user_data);
+
+void db_async_get_recent_history(int limit, DbHistoryFunc done, gpointer user_data);
+
+// The timing is copied
+void db_async_add_connection_stats(int host_id, int proxy_host_id, const ConnectTiming *timing);
+
+void db_async_get_connection_stats(int host_id, int limit, DbStatsFunc done, gpointer user_data);
+
+// The histogram is copied
+void db_async_merge_echo_latency(int host_id, int proxy_host_id, const LatencyHistogram *session);
+
+void db_async_get_echo_latency(int host_id, int proxy_host_id, DbLatencyFunc done, gpointer user_data);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef FILE_PREVIEW_H
+#define FILE_PREVIEW_H
+
+#include <gtk/gtk.h>
+#include "ssh_sftp.h"
+
+// Opens a read-only viewer on a remote file that only fetches the parts being
+// looked at. The viewer keeps its own reference on ctx while it is open.
+void show_file_preview(GtkWindow *parent, SFTPContext *ctx, const char *remote_path);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef HOST_IMPORT_H
+#define HOST_IMPORT_H
+
+#include <stdbool.h>
+#include "db.h"
+
+// Reads hosts from OpenSSH and inventory files into memory, deduplicated by
+// name, ready for db_import_hosts. Hosts seen again only fill the fields that
+// are still missing, as ssh does with repeated Host blocks.
+typedef struct HostImportList HostImportList;
+
+HostImportList* host_import_list_new();
+
+void host_import_list_free(HostImportList *list);
+
+// Host, HostName, Port, User, IdentityFile and ProxyJump of every concrete
+// Host alias, following Include. "Host *" values apply to every host, in file
+// order with the Host blocks: the first value of an option wins, as in ssh.
+bool host_import_ssh_config(HostImportList *list, const char *path);
+
+// Plain host names of a known_hosts file (hashed entries can't be read back),
+// skipping the targets already in the list.
+bool host_import_known_hosts(HostImportList *list, const char *path);
+
+// Ansible INI inventory ([group] sections, ansible_host/port/user) or CSV with
+// an optional header row, detected from the content. False when the file can't
+// be read or a web[01:20] range would expand to too many hosts.
+bool host_import_inventory(HostImportList *list, const char *path);
+
+// Picks the parser from the file name and content
+bool host_import_file(HostImportList *list, const char *path);
+
+// ~/.ssh/config then ~/.ssh/known_hosts. Returns false if neither could be read.
+bool host_import_ssh_dir(HostImportList *list);
+
+// Applies the defaults and resolves the jump hosts, then hands over the hosts
+// (free with host_import_free). The list is empty afterwards.
+HostImport* host_import_list_take(HostImportList *list, int *count);
+
+void host_import_free(HostImport *hosts, int count);
+
+#endif
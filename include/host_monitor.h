@@ -0,0 +1,51 @@
+#ifndef HOST_MONITOR_H
+#define HOST_MONITOR_H
+
+#include <stdbool.h>
+
+// Background reachability check of saved hosts: a TCP connect to each host's
+// port, all in flight together on one epoll loop with a bounded number of
+// sockets. Names are resolved by a separate thread and cached, so a slow DNS
+// server never stalls the probes. Hidden hosts and hosts that stay down are
+// probed less often.
+typedef struct HostMonitor HostMonitor;
+
+typedef enum {
+    HOST_STATE_UNKNOWN,
+    HOST_STATE_UP,
+    HOST_STATE_DOWN
+} HostState;
+
+#define HOST_MONITOR_HISTORY 16
+
+typedef struct {
+    HostState state;
+    int rtt_us;                 // Last connect time, -1 if never up
+    int avg_rtt_us;             // Over the successful probes kept in history
+    int history[HOST_MONITOR_HISTORY];   // Oldest first, -1 for a failed probe
+    int history_count;
+} HostStatus;
+
+// interval_ms between two probes of a visible host, 0 pauses the monitor
+HostMonitor* host_monitor_start(int interval_ms);
+
+void host_monitor_stop(HostMonitor *mon);
+
+void host_monitor_set_interval(HostMonitor *mon, int interval_ms);
+
+// Adds the host, or updates it (its history restarts if the address changed)
+void host_monitor_watch(HostMonitor *mon, int id, const char *hostname, int port);
+
+void host_monitor_unwatch(HostMonitor *mon, int id);
+
+void host_monitor_clear(HostMonitor *mon);
+
+// Visible hosts use the base interval, a host shown again after a long time is probed at once
+void host_monitor_set_visible(HostMonitor *mon, int id, bool visible);
+
+bool host_monitor_get_status(HostMonitor *mon, int id, HostStatus *status);
+
+// Hosts whose status changed since the last call, returns how many were written
+int host_monitor_take_changes(HostMonitor *mon, int *ids, int max_ids);
+
+#endif
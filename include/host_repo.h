@@ -0,0 +1,72 @@
+#ifndef HOST_REPO_H
+#define HOST_REPO_H
+
+#include <glib.h>
+#include "db.h"
+
+// In-memory copy of the hosts and groups tables, indexed by id, by group and
+// by name. It is loaded once; writes go through the db worker and are applied
+// to the copy when they complete, then reported to listeners one row at a
+// time. Main thread only.
+
+typedef enum {
+    HOST_REPO_RELOADED,
+    HOST_REPO_HOST_ADDED,
+    HOST_REPO_HOST_CHANGED,
+    HOST_REPO_HOST_REMOVED,
+    HOST_REPO_GROUP_ADDED,
+    HOST_REPO_GROUP_REMOVED
+} HostRepoEvent;
+
+// id is the host or group concerned (unused for RELOADED). For HOST_REMOVED
+// and GROUP_REMOVED the row is already gone from the repository.
+typedef void (*HostRepoListener)(HostRepoEvent event, int id, gpointer user_data);
+
+guint host_repo_add_listener(HostRepoListener listener, gpointer user_data);
+
+void host_repo_remove_listener(guint handle);
+
+// Loads (or reloads) everything from the database, RELOADED follows.
+void host_repo_load();
+
+bool host_repo_is_loaded();
+
+// --- Lookups, pointers stay valid until the row changes ---
+const Host* host_repo_get_host(int id);
+
+const Host* host_repo_find_host_by_name(const char *name);
+
+// All hosts sorted by name
+const Host* const* host_repo_get_hosts(int *count);
+
+// Hosts of a group sorted by name (group 0 holds the ungrouped ones)
+const Host* const* host_repo_get_group_hosts(int group_id, int *count);
+
+// Position of the host inside its group's sorted list, -1 if unknown
+int host_repo_get_host_position(int id);
+
+const Group* host_repo_get_group(int id);
+
+// Named groups sorted by name
+const Group* const* host_repo_get_groups(int *count);
+
+// Position of the group in host_repo_get_groups, -1 if unknown
+int host_repo_get_group_position(int id);
+
+// --- Writes ---
+void host_repo_add_host(const char* name, const char* hostname, int port, const char* user, const char* password, const char* key_path, const char* protocol, int group_id, int proxy_host_id);
+
+void host_repo_update_host(int id, const char* name, const char* hostname, int port, const char* user, const char* password, const char* key_path, const char* protocol, int group_id, int proxy_host_id);
+
+void host_repo_delete_host(int id);
+
+void host_repo_add_group(const char* name);
+
+// Imports a file (NULL for ~/.ssh) in the background, then reloads: RELOADED
+// follows if anything was added. done gets the number of new hosts, -1 on error.
+void host_repo_import(const char *path, void (*done)(int added, gpointer user_data), gpointer user_data);
+
+// Hosts of the group move to group 0 (HOST_CHANGED each) before GROUP_REMOVED
+void host_repo_delete_group(int id);
+
+#endif
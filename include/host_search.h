@@ -0,0 +1,31 @@
+#ifndef HOST_SEARCH_H
+#define HOST_SEARCH_H
+
+#include <stdbool.h>
+
+// In-memory fuzzy search over hosts. Every host is indexed by the trigrams of
+// its name, hostname, user and group. A host missing some character of the
+// query is only scored when it shares enough trigrams with it to be a typo
+// match; a typo costs at most three trigrams.
+typedef struct HostSearch HostSearch;
+
+typedef struct {
+    int id;
+    int score;
+} HostSearchMatch;
+
+HostSearch* host_search_new();
+
+void host_search_free(HostSearch *search);
+
+// Adds the host or replaces its previous fields
+void host_search_put(HostSearch *search, int id, const char *name, const char *hostname, const char *user, const char *group);
+
+void host_search_remove(HostSearch *search, int id);
+
+void host_search_clear(HostSearch *search);
+
+// Words of the query must all match. Best first, returns the number written to matches.
+int host_search_query(HostSearch *search, const char *query, HostSearchMatch *matches, int max_matches);
+
+#endif
@@ -2,8 +2,20 @@
 #define HOSTS_VIEW_H
 
 #include <gtk/gtk.h>
+#include "db.h"
 
 // Crée la vue de la liste des hôtes
 GtkWidget* create_hosts_view(GtkWidget *main_stack);
 
+// Opens the host in the terminal or SFTP view, depending on its protocol
+void hosts_view_connect_host(GtkWidget *main_stack, const Host *host);
+
+// Seconds between two reachability checks of the hosts on screen, 0 turns them off
+void hosts_view_set_probe_interval(int seconds);
+
+int hosts_view_get_probe_interval();
+
+// Stops the reachability monitor, call before exiting
+void hosts_view_shutdown();
+
 #endif
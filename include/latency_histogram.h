@@ -0,0 +1,37 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Log-linear histogram in the style of HdrHistogram: exact up to 64 us, then
+// 32 buckets per power of two (about 3% precision) up to 2^26 us (67 s).
+// Longer samples land in the last bucket, the exact maximum is kept apart.
+#define LATENCY_HIST_BUCKETS 704
+
+typedef struct {
+    uint64_t samples;
+    uint64_t sum_us;
+    int64_t min_us;         // -1 while empty
+    int64_t max_us;
+    uint32_t counts[LATENCY_HIST_BUCKETS];
+} LatencyHistogram;
+
+void latency_histogram_reset(LatencyHistogram *h);
+
+void latency_histogram_record(LatencyHistogram *h, int64_t us);
+
+void latency_histogram_merge(LatencyHistogram *dst, const LatencyHistogram *src);
+
+// Highest value equivalent to the sample at that percentile (0-100), -1 while empty
+int64_t latency_histogram_percentile(const LatencyHistogram *h, double percentile);
+
+int64_t latency_histogram_mean(const LatencyHistogram *h);
+
+// Largest value counted in that bucket
+int64_t latency_histogram_bucket_max(int bucket);
+
+// JSON object with the summary and the non-empty buckets. Free with free().
+char* latency_histogram_json(const LatencyHistogram *h);
+
+#endif
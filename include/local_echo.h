@@ -0,0 +1,49 @@
+#ifndef LOCAL_ECHO_H
+#define LOCAL_ECHO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Predictive local echo in the style of mosh. Printable keys and left/right
+// arrows are drawn at once, underlined, before the server echoes them. Each
+// prediction is drawn with insert/delete character sequences so it can be
+// undone exactly: when server data comes in, every prediction is rolled back,
+// the data is fed, and those the server hasn't echoed yet are drawn again.
+// Predictions stop in full-screen applications (alternate screen), at password
+// prompts and after an echo that never came, until the next Enter.
+typedef struct LocalEcho LocalEcho;
+
+typedef enum {
+    LOCAL_ECHO_OFF,
+    LOCAL_ECHO_ADAPTIVE,    // Only while the echo round trip is slow
+    LOCAL_ECHO_ALWAYS
+} LocalEchoMode;
+
+// Room the output of the calls below needs on top of the server data
+#define LOCAL_ECHO_OVERHEAD 1024
+
+LocalEcho* local_echo_new();
+
+void local_echo_free(LocalEcho *le);
+
+void local_echo_set_mode(LocalEcho *le, LocalEchoMode mode);
+
+// A measured keystroke echo time, smoothed into the round trip ADAPTIVE looks at
+void local_echo_add_rtt(LocalEcho *le, int64_t rtt_us);
+
+// Keys about to be sent, cursor_col and columns as the terminal shows them.
+// Writes the predictions to draw into out (LOCAL_ECHO_OVERHEAD bytes) and
+// returns their length, 0 if nothing is predicted.
+size_t local_echo_keys(LocalEcho *le, const char *keys, size_t len, int cursor_col, int columns,
+                       int64_t now_us, char *out, size_t cap);
+
+// Data from the server. Writes what the terminal should be fed instead into
+// out (len + LOCAL_ECHO_OVERHEAD bytes) and returns its length.
+size_t local_echo_server(LocalEcho *le, const char *data, size_t len, char *out, size_t cap);
+
+// Rolls back predictions the server still hasn't echoed after a while.
+// Returns the length written to out (LOCAL_ECHO_OVERHEAD bytes), 0 if none.
+size_t local_echo_expire(LocalEcho *le, int64_t now_us, char *out, size_t cap);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef QUICK_CONNECT_H
+#define QUICK_CONNECT_H
+
+#include <gtk/gtk.h>
+
+// Keyboard palette that fuzzy-searches every host by name, hostname, user and
+// group as you type; Enter connects to the selected one.
+void show_quick_connect(GtkWindow *parent, GtkWidget *main_stack);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef SECRET_STORE_H
+#define SECRET_STORE_H
+
+#include <stdbool.h>
+
+// Host passwords in the desktop keyring (libsecret), keyed by host id. Without
+// HAVE_LIBSECRET, or when no keyring service answers, saving fails and the
+// caller keeps the password in the database instead, only obfuscated. Failures
+// are logged. Blocking, worker thread only.
+
+bool secret_store_save(int host_id, const char *password);
+
+// NULL if not found, free with db_free_password
+char* secret_store_lookup(int host_id);
+
+void secret_store_delete(int host_id);
+
+#endif
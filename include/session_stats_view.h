@@ -0,0 +1,20 @@
+#ifndef SESSION_STATS_VIEW_H
+#define SESSION_STATS_VIEW_H
+
+#include <gtk/gtk.h>
+#include "ssh_backend.h"
+
+// Session behind the panel, NULL while it isn't connected
+typedef SSHContext* (*SessionStatsSource)(gpointer user_data);
+
+// Button opening the live performance panel of a session: throughput, reads
+// per poll, write queue depth, window stalls and echo latency, refreshed every
+// second while it is open, with an export of the counters and echo latency
+// histograms as JSON
+GtkWidget* session_stats_button_new(SessionStatsSource source, gpointer user_data);
+
+// Saved host of the session, to show the echo latency of its past sessions
+// through the same jump host (0 for none) next to this one
+void session_stats_button_set_host(GtkWidget *button, int host_id, int proxy_host_id);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef SFTP_DU_H
+#define SFTP_DU_H
+
+#include "sftp_walk.h"
+
+// Disk usage of a remote directory, split by direct child. The subtree is
+// listed by an SFTPWalker, totals grow while the walk runs and can be read at
+// any time. Symlinks are counted by their own size and never followed.
+typedef struct SFTPDirSize SFTPDirSize;
+
+typedef struct {
+    char *name;
+    bool is_dir;
+    uint64_t bytes;
+    uint64_t files;
+} SFTPDirSizeEntry;
+
+// Only the ctx, concurrency and rate fields of connection are used.
+SFTPDirSize* sftp_dir_size_start(const char *root, const SFTPWalkConfig *connection);
+
+bool sftp_dir_size_is_finished(SFTPDirSize *ds, SFTPWalkStatus *status);
+
+// Copy of the current per-child totals, largest first. Free with sftp_dir_size_free_entries.
+SFTPDirSizeEntry* sftp_dir_size_snapshot(SFTPDirSize *ds, int *count, uint64_t *total_bytes);
+
+void sftp_dir_size_free_entries(SFTPDirSizeEntry *entries, int count);
+
+void sftp_dir_size_cancel(SFTPDirSize *ds);
+
+// Cancels if still running, without waiting: a walk still stopping frees the
+// rest on its own thread.
+void sftp_dir_size_free(SFTPDirSize *ds);
+
+#endif
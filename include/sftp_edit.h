@@ -0,0 +1,43 @@
+#ifndef SFTP_EDIT_H
+#define SFTP_EDIT_H
+
+#include "ssh_sftp.h"
+
+// A remote file mirrored into a local cache file for editing. Saves upload only
+// the blocks that changed since the last sync, into a temporary file next to
+// the target that is then renamed over it.
+typedef struct SFTPEditFile SFTPEditFile;
+
+typedef enum {
+    SFTP_EDIT_OK = 0,
+    SFTP_EDIT_UNCHANGED,
+    // The remote file changed since it was fetched, nothing was written
+    SFTP_EDIT_CONFLICT,
+    SFTP_EDIT_ERROR
+} SFTPEditResult;
+
+// What to do with a cached copy holding changes that never reached the server,
+// left by a conflict or a failed upload
+typedef enum {
+    // Open nothing and report them through pending
+    SFTP_EDIT_OPEN_ASK = 0,
+    // Keep editing the cached copy, the next save still checks for a conflict
+    SFTP_EDIT_OPEN_KEEP_LOCAL,
+    // Drop them and fetch the remote file again
+    SFTP_EDIT_OPEN_DISCARD_LOCAL
+} SFTPEditOpenMode;
+
+// Fetches remote_path into local_path, unless the cached copy is still current
+// (same remote size and mtime, local copy unchanged). reused and pending may be NULL.
+SFTPEditFile* sftp_edit_open(SFTPContext *ctx, const char *remote_path, const char *local_path,
+                             SFTPEditOpenMode mode, bool *reused, bool *pending);
+
+const char* sftp_edit_get_local_path(SFTPEditFile *edit);
+
+// Uploads the local changes. uploaded_bytes (may be NULL) receives the bytes sent.
+SFTPEditResult sftp_edit_save(SFTPEditFile *edit, uint64_t *uploaded_bytes);
+
+// Does not free ctx.
+void sftp_edit_close(SFTPEditFile *edit);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef SFTP_INDEX_H
+#define SFTP_INDEX_H
+
+#include "sftp_walk.h"
+
+// Per-host index of remote paths for instant fuzzy search. The tree is walked
+// in the background with a rate-limited SFTPWalker; unchanged directories
+// (same mtime) are reused from the previous index instead of being listed.
+typedef struct SFTPIndex SFTPIndex;
+
+typedef struct {
+    char *path;
+    bool is_dir;
+    int score;
+} SFTPIndexMatch;
+
+typedef void (*SFTPIndexDoneFunc)(SFTPIndex *index, SFTPWalkStatus status, void *user_data);
+
+// Loads cache_file if it exists. The index is saved back there after each refresh.
+SFTPIndex* sftp_index_open(const char *cache_file);
+
+// Returns at once. A refresh still stopping frees the index when it ends.
+void sftp_index_free(SFTPIndex *index);
+
+int sftp_index_get_count(SFTPIndex *index);
+
+// Returns the indexed root path (NULL if the index is empty). Free with free().
+char* sftp_index_get_root(SFTPIndex *index);
+
+// Starts a background refresh, replacing a running one. Only the ctx,
+// concurrency and rate fields of connection are used. done runs on the walker
+// thread.
+bool sftp_index_refresh(SFTPIndex *index, const char *root, const SFTPWalkConfig *connection,
+                        SFTPIndexDoneFunc done, void *user_data);
+
+void sftp_index_cancel(SFTPIndex *index);
+
+// Best matches first. Free with sftp_index_free_matches.
+SFTPIndexMatch* sftp_index_search(SFTPIndex *index, const char *query, int max_results, int *count);
+
+void sftp_index_free_matches(SFTPIndexMatch *matches, int count);
+
+#endif
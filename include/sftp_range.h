@@ -0,0 +1,31 @@
+#ifndef SFTP_RANGE_H
+#define SFTP_RANGE_H
+
+#include "ssh_sftp.h"
+#include <sys/types.h>
+
+// Random access to a remote file without downloading it. Reads go through a
+// small block cache; missing blocks plus a few blocks of readahead in the
+// current reading direction are requested together with async reads.
+// The reader holds a reference on ctx and locks it around each request, so it
+// can share the browser's session. A reader itself is not thread safe: use it
+// from one thread at a time, off the UI thread since reads wait on the network.
+typedef struct SFTPRangeReader SFTPRangeReader;
+
+SFTPRangeReader* sftp_range_open(SFTPContext *ctx, const char *remote_path);
+
+void sftp_range_close(SFTPRangeReader *reader);
+
+uint64_t sftp_range_get_size(SFTPRangeReader *reader);
+
+// Re-reads the remote size (for follow mode). Returns the new size, or the old one on error.
+uint64_t sftp_range_update_size(SFTPRangeReader *reader);
+
+// Returns the number of bytes read, -1 on error. Large reads and reads at
+// the end of the file are short.
+ssize_t sftp_range_read(SFTPRangeReader *reader, uint64_t offset, void *buf, size_t len);
+
+// Bytes actually fetched from the server so far.
+uint64_t sftp_range_get_fetched_bytes(SFTPRangeReader *reader);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef SFTP_SYNC_H
+#define SFTP_SYNC_H
+
+#include "ssh_sftp.h"
+
+// One-way local -> remote folder sync driven by inotify. Events are debounced
+// and coalesced per path, then applied as one batch. The context is locked per
+// remote operation, so it can stay shared with the browser.
+typedef struct SFTPSync SFTPSync;
+
+typedef struct {
+    uint64_t batches;
+    uint64_t events;
+    uint64_t uploads;
+    uint64_t renames;
+    uint64_t deletes;
+    uint64_t errors;
+    uint64_t bytes_sent;
+    uint64_t bytes_skipped;     // Holes not sent, see SFTPTransferStats
+} SFTPSyncStats;
+
+// Uploads local_dir into remote_dir once, then keeps watching it.
+SFTPSync* sftp_sync_start(SFTPContext *ctx, const char *local_dir, const char *remote_dir);
+
+// Returns at once. The pending batch is still sent in the background, the sync
+// holds a reference on the context until then (see sftp_context_ref).
+void sftp_sync_stop(SFTPSync *sync);
+
+SFTPSyncStats sftp_sync_get_stats(SFTPSync *sync);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef SFTP_WALK_H
+#define SFTP_WALK_H
+
+#include "ssh_sftp.h"
+
+// Concurrent remote tree walker riding on an existing session. libssh's SFTP
+// calls are synchronous, so the walker speaks the protocol itself on an SFTP
+// channel of its own and keeps several directories in flight from one thread.
+// The context is locked only around each send and receive, browsing goes on
+// meanwhile. Sessions using a fallback transport are listed one directory at a
+// time with sftp_list_directory. Jobs are opaque to the walker.
+typedef struct SFTPWalker SFTPWalker;
+
+typedef enum {
+    SFTP_WALK_DONE = 0,
+    SFTP_WALK_CANCELLED,
+    SFTP_WALK_FAILED
+} SFTPWalkStatus;
+
+typedef enum {
+    SFTP_WALK_LIST = 0,
+    // Fetch the directory's own attributes first, prepare is called again with them
+    SFTP_WALK_STAT,
+    // Nothing to list, the job is done
+    SFTP_WALK_SKIP
+} SFTPWalkStep;
+
+// Remote path of a job's directory
+typedef const char* (*SFTPWalkPathFunc)(void *job);
+// Decides what a job needs. attrs is NULL at first, then the result of an
+// SFTP_WALK_STAT (name unset). May push new jobs.
+typedef SFTPWalkStep (*SFTPWalkPrepareFunc)(SFTPWalker *walker, void *job, const SFTPFile *attrs, void *user_data);
+// Gets the listing of a job's directory. May push new jobs.
+typedef void (*SFTPWalkVisitFunc)(SFTPWalker *walker, void *job, SFTPFile **files, int count, void *user_data);
+// Runs once, last, on the walker thread. Do not free the walker from here.
+typedef void (*SFTPWalkDoneFunc)(SFTPWalker *walker, SFTPWalkStatus status, void *user_data);
+
+typedef struct {
+    // Shared with the caller, the walker holds a reference until it ends
+    SFTPContext *ctx;
+    // Directories listed at the same time
+    int concurrency;
+    // Remote requests per second, 0 for no limit. Every STAT, OPENDIR, READDIR
+    // and CLOSE counts; on the fallback transports, every listing.
+    int max_requests_per_sec;
+    SFTPWalkPathFunc path;
+    // Optional, every job is listed without it
+    SFTPWalkPrepareFunc prepare;
+    SFTPWalkVisitFunc visit;
+    SFTPWalkDoneFunc done;
+    void (*free_job)(void *job);
+    void *user_data;
+} SFTPWalkConfig;
+
+SFTPWalker* sftp_walk_start(const SFTPWalkConfig *config, void *root_job);
+
+void sftp_walk_push(SFTPWalker *walker, void *job);
+
+bool sftp_walk_is_cancelled(SFTPWalker *walker);
+
+void sftp_walk_cancel(SFTPWalker *walker);
+
+// Cancels if still running and returns without waiting. The walk stops at its
+// next step on its own thread: prepare and visit may still run until then, and
+// done always runs last, so user_data must live until done. The walker frees
+// itself afterwards.
+void sftp_walk_free(SFTPWalker *walker);
+
+#endif
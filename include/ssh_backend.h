@@ -3,6 +3,49 @@
 
 #include <libssh/libssh.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "connect_timing.h"
+#include "latency_histogram.h"
+
+// Live counters of a session, bumped with relaxed atomics on the I/O paths and
+// readable from any thread through ssh_stats_snapshot
+typedef struct {
+    atomic_int_fast64_t connected_at_us;    // Monotonic, 0 until connected
+    atomic_uint_fast64_t bytes_in;
+    atomic_uint_fast64_t bytes_out;
+    atomic_uint_fast64_t polls;             // Non-blocking reads, with or without data
+    atomic_uint_fast64_t reads;             // Reads that returned data
+    atomic_uint_fast64_t feeds;             // Chunks handed to the terminal widget
+    atomic_uint_fast64_t writes;
+    atomic_int write_queue;                 // Writes waiting on the channel right now
+    atomic_int write_queue_max;
+    atomic_uint_fast64_t window_stalls;     // Writes larger than the remote window
+    atomic_uint_fast64_t stall_us;          // Time those writes were blocked
+    atomic_int_fast64_t keystroke_at_us;    // Oldest keystroke not echoed yet, 0 for none
+    atomic_int_fast64_t echo_last_us;
+    atomic_uint_fast64_t echo_sum_us;
+    atomic_uint_fast64_t echo_samples;
+} SSHStats;
+
+// Plain copy of SSHStats
+typedef struct {
+    int64_t uptime_us;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t polls;
+    uint64_t reads;
+    uint64_t feeds;
+    uint64_t writes;
+    int write_queue;
+    int write_queue_max;
+    uint64_t window_stalls;
+    uint64_t stall_us;
+    int64_t echo_last_us;                   // -1 before the first echo
+    int64_t echo_avg_us;
+    uint64_t echo_samples;
+} SSHStatsSnapshot;
 
 typedef struct {
     ssh_session session;
@@ -13,6 +56,16 @@ typedef struct {
     ssh_session proxy_session;
     ssh_channel proxy_channel;
     int proxy_fd;
+
+    // Phases of the last ssh_connect_to_server
+    ConnectTiming timing;
+    // Failures found before libssh takes over (name resolution, TCP connect)
+    char error[160];
+
+    SSHStats stats;
+    // Every keystroke echo of the session
+    LatencyHistogram echo;
+    pthread_mutex_t echo_lock;
 } SSHContext;
 
 SSHContext* ssh_context_new();
@@ -33,6 +86,45 @@ int ssh_write_data(SSHContext* ctx, const char* buffer, size_t len);
 
 bool ssh_is_channel_open(SSHContext* ctx);
 
+// Starts a command on a separate exec channel, for streaming its stdin/stdout.
+ssh_channel ssh_exec_open(SSHContext* ctx, const char* command);
+
+// Gets each piece of a command's stdout as it arrives. A nonzero return stops the read.
+typedef int (*SSHExecOutputFunc)(const char* data, size_t len, void* user_data);
+
+// Reads an ssh_exec_open channel until the command is done, passing stdout to
+// on_stdout and dropping stderr; both are read in turns so neither can stall the
+// command. Returns 0, or -1 on a channel error or when on_stdout stopped it.
+int ssh_exec_read(ssh_channel channel, SSHExecOutputFunc on_stdout, void* user_data);
+
+// Drains, closes and frees an ssh_exec_open channel. Returns the exit status (-1 on error).
+int ssh_exec_close(ssh_channel channel);
+
+// Runs a command on a separate exec channel and returns its exit status (-1 on error).
+// Stdout is copied into output (NUL-terminated, may be NULL), stderr is read and dropped.
+int ssh_exec_command(SSHContext* ctx, const char* command, char* output, size_t output_len);
+
+// True when ~/.ssh/config or /etc/ssh/ssh_config give host a ProxyJump or ProxyCommand.
+bool ssh_config_has_proxy(const char* host);
+
+// Wraps s in single quotes for a POSIX shell. Free with free().
+char* ssh_shell_quote(const char* s);
+
 const char* ssh_get_error_msg(SSHContext* ctx);
 
+void ssh_stats_snapshot(SSHContext* ctx, SSHStatsSnapshot* out);
+
+// JSON object of a snapshot. Free with free().
+char* ssh_stats_json(const SSHStatsSnapshot* s);
+
+// A key was sent, the next data read back is its echo
+void ssh_stats_keystroke(SSHContext* ctx);
+
+// Copy of the echo latency histogram
+void ssh_stats_echo_histogram(SSHContext* ctx, LatencyHistogram* out);
+
+static inline void ssh_stats_add(atomic_uint_fast64_t *counter, uint64_t n) {
+    atomic_fetch_add_explicit(counter, n, memory_order_relaxed);
+}
+
 #endif
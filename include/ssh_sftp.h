@@ -3,6 +3,7 @@
 
 #include "ssh_backend.h"
 #include <libssh/sftp.h>
+#include <pthread.h>
 
 // File types
 typedef enum {
@@ -20,18 +21,53 @@ typedef struct {
     char *permissions;
 } SFTPFile;
 
+// Byte counters of the last transfer. Holes in sparse files (upload) and
+// zero runs (download) are counted as skipped instead of copied.
+typedef struct {
+    uint64_t total_bytes;
+    uint64_t transferred_bytes;
+    uint64_t skipped_bytes;
+} SFTPTransferStats;
+
+// How files are moved when the server has no SFTP subsystem. The fallbacks
+// run shell commands over exec channels and support listing, transfers,
+// mkdir and delete only; sftp is NULL for them.
+typedef enum {
+    SFTP_TRANSPORT_SFTP = 0,
+    SFTP_TRANSPORT_SCP,
+    SFTP_TRANSPORT_EXEC
+} SFTPTransport;
+
 typedef struct {
     SSHContext *ssh_ctx;
     sftp_session sftp;
+    SFTPTransport transport;
     bool is_initialized;
+    SFTPTransferStats last_transfer;
+    pthread_mutex_t lock;
+    atomic_int refs;
 } SFTPContext;
 
 SFTPContext* sftp_context_new(SSHContext *ssh_ctx);
 
+// The session is not thread-safe: a context shared with a background worker
+// (folder sync, ...) must be locked around each use. The lock is recursive.
+void sftp_context_lock(SFTPContext *ctx);
+
+void sftp_context_unlock(SFTPContext *ctx);
+
+// Falls back to SCP, then to plain exec streams, when the SFTP subsystem is missing.
 int sftp_init_session(SFTPContext *ctx);
 
 void sftp_context_free(SFTPContext *ctx);
 
+// For a context shared with background jobs that may outlive its owner. Each
+// job holds a reference; the last sftp_context_unref frees the context and the
+// SSH session under it, so the owner drops its own reference instead of freeing.
+SFTPContext* sftp_context_ref(SFTPContext *ctx);
+
+void sftp_context_unref(SFTPContext *ctx);
+
 SFTPFile** sftp_list_directory(SFTPContext *ctx, const char *path, int *count);
 
 void sftp_free_file_list(SFTPFile **files, int count);
@@ -40,6 +76,18 @@ int sftp_download_file(SFTPContext *ctx, const char *remote_path, const char *lo
 
 int sftp_upload_file(SFTPContext *ctx, const char *local_path, const char *remote_path);
 
+// For a context shared with other threads: the lock is taken per request rather
+// than around the whole file, and the counters go to stats, not last_transfer.
+int sftp_upload_file_shared(SFTPContext *ctx, const char *local_path, const char *remote_path, SFTPTransferStats *stats);
+
+// Streams a file between two hosts through a bounded in-memory pipeline, without
+// a local copy. src and dst must be different sessions. Stats land in dst.
+int sftp_copy_remote(SFTPContext *src, const char *src_path, SFTPContext *dst, const char *dst_path);
+
+// Lets the source host push the file to the destination with scp. Only works when
+// src can reach and authenticate to dst on its own (keys or agent forwarding).
+int sftp_copy_remote_direct(SFTPContext *src, const char *src_path, const char *dst_user, const char *dst_host, int dst_port, const char *dst_path);
+
 int sftp_create_directory(SFTPContext *ctx, const char *path);
 
 int sftp_delete_file(SFTPContext *ctx, const char *path);
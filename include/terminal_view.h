@@ -4,11 +4,17 @@
 #include <gtk/gtk.h>
 
 #include "db.h"
+#include "local_echo.h"
 
 // Crée la vue du terminal
 GtkWidget* create_terminal_view();
 
 // Connecte le terminal à un hôte
-void terminal_view_connect(GtkWidget *view, const char *hostname, int port, const char *username, const char *password, const char *key_path, const char *protocol, Host *proxy_host);
+void terminal_view_connect(GtkWidget *view, const Host *host, const Host *proxy_host);
+
+// Predictive local echo of the SSH tabs, off by default
+void terminal_view_set_predictive_echo(LocalEchoMode mode);
+
+LocalEchoMode terminal_view_get_predictive_echo();
 
 #endif
@@ -0,0 +1,92 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Leveled logging and timeline spans. Each thread writes into its own
+// lock-free ring, so recording never blocks or interleaves; a background
+// thread drains the rings to the log file and keeps the recent spans for a
+// Chrome/Perfetto trace export (chrome://tracing, ui.perfetto.dev).
+typedef enum {
+    TRACE_LEVEL_ERROR,
+    TRACE_LEVEL_WARN,
+    TRACE_LEVEL_INFO,
+    TRACE_LEVEL_DEBUG,
+    TRACE_LEVEL_TRACE
+} TraceLevel;
+
+// Levels above this one are compiled out
+#ifndef TRACE_COMPILED_LEVEL
+#ifdef NDEBUG
+#define TRACE_COMPILED_LEVEL TRACE_LEVEL_INFO
+#else
+#define TRACE_COMPILED_LEVEL TRACE_LEVEL_TRACE
+#endif
+#endif
+
+// Threshold and span switch checked before anything is formatted
+extern atomic_int trace_runtime_level;
+extern atomic_bool trace_spans_enabled;
+
+#define TRACE_LOG(level, category, ...) do { \
+    if ((level) <= TRACE_COMPILED_LEVEL && (int)(level) <= atomic_load_explicit(&trace_runtime_level, memory_order_relaxed)) \
+        trace_log((level), (category), __VA_ARGS__); \
+} while (0)
+
+#define LOG_ERROR(category, ...) TRACE_LOG(TRACE_LEVEL_ERROR, category, __VA_ARGS__)
+#define LOG_WARN(category, ...) TRACE_LOG(TRACE_LEVEL_WARN, category, __VA_ARGS__)
+#define LOG_INFO(category, ...) TRACE_LOG(TRACE_LEVEL_INFO, category, __VA_ARGS__)
+#define LOG_DEBUG(category, ...) TRACE_LOG(TRACE_LEVEL_DEBUG, category, __VA_ARGS__)
+#define LOG_TRACE(category, ...) TRACE_LOG(TRACE_LEVEL_TRACE, category, __VA_ARGS__)
+
+// Default size of the span timeline kept for export
+#define TRACE_TIMELINE_DEFAULT 65536
+
+// Starts the flusher. log_path NULL writes to stderr, timeline_events 0 turns spans off.
+// Until then, log lines go straight to stderr and spans are dropped.
+bool trace_start(TraceLevel level, const char *log_path, int timeline_events);
+
+// Drains every ring and stops the flusher. The timeline stays exportable.
+void trace_stop();
+
+void trace_set_level(TraceLevel level);
+
+// "error", "warn", "info", "debug" or "trace", fallback for anything else
+TraceLevel trace_level_from_name(const char *name, TraceLevel fallback);
+
+// Names the calling thread on the exported timeline
+void trace_set_thread_name(const char *name);
+
+// Writes the timeline as Chrome trace event JSON
+bool trace_export_chrome(const char *path);
+
+// Monotonic clock of every timestamp, in microseconds
+int64_t trace_now_us();
+
+// Use TRACE_LOG and its wrappers, which skip disabled levels for free
+void trace_log(TraceLevel level, const char *category, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+// Category and name must outlive the trace (string literals)
+typedef struct {
+    const char *category;
+    const char *name;
+    int64_t start_us;       // -1 when spans are off
+} TraceSpan;
+
+static inline TraceSpan trace_span_begin(const char *category, const char *name) {
+    TraceSpan span = { category, name, -1 };
+    if (atomic_load_explicit(&trace_spans_enabled, memory_order_relaxed)) span.start_us = trace_now_us();
+    return span;
+}
+
+void trace_span_end(TraceSpan *span);
+
+// Same, with a detail shown in the span's args on the timeline
+void trace_span_end_detail(TraceSpan *span, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// A span whose times were measured by the caller
+void trace_span_record(const char *category, const char *name, int64_t start_us, int64_t duration_us, const char *detail);
+
+#endif
@@ -0,0 +1,36 @@
+#include "connect_timing.h"
+#include <stdio.h>
+#include <string.h>
+
+void connect_timing_reset(ConnectTiming *t) {
+    memset(t, 0, sizeof(*t));
+    for (int i = 0; i < CONNECT_PHASE_COUNT; i++) t->phase_us[i] = -1;
+    t->total_us = -1;
+    t->publickey_us = -1;
+    t->failed_phase = -1;
+}
+
+const char* connect_phase_name(ConnectPhase phase) {
+    static const char *names[CONNECT_PHASE_COUNT] = {
+        [CONNECT_PHASE_DNS] = "dns",
+        [CONNECT_PHASE_TCP] = "tcp",
+        [CONNECT_PHASE_PROXY] = "jump host",
+        [CONNECT_PHASE_KEX] = "key exchange",
+        [CONNECT_PHASE_AUTH] = "auth",
+        [CONNECT_PHASE_CHANNEL] = "channel",
+    };
+    return phase >= 0 && phase < CONNECT_PHASE_COUNT ? names[phase] : "?";
+}
+
+void connect_timing_format(const ConnectTiming *t, char *buf, size_t len) {
+    if (len == 0) return;
+    buf[0] = '\0';
+    size_t used = 0;
+    for (int i = 0; i < CONNECT_PHASE_COUNT && used < len; i++) {
+        if (t->phase_us[i] < 0) continue;
+        int n = snprintf(buf + used, len - used, "%s%s %.1f ms", used ? ", " : "",
+                         connect_phase_name(i), t->phase_us[i] / 1000.0);
+        if (n < 0) break;
+        used += (size_t)n;
+    }
+}
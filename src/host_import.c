@@ -0,0 +1,839 @@
+#include "host_import.h"
+#include "trace.h"
+#include <ctype.h>
+#include <glob.h>
+#include <pwd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define INCLUDE_MAX_DEPTH 16
+#define MAX_ARGS 16
+#define KNOWN_HOSTS_GROUP "Known hosts"
+// Hosts a single web[a:b] pattern of an inventory may expand to
+#define ANSIBLE_MAX_RANGE 100000
+
+// Open addressing table from a string to an index in the host array
+typedef struct {
+    char **keys;
+    int *values;
+    size_t capacity;    // Power of two
+    size_t size;
+} StrIndex;
+
+enum {
+    FIELD_HOSTNAME,
+    FIELD_PORT,
+    FIELD_USER,
+    FIELD_KEY,
+    FIELD_PROXY,
+    FIELD_COUNT
+};
+
+// Position in the config files of the option that set each field, 0 when
+// another source set it
+typedef struct {
+    unsigned seq[FIELD_COUNT];
+} FieldOrder;
+
+struct HostImportList {
+    HostImport *hosts;
+    FieldOrder *order;  // Parallel to hosts
+    int count;
+    int capacity;
+    StrIndex names;
+    // "Host *" and top level values, merged into every host when finishing
+    HostImport defaults;
+    FieldOrder defaults_order;
+    unsigned seq;
+};
+
+// --- String index ---
+
+static uint32_t hash_str(const char *s) {
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static size_t strindex_slot(const StrIndex *idx, const char *key) {
+    size_t mask = idx->capacity - 1;
+    size_t i = hash_str(key) & mask;
+    while (idx->keys[i] && strcmp(idx->keys[i], key) != 0) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int strindex_find(const StrIndex *idx, const char *key) {
+    if (idx->capacity == 0) return -1;
+    size_t i = strindex_slot(idx, key);
+    return idx->keys[i] ? idx->values[i] : -1;
+}
+
+static void strindex_put(StrIndex *idx, const char *key, int value) {
+    // Kept at most half full
+    if ((idx->size + 1) * 2 > idx->capacity) {
+        StrIndex grown = { NULL, NULL, idx->capacity ? idx->capacity * 2 : 64, 0 };
+        grown.keys = calloc(grown.capacity, sizeof(char*));
+        grown.values = malloc(grown.capacity * sizeof(int));
+        for (size_t i = 0; i < idx->capacity; i++) {
+            if (!idx->keys[i]) continue;
+            size_t slot = strindex_slot(&grown, idx->keys[i]);
+            grown.keys[slot] = idx->keys[i];
+            grown.values[slot] = idx->values[i];
+            grown.size++;
+        }
+        free(idx->keys);
+        free(idx->values);
+        *idx = grown;
+    }
+    size_t i = strindex_slot(idx, key);
+    if (!idx->keys[i]) {
+        idx->keys[i] = strdup(key);
+        idx->size++;
+    }
+    idx->values[i] = value;
+}
+
+static void strindex_clear(StrIndex *idx) {
+    for (size_t i = 0; i < idx->capacity; i++) {
+        free(idx->keys[i]);
+    }
+    free(idx->keys);
+    free(idx->values);
+    memset(idx, 0, sizeof(*idx));
+}
+
+// --- List ---
+
+HostImportList* host_import_list_new() {
+    return calloc(1, sizeof(HostImportList));
+}
+
+static void free_fields(HostImport *h) {
+    free(h->name);
+    free(h->hostname);
+    free(h->username);
+    free(h->key_path);
+    free(h->group);
+    free(h->proxy);
+    memset(h, 0, sizeof(*h));
+}
+
+void host_import_free(HostImport *hosts, int count) {
+    if (!hosts) return;
+    for (int i = 0; i < count; i++) {
+        free_fields(&hosts[i]);
+    }
+    free(hosts);
+}
+
+void host_import_list_free(HostImportList *list) {
+    if (!list) return;
+    host_import_free(list->hosts, list->count);
+    free(list->order);
+    strindex_clear(&list->names);
+    free_fields(&list->defaults);
+    free(list);
+}
+
+// Index of the host called name, added empty if new
+static int get_host(HostImportList *list, const char *name) {
+    int i = strindex_find(&list->names, name);
+    if (i >= 0) return i;
+
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->hosts = realloc(list->hosts, list->capacity * sizeof(HostImport));
+        list->order = realloc(list->order, list->capacity * sizeof(FieldOrder));
+    }
+    i = list->count++;
+    memset(&list->hosts[i], 0, sizeof(HostImport));
+    memset(&list->order[i], 0, sizeof(FieldOrder));
+    list->hosts[i].name = strdup(name);
+    strindex_put(&list->names, name, i);
+    return i;
+}
+
+// The first value seen wins, like ssh
+static void set_field(char **field, const char *value) {
+    if (!*field && value && value[0]) *field = strdup(value);
+}
+
+static void set_port(int *port, const char *value) {
+    int p = value ? atoi(value) : 0;
+    if (*port == 0 && p > 0 && p < 65536) *port = p;
+}
+
+static void trim(char **s) {
+    char *p = *s;
+    while (isspace((unsigned char)*p)) p++;
+    char *end = p + strlen(p);
+    while (end > p && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    *s = p;
+}
+
+// "~/x" relative to the home directory, other relative paths to base
+static char* expand_path(const char *path, const char *base) {
+    const char *home = getenv("HOME");
+    char *out = NULL;
+    if (path[0] == '~' && path[1] == '/' && home) {
+        out = malloc(strlen(home) + strlen(path));
+        sprintf(out, "%s%s", home, path + 1);
+    } else if (path[0] != '/' && base) {
+        out = malloc(strlen(base) + strlen(path) + 2);
+        sprintf(out, "%s/%s", base, path);
+    } else {
+        out = strdup(path);
+    }
+    return out;
+}
+
+static bool is_pattern(const char *s) {
+    return strpbrk(s, "*?!") != NULL;
+}
+
+// --- OpenSSH config ---
+
+typedef struct {
+    HostImportList *list;
+    int *block;         // Hosts of the current Host line
+    int block_count;
+    int block_capacity;
+    bool block_defaults;
+    bool block_skipped; // Match blocks and pattern-only Host lines
+    char *ssh_dir;
+} SshConfigParser;
+
+// Splits "Keyword value ..." or "Keyword=value" in place, honouring quotes
+static int split_args(char *line, char **args, int max) {
+    int n = 0;
+    char *p = line;
+    while (*p && n < max) {
+        while (isspace((unsigned char)*p) || (n == 1 && *p == '=')) p++;
+        if (!*p || *p == '#') break;
+        if (*p == '"') {
+            args[n++] = ++p;
+            while (*p && *p != '"') p++;
+        } else {
+            args[n++] = p;
+            while (*p && !isspace((unsigned char)*p) && !(n == 1 && *p == '=')) p++;
+        }
+        if (*p) *p++ = '\0';
+    }
+    return n;
+}
+
+static bool field_is_set(const HostImport *h, int field) {
+    switch (field) {
+        case FIELD_HOSTNAME: return h->hostname != NULL;
+        case FIELD_PORT: return h->port != 0;
+        case FIELD_USER: return h->username != NULL;
+        case FIELD_KEY: return h->key_path != NULL;
+        default: return h->proxy != NULL;
+    }
+}
+
+// seq is the option's position in the config files, kept with the value it set
+static void apply_option(HostImport *h, FieldOrder *order, unsigned seq, const char *key, char **args, int argc, const char *ssh_dir) {
+    int field;
+    if (strcasecmp(key, "HostName") == 0) field = FIELD_HOSTNAME;
+    else if (strcasecmp(key, "Port") == 0) field = FIELD_PORT;
+    else if (strcasecmp(key, "User") == 0) field = FIELD_USER;
+    else if (strcasecmp(key, "IdentityFile") == 0) field = FIELD_KEY;
+    else if (strcasecmp(key, "ProxyJump") == 0) field = FIELD_PROXY;
+    else return;
+    if (field_is_set(h, field)) return;
+
+    if (field == FIELD_HOSTNAME) {
+        set_field(&h->hostname, args[0]);
+    } else if (field == FIELD_PORT) {
+        set_port(&h->port, args[0]);
+    } else if (field == FIELD_USER) {
+        set_field(&h->username, args[0]);
+    } else if (field == FIELD_KEY) {
+        h->key_path = expand_path(args[0], ssh_dir);
+    } else {
+        // "none" is kept so that a default doesn't apply, it resolves to no proxy
+        set_field(&h->proxy, args[0]);
+    }
+    if (field_is_set(h, field)) order->seq[field] = seq;
+}
+
+static void parse_ssh_config_file(SshConfigParser *p, const char *path, int depth);
+
+static void include_files(SshConfigParser *p, char **args, int argc, int depth) {
+    if (depth >= INCLUDE_MAX_DEPTH) return;
+    for (int i = 0; i < argc; i++) {
+        char *pattern = expand_path(args[i], p->ssh_dir);
+        glob_t g;
+        if (glob(pattern, 0, NULL, &g) == 0) {
+            for (size_t j = 0; j < g.gl_pathc; j++) {
+                parse_ssh_config_file(p, g.gl_pathv[j], depth + 1);
+            }
+            globfree(&g);
+        }
+        free(pattern);
+    }
+}
+
+static void start_block(SshConfigParser *p, char **args, int argc) {
+    p->block_count = 0;
+    p->block_defaults = false;
+    p->block_skipped = false;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(args[i], "*") == 0) {
+            p->block_defaults = true;
+        } else if (!is_pattern(args[i])) {
+            if (p->block_count == p->block_capacity) {
+                p->block_capacity = p->block_capacity ? p->block_capacity * 2 : 8;
+                p->block = realloc(p->block, p->block_capacity * sizeof(int));
+            }
+            p->block[p->block_count++] = get_host(p->list, args[i]);
+        }
+    }
+    // Wildcard lines with named hosts ("Host * web") would need pattern matching, keep the named ones
+    if (p->block_count > 0) p->block_defaults = false;
+    else if (!p->block_defaults) p->block_skipped = true;
+}
+
+static void parse_ssh_config_file(SshConfigParser *p, const char *path, int depth) {
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, f) != -1) {
+        char *args[MAX_ARGS];
+        int argc = split_args(line, args, MAX_ARGS);
+        if (argc < 2) continue;
+
+        const char *key = args[0];
+        if (strcasecmp(key, "Host") == 0) {
+            start_block(p, args + 1, argc - 1);
+        } else if (strcasecmp(key, "Match") == 0) {
+            p->block_count = 0;
+            p->block_defaults = false;
+            p->block_skipped = true;
+        } else if (strcasecmp(key, "Include") == 0) {
+            include_files(p, args + 1, argc - 1, depth);
+        } else if (p->block_defaults) {
+            apply_option(&p->list->defaults, &p->list->defaults_order, ++p->list->seq, key, args + 1, argc - 1, p->ssh_dir);
+        } else if (!p->block_skipped) {
+            unsigned seq = ++p->list->seq;
+            for (int i = 0; i < p->block_count; i++) {
+                apply_option(&p->list->hosts[p->block[i]], &p->list->order[p->block[i]], seq, key, args + 1, argc - 1, p->ssh_dir);
+            }
+        }
+    }
+    free(line);
+    fclose(f);
+}
+
+bool host_import_ssh_config(HostImportList *list, const char *path) {
+    if (access(path, R_OK) != 0) return false;
+
+    // Options before the first Host line apply to every host
+    SshConfigParser p = { .list = list, .block_defaults = true };
+    p.ssh_dir = expand_path("~/.ssh", NULL);
+    parse_ssh_config_file(&p, path, 0);
+    free(p.block);
+    free(p.ssh_dir);
+    return true;
+}
+
+// --- known_hosts ---
+
+static void target_key(char *buf, size_t size, const char *hostname, int port) {
+    snprintf(buf, size, "%s:%d", hostname, port > 0 ? port : 22);
+}
+
+bool host_import_known_hosts(HostImportList *list, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+
+    // Targets already imported, under their real hostname
+    StrIndex targets = {0};
+    char key[1100];
+    for (int i = 0; i < list->count; i++) {
+        const HostImport *h = &list->hosts[i];
+        target_key(key, sizeof(key), h->hostname ? h->hostname : h->name, h->port ? h->port : list->defaults.port);
+        strindex_put(&targets, key, i);
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, f) != -1) {
+        char *p = line;
+        trim(&p);
+        // Comments, hashed names and @cert-authority/@revoked lines
+        if (!*p || *p == '#' || *p == '|' || *p == '@') continue;
+
+        // "host,ip,... keytype key": the first name is enough
+        p[strcspn(p, ", \t")] = '\0';
+        if (is_pattern(p)) continue;
+
+        int port = 22;
+        if (*p == '[') {
+            char *close = strchr(p, ']');
+            if (!close) continue;
+            *close = '\0';
+            if (close[1] == ':') port = atoi(close + 2);
+            p++;
+        }
+        if (!*p || strlen(p) > 1024) continue;
+
+        target_key(key, sizeof(key), p, port);
+        if (strindex_find(&targets, key) >= 0) continue;
+
+        const char *name = port == 22 ? p : key;
+        if (strindex_find(&list->names, name) >= 0) continue;
+        int i = get_host(list, name);
+        set_field(&list->hosts[i].hostname, p);
+        list->hosts[i].port = port;
+        set_field(&list->hosts[i].group, KNOWN_HOSTS_GROUP);
+        strindex_put(&targets, key, i);
+    }
+    free(line);
+    fclose(f);
+    strindex_clear(&targets);
+    return true;
+}
+
+// --- Inventories ---
+
+static char* read_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = size >= 0 ? malloc(size + 1) : NULL;
+    if (buf) {
+        size_t n = fread(buf, 1, size, f);
+        buf[n] = '\0';
+    }
+    fclose(f);
+    return buf;
+}
+
+// Next line of buf, NUL terminated in place; NULL at the end
+static char* next_line(char **cursor) {
+    char *start = *cursor;
+    if (!*start) return NULL;
+    char *end = strchr(start, '\n');
+    if (end) {
+        *end = '\0';
+        *cursor = end + 1;
+    } else {
+        *cursor = start + strlen(start);
+    }
+    return start;
+}
+
+static void add_inventory_host(HostImportList *list, const char *name, const char *hostname, const char *port,
+                               const char *user, const char *key_path, const char *group, const char *proxy) {
+    if ((!name || !*name) && (!hostname || !*hostname)) return;
+    int i = get_host(list, name && *name ? name : hostname);
+    HostImport *h = &list->hosts[i];
+    set_field(&h->hostname, hostname);
+    set_port(&h->port, port);
+    set_field(&h->username, user);
+    if (!h->key_path && key_path && *key_path) h->key_path = expand_path(key_path, NULL);
+    set_field(&h->group, group);
+    set_field(&h->proxy, proxy);
+}
+
+// Ansible host line: "alias[:port] ansible_host=... ansible_port=... ansible_user=..."
+// False for a range pattern too large to expand.
+static bool parse_ansible_host(HostImportList *list, char *line, const char *group) {
+    char *args[MAX_ARGS];
+    int argc = 0;
+    char *p = line;
+    while (*p && argc < MAX_ARGS) {
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p || *p == '#') break;
+        args[argc++] = p;
+        while (*p && !isspace((unsigned char)*p)) p++;
+        if (*p) *p++ = '\0';
+    }
+    if (argc == 0 || strchr(args[0], '=')) return true;
+
+    const char *hostname = NULL, *port = NULL, *user = NULL, *key_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        char *value = strchr(args[i], '=');
+        if (!value) continue;
+        *value++ = '\0';
+        size_t len = strlen(value);
+        if (len >= 2 && (value[0] == '"' || value[0] == '\'') && value[len - 1] == value[0]) {
+            value[len - 1] = '\0';
+            value++;
+        }
+        if (strcmp(args[i], "ansible_host") == 0 || strcmp(args[i], "ansible_ssh_host") == 0) hostname = value;
+        else if (strcmp(args[i], "ansible_port") == 0 || strcmp(args[i], "ansible_ssh_port") == 0) port = value;
+        else if (strcmp(args[i], "ansible_user") == 0 || strcmp(args[i], "ansible_ssh_user") == 0) user = value;
+        else if (strcmp(args[i], "ansible_ssh_private_key_file") == 0 || strcmp(args[i], "ansible_private_key_file") == 0) key_path = value;
+    }
+
+    // "alias:port" unless it is an IPv6 address
+    char *alias = args[0];
+    char *colon = strrchr(alias, ':');
+    if (colon && colon == strchr(alias, ':') && !strchr(alias, '[')) {
+        *colon = '\0';
+        if (!port) port = colon + 1;
+    }
+
+    // One numeric range like web[01:20], zero padding kept
+    char *open = strchr(alias, '[');
+    char *sep = open ? strchr(open, ':') : NULL;
+    char *close = sep ? strchr(sep, ']') : NULL;
+    if (!close || !isdigit((unsigned char)open[1]) || !isdigit((unsigned char)sep[1])) {
+        add_inventory_host(list, alias, hostname ? hostname : alias, port, user, key_path, group, NULL);
+        return true;
+    }
+
+    *open = *sep = *close = '\0';
+    long long first = strtoll(open + 1, NULL, 10), last = strtoll(sep + 1, NULL, 10);
+    if (last >= first && last - first >= ANSIBLE_MAX_RANGE) {
+        LOG_ERROR("hosts", "%s[%s:%s]%s expands to more than %d hosts", alias, open + 1, sep + 1, close + 1, ANSIBLE_MAX_RANGE);
+        return false;
+    }
+    int width = open[1] == '0' ? (int)strlen(open + 1) : 0;
+    for (long long n = first; n <= last; n++) {
+        char name[512];
+        snprintf(name, sizeof(name), "%s%0*lld%s", alias, width, n, close + 1);
+        add_inventory_host(list, name, name, port, user, key_path, group, NULL);
+    }
+    return true;
+}
+
+static bool parse_ansible(HostImportList *list, char *buf) {
+    char *cursor = buf;
+    char *line;
+    char *group = NULL;
+    bool skip = false;
+    bool ok = true;
+
+    while ((line = next_line(&cursor))) {
+        trim(&line);
+        if (!*line || *line == '#' || *line == ';') continue;
+
+        if (*line == '[') {
+            char *end = strchr(line, ']');
+            if (end) *end = '\0';
+            line++;
+            // [group:vars] and [group:children] hold no hosts
+            skip = strchr(line, ':') != NULL;
+            free(group);
+            group = skip || strcmp(line, "all") == 0 || strcmp(line, "ungrouped") == 0 ? NULL : strdup(line);
+            continue;
+        }
+        if (!skip && !parse_ansible_host(list, line, group)) ok = false;
+    }
+    free(group);
+    return ok;
+}
+
+enum {
+    COL_NONE,
+    COL_NAME,
+    COL_HOSTNAME,
+    COL_PORT,
+    COL_USER,
+    COL_GROUP,
+    COL_KEY,
+    COL_PROXY,
+    COL_TYPES
+};
+
+// Splits one CSV record in place, "quoted ""fields""" included
+static int split_csv(char *line, char delim, char **fields, int max) {
+    int n = 0;
+    char *p = line;
+    while (n < max) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '"') {
+            char *out = ++p;
+            fields[n++] = out;
+            while (*p) {
+                if (*p == '"' && p[1] == '"') {
+                    *out++ = '"';
+                    p += 2;
+                } else if (*p == '"') {
+                    p++;
+                    break;
+                } else {
+                    *out++ = *p++;
+                }
+            }
+            while (*p && *p != delim) p++;
+            bool more = *p == delim;
+            *out = '\0';
+            if (!more) break;
+            p++;
+        } else {
+            fields[n++] = p;
+            char *end = strchr(p, delim);
+            if (end) *end = '\0';
+            char *f = fields[n - 1];
+            trim(&f);
+            fields[n - 1] = f;
+            if (!end) break;
+            p = end + 1;
+        }
+    }
+    return n;
+}
+
+static int column_type(const char *header) {
+    static const struct { const char *name; int type; } names[] = {
+        { "name", COL_NAME }, { "alias", COL_NAME }, { "label", COL_NAME },
+        { "hostname", COL_HOSTNAME }, { "host", COL_HOSTNAME }, { "address", COL_HOSTNAME }, { "ip", COL_HOSTNAME },
+        { "port", COL_PORT },
+        { "user", COL_USER }, { "username", COL_USER }, { "login", COL_USER },
+        { "group", COL_GROUP }, { "folder", COL_GROUP },
+        { "key", COL_KEY }, { "key_path", COL_KEY }, { "identityfile", COL_KEY }, { "identity_file", COL_KEY },
+        { "proxy", COL_PROXY }, { "proxyjump", COL_PROXY }, { "proxy_jump", COL_PROXY }, { "jump_host", COL_PROXY },
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcasecmp(header, names[i].name) == 0) return names[i].type;
+    }
+    return COL_NONE;
+}
+
+static void parse_csv(HostImportList *list, char *buf) {
+    char *cursor = buf;
+    char *line;
+    char delim = 0;
+    // Without a header: name, hostname, port, user, group
+    int columns[MAX_ARGS] = { COL_NAME, COL_HOSTNAME, COL_PORT, COL_USER, COL_GROUP };
+    bool first = true;
+
+    while ((line = next_line(&cursor))) {
+        size_t len = strlen(line);
+        if (len && line[len - 1] == '\r') line[len - 1] = '\0';
+        if (!line[0] || line[0] == '#') continue;
+
+        if (!delim) delim = strchr(line, ';') && !strchr(line, ',') ? ';' : ',';
+        char *fields[MAX_ARGS];
+        int n = split_csv(line, delim, fields, MAX_ARGS);
+
+        if (first) {
+            first = false;
+            int known = 0;
+            int header[MAX_ARGS] = {0};
+            for (int i = 0; i < n; i++) {
+                header[i] = column_type(fields[i]);
+                if (header[i] != COL_NONE) known++;
+            }
+            if (known > 0) {
+                memcpy(columns, header, sizeof(columns));
+                continue;
+            }
+        }
+
+        const char *values[COL_TYPES] = {0};
+        for (int i = 0; i < n; i++) {
+            if (columns[i] != COL_NONE && fields[i][0]) values[columns[i]] = fields[i];
+        }
+        const char *hostname = values[COL_HOSTNAME] ? values[COL_HOSTNAME] : values[COL_NAME];
+        add_inventory_host(list, values[COL_NAME], hostname, values[COL_PORT], values[COL_USER],
+                           values[COL_KEY], values[COL_GROUP], values[COL_PROXY]);
+    }
+}
+
+// INI inventories open with a [group] or set ansible_* variables
+static bool looks_like_ansible(const char *buf) {
+    if (strstr(buf, "ansible_")) return true;
+    const char *p = buf;
+    while (*p) {
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '#' || *p == ';') {
+            p += strcspn(p, "\n");
+            continue;
+        }
+        return *p == '[';
+    }
+    return false;
+}
+
+bool host_import_inventory(HostImportList *list, const char *path) {
+    char *buf = read_file(path);
+    if (!buf) return false;
+    bool ok = true;
+    if (looks_like_ansible(buf)) {
+        ok = parse_ansible(list, buf);
+    } else {
+        parse_csv(list, buf);
+    }
+    free(buf);
+    return ok;
+}
+
+// ssh_config files have Host or Match blocks, inventories never start a line with them
+static bool looks_like_ssh_config(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    char *line = NULL;
+    size_t cap = 0;
+    bool result = false;
+    while (!result && getline(&line, &cap, f) != -1) {
+        char *args[2];
+        if (split_args(line, args, 2) < 2) continue;
+        result = strcasecmp(args[0], "Host") == 0 || strcasecmp(args[0], "Match") == 0;
+    }
+    free(line);
+    fclose(f);
+    return result;
+}
+
+bool host_import_file(HostImportList *list, const char *path) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    if (strstr(base, "known_hosts")) return host_import_known_hosts(list, path);
+    if (looks_like_ssh_config(path)) return host_import_ssh_config(list, path);
+    return host_import_inventory(list, path);
+}
+
+bool host_import_ssh_dir(HostImportList *list) {
+    char *config = expand_path("~/.ssh/config", NULL);
+    char *known_hosts = expand_path("~/.ssh/known_hosts", NULL);
+    // Config first, so known_hosts only adds the hosts it doesn't name
+    bool ok = host_import_ssh_config(list, config);
+    ok = host_import_known_hosts(list, known_hosts) || ok;
+    free(config);
+    free(known_hosts);
+    return ok;
+}
+
+// --- Finishing ---
+
+static const char* local_user() {
+    const char *user = getenv("USER");
+    if (user && *user) return user;
+    struct passwd *pw = getpwuid(getuid());
+    return pw ? pw->pw_name : "root";
+}
+
+// Name of the host reached through a ProxyJump value, added if it is only an address
+static char* resolve_jump(HostImportList *list, const char *spec) {
+    // Only the first hop of a chain, hosts keep a single proxy
+    char hop[512];
+    snprintf(hop, sizeof(hop), "%.*s", (int)strcspn(spec, ","), spec);
+    if (!hop[0] || strcasecmp(hop, "none") == 0) return NULL;
+    if (strindex_find(&list->names, hop) >= 0) return strdup(hop);
+
+    // [user@]host[:port], host may be a bracketed IPv6 address
+    char *user = NULL;
+    char *host = hop;
+    char *at = strrchr(hop, '@');
+    if (at) {
+        *at = '\0';
+        user = hop;
+        host = at + 1;
+    }
+    char *port = NULL;
+    if (*host == '[') {
+        char *close = strchr(host, ']');
+        if (close) {
+            *close = '\0';
+            if (close[1] == ':') port = close + 2;
+        }
+        host++;
+    } else {
+        char *colon = strchr(host, ':');
+        if (colon && !strchr(colon + 1, ':')) {
+            *colon = '\0';
+            port = colon + 1;
+        }
+    }
+    if (!*host) return NULL;
+
+    // An alias given with a user or port is another login to it, added as a host
+    // of its own that keeps the alias's address, key and jump host
+    int alias = strindex_find(&list->names, host);
+    if (alias >= 0 && !user && !port) return strdup(host);
+
+    char name[1100];
+    snprintf(name, sizeof(name), "%s%s%s%s%s", user ? user : "", user ? "@" : "", host, port ? ":" : "", port ? port : "");
+    bool added = strindex_find(&list->names, name) < 0;
+    int i = get_host(list, name);
+    HostImport *h = &list->hosts[i];
+    set_port(&h->port, port);
+    set_field(&h->username, user);
+    if (alias >= 0) {
+        const HostImport *a = &list->hosts[alias];
+        set_field(&h->hostname, a->hostname ? a->hostname : a->name);
+        if (h->port == 0) h->port = a->port;
+        set_field(&h->username, a->username);
+        set_field(&h->key_path, a->key_path);
+        set_field(&h->proxy, a->proxy);
+        if (added) {
+            list->order[i] = list->order[alias];
+            if (user) list->order[i].seq[FIELD_USER] = 0;
+            if (port) list->order[i].seq[FIELD_PORT] = 0;
+        }
+    } else {
+        set_field(&h->hostname, host);
+    }
+    return strdup(name);
+}
+
+// A "Host *" value replaces the host's own one when it came first in the
+// files, ssh keeps the first value it reads of each option
+static bool default_wins(const HostImportList *list, int i, int field) {
+    unsigned def = list->defaults_order.seq[field];
+    unsigned own = list->order[i].seq[field];
+    if (!def) return false;
+    return !field_is_set(&list->hosts[i], field) || (own && def < own);
+}
+
+static void replace_field(char **field, const char *value) {
+    free(*field);
+    *field = strdup(value);
+}
+
+HostImport* host_import_list_take(HostImportList *list, int *count) {
+    const HostImport *d = &list->defaults;
+    const char *user = local_user();
+
+    // Jump hosts added by resolve_jump are appended and finished by this same loop
+    for (int i = 0; i < list->count; i++) {
+        HostImport *h = &list->hosts[i];
+        if (default_wins(list, i, FIELD_PORT)) h->port = d->port;
+        if (default_wins(list, i, FIELD_USER)) replace_field(&h->username, d->username);
+        if (default_wins(list, i, FIELD_KEY)) replace_field(&h->key_path, d->key_path);
+        if (default_wins(list, i, FIELD_PROXY)) replace_field(&h->proxy, d->proxy);
+        set_field(&h->hostname, h->name);
+        if (h->port == 0) h->port = 22;
+        set_field(&h->username, user);
+
+        if (h->proxy) {
+            char *spec = h->proxy;
+            char *jump = resolve_jump(list, spec);
+            free(spec);
+            // resolve_jump may have grown the array
+            h = &list->hosts[i];
+            h->proxy = jump && strcmp(jump, h->name) != 0 ? jump : NULL;
+            if (!h->proxy) free(jump);
+        }
+    }
+
+    HostImport *hosts = list->hosts;
+    *count = list->count;
+    list->hosts = NULL;
+    free(list->order);
+    list->order = NULL;
+    list->count = list->capacity = 0;
+    strindex_clear(&list->names);
+    return hosts;
+}
@@ -0,0 +1,511 @@
+#define _GNU_SOURCE
+#include "host_monitor.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+// Sockets open at once, whatever the number of hosts
+#define MONITOR_MAX_INFLIGHT 128
+#define MONITOR_TIMEOUT_MS 3000
+// Hosts that are not on screen are probed this many times less often
+#define MONITOR_HIDDEN_FACTOR 10
+// A host that stays down waits up to this many intervals between probes
+#define MONITOR_MAX_BACKOFF 16
+#define MONITOR_RESOLVERS 4
+#define MONITOR_DNS_TTL_MS (10 * 60 * 1000)
+#define MONITOR_DNS_RETRY_MS (60 * 1000)
+
+typedef struct {
+    int id;
+    char *hostname;
+    int port;
+    bool visible;
+
+    // Set by the resolvers
+    struct sockaddr_storage addr;
+    socklen_t addr_len;     // 0 until resolved
+    bool resolving;
+    uint64_t resolve_gen;   // Of the lookup in flight, a later watch makes it stale
+    bool resolve_failed;
+    long long resolve_due_ms;
+
+    int fd;                 // -1 when no probe is in flight
+    long long probe_start_us;
+    long long next_probe_ms;
+    long long last_probe_ms;
+    int failures;
+
+    HostState state;
+    int rtt_us;
+    int history[HOST_MONITOR_HISTORY];
+    int history_pos;
+    int history_count;
+    bool changed;
+} Target;
+
+struct HostMonitor {
+    pthread_mutex_t lock;
+    pthread_cond_t resolve_cond;
+
+    Target **targets;       // Sorted by id
+    int count;
+    int capacity;
+
+    int interval_ms;
+    int inflight;
+    int epoll_fd;
+    int wake_pipe[2];
+    bool stopping;
+
+    pthread_t prober;
+    pthread_t resolvers[MONITOR_RESOLVERS];
+    int resolver_count;
+    uint64_t resolve_gen;
+};
+
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static long long now_ms(void) {
+    return now_us() / 1000;
+}
+
+static void wake_prober(HostMonitor *mon) {
+    char c = 1;
+    if (write(mon->wake_pipe[1], &c, 1) < 0) {
+        // Pipe full, the prober is already due to wake up
+    }
+}
+
+// Index of id, or of where it would be inserted
+static int find_index(HostMonitor *mon, int id) {
+    int lo = 0, hi = mon->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (mon->targets[mid]->id < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static Target* find_target(HostMonitor *mon, int id) {
+    int i = find_index(mon, id);
+    return i < mon->count && mon->targets[i]->id == id ? mon->targets[i] : NULL;
+}
+
+static void close_probe(HostMonitor *mon, Target *t) {
+    if (t->fd < 0) return;
+    close(t->fd);   // Also drops it from the epoll set
+    t->fd = -1;
+    mon->inflight--;
+}
+
+static void free_target(HostMonitor *mon, Target *t) {
+    close_probe(mon, t);
+    free(t->hostname);
+    free(t);
+}
+
+// Records a probe result and schedules the next one
+static void finish_probe(HostMonitor *mon, Target *t, bool up, int rtt_us, long long now) {
+    close_probe(mon, t);
+
+    t->history[t->history_pos] = up ? rtt_us : -1;
+    t->history_pos = (t->history_pos + 1) % HOST_MONITOR_HISTORY;
+    if (t->history_count < HOST_MONITOR_HISTORY) t->history_count++;
+
+    HostState state = up ? HOST_STATE_UP : HOST_STATE_DOWN;
+    if (up) {
+        t->rtt_us = rtt_us;
+        t->failures = 0;
+    } else {
+        t->failures++;
+    }
+    t->state = state;
+    t->changed = true;
+    t->last_probe_ms = now;
+
+    long long interval = mon->interval_ms;
+    if (!t->visible) interval *= MONITOR_HIDDEN_FACTOR;
+    if (t->failures > 1) {
+        int backoff = 1 << (t->failures - 1 < 4 ? t->failures - 1 : 4);
+        interval *= backoff < MONITOR_MAX_BACKOFF ? backoff : MONITOR_MAX_BACKOFF;
+    }
+    t->next_probe_ms = now + interval;
+}
+
+static void start_probe(HostMonitor *mon, Target *t, long long now) {
+    int fd = socket(t->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        // Out of descriptors, try again at the next interval
+        t->next_probe_ms = now + mon->interval_ms;
+        return;
+    }
+
+    t->probe_start_us = now_us();
+    int rc = connect(fd, (struct sockaddr *)&t->addr, t->addr_len);
+    if (rc == 0) {
+        close(fd);
+        finish_probe(mon, t, true, (int)(now_us() - t->probe_start_us), now);
+        return;
+    }
+    if (errno != EINPROGRESS) {
+        close(fd);
+        finish_probe(mon, t, false, 0, now);
+        return;
+    }
+
+    // The id tells the event apart from one of an older socket of a removed host
+    struct epoll_event ev = { .events = EPOLLOUT };
+    ev.data.u64 = ((uint64_t)(uint32_t)t->id << 32) | (uint32_t)fd;
+    if (epoll_ctl(mon->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        close(fd);
+        t->next_probe_ms = now + mon->interval_ms;
+        return;
+    }
+    t->fd = fd;
+    mon->inflight++;
+}
+
+// Starts the due probes and expires the late ones. Returns the epoll timeout.
+static int schedule_probes(HostMonitor *mon) {
+    long long now = now_ms();
+    long long wait = 1000;
+    if (mon->interval_ms <= 0) return (int)wait;
+
+    // Visible hosts first, so they get the free sockets
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < mon->count; i++) {
+            Target *t = mon->targets[i];
+            if (t->visible != (pass == 0)) continue;
+
+            if (t->fd >= 0) {
+                long long deadline = t->probe_start_us / 1000 + MONITOR_TIMEOUT_MS;
+                if (now >= deadline) finish_probe(mon, t, false, 0, now);
+                else if (deadline - now < wait) wait = deadline - now;
+                continue;
+            }
+            if (now < t->next_probe_ms) {
+                if (t->next_probe_ms - now < wait) wait = t->next_probe_ms - now;
+                continue;
+            }
+            if (t->addr_len > 0) {
+                if (mon->inflight < MONITOR_MAX_INFLIGHT) start_probe(mon, t, now);
+            } else if (t->resolve_failed) {
+                finish_probe(mon, t, false, 0, now);
+            }
+        }
+    }
+    return (int)(wait > 0 ? wait : 1);
+}
+
+static void* prober_func(void *arg) {
+    HostMonitor *mon = (HostMonitor *)arg;
+    struct epoll_event events[64];
+    trace_set_thread_name("monitor-probe");
+
+    pthread_mutex_lock(&mon->lock);
+    while (!mon->stopping) {
+        int timeout = schedule_probes(mon);
+        pthread_mutex_unlock(&mon->lock);
+
+        int n = epoll_wait(mon->epoll_fd, events, 64, timeout);
+
+        pthread_mutex_lock(&mon->lock);
+        long long end = now_us();
+        for (int i = 0; i < n; i++) {
+            uint64_t data = events[i].data.u64;
+            if (data == UINT64_MAX) {
+                char buf[64];
+                while (read(mon->wake_pipe[0], buf, sizeof(buf)) > 0) {}
+                continue;
+            }
+            Target *t = find_target(mon, (int)(uint32_t)(data >> 32));
+            int fd = (int)(uint32_t)data;
+            if (!t || t->fd != fd) continue;
+
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            finish_probe(mon, t, err == 0, (int)(end - t->probe_start_us), end / 1000);
+        }
+    }
+    pthread_mutex_unlock(&mon->lock);
+    return NULL;
+}
+
+// Next host to resolve, visible ones first. Call with the lock held.
+static Target* next_to_resolve(HostMonitor *mon, long long now, long long *wait) {
+    Target *best = NULL;
+    for (int i = 0; i < mon->count; i++) {
+        Target *t = mon->targets[i];
+        if (t->resolving) continue;
+        if (t->resolve_due_ms > now) {
+            if (t->resolve_due_ms - now < *wait) *wait = t->resolve_due_ms - now;
+            continue;
+        }
+        if (t->visible) return t;
+        if (!best) best = t;
+    }
+    return best;
+}
+
+static void* resolver_func(void *arg) {
+    HostMonitor *mon = (HostMonitor *)arg;
+    trace_set_thread_name("monitor-resolve");
+
+    pthread_mutex_lock(&mon->lock);
+    while (!mon->stopping) {
+        long long wait = 60000;
+        Target *t = mon->interval_ms > 0 ? next_to_resolve(mon, now_ms(), &wait) : NULL;
+        if (!t) {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += wait / 1000;
+            until.tv_nsec += (wait % 1000) * 1000000;
+            if (until.tv_nsec >= 1000000000) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&mon->resolve_cond, &mon->lock, &until);
+            continue;
+        }
+
+        t->resolving = true;
+        t->resolve_gen = ++mon->resolve_gen;
+        uint64_t gen = t->resolve_gen;
+        int id = t->id;
+        char *hostname = strdup(t->hostname);
+        char port[16];
+        snprintf(port, sizeof(port), "%d", t->port);
+        pthread_mutex_unlock(&mon->lock);
+
+        struct addrinfo hints = { .ai_socktype = SOCK_STREAM, .ai_flags = AI_ADDRCONFIG };
+        struct addrinfo *res = NULL;
+        int rc = getaddrinfo(hostname, port, &hints, &res);
+
+        pthread_mutex_lock(&mon->lock);
+        // The host may have been removed or changed meanwhile, even back to
+        // the same name: only the lookup the target is waiting for counts
+        t = find_target(mon, id);
+        if (t && t->resolving && t->resolve_gen == gen) {
+            t->resolving = false;
+            if (rc == 0 && res && res->ai_addrlen <= sizeof(t->addr)) {
+                memcpy(&t->addr, res->ai_addr, res->ai_addrlen);
+                t->addr_len = res->ai_addrlen;
+                t->resolve_failed = false;
+                t->resolve_due_ms = now_ms() + MONITOR_DNS_TTL_MS;
+            } else {
+                t->resolve_failed = t->addr_len == 0;
+                t->resolve_due_ms = now_ms() + MONITOR_DNS_RETRY_MS;
+            }
+            wake_prober(mon);
+        }
+        if (res) freeaddrinfo(res);
+        free(hostname);
+    }
+    pthread_mutex_unlock(&mon->lock);
+    return NULL;
+}
+
+HostMonitor* host_monitor_start(int interval_ms) {
+    HostMonitor *mon = calloc(1, sizeof(HostMonitor));
+    mon->interval_ms = interval_ms;
+    pthread_mutex_init(&mon->lock, NULL);
+    pthread_cond_init(&mon->resolve_cond, NULL);
+
+    mon->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (mon->epoll_fd < 0 || pipe2(mon->wake_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+        if (mon->epoll_fd >= 0) close(mon->epoll_fd);
+        pthread_mutex_destroy(&mon->lock);
+        pthread_cond_destroy(&mon->resolve_cond);
+        free(mon);
+        return NULL;
+    }
+    struct epoll_event ev = { .events = EPOLLIN };
+    ev.data.u64 = UINT64_MAX;
+    epoll_ctl(mon->epoll_fd, EPOLL_CTL_ADD, mon->wake_pipe[0], &ev);
+
+    if (pthread_create(&mon->prober, NULL, prober_func, mon) != 0) {
+        close(mon->epoll_fd);
+        close(mon->wake_pipe[0]);
+        close(mon->wake_pipe[1]);
+        pthread_mutex_destroy(&mon->lock);
+        pthread_cond_destroy(&mon->resolve_cond);
+        free(mon);
+        return NULL;
+    }
+    for (int i = 0; i < MONITOR_RESOLVERS; i++) {
+        if (pthread_create(&mon->resolvers[mon->resolver_count], NULL, resolver_func, mon) == 0) {
+            mon->resolver_count++;
+        }
+    }
+    return mon;
+}
+
+void host_monitor_stop(HostMonitor *mon) {
+    if (!mon) return;
+    pthread_mutex_lock(&mon->lock);
+    mon->stopping = true;
+    pthread_cond_broadcast(&mon->resolve_cond);
+    wake_prober(mon);
+    pthread_mutex_unlock(&mon->lock);
+
+    // Resolvers stuck in getaddrinfo finish their lookup first
+    pthread_join(mon->prober, NULL);
+    for (int i = 0; i < mon->resolver_count; i++) {
+        pthread_join(mon->resolvers[i], NULL);
+    }
+
+    for (int i = 0; i < mon->count; i++) {
+        free_target(mon, mon->targets[i]);
+    }
+    free(mon->targets);
+    close(mon->epoll_fd);
+    close(mon->wake_pipe[0]);
+    close(mon->wake_pipe[1]);
+    pthread_mutex_destroy(&mon->lock);
+    pthread_cond_destroy(&mon->resolve_cond);
+    free(mon);
+}
+
+void host_monitor_set_interval(HostMonitor *mon, int interval_ms) {
+    pthread_mutex_lock(&mon->lock);
+    bool resumed = mon->interval_ms <= 0 && interval_ms > 0;
+    mon->interval_ms = interval_ms;
+    if (resumed) {
+        long long now = now_ms();
+        for (int i = 0; i < mon->count; i++) {
+            mon->targets[i]->next_probe_ms = now;
+        }
+    }
+    pthread_cond_broadcast(&mon->resolve_cond);
+    wake_prober(mon);
+    pthread_mutex_unlock(&mon->lock);
+}
+
+void host_monitor_watch(HostMonitor *mon, int id, const char *hostname, int port) {
+    pthread_mutex_lock(&mon->lock);
+    int i = find_index(mon, id);
+    Target *t = i < mon->count && mon->targets[i]->id == id ? mon->targets[i] : NULL;
+
+    if (t && t->port == port && strcmp(t->hostname, hostname) == 0) {
+        pthread_mutex_unlock(&mon->lock);
+        return;
+    }
+
+    if (t) {
+        // New address: start over
+        bool visible = t->visible;
+        close_probe(mon, t);
+        free(t->hostname);
+        memset(t, 0, sizeof(*t));
+        t->visible = visible;
+    } else {
+        if (mon->count == mon->capacity) {
+            mon->capacity = mon->capacity ? mon->capacity * 2 : 64;
+            mon->targets = realloc(mon->targets, mon->capacity * sizeof(Target*));
+        }
+        memmove(&mon->targets[i + 1], &mon->targets[i], (mon->count - i) * sizeof(Target*));
+        t = calloc(1, sizeof(Target));
+        mon->targets[i] = t;
+        mon->count++;
+    }
+
+    t->id = id;
+    t->hostname = strdup(hostname);
+    t->port = port;
+    t->fd = -1;
+    t->rtt_us = -1;
+    t->next_probe_ms = now_ms();
+    t->changed = true;
+
+    pthread_cond_signal(&mon->resolve_cond);
+    pthread_mutex_unlock(&mon->lock);
+}
+
+void host_monitor_unwatch(HostMonitor *mon, int id) {
+    pthread_mutex_lock(&mon->lock);
+    int i = find_index(mon, id);
+    if (i < mon->count && mon->targets[i]->id == id) {
+        free_target(mon, mon->targets[i]);
+        memmove(&mon->targets[i], &mon->targets[i + 1], (mon->count - i - 1) * sizeof(Target*));
+        mon->count--;
+    }
+    pthread_mutex_unlock(&mon->lock);
+}
+
+void host_monitor_clear(HostMonitor *mon) {
+    pthread_mutex_lock(&mon->lock);
+    for (int i = 0; i < mon->count; i++) {
+        free_target(mon, mon->targets[i]);
+    }
+    mon->count = 0;
+    pthread_mutex_unlock(&mon->lock);
+}
+
+void host_monitor_set_visible(HostMonitor *mon, int id, bool visible) {
+    pthread_mutex_lock(&mon->lock);
+    Target *t = find_target(mon, id);
+    if (t && t->visible != visible) {
+        t->visible = visible;
+        long long now = now_ms();
+        // Back on screen with a stale result: refresh it now rather than at the hidden pace
+        if (visible && t->fd < 0 && t->failures <= 1 && now - t->last_probe_ms > mon->interval_ms) {
+            t->next_probe_ms = now;
+            wake_prober(mon);
+        }
+    }
+    pthread_mutex_unlock(&mon->lock);
+}
+
+bool host_monitor_get_status(HostMonitor *mon, int id, HostStatus *status) {
+    pthread_mutex_lock(&mon->lock);
+    Target *t = find_target(mon, id);
+    if (t) {
+        status->state = t->state;
+        status->rtt_us = t->rtt_us;
+        status->history_count = t->history_count;
+
+        long long sum = 0;
+        int ok = 0;
+        int start = (t->history_pos - t->history_count + HOST_MONITOR_HISTORY) % HOST_MONITOR_HISTORY;
+        for (int i = 0; i < t->history_count; i++) {
+            int rtt = t->history[(start + i) % HOST_MONITOR_HISTORY];
+            status->history[i] = rtt;
+            if (rtt >= 0) {
+                sum += rtt;
+                ok++;
+            }
+        }
+        status->avg_rtt_us = ok > 0 ? (int)(sum / ok) : -1;
+    }
+    pthread_mutex_unlock(&mon->lock);
+    return t != NULL;
+}
+
+int host_monitor_take_changes(HostMonitor *mon, int *ids, int max_ids) {
+    int n = 0;
+    pthread_mutex_lock(&mon->lock);
+    for (int i = 0; i < mon->count && n < max_ids; i++) {
+        if (mon->targets[i]->changed) {
+            mon->targets[i]->changed = false;
+            ids[n++] = mon->targets[i]->id;
+        }
+    }
+    pthread_mutex_unlock(&mon->lock);
+    return n;
+}
@@ -0,0 +1,489 @@
+#include "host_search.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <ctype.h>
+
+#define SEARCH_FIELDS 4
+#define SEARCH_MAX_TOKENS 8
+#define SEARCH_MAX_TOKEN 64
+
+#define ID_EMPTY INT_MIN
+#define ID_DELETED (INT_MIN + 1)
+
+// Name ranks above hostname, user and group
+static const int field_weight[SEARCH_FIELDS] = { 300, 200, 100, 50 };
+
+typedef struct {
+    int id;
+    bool live;
+    // Lowercased fields separated by '\n'
+    char *text;
+    uint16_t field_start[SEARCH_FIELDS];
+    uint16_t field_len[SEARCH_FIELDS];
+    // Characters present in the text, to reject most hosts cheaply
+    uint32_t mask;
+} SearchDoc;
+
+typedef struct {
+    uint32_t trigram;   // 0 for an empty bucket
+    int *docs;          // Ascending doc indexes, may include dead ones
+    int count;
+    int capacity;
+} Posting;
+
+typedef struct {
+    int key;
+    int doc;
+} IdSlot;
+
+struct HostSearch {
+    SearchDoc *docs;
+    int doc_count;
+    int doc_capacity;
+    int dead_count;
+
+    Posting *postings;
+    int posting_capacity;
+    int posting_used;
+
+    IdSlot *ids;
+    int id_capacity;
+    int id_used;    // Live and deleted slots
+
+    // Per-query scratch, indexed by doc
+    uint32_t *stamp;
+    uint16_t *hits;
+    uint32_t generation;
+    int *candidates;
+};
+
+static uint32_t char_bit(unsigned char c) {
+    if (c >= 'a' && c <= 'z') return 1u << (c - 'a');
+    if (c >= '0' && c <= '9') return 1u << 26;
+    return 1u << 27;
+}
+
+static uint32_t hash_int(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x45d9f3bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint32_t make_trigram(const char *s) {
+    return ((uint32_t)(unsigned char)s[0] << 16) | ((uint32_t)(unsigned char)s[1] << 8) | (unsigned char)s[2];
+}
+
+// --- id -> doc map (open addressing) ---
+
+static void ids_insert(HostSearch *s, int id, int doc);
+
+static void ids_grow(HostSearch *s) {
+    IdSlot *old = s->ids;
+    int old_capacity = s->id_capacity;
+
+    s->id_capacity = old_capacity ? old_capacity * 2 : 256;
+    s->ids = malloc(sizeof(IdSlot) * s->id_capacity);
+    for (int i = 0; i < s->id_capacity; i++) s->ids[i].key = ID_EMPTY;
+    s->id_used = 0;
+
+    for (int i = 0; i < old_capacity; i++) {
+        if (old[i].key != ID_EMPTY && old[i].key != ID_DELETED) ids_insert(s, old[i].key, old[i].doc);
+    }
+    free(old);
+}
+
+static int ids_find_slot(HostSearch *s, int id) {
+    if (!s->ids) return -1;
+    uint32_t mask = s->id_capacity - 1;
+    for (uint32_t i = hash_int((uint32_t)id) & mask;; i = (i + 1) & mask) {
+        if (s->ids[i].key == ID_EMPTY) return -1;
+        if (s->ids[i].key == id) return (int)i;
+    }
+}
+
+static void ids_insert(HostSearch *s, int id, int doc) {
+    if ((s->id_used + 1) * 2 > s->id_capacity) ids_grow(s);
+    uint32_t mask = s->id_capacity - 1;
+    uint32_t i = hash_int((uint32_t)id) & mask;
+    while (s->ids[i].key != ID_EMPTY && s->ids[i].key != ID_DELETED) i = (i + 1) & mask;
+    if (s->ids[i].key == ID_EMPTY) s->id_used++;
+    s->ids[i].key = id;
+    s->ids[i].doc = doc;
+}
+
+// --- trigram -> posting list (open addressing, never shrinks) ---
+
+static Posting* postings_get(HostSearch *s, uint32_t trigram, bool create);
+
+static void postings_grow(HostSearch *s) {
+    Posting *old = s->postings;
+    int old_capacity = s->posting_capacity;
+
+    s->posting_capacity = old_capacity ? old_capacity * 2 : 1024;
+    s->postings = calloc(s->posting_capacity, sizeof(Posting));
+    s->posting_used = 0;
+
+    for (int i = 0; i < old_capacity; i++) {
+        if (!old[i].trigram) continue;
+        Posting *p = postings_get(s, old[i].trigram, true);
+        *p = old[i];
+    }
+    free(old);
+}
+
+static Posting* postings_get(HostSearch *s, uint32_t trigram, bool create) {
+    if (create && (s->posting_used + 1) * 2 > s->posting_capacity) postings_grow(s);
+    if (!s->postings) return NULL;
+
+    uint32_t mask = s->posting_capacity - 1;
+    for (uint32_t i = hash_int(trigram) & mask;; i = (i + 1) & mask) {
+        Posting *p = &s->postings[i];
+        if (p->trigram == trigram) return p;
+        if (!p->trigram) {
+            if (!create) return NULL;
+            p->trigram = trigram;
+            s->posting_used++;
+            return p;
+        }
+    }
+}
+
+static void index_doc(HostSearch *s, int doc) {
+    const SearchDoc *d = &s->docs[doc];
+    for (int f = 0; f < SEARCH_FIELDS; f++) {
+        const char *field = d->text + d->field_start[f];
+        for (int i = 0; i + 3 <= d->field_len[f]; i++) {
+            Posting *p = postings_get(s, make_trigram(field + i), true);
+            // Docs are indexed in ascending order, so a repeat is always last
+            if (p->count > 0 && p->docs[p->count - 1] == doc) continue;
+            if (p->count >= p->capacity) {
+                p->capacity = p->capacity ? p->capacity * 2 : 4;
+                p->docs = realloc(p->docs, sizeof(int) * p->capacity);
+            }
+            p->docs[p->count++] = doc;
+        }
+    }
+}
+
+// Drops the dead docs and rebuilds the postings once they outnumber the live ones
+static void compact(HostSearch *s) {
+    for (int i = 0; i < s->posting_capacity; i++) {
+        free(s->postings[i].docs);
+        s->postings[i].docs = NULL;
+        s->postings[i].count = 0;
+        s->postings[i].capacity = 0;
+    }
+
+    int live = 0;
+    for (int i = 0; i < s->doc_count; i++) {
+        if (!s->docs[i].live) {
+            free(s->docs[i].text);
+            continue;
+        }
+        s->docs[live] = s->docs[i];
+        s->ids[ids_find_slot(s, s->docs[live].id)].doc = live;
+        index_doc(s, live);
+        live++;
+    }
+    s->doc_count = live;
+    s->dead_count = 0;
+}
+
+HostSearch* host_search_new() {
+    return calloc(1, sizeof(HostSearch));
+}
+
+void host_search_clear(HostSearch *search) {
+    if (!search) return;
+    for (int i = 0; i < search->doc_count; i++) free(search->docs[i].text);
+    for (int i = 0; i < search->posting_capacity; i++) free(search->postings[i].docs);
+    free(search->docs);
+    free(search->postings);
+    free(search->ids);
+    free(search->stamp);
+    free(search->hits);
+    free(search->candidates);
+    memset(search, 0, sizeof(HostSearch));
+}
+
+void host_search_free(HostSearch *search) {
+    if (!search) return;
+    host_search_clear(search);
+    free(search);
+}
+
+void host_search_remove(HostSearch *search, int id) {
+    if (!search) return;
+    int slot = ids_find_slot(search, id);
+    if (slot < 0) return;
+
+    search->docs[search->ids[slot].doc].live = false;
+    search->ids[slot].key = ID_DELETED;
+    search->dead_count++;
+    if (search->dead_count > 256 && search->dead_count > search->doc_count - search->dead_count) {
+        compact(search);
+    }
+}
+
+void host_search_put(HostSearch *search, int id, const char *name, const char *hostname, const char *user, const char *group) {
+    if (!search) return;
+    host_search_remove(search, id);
+
+    if (search->doc_count >= search->doc_capacity) {
+        search->doc_capacity = search->doc_capacity ? search->doc_capacity * 2 : 256;
+        search->docs = realloc(search->docs, sizeof(SearchDoc) * search->doc_capacity);
+        search->stamp = realloc(search->stamp, sizeof(uint32_t) * search->doc_capacity);
+        search->hits = realloc(search->hits, sizeof(uint16_t) * search->doc_capacity);
+        search->candidates = realloc(search->candidates, sizeof(int) * search->doc_capacity);
+    }
+
+    const char *fields[SEARCH_FIELDS] = { name, hostname, user, group };
+    size_t total = 0;
+    for (int f = 0; f < SEARCH_FIELDS; f++) {
+        size_t len = fields[f] ? strlen(fields[f]) : 0;
+        if (len > 255) len = 255;
+        total += len + 1;
+    }
+
+    int doc = search->doc_count++;
+    SearchDoc *d = &search->docs[doc];
+    d->id = id;
+    d->live = true;
+    d->mask = 0;
+    d->text = malloc(total);
+    search->stamp[doc] = 0;
+
+    size_t off = 0;
+    for (int f = 0; f < SEARCH_FIELDS; f++) {
+        size_t len = fields[f] ? strlen(fields[f]) : 0;
+        if (len > 255) len = 255;
+        d->field_start[f] = (uint16_t)off;
+        d->field_len[f] = (uint16_t)len;
+        for (size_t i = 0; i < len; i++) {
+            char c = tolower((unsigned char)fields[f][i]);
+            d->text[off++] = c;
+            d->mask |= char_bit((unsigned char)c);
+        }
+        d->text[off++] = f + 1 < SEARCH_FIELDS ? '\n' : '\0';
+    }
+
+    index_doc(search, doc);
+    ids_insert(search, id, doc);
+}
+
+// --- Scoring ---
+
+// Trigrams of a token a host must share to count as a typo match. A swap of
+// two characters destroys up to four of them.
+static int required_trigrams(int total) {
+    int after_typo = total - 4;
+    int third = (total + 2) / 3;
+    return after_typo > third ? after_typo : third;
+}
+
+// Subsequence match, higher is better, -1 when query is not contained in text
+static int fuzzy_score(const char *text, int len, const char *query) {
+    int score = 0, ti = 0, prev = -2;
+    for (const char *q = query; *q; q++) {
+        while (ti < len && text[ti] != *q) ti++;
+        if (ti == len) return -1;
+
+        int s = 1;
+        if (ti == prev + 1) s += 5;
+        if (ti == 0 || strchr("._-@ ", text[ti - 1])) s += 3;
+        score += s;
+        prev = ti++;
+    }
+    return score * 16 - len;
+}
+
+// Substring matches rank above subsequence matches, which rank above typos.
+// Returns -1 when the token does not match the host at all.
+static int token_score(const SearchDoc *d, const char *token, int len) {
+    int best = -1;
+
+    for (int f = 0; f < SEARCH_FIELDS; f++) {
+        const char *field = d->text + d->field_start[f];
+        int field_len = d->field_len[f];
+        if (field_len < len) continue;
+
+        const char *hit = strstr(field, token);
+        if (hit && hit + len <= field + field_len) {
+            int score = 100000 + field_weight[f] * 10 - (field_len - len);
+            if (hit == field) score += field_len == len ? 4000 : 2000;
+            else if (strchr("._-@ ", hit[-1])) score += 1000;
+            if (score > best) best = score;
+        }
+    }
+    if (best >= 0) return best;
+
+    for (int f = 0; f < SEARCH_FIELDS; f++) {
+        int score = fuzzy_score(d->text + d->field_start[f], d->field_len[f], token);
+        if (score >= 0) {
+            score = 50000 + score + field_weight[f];
+            if (score > best) best = score;
+        }
+    }
+    if (best >= 0 || len < 4) return best;
+
+    // Typo tolerance: enough of the token's trigrams appear in one field
+    for (int f = 0; f < SEARCH_FIELDS; f++) {
+        const char *field = d->text + d->field_start[f];
+        int field_len = d->field_len[f];
+        int shared = 0, total = len - 2;
+        for (int i = 0; i + 3 <= len; i++) {
+            for (int j = 0; j + 3 <= field_len; j++) {
+                if (memcmp(token + i, field + j, 3) == 0) {
+                    shared++;
+                    break;
+                }
+            }
+        }
+        if (shared > 0 && shared >= required_trigrams(total)) {
+            int score = shared * 1000 / total + field_weight[f];
+            if (score > best) best = score;
+        }
+    }
+    return best;
+}
+
+typedef struct {
+    char tokens[SEARCH_MAX_TOKENS][SEARCH_MAX_TOKEN];
+    int token_len[SEARCH_MAX_TOKENS];
+    int token_count;
+    int longest;
+    // Short tokens get no typo tolerance, all their characters must be present
+    uint32_t short_mask;
+    uint32_t longest_mask;
+} SearchQuery;
+
+static void parse_query(SearchQuery *q, const char *query) {
+    q->token_count = 0;
+    q->longest = -1;
+    q->short_mask = 0;
+    q->longest_mask = 0;
+
+    const char *c = query;
+    while (*c && q->token_count < SEARCH_MAX_TOKENS) {
+        while (*c && isspace((unsigned char)*c)) c++;
+        if (!*c) break;
+        char *token = q->tokens[q->token_count];
+        int len = 0;
+        while (*c && !isspace((unsigned char)*c)) {
+            if (len < SEARCH_MAX_TOKEN - 1) token[len++] = tolower((unsigned char)*c);
+            c++;
+        }
+        token[len] = '\0';
+        q->token_len[q->token_count] = len;
+        if (len < 4) {
+            for (int i = 0; i < len; i++) q->short_mask |= char_bit((unsigned char)token[i]);
+        }
+        if (q->longest < 0 || len > q->token_len[q->longest]) q->longest = q->token_count;
+        q->token_count++;
+    }
+    if (q->longest >= 0) {
+        for (int i = 0; i < q->token_len[q->longest]; i++) {
+            q->longest_mask |= char_bit((unsigned char)q->tokens[q->longest][i]);
+        }
+    }
+}
+
+static uint32_t next_generation(HostSearch *search) {
+    uint32_t gen = ++search->generation;
+    if (gen == 0) {
+        memset(search->stamp, 0, sizeof(uint32_t) * search->doc_count);
+        gen = search->generation = 1;
+    }
+    return gen;
+}
+
+// Stamps the hosts sharing enough trigrams with the longest token with the
+// current generation, the only ones where it can match with a typo
+static void mark_trigram_candidates(HostSearch *search, const SearchQuery *q) {
+    const char *t = q->tokens[q->longest];
+    int trigram_count = q->token_len[q->longest] - 2;
+    int min_hits = required_trigrams(trigram_count);
+    uint32_t gen = next_generation(search);
+
+    int *candidates = search->candidates;
+    int found = 0;
+    for (int i = 0; i < trigram_count; i++) {
+        // Repeated trigrams of the token count once
+        bool repeat = false;
+        for (int j = 0; j < i && !repeat; j++) {
+            repeat = memcmp(t + i, t + j, 3) == 0;
+        }
+        if (repeat) {
+            min_hits--;
+            continue;
+        }
+
+        Posting *p = postings_get(search, make_trigram(t + i), false);
+        if (!p) continue;
+        for (int k = 0; k < p->count; k++) {
+            int doc = p->docs[k];
+            if (search->stamp[doc] != gen) {
+                search->stamp[doc] = gen;
+                search->hits[doc] = 0;
+                candidates[found++] = doc;
+            }
+            search->hits[doc]++;
+        }
+    }
+    if (min_hits < 1) min_hits = 1;
+
+    int count = 0;
+    for (int i = 0; i < found; i++) {
+        if (search->hits[candidates[i]] >= min_hits) candidates[count++] = candidates[i];
+    }
+    gen = next_generation(search);
+    for (int i = 0; i < count; i++) search->stamp[candidates[i]] = gen;
+}
+
+// Scores every doc into the sorted top-N list. With typo_candidates, docs off
+// the trigram candidates are only scored when the longest token can still match
+// them as a substring or subsequence, that is when all its characters are there.
+static int score_docs(HostSearch *search, const SearchQuery *q, bool typo_candidates,
+                      HostSearchMatch *matches, int max_matches) {
+    int found = 0;
+    for (int i = 0; i < search->doc_count; i++) {
+        const SearchDoc *d = &search->docs[i];
+        if (!d->live || (d->mask & q->short_mask) != q->short_mask) continue;
+        if (typo_candidates && search->stamp[i] != search->generation &&
+            (d->mask & q->longest_mask) != q->longest_mask) continue;
+
+        int score = 0;
+        for (int t = 0; t < q->token_count && score >= 0; t++) {
+            int s = token_score(d, q->tokens[t], q->token_len[t]);
+            score = s < 0 ? -1 : score + s;
+        }
+        if (score < 0) continue;
+        if (found == max_matches && score <= matches[found - 1].score) continue;
+
+        // Insertion into the small sorted top-N list
+        int pos = found < max_matches ? found++ : found - 1;
+        while (pos > 0 && matches[pos - 1].score < score) {
+            matches[pos] = matches[pos - 1];
+            pos--;
+        }
+        matches[pos].id = d->id;
+        matches[pos].score = score;
+    }
+    return found;
+}
+
+int host_search_query(HostSearch *search, const char *query, HostSearchMatch *matches, int max_matches) {
+    if (!search || !query || max_matches <= 0 || search->doc_count == 0) return 0;
+
+    SearchQuery q;
+    parse_query(&q, query);
+    if (q.token_count == 0) return 0;
+
+    // Short tokens have no typo matches, the character masks alone narrow the scan
+    bool typo_candidates = q.token_len[q.longest] >= 4;
+    if (typo_candidates) mark_trigram_candidates(search, &q);
+    return score_docs(search, &q, typo_candidates, matches, max_matches);
+}
@@ -0,0 +1,95 @@
+#include "latency_histogram.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SUB_BUCKETS 32
+#define LINEAR_MAX (SUB_BUCKETS * 2)
+
+static int bucket_of(uint64_t us) {
+    if (us < LINEAR_MAX) return (int)us;
+    int shift = 63 - __builtin_clzll(us) - 5;
+    int bucket = LINEAR_MAX + (shift - 1) * SUB_BUCKETS + (int)(us >> shift) - SUB_BUCKETS;
+    return bucket < LATENCY_HIST_BUCKETS ? bucket : LATENCY_HIST_BUCKETS - 1;
+}
+
+int64_t latency_histogram_bucket_max(int bucket) {
+    if (bucket < LINEAR_MAX) return bucket;
+    int shift = (bucket - LINEAR_MAX) / SUB_BUCKETS + 1;
+    int64_t sub = (bucket - LINEAR_MAX) % SUB_BUCKETS + SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+void latency_histogram_reset(LatencyHistogram *h) {
+    memset(h, 0, sizeof(*h));
+    h->min_us = -1;
+}
+
+void latency_histogram_record(LatencyHistogram *h, int64_t us) {
+    if (us < 0) us = 0;
+    h->counts[bucket_of((uint64_t)us)]++;
+    h->samples++;
+    h->sum_us += (uint64_t)us;
+    if (h->min_us < 0 || us < h->min_us) h->min_us = us;
+    if (us > h->max_us) h->max_us = us;
+}
+
+void latency_histogram_merge(LatencyHistogram *dst, const LatencyHistogram *src) {
+    if (src->samples == 0) return;
+    for (int i = 0; i < LATENCY_HIST_BUCKETS; i++) dst->counts[i] += src->counts[i];
+    dst->samples += src->samples;
+    dst->sum_us += src->sum_us;
+    if (dst->min_us < 0 || src->min_us < dst->min_us) dst->min_us = src->min_us;
+    if (src->max_us > dst->max_us) dst->max_us = src->max_us;
+}
+
+int64_t latency_histogram_percentile(const LatencyHistogram *h, double percentile) {
+    if (h->samples == 0) return -1;
+    if (percentile < 0) percentile = 0;
+    if (percentile > 100) percentile = 100;
+    uint64_t rank = (uint64_t)(percentile / 100.0 * h->samples + 0.5);
+    if (rank < 1) rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            int64_t value = latency_histogram_bucket_max(i);
+            return value < h->max_us ? value : h->max_us;
+        }
+    }
+    return h->max_us;
+}
+
+int64_t latency_histogram_mean(const LatencyHistogram *h) {
+    return h->samples > 0 ? (int64_t)(h->sum_us / h->samples) : -1;
+}
+
+char* latency_histogram_json(const LatencyHistogram *h) {
+    int used_buckets = 0;
+    for (int i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        if (h->counts[i]) used_buckets++;
+    }
+    // Summary, then at most 34 characters per [upper bound, count] pair
+    size_t size = 384 + (size_t)used_buckets * 34;
+    char *json = malloc(size);
+    if (!json) return NULL;
+
+    size_t used = (size_t)snprintf(json, size,
+        "{\"samples\":%llu,\"mean_us\":%lld,\"min_us\":%lld,\"max_us\":%lld,"
+        "\"p50_us\":%lld,\"p90_us\":%lld,\"p99_us\":%lld,\"p999_us\":%lld,\"buckets\":[",
+        (unsigned long long)h->samples, (long long)latency_histogram_mean(h),
+        (long long)h->min_us, (long long)(h->samples ? h->max_us : -1),
+        (long long)latency_histogram_percentile(h, 50), (long long)latency_histogram_percentile(h, 90),
+        (long long)latency_histogram_percentile(h, 99), (long long)latency_histogram_percentile(h, 99.9));
+
+    bool first = true;
+    for (int i = 0; i < LATENCY_HIST_BUCKETS && used < size; i++) {
+        if (!h->counts[i]) continue;
+        used += (size_t)snprintf(json + used, size - used, "%s[%lld,%u]", first ? "" : ",",
+                                 (long long)latency_histogram_bucket_max(i), h->counts[i]);
+        first = false;
+    }
+    if (used < size) snprintf(json + used, size - used, "]}");
+    return json;
+}
@@ -0,0 +1,327 @@
+#include "local_echo.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MAX_PENDING 32
+#define LINE_TAIL 64
+// ADAPTIVE starts predicting above the first and stops below the second
+#define RTT_SHOW_US 30000
+#define RTT_HIDE_US 20000
+// A prediction not echoed within 2 RTT plus this is taken as wrong
+#define EXPIRE_MARGIN_US 500000
+
+typedef enum {
+    OP_CHAR,
+    OP_LEFT,
+    OP_RIGHT
+} OpType;
+
+typedef struct {
+    OpType type;
+    char bytes[4];      // UTF-8 of OP_CHAR
+    int len;
+    int64_t at_us;
+} Prediction;
+
+typedef enum {
+    PARSE_GROUND,
+    PARSE_ESC,
+    PARSE_CSI,
+    PARSE_STRING,       // OSC, DCS, APC and PM, until BEL or ST
+    PARSE_STRING_ESC
+} ParseState;
+
+struct LocalEcho {
+    LocalEchoMode mode;
+    int64_t srtt_us;            // -1 before the first sample
+    bool slow;                  // ADAPTIVE is predicting
+
+    // Drawn on screen, oldest first
+    Prediction pending[MAX_PENDING];
+    int count;
+    int advance;                // Columns the cursor moved through them
+
+    bool blocked;               // A key that wasn't predicted is in flight
+    bool suspended;             // Until the next Enter
+
+    // State of the server stream
+    ParseState state;
+    char csi[32];
+    int csi_len;
+    bool alt_screen;
+    char line[LINE_TAIL];       // End of the current line, printable only
+    int line_len;
+};
+
+LocalEcho* local_echo_new() {
+    LocalEcho *le = calloc(1, sizeof(LocalEcho));
+    if (le) le->srtt_us = -1;
+    return le;
+}
+
+void local_echo_free(LocalEcho *le) {
+    free(le);
+}
+
+void local_echo_set_mode(LocalEcho *le, LocalEchoMode mode) {
+    le->mode = mode;
+}
+
+void local_echo_add_rtt(LocalEcho *le, int64_t rtt_us) {
+    if (rtt_us < 0) return;
+    le->srtt_us = le->srtt_us < 0 ? rtt_us : (7 * le->srtt_us + rtt_us) / 8;
+    if (le->srtt_us > RTT_SHOW_US) le->slow = true;
+    else if (le->srtt_us < RTT_HIDE_US) le->slow = false;
+}
+
+static size_t put(char *out, size_t used, size_t cap, const char *s, size_t len) {
+    if (used + len > cap) return used;
+    memcpy(out + used, s, len);
+    return used + len;
+}
+
+#define PUT(str) used = put(out, used, cap, str, sizeof(str) - 1)
+
+// Insert a blank, write the key underlined over it: undone by deleting it
+static size_t draw(const Prediction *p, char *out, size_t used, size_t cap) {
+    switch (p->type) {
+        case OP_CHAR:
+            PUT("\033[@\033[4m");
+            used = put(out, used, cap, p->bytes, p->len);
+            PUT("\033[24m");
+            break;
+        case OP_LEFT:
+            PUT("\033[D");
+            break;
+        case OP_RIGHT:
+            PUT("\033[C");
+            break;
+    }
+    return used;
+}
+
+static size_t undo(const Prediction *p, char *out, size_t used, size_t cap) {
+    switch (p->type) {
+        case OP_CHAR:
+            PUT("\033[D\033[P");
+            break;
+        case OP_LEFT:
+            PUT("\033[C");
+            break;
+        case OP_RIGHT:
+            PUT("\033[D");
+            break;
+    }
+    return used;
+}
+
+static size_t rollback(LocalEcho *le, char *out, size_t used, size_t cap) {
+    for (int i = le->count - 1; i >= 0; i--) used = undo(&le->pending[i], out, used, cap);
+    return used;
+}
+
+static int op_advance(OpType type) {
+    return type == OP_LEFT ? -1 : 1;
+}
+
+// One printable character of display width 1: ASCII, or two-byte UTF-8 that isn't a combining mark
+static int printable_char(const char *s, size_t len) {
+    const unsigned char *u = (const unsigned char *)s;
+    if (len >= 1 && u[0] >= 0x20 && u[0] < 0x7f) return 1;
+    if (len >= 2 && u[0] >= 0xc2 && u[0] <= 0xdf && (u[1] & 0xc0) == 0x80) {
+        unsigned cp = ((u[0] & 0x1f) << 6) | (u[1] & 0x3f);
+        if (cp >= 0xa0 && (cp < 0x300 || cp > 0x36f)) return 2;
+    }
+    return 0;
+}
+
+static bool is_arrow(const char *keys, size_t len, char dir) {
+    return len == 3 && keys[0] == '\033' && (keys[1] == '[' || keys[1] == 'O') && keys[2] == dir;
+}
+
+static bool can_predict(const LocalEcho *le) {
+    if (le->mode == LOCAL_ECHO_OFF || (le->mode == LOCAL_ECHO_ADAPTIVE && !le->slow)) return false;
+    return !le->blocked && !le->suspended && !le->alt_screen && le->state == PARSE_GROUND && le->count < MAX_PENDING;
+}
+
+size_t local_echo_keys(LocalEcho *le, const char *keys, size_t len, int cursor_col, int columns,
+                       int64_t now_us, char *out, size_t cap) {
+    if (memchr(keys, '\r', len) || memchr(keys, '\n', len)) le->suspended = false;
+
+    Prediction p = { .at_us = now_us };
+    int n = printable_char(keys, len);
+    if (n > 0 && (size_t)n == len) {
+        p.type = OP_CHAR;
+        memcpy(p.bytes, keys, n);
+        p.len = n;
+    } else if (is_arrow(keys, len, 'D')) {
+        p.type = OP_LEFT;
+    } else if (is_arrow(keys, len, 'C')) {
+        p.type = OP_RIGHT;
+    } else {
+        // Enter, Tab, Backspace, a paste... its effect is unknown until the server answers
+        le->blocked = true;
+        return 0;
+    }
+
+    bool fits;
+    switch (p.type) {
+        case OP_CHAR: fits = cursor_col < columns - 1; break;
+        case OP_LEFT: fits = cursor_col > 0; break;
+        // Only back over text a predicted left arrow moved across
+        default: fits = le->advance < 0 && cursor_col < columns - 1; break;
+    }
+    if (!fits || !can_predict(le)) {
+        le->blocked = true;
+        return 0;
+    }
+
+    le->pending[le->count++] = p;
+    le->advance += op_advance(p.type);
+    return draw(&p, out, 0, cap);
+}
+
+// Length of the server's echo of p at the start of data, 0 if it isn't there
+static size_t match_echo(const Prediction *p, const char *data, size_t len) {
+    static const char *lefts[] = { "\b", "\033[D", "\033[1D" };
+    static const char *rights[] = { "\033[C", "\033[1C" };
+
+    switch (p->type) {
+        case OP_CHAR:
+            return len >= (size_t)p->len && memcmp(data, p->bytes, p->len) == 0 ? (size_t)p->len : 0;
+        case OP_LEFT:
+            for (size_t i = 0; i < sizeof(lefts) / sizeof(lefts[0]); i++) {
+                size_t n = strlen(lefts[i]);
+                if (len >= n && memcmp(data, lefts[i], n) == 0) return n;
+            }
+            return 0;
+        case OP_RIGHT:
+            for (size_t i = 0; i < sizeof(rights) / sizeof(rights[0]); i++) {
+                size_t n = strlen(rights[i]);
+                if (len >= n && memcmp(data, rights[i], n) == 0) return n;
+            }
+            // Readline moves right by printing the character again
+            return printable_char(data, len);
+    }
+    return 0;
+}
+
+// Private modes 47, 1047 and 1049 switch to the alternate screen
+static void handle_csi(LocalEcho *le, char final) {
+    if (le->csi_len == 0 || le->csi[0] != '?' || (final != 'h' && final != 'l')) return;
+    le->csi[le->csi_len] = '\0';
+    char *p = le->csi + 1;
+    while (*p) {
+        long mode = strtol(p, &p, 10);
+        if (mode == 47 || mode == 1047 || mode == 1049) le->alt_screen = final == 'h';
+        if (*p) p++;
+    }
+}
+
+static void line_append(LocalEcho *le, char c) {
+    if (le->line_len == LINE_TAIL) {
+        memmove(le->line, le->line + 1, LINE_TAIL - 1);
+        le->line_len--;
+    }
+    le->line[le->line_len++] = c;
+}
+
+static void parse(LocalEcho *le, const char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)data[i];
+        switch (le->state) {
+            case PARSE_GROUND:
+                if (c == '\033') le->state = PARSE_ESC;
+                else if (c == '\r' || c == '\n') le->line_len = 0;
+                else if (c == '\b' && le->line_len > 0) le->line_len--;
+                else if (c >= 0x20 && c != 0x7f) line_append(le, (char)c);
+                break;
+            case PARSE_ESC:
+                if (c == '[') {
+                    le->state = PARSE_CSI;
+                    le->csi_len = 0;
+                } else if (c == ']' || c == 'P' || c == '_' || c == '^') {
+                    le->state = PARSE_STRING;
+                } else {
+                    le->state = PARSE_GROUND;
+                }
+                break;
+            case PARSE_CSI:
+                if (c >= 0x40 && c <= 0x7e) {
+                    handle_csi(le, (char)c);
+                    le->state = PARSE_GROUND;
+                } else if (le->csi_len < (int)sizeof(le->csi) - 1) {
+                    le->csi[le->csi_len++] = (char)c;
+                }
+                break;
+            case PARSE_STRING:
+                if (c == '\a') le->state = PARSE_GROUND;
+                else if (c == '\033') le->state = PARSE_STRING_ESC;
+                break;
+            case PARSE_STRING_ESC:
+                le->state = c == '\\' ? PARSE_GROUND : PARSE_STRING;
+                break;
+        }
+    }
+}
+
+// The server won't echo what is typed after "Password:" and the like
+static bool at_secret_prompt(const LocalEcho *le) {
+    static const char *words[] = { "password", "passphrase", "passcode", "verification code" };
+    int end = le->line_len;
+    while (end > 0 && le->line[end - 1] == ' ') end--;
+    if (end == 0 || le->line[end - 1] != ':') return false;
+
+    char lower[LINE_TAIL + 1];
+    for (int i = 0; i < end; i++) lower[i] = (char)tolower((unsigned char)le->line[i]);
+    lower[end] = '\0';
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        if (strstr(lower, words[i])) return true;
+    }
+    return false;
+}
+
+size_t local_echo_server(LocalEcho *le, const char *data, size_t len, char *out, size_t cap) {
+    size_t used = rollback(le, out, 0, cap);
+    used = put(out, used, cap, data, len);
+
+    // Echoes of the oldest predictions, in order
+    int confirmed = 0;
+    size_t at = 0;
+    while (confirmed < le->count) {
+        size_t n = match_echo(&le->pending[confirmed], data + at, len - at);
+        if (n == 0) break;
+        at += n;
+        confirmed++;
+    }
+    // Anything else means the screen no longer is what the predictions assumed
+    int keep = at == len ? le->count - confirmed : 0;
+    if (le->count > 0 && confirmed == 0) le->suspended = true;
+
+    parse(le, data, len);
+    if (at_secret_prompt(le)) le->suspended = true;
+    if (le->state != PARSE_GROUND || le->alt_screen) keep = 0;
+
+    memmove(le->pending, le->pending + le->count - keep, keep * sizeof(Prediction));
+    le->count = keep;
+    le->advance = 0;
+    for (int i = 0; i < keep; i++) {
+        le->advance += op_advance(le->pending[i].type);
+        used = draw(&le->pending[i], out, used, cap);
+    }
+    if (keep == 0) le->blocked = false;
+    return used;
+}
+
+size_t local_echo_expire(LocalEcho *le, int64_t now_us, char *out, size_t cap) {
+    if (le->count == 0) return 0;
+    int64_t timeout = EXPIRE_MARGIN_US + (le->srtt_us > 0 ? 2 * le->srtt_us : 0);
+    if (now_us - le->pending[0].at_us < timeout) return 0;
+
+    size_t used = rollback(le, out, 0, cap);
+    le->count = 0;
+    le->advance = 0;
+    le->suspended = true;
+    return used;
+}
@@ -2,14 +2,18 @@
 #include <libssh/libssh.h>
 #include <signal.h>
 #include "window.h"
-#include "db.h"
+#include "hosts_view.h"
+#include "db_worker.h"
 #include "theme_manager.h"
+#include "trace.h"
 
 static void activate(GtkApplication *app, gpointer user_data) {
     theme_manager_init();
     
     if (!db_init()) {
         g_printerr("Database initialization error.\n");
+    } else if (!db_worker_start()) {
+        g_printerr("Storage worker could not start, using the database synchronously.\n");
     }
 
     GtkWidget *window = create_main_window(app);
@@ -17,6 +21,13 @@ static void activate(GtkApplication *app, gpointer user_data) {
 }
 
 int main(int argc, char **argv) {
+    // MODERN_SSH_LOG sets the level, MODERN_SSH_LOG_FILE sends it to a file
+    // and MODERN_SSH_TRACE writes a Chrome trace of the session there on exit
+    const char *trace_path = g_getenv("MODERN_SSH_TRACE");
+    trace_start(trace_level_from_name(g_getenv("MODERN_SSH_LOG"), TRACE_LEVEL_WARN), g_getenv("MODERN_SSH_LOG_FILE"),
+                trace_path ? TRACE_TIMELINE_DEFAULT : 0);
+    trace_set_thread_name("main");
+
     ssh_init();
     
     signal(SIGPIPE, SIG_IGN);
@@ -28,10 +39,17 @@ int main(int argc, char **argv) {
     g_signal_connect(app, "activate", G_CALLBACK(activate), NULL);
     status = g_application_run(G_APPLICATION(app), argc, argv);
     
+    hosts_view_shutdown();
+    db_worker_stop();
     db_close();
     g_object_unref(app);
     
     ssh_finalize();
 
+    if (trace_path && !trace_export_chrome(trace_path)) {
+        g_printerr("Could not write the trace to %s\n", trace_path);
+    }
+    trace_stop();
+
     return status;
 }
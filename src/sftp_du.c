@@ -0,0 +1,223 @@
+#include "sftp_du.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    char *path;
+    // Direct child of the root this directory counts towards, -1 for the root itself
+    int slot;
+} DirSizeJob;
+
+struct SFTPDirSize {
+    char *root;
+    SFTPWalker *walker;
+
+    pthread_mutex_t lock;
+    SFTPDirSizeEntry *slots;
+    int slot_count;
+
+    bool finished;
+    SFTPWalkStatus status;
+    // sftp_dir_size_free ran while the walk was still going, done frees
+    bool released;
+};
+
+static const char *excluded_paths[] = { "/proc", "/sys", "/dev", "/run", NULL };
+
+static DirSizeJob* job_new(const char *parent_path, const char *name, int slot) {
+    DirSizeJob *job = malloc(sizeof(DirSizeJob));
+    if (name) {
+        size_t len = strlen(parent_path) + strlen(name) + 2;
+        job->path = malloc(len);
+        bool needs_slash = parent_path[0] != '\0' && parent_path[strlen(parent_path) - 1] != '/';
+        snprintf(job->path, len, "%s%s%s", parent_path, needs_slash ? "/" : "", name);
+    } else {
+        job->path = strdup(parent_path);
+    }
+    job->slot = slot;
+    return job;
+}
+
+static void job_free(void *data) {
+    DirSizeJob *job = (DirSizeJob *)data;
+    free(job->path);
+    free(job);
+}
+
+static const char* job_path(void *data) {
+    return ((DirSizeJob *)data)->path;
+}
+
+static bool is_excluded(const char *path) {
+    for (int i = 0; excluded_paths[i]; i++) {
+        if (strcmp(path, excluded_paths[i]) == 0) return true;
+    }
+    return false;
+}
+
+// The root listing creates one slot per child before any other job exists,
+// so the slot array never moves while later listings add to it.
+static void visit_root(SFTPWalker *walker, SFTPDirSize *ds, DirSizeJob *job, SFTPFile **files, int count) {
+    pthread_mutex_lock(&ds->lock);
+    ds->slots = calloc(count ? count : 1, sizeof(SFTPDirSizeEntry));
+    for (int i = 0; i < count; i++) {
+        SFTPFile *f = files[i];
+        if (strcmp(f->name, ".") == 0 || strcmp(f->name, "..") == 0) continue;
+
+        SFTPDirSizeEntry *e = &ds->slots[ds->slot_count];
+        e->name = strdup(f->name);
+        e->is_dir = f->type == SFTP_TYPE_DIRECTORY;
+        if (!e->is_dir) {
+            e->bytes = f->size;
+            e->files = 1;
+        }
+        ds->slot_count++;
+    }
+    pthread_mutex_unlock(&ds->lock);
+
+    for (int i = 0; i < ds->slot_count; i++) {
+        if (!ds->slots[i].is_dir) continue;
+        DirSizeJob *child = job_new(job->path, ds->slots[i].name, i);
+        if (is_excluded(child->path)) {
+            job_free(child);
+            continue;
+        }
+        sftp_walk_push(walker, child);
+    }
+}
+
+static void dir_size_visit(SFTPWalker *walker, void *data, SFTPFile **files, int count, void *user_data) {
+    DirSizeJob *job = (DirSizeJob *)data;
+    SFTPDirSize *ds = (SFTPDirSize *)user_data;
+
+    if (job->slot < 0) {
+        visit_root(walker, ds, job, files, count);
+        return;
+    }
+
+    // Sum locally, one locked update per directory
+    uint64_t bytes = 0;
+    uint64_t file_count = 0;
+    for (int i = 0; i < count; i++) {
+        SFTPFile *f = files[i];
+        if (strcmp(f->name, ".") == 0 || strcmp(f->name, "..") == 0) continue;
+
+        if (f->type == SFTP_TYPE_DIRECTORY) {
+            DirSizeJob *child = job_new(job->path, f->name, job->slot);
+            if (is_excluded(child->path)) {
+                job_free(child);
+                continue;
+            }
+            sftp_walk_push(walker, child);
+        } else {
+            bytes += f->size;
+            file_count++;
+        }
+    }
+
+    pthread_mutex_lock(&ds->lock);
+    ds->slots[job->slot].bytes += bytes;
+    ds->slots[job->slot].files += file_count;
+    pthread_mutex_unlock(&ds->lock);
+}
+
+static void dir_size_destroy(SFTPDirSize *ds) {
+    for (int i = 0; i < ds->slot_count; i++) free(ds->slots[i].name);
+    free(ds->slots);
+    pthread_mutex_destroy(&ds->lock);
+    free(ds->root);
+    free(ds);
+}
+
+static void dir_size_done(SFTPWalker *walker, SFTPWalkStatus status, void *user_data) {
+    SFTPDirSize *ds = (SFTPDirSize *)user_data;
+    pthread_mutex_lock(&ds->lock);
+    ds->finished = true;
+    ds->status = status;
+    bool released = ds->released;
+    pthread_mutex_unlock(&ds->lock);
+    if (released) dir_size_destroy(ds);
+}
+
+SFTPDirSize* sftp_dir_size_start(const char *root, const SFTPWalkConfig *connection) {
+    if (!root || !connection) return NULL;
+
+    SFTPDirSize *ds = calloc(1, sizeof(SFTPDirSize));
+    ds->root = strdup(root);
+    pthread_mutex_init(&ds->lock, NULL);
+
+    SFTPWalkConfig config = *connection;
+    config.path = job_path;
+    config.prepare = NULL;
+    config.visit = dir_size_visit;
+    config.done = dir_size_done;
+    config.free_job = job_free;
+    config.user_data = ds;
+
+    DirSizeJob *root_job = job_new(root, NULL, -1);
+    ds->walker = sftp_walk_start(&config, root_job);
+    if (!ds->walker) {
+        job_free(root_job);
+        dir_size_destroy(ds);
+        return NULL;
+    }
+    return ds;
+}
+
+bool sftp_dir_size_is_finished(SFTPDirSize *ds, SFTPWalkStatus *status) {
+    pthread_mutex_lock(&ds->lock);
+    bool finished = ds->finished;
+    if (status) *status = ds->status;
+    pthread_mutex_unlock(&ds->lock);
+    return finished;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const SFTPDirSizeEntry *ea = (const SFTPDirSizeEntry *)a;
+    const SFTPDirSizeEntry *eb = (const SFTPDirSizeEntry *)b;
+    if (ea->bytes != eb->bytes) return ea->bytes < eb->bytes ? 1 : -1;
+    return strcmp(ea->name, eb->name);
+}
+
+SFTPDirSizeEntry* sftp_dir_size_snapshot(SFTPDirSize *ds, int *count, uint64_t *total_bytes) {
+    *count = 0;
+    if (total_bytes) *total_bytes = 0;
+
+    pthread_mutex_lock(&ds->lock);
+    SFTPDirSizeEntry *entries = malloc(sizeof(SFTPDirSizeEntry) * (ds->slot_count ? ds->slot_count : 1));
+    uint64_t total = 0;
+    for (int i = 0; i < ds->slot_count; i++) {
+        entries[i] = ds->slots[i];
+        entries[i].name = strdup(ds->slots[i].name);
+        total += ds->slots[i].bytes;
+    }
+    *count = ds->slot_count;
+    pthread_mutex_unlock(&ds->lock);
+
+    qsort(entries, *count, sizeof(SFTPDirSizeEntry), compare_entries);
+    if (total_bytes) *total_bytes = total;
+    return entries;
+}
+
+void sftp_dir_size_free_entries(SFTPDirSizeEntry *entries, int count) {
+    if (!entries) return;
+    for (int i = 0; i < count; i++) free(entries[i].name);
+    free(entries);
+}
+
+void sftp_dir_size_cancel(SFTPDirSize *ds) {
+    if (ds) sftp_walk_cancel(ds->walker);
+}
+
+void sftp_dir_size_free(SFTPDirSize *ds) {
+    if (!ds) return;
+    sftp_walk_free(ds->walker);
+
+    // The walk may still be stopping, whoever comes last frees
+    pthread_mutex_lock(&ds->lock);
+    ds->released = true;
+    bool finished = ds->finished;
+    pthread_mutex_unlock(&ds->lock);
+    if (finished) dir_size_destroy(ds);
+}
@@ -0,0 +1,343 @@
+#include "sftp_edit.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define EDIT_BLOCK_SIZE 4096
+#define EDIT_META_MAGIC 0x44454653 // "SFED"
+#define EDIT_META_VERSION 1
+
+// State of the last sync, saved next to the cache file. Blocks are compared by
+// hash so the previous content does not have to be kept around.
+typedef struct {
+    uint64_t remote_size;
+    uint64_t remote_mtime;
+    uint64_t local_mtime;
+    uint32_t block_count;
+    uint64_t *hashes;
+} EditMeta;
+
+struct SFTPEditFile {
+    SFTPContext *ctx;
+    char *remote_path;
+    char *local_path;
+    char *meta_path;
+    uint32_t permissions;
+    EditMeta meta;
+};
+
+// FNV-1a with a final avalanche step
+static uint64_t hash_block(const unsigned char *data, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static bool hash_local_file(const char *path, uint64_t **hashes, uint32_t *count, uint64_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    *size = st.st_size;
+    *count = (st.st_size + EDIT_BLOCK_SIZE - 1) / EDIT_BLOCK_SIZE;
+    *hashes = malloc(sizeof(uint64_t) * (*count ? *count : 1));
+
+    unsigned char block[EDIT_BLOCK_SIZE];
+    bool ok = true;
+    for (uint32_t i = 0; i < *count; i++) {
+        ssize_t n = pread(fd, block, EDIT_BLOCK_SIZE, (off_t)i * EDIT_BLOCK_SIZE);
+        if (n <= 0) {
+            ok = false;
+            break;
+        }
+        (*hashes)[i] = hash_block(block, n);
+    }
+    close(fd);
+    if (!ok) free(*hashes);
+    return ok;
+}
+
+static bool meta_load(EditMeta *meta, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+
+    uint32_t header[2];
+    bool ok = fread(header, sizeof(header), 1, f) == 1 &&
+              header[0] == EDIT_META_MAGIC && header[1] == EDIT_META_VERSION &&
+              fread(&meta->remote_size, sizeof(uint64_t), 1, f) == 1 &&
+              fread(&meta->remote_mtime, sizeof(uint64_t), 1, f) == 1 &&
+              fread(&meta->local_mtime, sizeof(uint64_t), 1, f) == 1 &&
+              fread(&meta->block_count, sizeof(uint32_t), 1, f) == 1 &&
+              meta->block_count == (meta->remote_size + EDIT_BLOCK_SIZE - 1) / EDIT_BLOCK_SIZE;
+    if (ok) {
+        meta->hashes = malloc(sizeof(uint64_t) * (meta->block_count ? meta->block_count : 1));
+        ok = fread(meta->hashes, sizeof(uint64_t), meta->block_count, f) == meta->block_count;
+        if (!ok) {
+            free(meta->hashes);
+            meta->hashes = NULL;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+static bool meta_save(const EditMeta *meta, const char *path) {
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return false;
+
+    uint32_t header[2] = { EDIT_META_MAGIC, EDIT_META_VERSION };
+    bool ok = fwrite(header, sizeof(header), 1, f) == 1 &&
+              fwrite(&meta->remote_size, sizeof(uint64_t), 1, f) == 1 &&
+              fwrite(&meta->remote_mtime, sizeof(uint64_t), 1, f) == 1 &&
+              fwrite(&meta->local_mtime, sizeof(uint64_t), 1, f) == 1 &&
+              fwrite(&meta->block_count, sizeof(uint32_t), 1, f) == 1 &&
+              fwrite(meta->hashes, sizeof(uint64_t), meta->block_count, f) == meta->block_count;
+    ok = (fclose(f) == 0) && ok;
+
+    if (ok) ok = rename(tmp, path) == 0;
+    else remove(tmp);
+    return ok;
+}
+
+static uint64_t local_mtime(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (uint64_t)st.st_mtime : 0;
+}
+
+// Records the current local content as the synced state
+static bool record_sync(SFTPEditFile *edit, uint64_t remote_size, uint64_t remote_mtime) {
+    uint64_t size;
+    uint64_t *hashes;
+    uint32_t count;
+    if (!hash_local_file(edit->local_path, &hashes, &count, &size)) return false;
+
+    free(edit->meta.hashes);
+    edit->meta.hashes = hashes;
+    edit->meta.block_count = count;
+    edit->meta.remote_size = remote_size;
+    edit->meta.remote_mtime = remote_mtime;
+    edit->meta.local_mtime = local_mtime(edit->local_path);
+    return meta_save(&edit->meta, edit->meta_path);
+}
+
+// Whether the local copy still holds exactly the last synced content
+static bool local_is_synced(SFTPEditFile *edit) {
+    if (edit->meta.local_mtime == local_mtime(edit->local_path)) return true;
+
+    uint64_t size;
+    uint64_t *hashes;
+    uint32_t count;
+    if (!hash_local_file(edit->local_path, &hashes, &count, &size)) return false;
+    bool same = size == edit->meta.remote_size && count == edit->meta.block_count &&
+                memcmp(hashes, edit->meta.hashes, sizeof(uint64_t) * count) == 0;
+    free(hashes);
+    return same;
+}
+
+SFTPEditFile* sftp_edit_open(SFTPContext *ctx, const char *remote_path, const char *local_path,
+                             SFTPEditOpenMode mode, bool *reused, bool *pending) {
+    if (!ctx || !ctx->sftp || !remote_path || !local_path) return NULL;
+    if (reused) *reused = false;
+    if (pending) *pending = false;
+
+    sftp_attributes attr = sftp_stat(ctx->sftp, remote_path);
+    if (!attr) return NULL;
+    if (attr->type != SSH_FILEXFER_TYPE_REGULAR) {
+        sftp_attributes_free(attr);
+        return NULL;
+    }
+
+    SFTPEditFile *edit = calloc(1, sizeof(SFTPEditFile));
+    edit->ctx = ctx;
+    edit->remote_path = strdup(remote_path);
+    edit->local_path = strdup(local_path);
+    edit->permissions = attr->permissions & 07777;
+
+    // Hidden sidecar in the same directory: ".name.sfedit"
+    char *slash = strrchr(edit->local_path, '/');
+    size_t dir_len = slash ? (size_t)(slash - edit->local_path + 1) : 0;
+    size_t len = strlen(local_path) + 16;
+    edit->meta_path = malloc(len);
+    snprintf(edit->meta_path, len, "%.*s.%s.sfedit", (int)dir_len, edit->local_path, edit->local_path + dir_len);
+
+    uint64_t remote_size = attr->size;
+    uint64_t remote_mtime = attr->mtime;
+    sftp_attributes_free(attr);
+
+    if (meta_load(&edit->meta, edit->meta_path) && access(local_path, F_OK) == 0) {
+        bool synced = local_is_synced(edit);
+        bool current = edit->meta.remote_size == remote_size && edit->meta.remote_mtime == remote_mtime;
+        if ((synced && current) || (!synced && mode == SFTP_EDIT_OPEN_KEEP_LOCAL)) {
+            if (reused) *reused = true;
+            return edit;
+        }
+        if (!synced && mode == SFTP_EDIT_OPEN_ASK) {
+            if (pending) *pending = true;
+            sftp_edit_close(edit);
+            return NULL;
+        }
+    }
+
+    if (sftp_download_file(ctx, remote_path, local_path) != 0 || !record_sync(edit, remote_size, remote_mtime)) {
+        sftp_edit_close(edit);
+        return NULL;
+    }
+    return edit;
+}
+
+const char* sftp_edit_get_local_path(SFTPEditFile *edit) {
+    return edit ? edit->local_path : NULL;
+}
+
+static bool write_range(sftp_file file, int fd, uint64_t start, uint64_t end, uint64_t *uploaded) {
+    if (sftp_seek64(file, start) != 0) return false;
+
+    char buffer[32768];
+    uint64_t offset = start;
+    while (offset < end) {
+        size_t want = end - offset < sizeof(buffer) ? end - offset : sizeof(buffer);
+        ssize_t n = pread(fd, buffer, want, offset);
+        if (n <= 0) return false;
+        if (sftp_write(file, buffer, n) != n) return false;
+        offset += n;
+        *uploaded += n;
+    }
+    return true;
+}
+
+// Seeds tmp_path with the current remote content without sending it over the
+// wire. Needs a shell on the server, returns false if there is none.
+static bool copy_remote_side(SFTPEditFile *edit, const char *tmp_path) {
+    char *q_src = ssh_shell_quote(edit->remote_path);
+    char *q_dst = ssh_shell_quote(tmp_path);
+    char command[8300];
+    snprintf(command, sizeof(command), "cp -p -- %s %s", q_src, q_dst);
+    free(q_src);
+    free(q_dst);
+    return ssh_exec_command(edit->ctx->ssh_ctx, command, NULL, 0) == 0;
+}
+
+// sftp_rename refuses to replace an existing file on SFTP v3 servers, mv does it atomically
+static bool replace_remote(SFTPEditFile *edit, const char *tmp_path) {
+    if (sftp_rename(edit->ctx->sftp, tmp_path, edit->remote_path) == 0) return true;
+
+    char *q_src = ssh_shell_quote(tmp_path);
+    char *q_dst = ssh_shell_quote(edit->remote_path);
+    char command[8300];
+    snprintf(command, sizeof(command), "mv -f -- %s %s", q_src, q_dst);
+    free(q_src);
+    free(q_dst);
+    return ssh_exec_command(edit->ctx->ssh_ctx, command, NULL, 0) == 0;
+}
+
+SFTPEditResult sftp_edit_save(SFTPEditFile *edit, uint64_t *uploaded_bytes) {
+    if (uploaded_bytes) *uploaded_bytes = 0;
+    if (!edit) return SFTP_EDIT_ERROR;
+
+    uint64_t new_size;
+    uint64_t *hashes;
+    uint32_t count;
+    if (!hash_local_file(edit->local_path, &hashes, &count, &new_size)) return SFTP_EDIT_ERROR;
+
+    bool same = new_size == edit->meta.remote_size && count == edit->meta.block_count &&
+                memcmp(hashes, edit->meta.hashes, sizeof(uint64_t) * count) == 0;
+    if (same) {
+        free(hashes);
+        edit->meta.local_mtime = local_mtime(edit->local_path);
+        meta_save(&edit->meta, edit->meta_path);
+        return SFTP_EDIT_UNCHANGED;
+    }
+
+    sftp_attributes attr = sftp_stat(edit->ctx->sftp, edit->remote_path);
+    if (!attr) {
+        free(hashes);
+        return SFTP_EDIT_ERROR;
+    }
+    bool conflict = attr->size != edit->meta.remote_size || attr->mtime != edit->meta.remote_mtime;
+    sftp_attributes_free(attr);
+    if (conflict) {
+        free(hashes);
+        return SFTP_EDIT_CONFLICT;
+    }
+
+    // Temporary file next to the target so the rename stays on one filesystem
+    size_t len = strlen(edit->remote_path) + 32;
+    char *tmp_path = malloc(len);
+    const char *slash = strrchr(edit->remote_path, '/');
+    size_t dir_len = slash ? (size_t)(slash - edit->remote_path + 1) : 0;
+    snprintf(tmp_path, len, "%.*s.%s.%d.tmp", (int)dir_len, edit->remote_path, edit->remote_path + dir_len, (int)getpid());
+
+    bool incremental = copy_remote_side(edit, tmp_path);
+    sftp_file file = sftp_open(edit->ctx->sftp, tmp_path, O_WRONLY | (incremental ? 0 : O_CREAT | O_TRUNC), edit->permissions);
+    int fd = open(edit->local_path, O_RDONLY);
+    bool ok = file && fd >= 0;
+
+    uint64_t uploaded = 0;
+    if (ok && incremental) {
+        // Coalesce runs of changed blocks into single writes
+        uint32_t i = 0;
+        while (ok && i < count) {
+            if (i < edit->meta.block_count && hashes[i] == edit->meta.hashes[i]) {
+                i++;
+                continue;
+            }
+            uint32_t run_end = i + 1;
+            while (run_end < count && !(run_end < edit->meta.block_count && hashes[run_end] == edit->meta.hashes[run_end])) {
+                run_end++;
+            }
+            uint64_t start = (uint64_t)i * EDIT_BLOCK_SIZE;
+            uint64_t end = (uint64_t)run_end * EDIT_BLOCK_SIZE;
+            if (end > new_size) end = new_size;
+            ok = write_range(file, fd, start, end, &uploaded);
+            i = run_end;
+        }
+        if (ok && new_size < edit->meta.remote_size) {
+            struct sftp_attributes_struct size_attr;
+            memset(&size_attr, 0, sizeof(size_attr));
+            size_attr.flags = SSH_FILEXFER_ATTR_SIZE;
+            size_attr.size = new_size;
+            ok = sftp_setstat(edit->ctx->sftp, tmp_path, &size_attr) == 0;
+        }
+    } else if (ok) {
+        ok = write_range(file, fd, 0, new_size, &uploaded);
+    }
+    if (fd >= 0) close(fd);
+    if (file && sftp_close(file) != 0) ok = false;
+
+    if (ok) ok = replace_remote(edit, tmp_path);
+    if (!ok) sftp_unlink(edit->ctx->sftp, tmp_path);
+    free(tmp_path);
+    free(hashes);
+    if (uploaded_bytes) *uploaded_bytes = uploaded;
+    if (!ok) return SFTP_EDIT_ERROR;
+
+    attr = sftp_stat(edit->ctx->sftp, edit->remote_path);
+    if (!attr) return SFTP_EDIT_ERROR;
+    record_sync(edit, attr->size, attr->mtime);
+    sftp_attributes_free(attr);
+    return SFTP_EDIT_OK;
+}
+
+void sftp_edit_close(SFTPEditFile *edit) {
+    if (!edit) return;
+    free(edit->meta.hashes);
+    free(edit->remote_path);
+    free(edit->local_path);
+    free(edit->meta_path);
+    free(edit);
+}
@@ -0,0 +1,583 @@
+#include "sftp_index.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+
+#define INDEX_MAGIC 0x58494653 // "SFIX"
+#define INDEX_VERSION 2
+#define INDEX_MAX_ENTRIES 2000000
+#define INDEX_MAX_PATH 4096
+#define INDEX_MAX_DEPTH 256
+
+// 24 bytes per entry plus the name, which is NUL-terminated in the names blob.
+// Parents always come before their children. The cache file is a raw dump.
+typedef struct {
+    int32_t parent;
+    uint32_t name_off;
+    uint16_t name_len;
+    uint8_t is_dir;
+    uint8_t listed;
+    uint32_t mtime;
+    // Characters present in the name / full path, to reject most entries cheaply
+    uint32_t name_mask;
+    uint32_t path_mask;
+} IndexEntry;
+
+typedef struct {
+    IndexEntry *entries;
+    int count;
+    int capacity;
+    char *names;
+    uint32_t names_size;
+    uint32_t names_capacity;
+} IndexTable;
+
+_Static_assert(sizeof(IndexEntry) == 24, "IndexEntry is written to the cache file as is");
+
+typedef struct {
+    SFTPIndex *index;
+    IndexTable fresh;
+    // Also guards the reads of the previous table, and the flags below
+    pthread_mutex_t lock;
+    // The owner let go while the walk was still stopping (see refresh_release)
+    bool abandoned;
+    bool free_index;
+    bool finished;
+    // Child lists of the previous table, for incremental reuse
+    int32_t *old_first_child;
+    int32_t *old_next_sibling;
+    SFTPIndexDoneFunc done;
+    void *user_data;
+} IndexRefresh;
+
+typedef struct {
+    char *path;
+    int32_t old_idx;
+    int32_t new_idx;
+    bool mtime_known;
+    uint32_t mtime;
+} IndexJob;
+
+struct SFTPIndex {
+    char *cache_file;
+    IndexTable table;
+    pthread_rwlock_t table_lock;
+    SFTPWalker *walker;
+    IndexRefresh *refresh;
+};
+
+static const char *excluded_names[] = { ".git", "node_modules", ".cache", NULL };
+static const char *excluded_paths[] = { "/proc", "/sys", "/dev", "/run", NULL };
+
+static uint32_t char_bit(unsigned char c) {
+    c = tolower(c);
+    if (c >= 'a' && c <= 'z') return 1u << (c - 'a');
+    if (c >= '0' && c <= '9') return 1u << (26 + (c - '0') % 5);
+    return 1u << 31;
+}
+
+static uint32_t text_mask(const char *s, size_t len) {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < len; i++) mask |= char_bit(s[i]);
+    return mask;
+}
+
+static void table_free(IndexTable *t) {
+    free(t->entries);
+    free(t->names);
+    memset(t, 0, sizeof(*t));
+}
+
+static int table_append(IndexTable *t, int32_t parent, const char *name, bool is_dir, uint32_t mtime) {
+    size_t len = strlen(name);
+    if (len > UINT16_MAX) len = UINT16_MAX;
+
+    if (t->count >= t->capacity) {
+        t->capacity = t->capacity ? t->capacity * 2 : 1024;
+        t->entries = realloc(t->entries, sizeof(IndexEntry) * t->capacity);
+    }
+    if (t->names_size + len + 1 > t->names_capacity) {
+        while (t->names_size + len + 1 > t->names_capacity) {
+            t->names_capacity = t->names_capacity ? t->names_capacity * 2 : 16384;
+        }
+        t->names = realloc(t->names, t->names_capacity);
+    }
+
+    IndexEntry *e = &t->entries[t->count];
+    memset(e, 0, sizeof(*e));
+    e->parent = parent;
+    e->name_off = t->names_size;
+    e->name_len = (uint16_t)len;
+    e->is_dir = is_dir;
+    e->mtime = mtime;
+    memcpy(t->names + t->names_size, name, len);
+    t->names[t->names_size + len] = '\0';
+    t->names_size += len + 1;
+    return t->count++;
+}
+
+// Writes the full path of idx into buf, returns its length. -1 when the entry
+// is nested deeper than INDEX_MAX_DEPTH or its path does not fit.
+static int table_path(const IndexTable *t, int32_t idx, char *buf, int size) {
+    int32_t chain[INDEX_MAX_DEPTH];
+    int depth = 0;
+    for (int32_t i = idx; i >= 0; i = t->entries[i].parent) {
+        if (depth == INDEX_MAX_DEPTH) return -1;
+        chain[depth++] = i;
+    }
+
+    int len = 0;
+    for (int d = depth - 1; d >= 0; d--) {
+        const IndexEntry *e = &t->entries[chain[d]];
+        bool slash = d != depth - 1 && len > 0 && buf[len - 1] != '/';
+        if (len + slash + e->name_len > size - 1) return -1;
+        if (slash) buf[len++] = '/';
+        memcpy(buf + len, t->names + e->name_off, e->name_len);
+        len += e->name_len;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+static void table_compute_masks(IndexTable *t) {
+    for (int i = 0; i < t->count; i++) {
+        IndexEntry *e = &t->entries[i];
+        e->name_mask = text_mask(t->names + e->name_off, e->name_len);
+        e->path_mask = e->name_mask | (e->parent >= 0 ? t->entries[e->parent].path_mask : 0);
+    }
+}
+
+// --- Persistence ---
+
+// The cache file is not trusted: every parent link and name must stay inside
+// the table, or searches would read out of bounds.
+static bool table_is_valid(const IndexTable *t) {
+    for (int i = 0; i < t->count; i++) {
+        const IndexEntry *e = &t->entries[i];
+        if (i == 0 ? e->parent != -1 : (e->parent < 0 || e->parent >= i)) return false;
+        if (e->name_off >= t->names_size || e->name_len >= t->names_size - e->name_off) return false;
+        if (t->names[e->name_off + e->name_len] != '\0') return false;
+    }
+    return true;
+}
+
+static bool table_load(IndexTable *t, const char *file) {
+    FILE *f = fopen(file, "rb");
+    if (!f) return false;
+
+    struct stat st;
+    uint32_t header[4];
+    bool ok = fstat(fileno(f), &st) == 0 &&
+              fread(header, sizeof(header), 1, f) == 1 &&
+              header[0] == INDEX_MAGIC && header[1] == INDEX_VERSION &&
+              header[2] <= INDEX_MAX_ENTRIES &&
+              (uint64_t)st.st_size == sizeof(header) + (uint64_t)header[2] * sizeof(IndexEntry) + header[3];
+    if (ok) {
+        t->count = t->capacity = header[2];
+        t->names_size = t->names_capacity = header[3];
+        t->entries = malloc(sizeof(IndexEntry) * (t->capacity ? t->capacity : 1));
+        t->names = malloc(t->names_capacity ? t->names_capacity : 1);
+        ok = fread(t->entries, sizeof(IndexEntry), t->count, f) == (size_t)t->count &&
+             fread(t->names, 1, t->names_size, f) == t->names_size &&
+             table_is_valid(t);
+    }
+    fclose(f);
+
+    if (!ok) table_free(t);
+    return ok;
+}
+
+static bool table_save(const IndexTable *t, const char *file) {
+    char tmp[INDEX_MAX_PATH];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return false;
+
+    uint32_t header[4] = { INDEX_MAGIC, INDEX_VERSION, (uint32_t)t->count, t->names_size };
+    bool ok = fwrite(header, sizeof(header), 1, f) == 1 &&
+              fwrite(t->entries, sizeof(IndexEntry), t->count, f) == (size_t)t->count &&
+              fwrite(t->names, 1, t->names_size, f) == t->names_size;
+    ok = (fclose(f) == 0) && ok;
+
+    if (ok) ok = rename(tmp, file) == 0;
+    else remove(tmp);
+    return ok;
+}
+
+// --- Refresh ---
+
+static bool is_excluded(const char *path, const char *name) {
+    for (int i = 0; excluded_names[i]; i++) {
+        if (strcmp(name, excluded_names[i]) == 0) return true;
+    }
+    for (int i = 0; excluded_paths[i]; i++) {
+        if (strcmp(path, excluded_paths[i]) == 0) return true;
+    }
+    return false;
+}
+
+static IndexJob* job_new(const char *parent_path, const char *name, int32_t old_idx, int32_t new_idx, bool mtime_known, uint32_t mtime) {
+    IndexJob *job = malloc(sizeof(IndexJob));
+    if (name) {
+        size_t len = strlen(parent_path) + strlen(name) + 2;
+        job->path = malloc(len);
+        bool needs_slash = parent_path[0] != '\0' && parent_path[strlen(parent_path) - 1] != '/';
+        snprintf(job->path, len, "%s%s%s", parent_path, needs_slash ? "/" : "", name);
+    } else {
+        job->path = strdup(parent_path);
+    }
+    job->old_idx = old_idx;
+    job->new_idx = new_idx;
+    job->mtime_known = mtime_known;
+    job->mtime = mtime;
+    return job;
+}
+
+static void job_free(void *data) {
+    IndexJob *job = (IndexJob *)data;
+    free(job->path);
+    free(job);
+}
+
+static const char* job_path(void *data) {
+    return ((IndexJob *)data)->path;
+}
+
+static int32_t old_child_by_name(IndexRefresh *r, int32_t old_parent, const char *name) {
+    if (old_parent < 0) return -1;
+    const IndexTable *old = &r->index->table;
+    size_t len = strlen(name);
+    for (int32_t c = r->old_first_child[old_parent]; c >= 0; c = r->old_next_sibling[c]) {
+        const IndexEntry *e = &old->entries[c];
+        if (e->name_len == len && memcmp(old->names + e->name_off, name, len) == 0) return c;
+    }
+    return -1;
+}
+
+// Directories known from their parent's listing have their mtime already,
+// the others are stat'ed first
+static SFTPWalkStep index_prepare(SFTPWalker *walker, void *data, const SFTPFile *attrs, void *user_data) {
+    IndexJob *job = (IndexJob *)data;
+    IndexRefresh *r = (IndexRefresh *)user_data;
+    const IndexTable *old = &r->index->table;
+
+    if (!job->mtime_known) {
+        if (!attrs) return SFTP_WALK_STAT;
+        job->mtime = (uint32_t)attrs->mtime;
+        job->mtime_known = true;
+    }
+    uint32_t mtime = job->mtime;
+
+    pthread_mutex_lock(&r->lock);
+    if (r->abandoned) {
+        pthread_mutex_unlock(&r->lock);
+        return SFTP_WALK_SKIP;
+    }
+    // Unchanged directory: reuse its entries, only its subdirectories need a look
+    if (job->old_idx >= 0 && old->entries[job->old_idx].listed && old->entries[job->old_idx].mtime == mtime && mtime != 0) {
+        r->fresh.entries[job->new_idx].mtime = mtime;
+        r->fresh.entries[job->new_idx].listed = 1;
+        for (int32_t c = r->old_first_child[job->old_idx]; c >= 0; c = r->old_next_sibling[c]) {
+            if (r->fresh.count >= INDEX_MAX_ENTRIES) break;
+            const IndexEntry *oe = &old->entries[c];
+            char name[UINT16_MAX + 1];
+            memcpy(name, old->names + oe->name_off, oe->name_len);
+            name[oe->name_len] = '\0';
+            int32_t idx = table_append(&r->fresh, job->new_idx, name, oe->is_dir, oe->mtime);
+            r->fresh.entries[idx].listed = 0;
+            if (oe->is_dir && oe->listed) {
+                sftp_walk_push(walker, job_new(job->path, name, c, idx, false, 0));
+            }
+        }
+        pthread_mutex_unlock(&r->lock);
+        return SFTP_WALK_SKIP;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return SFTP_WALK_LIST;
+}
+
+static void index_visit(SFTPWalker *walker, void *data, SFTPFile **files, int count, void *user_data) {
+    IndexJob *job = (IndexJob *)data;
+    IndexRefresh *r = (IndexRefresh *)user_data;
+
+    pthread_mutex_lock(&r->lock);
+    if (r->abandoned) {
+        pthread_mutex_unlock(&r->lock);
+        return;
+    }
+    r->fresh.entries[job->new_idx].mtime = job->mtime;
+    r->fresh.entries[job->new_idx].listed = 1;
+    for (int i = 0; i < count; i++) {
+        SFTPFile *f = files[i];
+        if (strcmp(f->name, ".") == 0 || strcmp(f->name, "..") == 0) continue;
+        if (r->fresh.count >= INDEX_MAX_ENTRIES) break;
+
+        bool is_dir = f->type == SFTP_TYPE_DIRECTORY;
+        int32_t idx = table_append(&r->fresh, job->new_idx, f->name, is_dir, (uint32_t)f->mtime);
+        if (is_dir) {
+            IndexJob *child = job_new(job->path, f->name, -1, idx, true, (uint32_t)f->mtime);
+            if (is_excluded(child->path, f->name)) {
+                job_free(child);
+                continue;
+            }
+            child->old_idx = old_child_by_name(r, job->old_idx, f->name);
+            sftp_walk_push(walker, child);
+        }
+    }
+    pthread_mutex_unlock(&r->lock);
+}
+
+static void refresh_free(IndexRefresh *r) {
+    if (!r) return;
+    table_free(&r->fresh);
+    free(r->old_first_child);
+    free(r->old_next_sibling);
+    pthread_mutex_destroy(&r->lock);
+    free(r);
+}
+
+static void index_destroy(SFTPIndex *index) {
+    table_free(&index->table);
+    pthread_rwlock_destroy(&index->table_lock);
+    free(index->cache_file);
+    free(index);
+}
+
+static void index_walk_done(SFTPWalker *walker, SFTPWalkStatus status, void *user_data) {
+    IndexRefresh *r = (IndexRefresh *)user_data;
+    SFTPIndex *index = r->index;
+
+    pthread_mutex_lock(&r->lock);
+    bool abandoned = r->abandoned;
+    if (!abandoned && status == SFTP_WALK_DONE) {
+        table_compute_masks(&r->fresh);
+        pthread_rwlock_wrlock(&index->table_lock);
+        table_free(&index->table);
+        index->table = r->fresh;
+        memset(&r->fresh, 0, sizeof(r->fresh));
+        pthread_rwlock_unlock(&index->table_lock);
+
+        pthread_rwlock_rdlock(&index->table_lock);
+        table_save(&index->table, index->cache_file);
+        pthread_rwlock_unlock(&index->table_lock);
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    // The owner only frees r once finished is set, so it is still there
+    if (!abandoned && r->done) r->done(index, status, r->user_data);
+
+    pthread_mutex_lock(&r->lock);
+    r->finished = true;
+    abandoned = r->abandoned;
+    bool free_index = r->free_index;
+    pthread_mutex_unlock(&r->lock);
+    if (abandoned) {
+        refresh_free(r);
+        if (free_index) index_destroy(index);
+    }
+}
+
+// Stops the current refresh without waiting for it. Returns false when it is
+// still stopping: it then frees itself, and the index too if free_index.
+static bool refresh_release(SFTPIndex *index, bool free_index) {
+    IndexRefresh *r = index->refresh;
+    if (!r) return true;
+    sftp_walk_free(index->walker);
+    index->walker = NULL;
+    index->refresh = NULL;
+
+    pthread_mutex_lock(&r->lock);
+    r->abandoned = true;
+    r->free_index = free_index;
+    bool finished = r->finished;
+    pthread_mutex_unlock(&r->lock);
+    if (!finished) return false;
+    refresh_free(r);
+    return true;
+}
+
+// --- Public API ---
+
+SFTPIndex* sftp_index_open(const char *cache_file) {
+    if (!cache_file) return NULL;
+    SFTPIndex *index = calloc(1, sizeof(SFTPIndex));
+    index->cache_file = strdup(cache_file);
+    pthread_rwlock_init(&index->table_lock, NULL);
+    table_load(&index->table, cache_file);
+    return index;
+}
+
+void sftp_index_free(SFTPIndex *index) {
+    if (!index) return;
+    if (refresh_release(index, true)) index_destroy(index);
+}
+
+int sftp_index_get_count(SFTPIndex *index) {
+    if (!index) return 0;
+    pthread_rwlock_rdlock(&index->table_lock);
+    int count = index->table.count;
+    pthread_rwlock_unlock(&index->table_lock);
+    return count;
+}
+
+char* sftp_index_get_root(SFTPIndex *index) {
+    if (!index) return NULL;
+    char *root = NULL;
+    pthread_rwlock_rdlock(&index->table_lock);
+    if (index->table.count > 0) {
+        root = malloc(index->table.entries[0].name_len + 1);
+        memcpy(root, index->table.names + index->table.entries[0].name_off, index->table.entries[0].name_len);
+        root[index->table.entries[0].name_len] = '\0';
+    }
+    pthread_rwlock_unlock(&index->table_lock);
+    return root;
+}
+
+bool sftp_index_refresh(SFTPIndex *index, const char *root, const SFTPWalkConfig *connection,
+                        SFTPIndexDoneFunc done, void *user_data) {
+    if (!index || !root || !connection) return false;
+
+    // A previous walk still stopping no longer reads or writes the table
+    refresh_release(index, false);
+
+    IndexRefresh *r = calloc(1, sizeof(IndexRefresh));
+    r->index = index;
+    r->done = done;
+    r->user_data = user_data;
+    pthread_mutex_init(&r->lock, NULL);
+    index->refresh = r;
+
+    // Only refresh writes the table, so reading it here without the lock is safe
+    const IndexTable *old = &index->table;
+    int32_t old_root = -1;
+    if (old->count > 0) {
+        r->old_first_child = malloc(sizeof(int32_t) * old->count);
+        r->old_next_sibling = malloc(sizeof(int32_t) * old->count);
+        for (int i = 0; i < old->count; i++) {
+            r->old_first_child[i] = -1;
+            r->old_next_sibling[i] = -1;
+        }
+        for (int i = old->count - 1; i > 0; i--) {
+            int32_t parent = old->entries[i].parent;
+            r->old_next_sibling[i] = r->old_first_child[parent];
+            r->old_first_child[parent] = i;
+        }
+        if (old->entries[0].name_len == strlen(root) && memcmp(old->names + old->entries[0].name_off, root, old->entries[0].name_len) == 0) {
+            old_root = 0;
+        }
+    }
+
+    int32_t new_root = table_append(&r->fresh, -1, root, true, 0);
+
+    SFTPWalkConfig config = *connection;
+    config.path = job_path;
+    config.prepare = index_prepare;
+    config.visit = index_visit;
+    config.done = index_walk_done;
+    config.free_job = job_free;
+    config.user_data = r;
+
+    IndexJob *root_job = job_new(root, NULL, old_root, new_root, false, 0);
+    index->walker = sftp_walk_start(&config, root_job);
+    if (!index->walker) {
+        job_free(root_job);
+        refresh_free(r);
+        index->refresh = NULL;
+        return false;
+    }
+    return true;
+}
+
+void sftp_index_cancel(SFTPIndex *index) {
+    if (index) sftp_walk_cancel(index->walker);
+}
+
+// Subsequence match, higher is better, -1 when query is not contained in text
+static int fuzzy_score(const char *text, int len, const char *query) {
+    int score = 0, ti = 0, prev = -2;
+    for (const char *q = query; *q; q++) {
+        while (ti < len && tolower((unsigned char)text[ti]) != *q) ti++;
+        if (ti == len) return -1;
+
+        int s = 1;
+        if (ti == prev + 1) s += 5;
+        if (ti == 0 || strchr("/._- ", text[ti - 1])) s += 3;
+        score += s;
+        prev = ti++;
+    }
+    return score * 16 - len;
+}
+
+SFTPIndexMatch* sftp_index_search(SFTPIndex *index, const char *query, int max_results, int *count) {
+    *count = 0;
+    if (!index || !query || max_results <= 0) return NULL;
+
+    char q[256];
+    int qlen = 0;
+    bool match_path = false;
+    for (const char *c = query; *c && qlen < (int)sizeof(q) - 1; c++) {
+        if (*c == ' ') continue;
+        if (*c == '/') match_path = true;
+        q[qlen++] = tolower((unsigned char)*c);
+    }
+    q[qlen] = '\0';
+    if (qlen == 0) return NULL;
+    uint32_t qmask = text_mask(q, qlen);
+
+    int32_t *best = malloc(sizeof(int32_t) * max_results);
+    int *best_score = malloc(sizeof(int) * max_results);
+    int found = 0;
+    char path[INDEX_MAX_PATH];
+
+    pthread_rwlock_rdlock(&index->table_lock);
+    const IndexTable *t = &index->table;
+    for (int i = 1; i < t->count; i++) {
+        const IndexEntry *e = &t->entries[i];
+        int score;
+        if (match_path) {
+            if ((e->path_mask & qmask) != qmask) continue;
+            int len = table_path(t, i, path, sizeof(path));
+            if (len < 0) continue;
+            score = fuzzy_score(path, len, q);
+        } else {
+            if ((e->name_mask & qmask) != qmask) continue;
+            score = fuzzy_score(t->names + e->name_off, e->name_len, q);
+        }
+        if (score < 0) continue;
+        if (found == max_results && score <= best_score[found - 1]) continue;
+        // A name match that cannot be turned into a path is of no use
+        if (!match_path && table_path(t, i, path, sizeof(path)) < 0) continue;
+
+        // Insertion into the small sorted top-N list
+        int pos = found < max_results ? found++ : found - 1;
+        while (pos > 0 && best_score[pos - 1] < score) {
+            best[pos] = best[pos - 1];
+            best_score[pos] = best_score[pos - 1];
+            pos--;
+        }
+        best[pos] = i;
+        best_score[pos] = score;
+    }
+
+    SFTPIndexMatch *matches = found ? malloc(sizeof(SFTPIndexMatch) * found) : NULL;
+    for (int i = 0; i < found; i++) {
+        table_path(t, best[i], path, sizeof(path));
+        matches[i].path = strdup(path);
+        matches[i].is_dir = t->entries[best[i]].is_dir;
+        matches[i].score = best_score[i];
+    }
+    pthread_rwlock_unlock(&index->table_lock);
+
+    free(best);
+    free(best_score);
+    *count = found;
+    return matches;
+}
+
+void sftp_index_free_matches(SFTPIndexMatch *matches, int count) {
+    if (!matches) return;
+    for (int i = 0; i < count; i++) free(matches[i].path);
+    free(matches);
+}
@@ -0,0 +1,215 @@
+#include "sftp_range.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+
+#define RANGE_BLOCK_SIZE 32768
+#define RANGE_CACHE_BLOCKS 64
+#define RANGE_READAHEAD_BLOCKS 4
+#define RANGE_MAX_IN_FLIGHT 16
+
+typedef struct {
+    uint64_t block; // Block number, UINT64_MAX when unused
+    uint32_t len;   // Short for the last block of the file
+    uint64_t last_used;
+    char data[RANGE_BLOCK_SIZE];
+} RangeBlock;
+
+struct SFTPRangeReader {
+    SFTPContext *ctx;
+    sftp_file file;
+    uint64_t size;
+    uint64_t fetched_bytes;
+
+    RangeBlock *cache;
+    uint64_t clock;
+    uint64_t last_block;
+    bool backwards;
+};
+
+static RangeBlock* cache_lookup(SFTPRangeReader *r, uint64_t block) {
+    for (int i = 0; i < RANGE_CACHE_BLOCKS; i++) {
+        if (r->cache[i].block == block) {
+            r->cache[i].last_used = ++r->clock;
+            return &r->cache[i];
+        }
+    }
+    return NULL;
+}
+
+static RangeBlock* cache_victim(SFTPRangeReader *r) {
+    RangeBlock *victim = &r->cache[0];
+    for (int i = 1; i < RANGE_CACHE_BLOCKS; i++) {
+        if (r->cache[i].last_used < victim->last_used) victim = &r->cache[i];
+    }
+    return victim;
+}
+
+static uint64_t block_count(SFTPRangeReader *r) {
+    return (r->size + RANGE_BLOCK_SIZE - 1) / RANGE_BLOCK_SIZE;
+}
+
+static uint32_t block_len(SFTPRangeReader *r, uint64_t block) {
+    uint64_t start = block * RANGE_BLOCK_SIZE;
+    uint64_t left = r->size - start;
+    return left < RANGE_BLOCK_SIZE ? (uint32_t)left : RANGE_BLOCK_SIZE;
+}
+
+// Requests every block of [first, last] that is not cached, RANGE_MAX_IN_FLIGHT at a time
+static void fetch_blocks(SFTPRangeReader *r, uint64_t first, uint64_t last) {
+    uint64_t wanted[RANGE_MAX_IN_FLIGHT];
+    int ids[RANGE_MAX_IN_FLIGHT];
+    RangeBlock *slots[RANGE_MAX_IN_FLIGHT];
+
+    uint64_t b = first;
+    while (b <= last) {
+        int count = 0;
+        for (; b <= last && count < RANGE_MAX_IN_FLIGHT; b++) {
+            if (cache_lookup(r, b)) continue;
+            RangeBlock *slot = cache_victim(r);
+            // Claim the slot now so the next victim is a different one
+            slot->block = UINT64_MAX;
+            slot->last_used = ++r->clock;
+            wanted[count] = b;
+            slots[count] = slot;
+            count++;
+        }
+
+        // The lock is taken per request, replies to other users of the session
+        // are queued by libssh and wait for their own reader
+        for (int i = 0; i < count; i++) {
+            sftp_context_lock(r->ctx);
+            sftp_seek64(r->file, wanted[i] * RANGE_BLOCK_SIZE);
+            ids[i] = sftp_async_read_begin(r->file, block_len(r, wanted[i]));
+            sftp_context_unlock(r->ctx);
+        }
+
+        for (int i = 0; i < count; i++) {
+            uint32_t len = block_len(r, wanted[i]);
+            uint32_t got = 0;
+            if (ids[i] >= 0) {
+                sftp_context_lock(r->ctx);
+                int n = sftp_async_read(r->file, slots[i]->data, len, ids[i]);
+                sftp_context_unlock(r->ctx);
+                if (n > 0) got = (uint32_t)n;
+            }
+            // The server may return less than asked, finish synchronously
+            while (got < len) {
+                sftp_context_lock(r->ctx);
+                sftp_seek64(r->file, wanted[i] * RANGE_BLOCK_SIZE + got);
+                ssize_t n = sftp_read(r->file, slots[i]->data + got, len - got);
+                sftp_context_unlock(r->ctx);
+                if (n <= 0) break;
+                got += (uint32_t)n;
+            }
+            r->fetched_bytes += got;
+            if (got > 0) {
+                slots[i]->block = wanted[i];
+                slots[i]->len = got;
+            }
+        }
+    }
+}
+
+SFTPRangeReader* sftp_range_open(SFTPContext *ctx, const char *remote_path) {
+    if (!ctx || !ctx->sftp || !remote_path) return NULL;
+
+    sftp_context_lock(ctx);
+    sftp_file file = sftp_open(ctx->sftp, remote_path, O_RDONLY, 0);
+    sftp_attributes attr = file ? sftp_fstat(file) : NULL;
+    if (file && !attr) sftp_close(file);
+    sftp_context_unlock(ctx);
+    if (!attr) return NULL;
+
+    SFTPRangeReader *r = calloc(1, sizeof(SFTPRangeReader));
+    r->ctx = sftp_context_ref(ctx);
+    r->file = file;
+    r->size = attr->size;
+    sftp_attributes_free(attr);
+
+    r->cache = calloc(RANGE_CACHE_BLOCKS, sizeof(RangeBlock));
+    for (int i = 0; i < RANGE_CACHE_BLOCKS; i++) r->cache[i].block = UINT64_MAX;
+    return r;
+}
+
+void sftp_range_close(SFTPRangeReader *reader) {
+    if (!reader) return;
+    sftp_context_lock(reader->ctx);
+    sftp_close(reader->file);
+    sftp_context_unlock(reader->ctx);
+    sftp_context_unref(reader->ctx);
+    free(reader->cache);
+    free(reader);
+}
+
+uint64_t sftp_range_get_size(SFTPRangeReader *reader) {
+    return reader ? reader->size : 0;
+}
+
+uint64_t sftp_range_update_size(SFTPRangeReader *reader) {
+    sftp_context_lock(reader->ctx);
+    sftp_attributes attr = sftp_fstat(reader->file);
+    sftp_context_unlock(reader->ctx);
+    if (!attr) return reader->size;
+    uint64_t new_size = attr->size;
+    sftp_attributes_free(attr);
+
+    if (new_size != reader->size) {
+        // The old last block was short (grown file) or is gone (truncated)
+        uint64_t keep = (new_size < reader->size ? new_size : reader->size) / RANGE_BLOCK_SIZE;
+        for (int i = 0; i < RANGE_CACHE_BLOCKS; i++) {
+            if (reader->cache[i].block != UINT64_MAX && reader->cache[i].block >= keep) {
+                reader->cache[i].block = UINT64_MAX;
+            }
+        }
+        reader->size = new_size;
+    }
+    return new_size;
+}
+
+ssize_t sftp_range_read(SFTPRangeReader *reader, uint64_t offset, void *buf, size_t len) {
+    if (!reader) return -1;
+    if (offset >= reader->size || len == 0) return 0;
+    if (len > reader->size - offset) len = reader->size - offset;
+
+    // Half the cache at most, so a single read never evicts its own blocks
+    size_t max_len = (RANGE_CACHE_BLOCKS / 2 - RANGE_READAHEAD_BLOCKS) * (size_t)RANGE_BLOCK_SIZE;
+    if (len > max_len) len = max_len;
+
+    uint64_t first = offset / RANGE_BLOCK_SIZE;
+    uint64_t last = (offset + len - 1) / RANGE_BLOCK_SIZE;
+
+    // Readahead follows the direction of the previous read
+    if (first < reader->last_block) reader->backwards = true;
+    else if (first > reader->last_block) reader->backwards = false;
+    reader->last_block = first;
+
+    uint64_t fetch_first = first;
+    uint64_t fetch_last = last;
+    if (reader->backwards) {
+        fetch_first = first > RANGE_READAHEAD_BLOCKS ? first - RANGE_READAHEAD_BLOCKS : 0;
+    } else {
+        fetch_last = last + RANGE_READAHEAD_BLOCKS;
+        if (fetch_last >= block_count(reader)) fetch_last = block_count(reader) - 1;
+    }
+    fetch_blocks(reader, fetch_first, fetch_last);
+
+    size_t done = 0;
+    while (done < len) {
+        uint64_t pos = offset + done;
+        RangeBlock *block = cache_lookup(reader, pos / RANGE_BLOCK_SIZE);
+        if (!block) break;
+
+        uint32_t in_block = pos % RANGE_BLOCK_SIZE;
+        if (in_block >= block->len) break;
+        size_t n = block->len - in_block;
+        if (n > len - done) n = len - done;
+        memcpy((char *)buf + done, block->data + in_block, n);
+        done += n;
+    }
+    return done > 0 ? (ssize_t)done : -1;
+}
+
+uint64_t sftp_range_get_fetched_bytes(SFTPRangeReader *reader) {
+    return reader ? reader->fetched_bytes : 0;
+}
@@ -0,0 +1,720 @@
+#define _GNU_SOURCE
+#include "sftp_sync.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+// A batch is flushed once no event arrived for SYNC_DEBOUNCE_MS, or at the
+// latest SYNC_MAX_DELAY_MS after its first event (editors rarely stop writing).
+#define SYNC_DEBOUNCE_MS 300
+#define SYNC_MAX_DELAY_MS 2000
+
+#define SYNC_WATCH_MASK (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB)
+
+enum {
+    SYNC_UPLOAD = 1 << 0,
+    SYNC_DELETE = 1 << 1,
+    SYNC_RENAME = 1 << 2,
+    // Did not exist before this batch, so it never reached the server
+    SYNC_NEW = 1 << 3
+};
+
+typedef struct {
+    int wd;
+    char *rel;
+} SyncWatch;
+
+typedef struct {
+    char *rel;
+    char *from;
+    int flags;
+    bool is_dir;
+} SyncEntry;
+
+struct SFTPSync {
+    SFTPContext *ctx;
+    char *local_root;
+    char *remote_root;
+
+    int inotify_fd;
+    int stop_pipe[2];
+    pthread_t thread;
+
+    SyncWatch *watches;
+    int watch_count;
+    int watch_capacity;
+
+    SyncEntry *pending;
+    int pending_count;
+    int pending_capacity;
+
+    // MOVED_FROM waiting for its MOVED_TO
+    uint32_t move_cookie;
+    char *move_from;
+    bool move_is_dir;
+
+    // Events were lost (IN_Q_OVERFLOW), the tree is compared again
+    bool rescan;
+    atomic_bool stopping;
+
+    SFTPSyncStats stats;
+    pthread_mutex_t stats_lock;
+};
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static char* join_path(const char *root, const char *rel) {
+    size_t len = strlen(root) + strlen(rel) + 2;
+    char *out = malloc(len);
+    if (rel[0] == '\0') {
+        snprintf(out, len, "%s", root);
+    } else if (root[0] != '\0' && root[strlen(root) - 1] == '/') {
+        snprintf(out, len, "%s%s", root, rel);
+    } else {
+        snprintf(out, len, "%s/%s", root, rel);
+    }
+    return out;
+}
+
+static void stats_add(SFTPSync *sync, uint64_t *counter, uint64_t n) {
+    pthread_mutex_lock(&sync->stats_lock);
+    *counter += n;
+    pthread_mutex_unlock(&sync->stats_lock);
+}
+
+// --- Watches ---
+
+static const char* watch_rel(SFTPSync *sync, int wd) {
+    for (int i = 0; i < sync->watch_count; i++) {
+        if (sync->watches[i].wd == wd) return sync->watches[i].rel;
+    }
+    return NULL;
+}
+
+static void watch_remove(SFTPSync *sync, int wd) {
+    for (int i = 0; i < sync->watch_count; i++) {
+        if (sync->watches[i].wd == wd) {
+            free(sync->watches[i].rel);
+            sync->watches[i] = sync->watches[--sync->watch_count];
+            return;
+        }
+    }
+}
+
+static void add_watch_recursive(SFTPSync *sync, const char *rel) {
+    char *path = join_path(sync->local_root, rel);
+    int wd = inotify_add_watch(sync->inotify_fd, path, SYNC_WATCH_MASK | IN_ONLYDIR);
+    if (wd < 0) {
+        free(path);
+        return;
+    }
+
+    if (!watch_rel(sync, wd)) {
+        if (sync->watch_count >= sync->watch_capacity) {
+            sync->watch_capacity = sync->watch_capacity ? sync->watch_capacity * 2 : 16;
+            sync->watches = realloc(sync->watches, sizeof(SyncWatch) * sync->watch_capacity);
+        }
+        sync->watches[sync->watch_count].wd = wd;
+        sync->watches[sync->watch_count].rel = strdup(rel);
+        sync->watch_count++;
+    }
+
+    DIR *dir = opendir(path);
+    free(path);
+    if (!dir) return;
+
+    struct dirent *e;
+    while ((e = readdir(dir)) != NULL) {
+        if (e->d_type != DT_DIR || strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        char *child = join_path(rel, e->d_name);
+        add_watch_recursive(sync, child);
+        free(child);
+    }
+    closedir(dir);
+}
+
+// True for prefix itself and for the paths below it
+static bool path_in(const char *rel, const char *prefix, size_t prefix_len) {
+    return strncmp(rel, prefix, prefix_len) == 0 && (rel[prefix_len] == '\0' || rel[prefix_len] == '/');
+}
+
+static char* replace_prefix(const char *rel, size_t prefix_len, const char *to) {
+    char *renamed = malloc(strlen(to) + strlen(rel + prefix_len) + 1);
+    sprintf(renamed, "%s%s", to, rel + prefix_len);
+    return renamed;
+}
+
+// A directory moved inside the tree keeps its watches, only their paths change
+static void rename_watch_prefix(SFTPSync *sync, const char *from, const char *to) {
+    size_t from_len = strlen(from);
+    for (int i = 0; i < sync->watch_count; i++) {
+        char *rel = sync->watches[i].rel;
+        if (path_in(rel, from, from_len)) {
+            sync->watches[i].rel = replace_prefix(rel, from_len, to);
+            free(rel);
+        }
+    }
+}
+
+// A directory moved out of the tree is no longer ours to follow
+static void remove_watch_tree(SFTPSync *sync, const char *rel) {
+    size_t len = strlen(rel);
+    for (int i = sync->watch_count - 1; i >= 0; i--) {
+        if (!path_in(sync->watches[i].rel, rel, len)) continue;
+        // The IN_IGNORED that follows finds nothing left to remove
+        inotify_rm_watch(sync->inotify_fd, sync->watches[i].wd);
+        free(sync->watches[i].rel);
+        sync->watches[i] = sync->watches[--sync->watch_count];
+    }
+}
+
+// --- Pending batch ---
+
+static SyncEntry* pending_find(SFTPSync *sync, const char *rel) {
+    for (int i = 0; i < sync->pending_count; i++) {
+        if (strcmp(sync->pending[i].rel, rel) == 0) return &sync->pending[i];
+    }
+    return NULL;
+}
+
+static SyncEntry* pending_get(SFTPSync *sync, const char *rel, bool is_dir) {
+    SyncEntry *e = pending_find(sync, rel);
+    if (e) {
+        e->is_dir = is_dir;
+        return e;
+    }
+    if (sync->pending_count >= sync->pending_capacity) {
+        sync->pending_capacity = sync->pending_capacity ? sync->pending_capacity * 2 : 32;
+        sync->pending = realloc(sync->pending, sizeof(SyncEntry) * sync->pending_capacity);
+    }
+    e = &sync->pending[sync->pending_count++];
+    e->rel = strdup(rel);
+    e->from = NULL;
+    e->flags = 0;
+    e->is_dir = is_dir;
+    return e;
+}
+
+static void pending_drop(SFTPSync *sync, SyncEntry *e) {
+    free(e->rel);
+    free(e->from);
+    *e = sync->pending[--sync->pending_count];
+}
+
+// Changes queued below a directory follow it when it is renamed. The directory
+// rename reaches the server first (parents first), so renames inside it use the
+// new name for their source too.
+static void rename_pending_prefix(SFTPSync *sync, const char *from, const char *to) {
+    size_t from_len = strlen(from);
+    for (int i = sync->pending_count - 1; i >= 0; i--) {
+        SyncEntry *e = &sync->pending[i];
+        if (!path_in(e->rel, from, from_len) || e->rel[from_len] != '/') continue;
+
+        if (e->from && path_in(e->from, from, from_len)) {
+            char *renamed_from = replace_prefix(e->from, from_len, to);
+            free(e->from);
+            e->from = renamed_from;
+        }
+
+        char *renamed = replace_prefix(e->rel, from_len, to);
+        SyncEntry *stale = pending_find(sync, renamed);
+        if (stale && stale != e) {
+            // What was queued for the old file at the new name is superseded.
+            // Entries after i are done, so the one moved into i by the drop is too.
+            free(stale->from);
+            stale->from = e->from;
+            e->from = NULL;
+            stale->flags = e->flags;
+            stale->is_dir = e->is_dir;
+            free(renamed);
+            pending_drop(sync, e);
+        } else {
+            free(e->rel);
+            e->rel = renamed;
+        }
+    }
+}
+
+static bool pending_is_rename_source(SFTPSync *sync, const char *rel) {
+    for (int i = 0; i < sync->pending_count; i++) {
+        if (sync->pending[i].from && strcmp(sync->pending[i].from, rel) == 0) return true;
+    }
+    return false;
+}
+
+static void on_path_written(SFTPSync *sync, const char *rel, bool is_dir, bool created) {
+    SyncEntry *e = pending_find(sync, rel);
+    // A name freed by a pending rename still exists on the server
+    if (!e && created && !pending_is_rename_source(sync, rel)) {
+        e = pending_get(sync, rel, is_dir);
+        e->flags |= SYNC_NEW;
+    }
+    if (!e) e = pending_get(sync, rel, is_dir);
+    e->flags &= ~SYNC_DELETE;
+    e->flags |= SYNC_UPLOAD;
+}
+
+static void on_path_deleted(SFTPSync *sync, const char *rel, bool is_dir) {
+    SyncEntry *e = pending_find(sync, rel);
+    char *renamed_from = NULL;
+    if (e) {
+        // Created and removed within one batch: the server never needs to know
+        if (e->flags & SYNC_NEW) {
+            pending_drop(sync, e);
+            return;
+        }
+        if ((e->flags & SYNC_RENAME) && e->from) {
+            // The rename never reached the server, so this name does not exist there
+            renamed_from = strdup(e->from);
+            pending_drop(sync, e);
+        } else {
+            free(e->from);
+            e->from = NULL;
+            e->flags = SYNC_DELETE;
+            e->is_dir = is_dir;
+        }
+    } else {
+        e = pending_get(sync, rel, is_dir);
+        e->flags = SYNC_DELETE;
+    }
+
+    // Delete the original name instead, unless it was written again meanwhile (vim: a -> a~, write a, rm a~)
+    if (renamed_from) {
+        SyncEntry *orig = pending_find(sync, renamed_from);
+        if (!orig) {
+            orig = pending_get(sync, renamed_from, is_dir);
+            orig->flags = SYNC_DELETE;
+        }
+        free(renamed_from);
+    }
+}
+
+static void on_path_moved(SFTPSync *sync, const char *from, const char *to, bool is_dir) {
+    SyncEntry *src = pending_find(sync, from);
+    int src_flags = src ? src->flags : 0;
+    char *origin = (src && (src->flags & SYNC_RENAME) && src->from) ? strdup(src->from) : strdup(from);
+    if (src) pending_drop(sync, src);
+
+    SyncEntry *dst = pending_get(sync, to, is_dir);
+    free(dst->from);
+    dst->from = NULL;
+    if (src_flags & SYNC_NEW) {
+        // Typical editor save: temp file written, then renamed over the target
+        dst->flags = SYNC_UPLOAD;
+    } else {
+        dst->flags = SYNC_RENAME | (src_flags & SYNC_UPLOAD);
+        dst->from = origin;
+        origin = NULL;
+    }
+    free(origin);
+
+    if (is_dir) {
+        rename_pending_prefix(sync, from, to);
+        rename_watch_prefix(sync, from, to);
+    }
+}
+
+static void resolve_pending_move(SFTPSync *sync) {
+    if (!sync->move_from) return;
+    // Moved out of the watched tree
+    on_path_deleted(sync, sync->move_from, sync->move_is_dir);
+    if (sync->move_is_dir) remove_watch_tree(sync, sync->move_from);
+    free(sync->move_from);
+    sync->move_from = NULL;
+}
+
+static void handle_event(SFTPSync *sync, const struct inotify_event *ev) {
+    if (ev->mask & IN_Q_OVERFLOW) {
+        sync->rescan = true;
+        return;
+    }
+    if (ev->mask & IN_IGNORED) {
+        watch_remove(sync, ev->wd);
+        return;
+    }
+    if (ev->len == 0) return;
+
+    const char *dir_rel = watch_rel(sync, ev->wd);
+    if (!dir_rel) return;
+
+    stats_add(sync, &sync->stats.events, 1);
+
+    char *rel = join_path(dir_rel, ev->name);
+    bool is_dir = (ev->mask & IN_ISDIR) != 0;
+
+    if (ev->mask & IN_MOVED_FROM) {
+        resolve_pending_move(sync);
+        sync->move_cookie = ev->cookie;
+        sync->move_from = rel;
+        sync->move_is_dir = is_dir;
+        return;
+    }
+
+    if (ev->mask & IN_MOVED_TO) {
+        if (sync->move_from && sync->move_cookie == ev->cookie) {
+            on_path_moved(sync, sync->move_from, rel, is_dir);
+            free(sync->move_from);
+            sync->move_from = NULL;
+        } else {
+            resolve_pending_move(sync);
+            // Moved in from outside the tree
+            on_path_written(sync, rel, is_dir, false);
+            if (is_dir) add_watch_recursive(sync, rel);
+        }
+    } else if (ev->mask & IN_CREATE) {
+        on_path_written(sync, rel, is_dir, true);
+        if (is_dir) add_watch_recursive(sync, rel);
+    } else if (ev->mask & IN_DELETE) {
+        on_path_deleted(sync, rel, is_dir);
+    } else if (ev->mask & (IN_CLOSE_WRITE | IN_ATTRIB)) {
+        if (!is_dir) on_path_written(sync, rel, false, false);
+    }
+    free(rel);
+}
+
+// --- Remote operations ---
+// The context is shared with the browser: each operation takes the lock on its
+// own so directory listings can go through between two files.
+
+static void remote_mkdirs(SFTPSync *sync, const char *remote_path) {
+    char *copy = strdup(remote_path);
+    sftp_context_lock(sync->ctx);
+    for (char *p = copy + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        sftp_mkdir(sync->ctx->sftp, copy, 0755);
+        *p = '/';
+    }
+    sftp_mkdir(sync->ctx->sftp, copy, 0755);
+    sftp_context_unlock(sync->ctx);
+    free(copy);
+}
+
+static void remote_unlink(SFTPSync *sync, const char *remote_path) {
+    sftp_context_lock(sync->ctx);
+    sftp_unlink(sync->ctx->sftp, remote_path);
+    sftp_context_unlock(sync->ctx);
+}
+
+static void remote_remove_tree(SFTPSync *sync, const char *remote_path) {
+    int count = 0;
+    sftp_context_lock(sync->ctx);
+    SFTPFile **files = sftp_list_directory(sync->ctx, remote_path, &count);
+    sftp_context_unlock(sync->ctx);
+    for (int i = 0; i < count; i++) {
+        if (strcmp(files[i]->name, ".") == 0 || strcmp(files[i]->name, "..") == 0) continue;
+        char *child = join_path(remote_path, files[i]->name);
+        if (files[i]->type == SFTP_TYPE_DIRECTORY) {
+            remote_remove_tree(sync, child);
+        } else {
+            remote_unlink(sync, child);
+        }
+        free(child);
+    }
+    sftp_free_file_list(files, count);
+    sftp_context_lock(sync->ctx);
+    sftp_rmdir(sync->ctx->sftp, remote_path);
+    sftp_context_unlock(sync->ctx);
+}
+
+// Skips files whose remote copy already has the same size and an mtime at least as recent
+static bool remote_is_current(SFTPSync *sync, const char *remote_path, const struct stat *st) {
+    sftp_context_lock(sync->ctx);
+    sftp_attributes attr = sftp_stat(sync->ctx->sftp, remote_path);
+    sftp_context_unlock(sync->ctx);
+    if (!attr) return false;
+    bool current = attr->size == (uint64_t)st->st_size && attr->mtime >= (uint32_t)st->st_mtime;
+    sftp_attributes_free(attr);
+    return current;
+}
+
+// Sends one file content. The upload locks the context per chunk so the browser
+// keeps working during large files, and reports into its own stats.
+static int remote_upload(SFTPSync *sync, const char *local, const char *remote, const struct stat *st) {
+    SFTPTransferStats transfer;
+    int rc = sftp_upload_file_shared(sync->ctx, local, remote, &transfer);
+    if (rc == 0) {
+        // Keep the local mtime so the next initial pass can skip the file
+        struct sftp_attributes_struct attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.flags = SSH_FILEXFER_ATTR_ACMODTIME;
+        attr.atime = (uint32_t)st->st_atime;
+        attr.mtime = (uint32_t)st->st_mtime;
+        sftp_context_lock(sync->ctx);
+        sftp_setstat(sync->ctx->sftp, remote, &attr);
+        sftp_context_unlock(sync->ctx);
+        stats_add(sync, &sync->stats.bytes_sent, transfer.transferred_bytes);
+        stats_add(sync, &sync->stats.bytes_skipped, transfer.skipped_bytes);
+    }
+    return rc;
+}
+
+// check_current is set for the full passes (start and rescans), which compare
+// with the server and stop early when the sync is stopped.
+static void upload_one(SFTPSync *sync, const char *rel, bool check_current) {
+    if (check_current && atomic_load(&sync->stopping)) return;
+
+    char *local = join_path(sync->local_root, rel);
+    char *remote = join_path(sync->remote_root, rel);
+
+    struct stat st;
+    if (stat(local, &st) != 0) {
+        // Already gone again, a later event will delete it
+        free(local);
+        free(remote);
+        return;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        sftp_context_lock(sync->ctx);
+        sftp_mkdir(sync->ctx->sftp, remote, 0755);
+        sftp_context_unlock(sync->ctx);
+        DIR *dir = opendir(local);
+        struct dirent *e;
+        while (dir && (e = readdir(dir)) != NULL) {
+            if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+            char *child = join_path(rel, e->d_name);
+            upload_one(sync, child, check_current);
+            free(child);
+        }
+        if (dir) closedir(dir);
+    } else if (S_ISREG(st.st_mode) && !(check_current && remote_is_current(sync, remote, &st))) {
+        int rc = remote_upload(sync, local, remote, &st);
+        if (rc != 0) {
+            // Parent may be missing on the server
+            char *slash = strrchr(remote, '/');
+            if (slash && slash != remote) {
+                *slash = '\0';
+                remote_mkdirs(sync, remote);
+                *slash = '/';
+                rc = remote_upload(sync, local, remote, &st);
+            }
+        }
+        if (rc == 0) {
+            stats_add(sync, &sync->stats.uploads, 1);
+        } else {
+            stats_add(sync, &sync->stats.errors, 1);
+        }
+    }
+
+    free(local);
+    free(remote);
+}
+
+static int cmp_depth_asc(const void *a, const void *b) {
+    const SyncEntry *x = a, *y = b;
+    size_t lx = strlen(x->rel), ly = strlen(y->rel);
+    return lx < ly ? -1 : lx > ly ? 1 : 0;
+}
+
+static bool has_uploading_ancestor(SFTPSync *sync, const char *rel) {
+    for (int i = 0; i < sync->pending_count; i++) {
+        SyncEntry *e = &sync->pending[i];
+        size_t len = strlen(e->rel);
+        if (e->is_dir && (e->flags & SYNC_UPLOAD) && !(e->flags & SYNC_RENAME) &&
+            strncmp(rel, e->rel, len) == 0 && rel[len] == '/') {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void flush_batch(SFTPSync *sync) {
+    resolve_pending_move(sync);
+    if (sync->pending_count == 0) return;
+
+    // Parents first for renames and uploads, children first for deletes
+    qsort(sync->pending, sync->pending_count, sizeof(SyncEntry), cmp_depth_asc);
+
+    for (int i = 0; i < sync->pending_count; i++) {
+        SyncEntry *e = &sync->pending[i];
+        if (!(e->flags & SYNC_RENAME) || !e->from) continue;
+        char *from = join_path(sync->remote_root, e->from);
+        char *to = join_path(sync->remote_root, e->rel);
+        sftp_context_lock(sync->ctx);
+        int rc = sftp_rename(sync->ctx->sftp, from, to);
+        sftp_context_unlock(sync->ctx);
+        if (rc == 0) {
+            stats_add(sync, &sync->stats.renames, 1);
+        } else {
+            // Source was never synced, send the content instead
+            e->flags |= SYNC_UPLOAD;
+        }
+        free(from);
+        free(to);
+    }
+
+    for (int i = sync->pending_count - 1; i >= 0; i--) {
+        SyncEntry *e = &sync->pending[i];
+        if (!(e->flags & SYNC_DELETE)) continue;
+        char *remote = join_path(sync->remote_root, e->rel);
+        if (e->is_dir) {
+            remote_remove_tree(sync, remote);
+        } else {
+            remote_unlink(sync, remote);
+        }
+        stats_add(sync, &sync->stats.deletes, 1);
+        free(remote);
+    }
+
+    for (int i = 0; i < sync->pending_count; i++) {
+        SyncEntry *e = &sync->pending[i];
+        if (!(e->flags & SYNC_UPLOAD) || has_uploading_ancestor(sync, e->rel)) continue;
+        upload_one(sync, e->rel, false);
+    }
+
+    while (sync->pending_count > 0) {
+        pending_drop(sync, &sync->pending[sync->pending_count - 1]);
+    }
+    stats_add(sync, &sync->stats.batches, 1);
+}
+
+// Brings the server up to date with the whole tree: at start, and again when
+// inotify dropped events. Files only present remotely are left alone.
+static void mirror_tree(SFTPSync *sync) {
+    remote_mkdirs(sync, sync->remote_root);
+    upload_one(sync, "", true);
+}
+
+static void sync_free(SFTPSync *sync) {
+    close(sync->inotify_fd);
+    close(sync->stop_pipe[0]);
+    close(sync->stop_pipe[1]);
+
+    for (int i = 0; i < sync->watch_count; i++) free(sync->watches[i].rel);
+    free(sync->watches);
+    while (sync->pending_count > 0) {
+        pending_drop(sync, &sync->pending[sync->pending_count - 1]);
+    }
+    free(sync->pending);
+    free(sync->move_from);
+    free(sync->local_root);
+    free(sync->remote_root);
+    pthread_mutex_destroy(&sync->stats_lock);
+    sftp_context_unref(sync->ctx);
+    free(sync);
+}
+
+static void* sync_thread_func(void *arg) {
+    SFTPSync *sync = (SFTPSync *)arg;
+    trace_set_thread_name("sftp-sync");
+
+    mirror_tree(sync);
+
+    char buffer[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)] __attribute__((aligned(__alignof__(struct inotify_event))));
+    long long first_event = 0, last_event = 0;
+
+    for (;;) {
+        int timeout = -1;
+        if (sync->pending_count > 0 || sync->move_from) {
+            long long now = now_ms();
+            long long deadline = last_event + SYNC_DEBOUNCE_MS;
+            if (first_event + SYNC_MAX_DELAY_MS < deadline) deadline = first_event + SYNC_MAX_DELAY_MS;
+            timeout = deadline > now ? (int)(deadline - now) : 0;
+        }
+
+        struct pollfd fds[2] = {
+            { .fd = sync->inotify_fd, .events = POLLIN },
+            { .fd = sync->stop_pipe[0], .events = POLLIN }
+        };
+        int rc = poll(fds, 2, timeout);
+        if (fds[1].revents) break;
+
+        if (rc == 0) {
+            flush_batch(sync);
+            continue;
+        }
+        if (rc < 0 || !(fds[0].revents & POLLIN)) continue;
+
+        ssize_t len = read(sync->inotify_fd, buffer, sizeof(buffer));
+        if (len <= 0) continue;
+
+        if (sync->pending_count == 0 && !sync->move_from) first_event = now_ms();
+        last_event = now_ms();
+
+        for (char *p = buffer; p < buffer + len; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            handle_event(sync, ev);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+
+        if (sync->rescan) {
+            LOG_WARN("sync", "inotify queue overflowed, rescanning %s", sync->local_root);
+            sync->rescan = false;
+            flush_batch(sync);
+            // Directories created during the gap have no watch yet
+            add_watch_recursive(sync, "");
+            mirror_tree(sync);
+        }
+    }
+
+    // Changes still waiting for their debounce are sent, then the sync owns the cleanup
+    flush_batch(sync);
+    sync_free(sync);
+    return NULL;
+}
+
+SFTPSync* sftp_sync_start(SFTPContext *ctx, const char *local_dir, const char *remote_dir) {
+    if (!ctx || !ctx->sftp || !local_dir || !remote_dir) return NULL;
+
+    SFTPSync *sync = calloc(1, sizeof(SFTPSync));
+    sync->ctx = sftp_context_ref(ctx);
+    sync->local_root = strdup(local_dir);
+    sync->remote_root = strdup(remote_dir);
+    pthread_mutex_init(&sync->stats_lock, NULL);
+
+    sync->inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (sync->inotify_fd < 0 || pipe(sync->stop_pipe) != 0) {
+        if (sync->inotify_fd >= 0) close(sync->inotify_fd);
+        sftp_context_unref(ctx);
+        free(sync->local_root);
+        free(sync->remote_root);
+        free(sync);
+        return NULL;
+    }
+
+    // Watches go in before the initial upload so nothing written meanwhile is missed
+    add_watch_recursive(sync, "");
+
+    if (pthread_create(&sync->thread, NULL, sync_thread_func, sync) != 0) {
+        sync_free(sync);
+        return NULL;
+    }
+    return sync;
+}
+
+void sftp_sync_stop(SFTPSync *sync) {
+    if (!sync) return;
+
+    // The thread may be in the middle of an upload: it is not waited for, it
+    // frees the sync (and its context reference) once it has stopped.
+    pthread_t thread = sync->thread;
+    atomic_store(&sync->stopping, true);
+    if (write(sync->stop_pipe[1], "x", 1) < 0) {
+        LOG_ERROR("sync", "sftp_sync_stop: %s", strerror(errno));
+    }
+    pthread_detach(thread);
+}
+
+SFTPSyncStats sftp_sync_get_stats(SFTPSync *sync) {
+    SFTPSyncStats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (!sync) return stats;
+    pthread_mutex_lock(&sync->stats_lock);
+    stats = sync->stats;
+    pthread_mutex_unlock(&sync->stats_lock);
+    return stats;
+}
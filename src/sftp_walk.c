@@ -0,0 +1,547 @@
+#include "sftp_walk.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+
+#define WALK_MAX_CONCURRENCY 64
+// Largest reply accepted, READDIR batches stay far below it
+#define WALK_MAX_PACKET (256 * 1024)
+#define WALK_READ_CHUNK 65536
+// Replies read by another user of the session land in our channel buffer
+// without waking the poll, so it never waits long
+#define WALK_POLL_MS 20
+#define WALK_SFTP_VERSION 3
+
+typedef enum {
+    OP_FREE = 0,
+    OP_STAT,
+    OP_OPENDIR,
+    OP_READDIR,
+    OP_CLOSE
+} WalkOpState;
+
+// A job in flight, waiting for the reply to request id
+typedef struct {
+    WalkOpState state;
+    uint32_t id;
+    void *job;
+    char *handle;
+    uint32_t handle_len;
+    SFTPFile **files;
+    int count;
+    int capacity;
+    bool listed;
+} WalkOp;
+
+typedef struct {
+    const uint8_t *p;
+    uint32_t left;
+} Reader;
+
+struct SFTPWalker {
+    SFTPWalkConfig config;
+
+    void **queue;
+    int queue_head;
+    int queue_count;
+    int queue_capacity;
+
+    bool cancelled;
+    bool finished;
+    // sftp_walk_free came first, the thread frees the walker when it ends
+    bool detached;
+    bool has_thread;
+    pthread_t thread;
+    pthread_mutex_t lock;
+
+    struct timespec next_slot;
+
+    // Protocol state, walker thread only
+    ssh_channel channel;
+    int fd;
+    bool ready;
+    bool broken;
+    uint32_t next_id;
+    WalkOp ops[WALK_MAX_CONCURRENCY];
+    int in_flight;
+    uint8_t *in;
+    size_t in_len;
+    size_t in_capacity;
+};
+
+static void queue_push_locked(SFTPWalker *w, void *job) {
+    if (w->queue_count >= w->queue_capacity) {
+        int new_capacity = w->queue_capacity ? w->queue_capacity * 2 : 64;
+        void **grown = malloc(sizeof(void*) * new_capacity);
+        for (int i = 0; i < w->queue_count; i++) {
+            grown[i] = w->queue[(w->queue_head + i) % w->queue_capacity];
+        }
+        free(w->queue);
+        w->queue = grown;
+        w->queue_head = 0;
+        w->queue_capacity = new_capacity;
+    }
+    w->queue[(w->queue_head + w->queue_count) % w->queue_capacity] = job;
+    w->queue_count++;
+}
+
+static void* queue_pop(SFTPWalker *w) {
+    void *job = NULL;
+    pthread_mutex_lock(&w->lock);
+    if (w->queue_count > 0) {
+        job = w->queue[w->queue_head];
+        w->queue_head = (w->queue_head + 1) % w->queue_capacity;
+        w->queue_count--;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return job;
+}
+
+static void walk_free_job(SFTPWalker *w, void *job) {
+    if (w->config.free_job) w->config.free_job(job);
+}
+
+// Blocks until the rate limit allows one more remote request
+static void walk_throttle(SFTPWalker *w) {
+    int rate = w->config.max_requests_per_sec;
+    if (rate <= 0) return;
+
+    long interval_ns = 1000000000L / rate;
+    struct timespec now, slot;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    slot = w->next_slot;
+    if (slot.tv_sec < now.tv_sec || (slot.tv_sec == now.tv_sec && slot.tv_nsec < now.tv_nsec)) {
+        slot = now;
+    }
+    w->next_slot.tv_sec = slot.tv_sec + (slot.tv_nsec + interval_ns) / 1000000000L;
+    w->next_slot.tv_nsec = (slot.tv_nsec + interval_ns) % 1000000000L;
+
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &slot, NULL);
+}
+
+// --- SFTP v3 wire format ---
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static bool read_u32(Reader *r, uint32_t *v) {
+    if (r->left < 4) return false;
+    *v = get_u32(r->p);
+    r->p += 4;
+    r->left -= 4;
+    return true;
+}
+
+static bool read_u64(Reader *r, uint64_t *v) {
+    uint32_t hi, lo;
+    if (!read_u32(r, &hi) || !read_u32(r, &lo)) return false;
+    *v = (uint64_t)hi << 32 | lo;
+    return true;
+}
+
+static bool read_string(Reader *r, const uint8_t **s, uint32_t *len) {
+    if (!read_u32(r, len) || r->left < *len) return false;
+    *s = r->p;
+    r->p += *len;
+    r->left -= *len;
+    return true;
+}
+
+// Fills size, mtime and type, like sftp_list_directory does
+static bool read_attrs(Reader *r, SFTPFile *f) {
+    uint32_t flags, skip;
+    if (!read_u32(r, &flags)) return false;
+    if ((flags & SSH_FILEXFER_ATTR_SIZE) && !read_u64(r, &f->size)) return false;
+    if ((flags & SSH_FILEXFER_ATTR_UIDGID) && (!read_u32(r, &skip) || !read_u32(r, &skip))) return false;
+    f->type = SFTP_TYPE_REGULAR;
+    if (flags & SSH_FILEXFER_ATTR_PERMISSIONS) {
+        uint32_t mode;
+        if (!read_u32(r, &mode)) return false;
+        if ((mode & SSH_S_IFMT) == SSH_S_IFDIR) f->type = SFTP_TYPE_DIRECTORY;
+        else if ((mode & SSH_S_IFMT) == SSH_S_IFLNK) f->type = SFTP_TYPE_SYMLINK;
+    }
+    if (flags & SSH_FILEXFER_ATTR_ACMODTIME) {
+        uint32_t mtime;
+        if (!read_u32(r, &skip) || !read_u32(r, &mtime)) return false;
+        f->mtime = mtime;
+    }
+    if (flags & SSH_FILEXFER_ATTR_EXTENDED) {
+        uint32_t count, len;
+        const uint8_t *s;
+        if (!read_u32(r, &count)) return false;
+        for (uint32_t i = 0; i < count; i++) {
+            if (!read_string(r, &s, &len) || !read_string(r, &s, &len)) return false;
+        }
+    }
+    return true;
+}
+
+static bool channel_send(SFTPWalker *w, const uint8_t *buf, uint32_t len) {
+    sftp_context_lock(w->config.ctx);
+    int rc = ssh_channel_write(w->channel, buf, len);
+    sftp_context_unlock(w->config.ctx);
+    return rc == (int)len;
+}
+
+// Sends a request whose only argument is a path or a handle
+static bool send_request(SFTPWalker *w, uint8_t type, uint32_t id, const char *arg, uint32_t arg_len) {
+    uint32_t len = 1 + 4 + 4 + arg_len;
+    uint8_t *buf = malloc(4 + len);
+    put_u32(buf, len);
+    buf[4] = type;
+    put_u32(buf + 5, id);
+    put_u32(buf + 9, arg_len);
+    memcpy(buf + 13, arg, arg_len);
+    bool ok = channel_send(w, buf, 4 + len);
+    free(buf);
+    return ok;
+}
+
+// --- Requests in flight ---
+
+static WalkOp* find_op(SFTPWalker *w, uint32_t id) {
+    for (int i = 0; i < w->config.concurrency; i++) {
+        if (w->ops[i].state != OP_FREE && w->ops[i].id == id) return &w->ops[i];
+    }
+    return NULL;
+}
+
+static void finish_op(SFTPWalker *w, WalkOp *op) {
+    sftp_free_file_list(op->files, op->count);
+    free(op->handle);
+    walk_free_job(w, op->job);
+    memset(op, 0, sizeof(*op));
+    w->in_flight--;
+}
+
+// Every request sent counts against the rate limit, READDIR and CLOSE included
+static void send_op(SFTPWalker *w, WalkOp *op, WalkOpState state, uint8_t type, const char *arg, uint32_t arg_len) {
+    walk_throttle(w);
+    op->state = state;
+    op->id = w->next_id++;
+    if (!send_request(w, type, op->id, arg, arg_len)) w->broken = true;
+}
+
+// Asks prepare what the job needs next and sends it
+static void advance_op(SFTPWalker *w, WalkOp *op, const SFTPFile *attrs) {
+    SFTPWalkStep step = w->config.prepare ? w->config.prepare(w, op->job, attrs, w->config.user_data) : SFTP_WALK_LIST;
+    if (step == SFTP_WALK_SKIP || (step == SFTP_WALK_STAT && attrs)) {
+        finish_op(w, op);
+        return;
+    }
+
+    const char *path = w->config.path(op->job);
+    if (step == SFTP_WALK_STAT) {
+        send_op(w, op, OP_STAT, SSH_FXP_STAT, path, strlen(path));
+    } else {
+        send_op(w, op, OP_OPENDIR, SSH_FXP_OPENDIR, path, strlen(path));
+    }
+}
+
+static bool append_names(WalkOp *op, Reader *r) {
+    uint32_t count;
+    if (!read_u32(r, &count)) return false;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *name, *longname;
+        uint32_t name_len, longname_len;
+        if (!read_string(r, &name, &name_len) || !read_string(r, &longname, &longname_len)) return false;
+
+        SFTPFile *f = calloc(1, sizeof(SFTPFile));
+        if (!read_attrs(r, f)) {
+            free(f);
+            return false;
+        }
+        f->name = strndup((const char *)name, name_len);
+        if (op->count >= op->capacity) {
+            op->capacity = op->capacity ? op->capacity * 2 : 64;
+            op->files = realloc(op->files, sizeof(SFTPFile*) * op->capacity);
+        }
+        op->files[op->count++] = f;
+    }
+    return true;
+}
+
+static void handle_packet(SFTPWalker *w, const uint8_t *p, uint32_t len) {
+    Reader r = { p + 1, len - 1 };
+    uint8_t type = p[0];
+    if (type == SSH_FXP_VERSION) {
+        w->ready = true;
+        return;
+    }
+
+    uint32_t id;
+    if (!read_u32(&r, &id)) {
+        w->broken = true;
+        return;
+    }
+    WalkOp *op = find_op(w, id);
+    if (!op) return;
+
+    switch (op->state) {
+    case OP_STAT: {
+        SFTPFile attrs;
+        memset(&attrs, 0, sizeof(attrs));
+        if (type == SSH_FXP_ATTRS && read_attrs(&r, &attrs)) {
+            advance_op(w, op, &attrs);
+        } else {
+            finish_op(w, op);
+        }
+        break;
+    }
+    case OP_OPENDIR: {
+        const uint8_t *handle;
+        uint32_t handle_len;
+        if (type != SSH_FXP_HANDLE || !read_string(&r, &handle, &handle_len)) {
+            finish_op(w, op);
+            break;
+        }
+        op->handle = malloc(handle_len ? handle_len : 1);
+        memcpy(op->handle, handle, handle_len);
+        op->handle_len = handle_len;
+        send_op(w, op, OP_READDIR, SSH_FXP_READDIR, op->handle, op->handle_len);
+        break;
+    }
+    case OP_READDIR: {
+        if (type == SSH_FXP_NAME) {
+            if (append_names(op, &r)) {
+                send_op(w, op, OP_READDIR, SSH_FXP_READDIR, op->handle, op->handle_len);
+                break;
+            }
+        } else {
+            uint32_t code;
+            if (type == SSH_FXP_STATUS && read_u32(&r, &code) && code == SSH_FX_EOF) op->listed = true;
+        }
+        // Listing complete (or failed): hand it over, then close the handle
+        if (op->listed) w->config.visit(w, op->job, op->files, op->count, w->config.user_data);
+        send_op(w, op, OP_CLOSE, SSH_FXP_CLOSE, op->handle, op->handle_len);
+        break;
+    }
+    case OP_CLOSE:
+    default:
+        finish_op(w, op);
+        break;
+    }
+}
+
+static void process_packets(SFTPWalker *w) {
+    size_t off = 0;
+    while (!w->broken && w->in_len - off >= 4) {
+        uint32_t len = get_u32(w->in + off);
+        if (len < 1 || len > WALK_MAX_PACKET) {
+            w->broken = true;
+            break;
+        }
+        if (w->in_len - off - 4 < len) break;
+        handle_packet(w, w->in + off + 4, len);
+        off += 4 + len;
+    }
+    memmove(w->in, w->in + off, w->in_len - off);
+    w->in_len -= off;
+}
+
+// Moves what arrived on the channel into the input buffer, waiting a little
+// when nothing did. False once the channel is gone.
+static bool receive(SFTPWalker *w) {
+    if (w->in_capacity - w->in_len < WALK_READ_CHUNK) {
+        w->in_capacity = w->in_len + WALK_READ_CHUNK;
+        w->in = realloc(w->in, w->in_capacity);
+    }
+
+    sftp_context_lock(w->config.ctx);
+    int nbytes = ssh_channel_read_nonblocking(w->channel, w->in + w->in_len, WALK_READ_CHUNK, 0);
+    bool gone = nbytes < 0 || (nbytes == 0 && (ssh_channel_is_eof(w->channel) || ssh_channel_is_closed(w->channel)));
+    sftp_context_unlock(w->config.ctx);
+    if (gone) return false;
+
+    if (nbytes == 0) {
+        struct pollfd pfd = { .fd = w->fd, .events = POLLIN };
+        poll(&pfd, 1, WALK_POLL_MS);
+    }
+    w->in_len += nbytes;
+    return true;
+}
+
+static bool open_channel(SFTPWalker *w) {
+    SFTPContext *ctx = w->config.ctx;
+    sftp_context_lock(ctx);
+    ssh_session session = ctx->ssh_ctx->session;
+    w->channel = ssh_channel_new(session);
+    bool ok = w->channel &&
+              ssh_channel_open_session(w->channel) == SSH_OK &&
+              ssh_channel_request_subsystem(w->channel, "sftp") == SSH_OK;
+    w->fd = ssh_get_fd(session);
+    sftp_context_unlock(ctx);
+    if (!ok) return false;
+
+    uint8_t init[9];
+    put_u32(init, 5);
+    init[4] = SSH_FXP_INIT;
+    put_u32(init + 5, WALK_SFTP_VERSION);
+    return channel_send(w, init, sizeof(init));
+}
+
+static void close_channel(SFTPWalker *w) {
+    if (!w->channel) return;
+    sftp_context_lock(w->config.ctx);
+    ssh_channel_close(w->channel);
+    ssh_channel_free(w->channel);
+    sftp_context_unlock(w->config.ctx);
+    w->channel = NULL;
+}
+
+static SFTPWalkStatus walk_pipelined(SFTPWalker *w) {
+    if (open_channel(w)) {
+        while (!w->ready && !w->broken && !sftp_walk_is_cancelled(w)) {
+            if (receive(w)) process_packets(w);
+            else w->broken = true;
+        }
+    } else {
+        w->broken = true;
+    }
+
+    while (w->ready && !w->broken && !sftp_walk_is_cancelled(w)) {
+        for (int i = 0; i < w->config.concurrency && !w->broken; i++) {
+            if (w->ops[i].state != OP_FREE) continue;
+            void *job = queue_pop(w);
+            if (!job) break;
+            w->ops[i].job = job;
+            w->in_flight++;
+            advance_op(w, &w->ops[i], NULL);
+        }
+        // Jobs skipped by prepare leave slots free, nothing in flight means nothing queued
+        if (w->in_flight == 0) break;
+
+        if (receive(w)) process_packets(w);
+        else w->broken = true;
+    }
+
+    SFTPWalkStatus status = sftp_walk_is_cancelled(w) ? SFTP_WALK_CANCELLED :
+                            w->broken ? SFTP_WALK_FAILED : SFTP_WALK_DONE;
+    // Replies still due are dropped with the channel
+    for (int i = 0; i < w->config.concurrency; i++) {
+        if (w->ops[i].state != OP_FREE) finish_op(w, &w->ops[i]);
+    }
+    close_channel(w);
+    free(w->in);
+    w->in = NULL;
+    return status;
+}
+
+// Fallback transports: one listing at a time, and no stat (such jobs are listed
+// right away)
+static SFTPWalkStatus walk_sequential(SFTPWalker *w) {
+    void *job;
+    while (!sftp_walk_is_cancelled(w) && (job = queue_pop(w)) != NULL) {
+        SFTPWalkStep step = w->config.prepare ? w->config.prepare(w, job, NULL, w->config.user_data) : SFTP_WALK_LIST;
+        if (step != SFTP_WALK_SKIP) {
+            walk_throttle(w);
+            int count = 0;
+            sftp_context_lock(w->config.ctx);
+            SFTPFile **files = sftp_list_directory(w->config.ctx, w->config.path(job), &count);
+            sftp_context_unlock(w->config.ctx);
+            if (files) w->config.visit(w, job, files, count, w->config.user_data);
+            sftp_free_file_list(files, count);
+        }
+        walk_free_job(w, job);
+    }
+    return sftp_walk_is_cancelled(w) ? SFTP_WALK_CANCELLED : SFTP_WALK_DONE;
+}
+
+static void walker_destroy(SFTPWalker *w) {
+    free(w->queue);
+    pthread_mutex_destroy(&w->lock);
+    free(w);
+}
+
+static void walk_end(SFTPWalker *w, SFTPWalkStatus status) {
+    void *job;
+    while ((job = queue_pop(w)) != NULL) walk_free_job(w, job);
+    if (w->config.done) w->config.done(w, status, w->config.user_data);
+    sftp_context_unref(w->config.ctx);
+}
+
+static void* walk_thread_func(void *arg) {
+    SFTPWalker *w = (SFTPWalker *)arg;
+    trace_set_thread_name("sftp-walk");
+
+    SFTPWalkStatus status = w->config.ctx->transport == SFTP_TRANSPORT_SFTP ? walk_pipelined(w) : walk_sequential(w);
+    walk_end(w, status);
+
+    pthread_mutex_lock(&w->lock);
+    w->finished = true;
+    bool detached = w->detached;
+    pthread_mutex_unlock(&w->lock);
+    if (detached) walker_destroy(w);
+    return NULL;
+}
+
+SFTPWalker* sftp_walk_start(const SFTPWalkConfig *config, void *root_job) {
+    if (!config || !config->ctx || !config->ctx->is_initialized || !config->path || !config->visit) return NULL;
+
+    SFTPWalker *w = calloc(1, sizeof(SFTPWalker));
+    w->config = *config;
+    if (w->config.concurrency < 1) w->config.concurrency = 1;
+    if (w->config.concurrency > WALK_MAX_CONCURRENCY) w->config.concurrency = WALK_MAX_CONCURRENCY;
+    w->next_id = 1;
+    sftp_context_ref(w->config.ctx);
+
+    pthread_mutex_init(&w->lock, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &w->next_slot);
+
+    queue_push_locked(w, root_job);
+
+    if (pthread_create(&w->thread, NULL, walk_thread_func, w) == 0) {
+        w->has_thread = true;
+    } else {
+        walk_end(w, SFTP_WALK_FAILED);
+        w->finished = true;
+    }
+    return w;
+}
+
+void sftp_walk_push(SFTPWalker *walker, void *job) {
+    pthread_mutex_lock(&walker->lock);
+    queue_push_locked(walker, job);
+    pthread_mutex_unlock(&walker->lock);
+}
+
+bool sftp_walk_is_cancelled(SFTPWalker *walker) {
+    pthread_mutex_lock(&walker->lock);
+    bool cancelled = walker->cancelled;
+    pthread_mutex_unlock(&walker->lock);
+    return cancelled;
+}
+
+void sftp_walk_cancel(SFTPWalker *walker) {
+    if (!walker) return;
+    pthread_mutex_lock(&walker->lock);
+    walker->cancelled = true;
+    pthread_mutex_unlock(&walker->lock);
+}
+
+void sftp_walk_free(SFTPWalker *walker) {
+    if (!walker) return;
+    pthread_mutex_lock(&walker->lock);
+    walker->cancelled = true;
+    if (!walker->finished) {
+        walker->detached = true;
+        pthread_detach(walker->thread);
+        pthread_mutex_unlock(&walker->lock);
+        return;
+    }
+    pthread_mutex_unlock(&walker->lock);
+
+    if (walker->has_thread) pthread_join(walker->thread, NULL);
+    walker_destroy(walker);
+}
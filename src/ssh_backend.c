@@ -1,24 +1,39 @@
+#define _GNU_SOURCE
 #include "ssh_backend.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <glob.h>
+#include <fnmatch.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <pthread.h>
+#include <poll.h>
+#include <netdb.h>
+#include <time.h>
 
 void ssh_proxy_poll(SSHContext* ctx);
 int ssh_open_shell(SSHContext* ctx);
 
 SSHContext* ssh_context_new() {
-    SSHContext* ctx = malloc(sizeof(SSHContext));
+    SSHContext* ctx = calloc(1, sizeof(SSHContext));
     ctx->session = ssh_new();
     ctx->channel = NULL;
     ctx->is_connected = false;
     ctx->proxy_session = NULL;
     ctx->proxy_channel = NULL;
     ctx->proxy_fd = -1;
+    connect_timing_reset(&ctx->timing);
+    ctx->error[0] = '\0';
+    latency_histogram_reset(&ctx->echo);
+    pthread_mutex_init(&ctx->echo_lock, NULL);
     if (ctx->session == NULL) {
+        pthread_mutex_destroy(&ctx->echo_lock);
         free(ctx);
         return NULL;
     }
@@ -49,21 +64,250 @@ void ssh_context_free(SSHContext* ctx) {
             ssh_free(ctx->proxy_session);
         }
         
+        pthread_mutex_destroy(&ctx->echo_lock);
         free(ctx);
     }
 }
 
-static int authenticate_session(ssh_session session, const char* password) {
+#define CONNECT_TIMEOUT_MS 10000
+
+// Times the phases of one connection attempt, each one ends when the next begins
+typedef struct {
+    ConnectTiming *timing;
+    int phase;              // Running phase, -1 for none
+    int64_t phase_start;
+    int64_t start;
+    const char *host;
+} PhaseClock;
+
+static void phase_enter(PhaseClock *clock, int phase) {
+    int64_t now = trace_now_us();
+    if (clock->phase >= 0) {
+        clock->timing->phase_us[clock->phase] = now - clock->phase_start;
+        trace_span_record("connect", connect_phase_name(clock->phase), clock->phase_start, now - clock->phase_start, NULL);
+    }
+    clock->phase = phase;
+    clock->phase_start = now;
+}
+
+// Ends the attempt, a failure is blamed on the running phase
+static int phase_finish(PhaseClock *clock, int rc) {
+    if (rc != 0) clock->timing->failed_phase = clock->phase;
+    phase_enter(clock, -1);
+    clock->timing->total_us = trace_now_us() - clock->start;
+
+    trace_span_record("connect", "connect", clock->start, clock->timing->total_us, clock->host);
+
+    char phases[256];
+    connect_timing_format(clock->timing, phases, sizeof(phases));
+    if (rc == 0) LOG_INFO("ssh", "Connected to %s after %.1f ms (%s)", clock->host, clock->timing->total_us / 1000.0, phases);
+    else LOG_WARN("ssh", "Connection to %s failed after %.1f ms (%s)", clock->host, clock->timing->total_us / 1000.0, phases);
+    return rc;
+}
+
+static int authenticate_session(ssh_session session, const char* password, ConnectTiming *timing) {
+    int64_t start = trace_now_us();
     int rc = ssh_userauth_publickey_auto(session, NULL, NULL);
-    if (rc == SSH_AUTH_SUCCESS) return 0;
+    if (timing) timing->publickey_us = trace_now_us() - start;
+    if (rc == SSH_AUTH_SUCCESS) {
+        if (timing) snprintf(timing->auth_method, sizeof(timing->auth_method), "publickey");
+        return 0;
+    }
 
     if (password && password[0] != '\0') {
         rc = ssh_userauth_password(session, NULL, password);
-        if (rc == SSH_AUTH_SUCCESS) return 0;
+        if (rc == SSH_AUTH_SUCCESS) {
+            if (timing) snprintf(timing->auth_method, sizeof(timing->auth_method), "password");
+            return 0;
+        }
     }
     return -1;
 }
 
+// Non-blocking connect bounded by CONNECT_TIMEOUT_MS. The socket is returned blocking.
+static int connect_with_timeout(const struct addrinfo *ai) {
+    int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+    if (fd < 0) return -1;
+    int flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+        int err = errno;
+        if (err == EINPROGRESS) {
+            struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+            socklen_t len = sizeof(err);
+            if (poll(&pfd, 1, CONNECT_TIMEOUT_MS) != 1) err = ETIMEDOUT;
+            else if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) err = errno;
+        }
+        if (err != 0) {
+            close(fd);
+            errno = err;
+            return -1;
+        }
+    }
+    fcntl(fd, F_SETFL, flags);
+    return fd;
+}
+
+#define CONFIG_INCLUDE_DEPTH 16
+
+typedef enum {
+    PROXY_UNSET,
+    PROXY_NONE,
+    PROXY_SET
+} ProxySetting;
+
+// Host line patterns, negated ones exclude
+static bool host_matches(const char *host, char *patterns) {
+    bool matched = false;
+    char *save = NULL;
+    for (char *p = strtok_r(patterns, " \t,", &save); p; p = strtok_r(NULL, " \t,", &save)) {
+        bool negate = p[0] == '!';
+        if (fnmatch(negate ? p + 1 : p, host, FNM_CASEFOLD) != 0) continue;
+        if (negate) return false;
+        matched = true;
+    }
+    return matched;
+}
+
+static ProxySetting scan_ssh_config(const char *path, const char *base, const char *host, int depth);
+
+static ProxySetting scan_includes(char *files, const char *base, const char *host, int depth) {
+    if (depth >= CONFIG_INCLUDE_DEPTH) return PROXY_UNSET;
+    const char *home = getenv("HOME");
+    ProxySetting result = PROXY_UNSET;
+    char *save = NULL;
+    for (char *f = strtok_r(files, " \t", &save); f && result == PROXY_UNSET; f = strtok_r(NULL, " \t", &save)) {
+        char pattern[4096];
+        if (f[0] == '~' && f[1] == '/' && home) snprintf(pattern, sizeof(pattern), "%s%s", home, f + 1);
+        else if (f[0] != '/') snprintf(pattern, sizeof(pattern), "%s/%s", base, f);
+        else snprintf(pattern, sizeof(pattern), "%s", f);
+
+        glob_t g;
+        if (glob(pattern, 0, NULL, &g) != 0) continue;
+        for (size_t i = 0; i < g.gl_pathc && result == PROXY_UNSET; i++) {
+            result = scan_ssh_config(g.gl_pathv[i], base, host, depth + 1);
+        }
+        globfree(&g);
+    }
+    return result;
+}
+
+// First ProxyJump or ProxyCommand that applies to host, as ssh keeps the first
+// value. Match criteria are not evaluated: a proxy under Match counts, a "none"
+// there does not.
+static ProxySetting scan_ssh_config(const char *path, const char *base, const char *host, int depth) {
+    FILE *f = fopen(path, "r");
+    if (!f) return PROXY_UNSET;
+
+    ProxySetting result = PROXY_UNSET;
+    bool applies = true; // Before the first Host line
+    bool in_match = false;
+    char line[4096];
+    while (result == PROXY_UNSET && fgets(line, sizeof(line), f)) {
+        char *save = NULL;
+        char *key = strtok_r(line, " \t\r\n=", &save);
+        char *value = key ? strtok_r(NULL, "\r\n", &save) : NULL;
+        if (!key || key[0] == '#' || !value) continue;
+        while (*value == ' ' || *value == '\t' || *value == '=') value++;
+        if (!*value) continue;
+
+        if (strcasecmp(key, "Host") == 0) {
+            applies = host_matches(host, value);
+            in_match = false;
+        } else if (strcasecmp(key, "Match") == 0) {
+            applies = true;
+            in_match = true;
+        } else if (!applies) {
+            continue;
+        } else if (strcasecmp(key, "Include") == 0) {
+            result = scan_includes(value, base, host, depth);
+        } else if (strcasecmp(key, "ProxyJump") == 0 || strcasecmp(key, "ProxyCommand") == 0) {
+            bool none = strncasecmp(value, "none", 4) == 0 && (value[4] == '\0' || isspace((unsigned char)value[4]));
+            if (!none) result = PROXY_SET;
+            else if (!in_match) result = PROXY_NONE;
+        }
+    }
+    fclose(f);
+    return result;
+}
+
+// libssh 0.11 runs a ProxyJump from ssh_config itself and offers no way to read
+// it back, so the config files are checked here for any proxy of the host
+bool ssh_config_has_proxy(const char *host) {
+    ProxySetting setting = PROXY_UNSET;
+    const char *home = getenv("HOME");
+    if (home) {
+        char base[4096];
+        char path[4200];
+        snprintf(base, sizeof(base), "%s/.ssh", home);
+        snprintf(path, sizeof(path), "%s/config", base);
+        setting = scan_ssh_config(path, base, host, 0);
+    }
+    if (setting == PROXY_UNSET) setting = scan_ssh_config("/etc/ssh/ssh_config", "/etc/ssh", host, 0);
+    return setting == PROXY_SET;
+}
+
+// Resolves and connects the session's socket here instead of in ssh_connect, so
+// DNS and TCP are timed apart from the key exchange. Host and port are read
+// back after ~/.ssh/config is applied; a host with a ProxyCommand or ProxyJump
+// is left to libssh.
+static int open_session_socket(SSHContext* ctx, PhaseClock *clock, ssh_session session) {
+    // Host patterns match the name as given, before a HostName replaces it
+    char *alias = NULL;
+    ssh_options_get(session, SSH_OPTIONS_HOST, &alias);
+    ssh_options_parse_config(session, NULL);
+
+    char *proxy_command = NULL;
+    bool proxied = ssh_options_get(session, SSH_OPTIONS_PROXYCOMMAND, &proxy_command) == SSH_OK;
+    ssh_string_free_char(proxy_command);
+    if (!proxied && alias) proxied = ssh_config_has_proxy(alias);
+    ssh_string_free_char(alias);
+    if (proxied) return 0;
+
+    char *host = NULL;
+    unsigned int port = 22;
+    if (ssh_options_get(session, SSH_OPTIONS_HOST, &host) != SSH_OK) {
+        snprintf(ctx->error, sizeof(ctx->error), "No host name");
+        return -1;
+    }
+    ssh_options_get_port(session, &port);
+
+    char service[16];
+    snprintf(service, sizeof(service), "%u", port);
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+    struct addrinfo *res = NULL;
+
+    phase_enter(clock, CONNECT_PHASE_DNS);
+    int rc = getaddrinfo(host, service, &hints, &res);
+    if (rc != 0) {
+        snprintf(ctx->error, sizeof(ctx->error), "Could not resolve %s: %s", host, gai_strerror(rc));
+        ssh_string_free_char(host);
+        return -1;
+    }
+
+    // Addresses in the resolver's order, as ssh does
+    phase_enter(clock, CONNECT_PHASE_TCP);
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = connect_with_timeout(ai);
+    }
+    freeaddrinfo(res);
+    if (fd < 0) {
+        snprintf(ctx->error, sizeof(ctx->error), "Could not connect to %s port %u: %s", host, port, strerror(errno));
+        ssh_string_free_char(host);
+        return -1;
+    }
+    ssh_string_free_char(host);
+
+    // The session owns the socket from now on
+    ssh_options_set(session, SSH_OPTIONS_FD, &fd);
+    return 0;
+}
+
 typedef struct {
     SSHContext* ctx;
     volatile bool running;
@@ -71,6 +315,7 @@ typedef struct {
 
 static void* proxy_pump_thread_func(void* arg) {
     PumpArgs* args = (PumpArgs*)arg;
+    trace_set_thread_name("ssh-proxy-pump");
     while (args->running) {
         ssh_proxy_poll(args->ctx);
         usleep(1000);
@@ -83,17 +328,22 @@ int ssh_connect_to_server(SSHContext* ctx, const char* hostname, int port, const
                           bool open_shell_flag) {
     if (!ctx || !ctx->session) return -1;
 
+    connect_timing_reset(&ctx->timing);
+    ctx->timing.started_at = time(NULL);
+    ctx->error[0] = '\0';
+    PhaseClock clock = { &ctx->timing, -1, 0, trace_now_us(), hostname };
+
     ssh_options_set(ctx->session, SSH_OPTIONS_HOST, hostname);
     ssh_options_set(ctx->session, SSH_OPTIONS_PORT, &port);
     
-    printf("Connecting to %s:%d\n", hostname, port);
+    LOG_DEBUG("ssh", "Connecting to %s:%d", hostname, port);
 
     if (proxy_hostname && proxy_hostname[0] != '\0') {
-        printf("Using proxy %s:%d\n", proxy_hostname, proxy_port);
+        LOG_DEBUG("ssh", "Using proxy %s:%d", proxy_hostname, proxy_port);
         ctx->proxy_session = ssh_new();
         if (!ctx->proxy_session) {
-            printf("Failed to create proxy session\n");
-            return -1;
+            LOG_ERROR("ssh", "Failed to create proxy session");
+            return phase_finish(&clock, -1);
         }
         
         ssh_options_set(ctx->proxy_session, SSH_OPTIONS_HOST, proxy_hostname);
@@ -103,31 +353,35 @@ int ssh_connect_to_server(SSHContext* ctx, const char* hostname, int port, const
             ssh_options_set(ctx->proxy_session, SSH_OPTIONS_IDENTITY, proxy_key_path);
         }
         
+        if (open_session_socket(ctx, &clock, ctx->proxy_session) != 0) {
+            LOG_ERROR("ssh", "Failed to connect to proxy: %s", ctx->error);
+            return phase_finish(&clock, -1);
+        }
+        phase_enter(&clock, CONNECT_PHASE_PROXY);
         if (ssh_connect(ctx->proxy_session) != SSH_OK) {
-            printf("Failed to connect to proxy: %s\n", ssh_get_error(ctx->proxy_session));
-            return -1;
+            snprintf(ctx->error, sizeof(ctx->error), "Jump host: %s", ssh_get_error(ctx->proxy_session));
+            LOG_ERROR("ssh", "Failed to connect to proxy: %s", ssh_get_error(ctx->proxy_session));
+            return phase_finish(&clock, -1);
         }
-        if (authenticate_session(ctx->proxy_session, proxy_password) != 0) {
-            printf("Failed to authenticate to proxy\n");
-            return -1;
+        if (authenticate_session(ctx->proxy_session, proxy_password, NULL) != 0) {
+            snprintf(ctx->error, sizeof(ctx->error), "Jump host: authentication failed");
+            LOG_ERROR("ssh", "Failed to authenticate to proxy");
+            return phase_finish(&clock, -1);
         }
-        
-        printf("Proxy connected and authenticated\n");
 
         ctx->proxy_channel = ssh_channel_new(ctx->proxy_session);
-        if (!ctx->proxy_channel) return -1;
+        if (!ctx->proxy_channel) return phase_finish(&clock, -1);
         
         if (ssh_channel_open_forward(ctx->proxy_channel, hostname, port, "localhost", 0) != SSH_OK) {
-            printf("Failed to open forward channel: %s\n", ssh_get_error(ctx->proxy_session));
-            return -1;
+            snprintf(ctx->error, sizeof(ctx->error), "Jump host: %s", ssh_get_error(ctx->proxy_session));
+            LOG_ERROR("ssh", "Failed to open forward channel: %s", ssh_get_error(ctx->proxy_session));
+            return phase_finish(&clock, -1);
         }
-        
-        printf("Forward channel opened\n");
 
         int sv[2];
         if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
-            perror("socketpair");
-            return -1;
+            LOG_ERROR("ssh", "socketpair: %s", strerror(errno));
+            return phase_finish(&clock, -1);
         }
         
         fcntl(sv[0], F_SETFL, O_NONBLOCK);
@@ -144,45 +398,50 @@ int ssh_connect_to_server(SSHContext* ctx, const char* hostname, int port, const
         ssh_options_set(ctx->session, SSH_OPTIONS_IDENTITY, key_path);
     }
 
+    if (ctx->proxy_fd == -1 && open_session_socket(ctx, &clock, ctx->session) != 0) {
+        LOG_ERROR("ssh", "Connection failed: %s", ctx->error);
+        return phase_finish(&clock, -1);
+    }
+
     pthread_t thread;
     PumpArgs args = {ctx, true};
     if (ctx->proxy_fd != -1) {
-        printf("Starting proxy pump thread\n");
         pthread_create(&thread, NULL, proxy_pump_thread_func, &args);
     }
 
-    printf("Connecting to target session...\n");
+    phase_enter(&clock, CONNECT_PHASE_KEX);
     int rc = ssh_connect(ctx->session);
-    printf("ssh_connect returned %d\n", rc);
     
     if (rc == SSH_OK) {
-        if (authenticate_session(ctx->session, password) == 0) {
+        phase_enter(&clock, CONNECT_PHASE_AUTH);
+        if (authenticate_session(ctx->session, password, &ctx->timing) == 0) {
             ctx->is_connected = true;
+            atomic_store(&ctx->stats.connected_at_us, trace_now_us());
             rc = 0;
             
             if (open_shell_flag) {
+                phase_enter(&clock, CONNECT_PHASE_CHANNEL);
                 if (ssh_open_shell(ctx) != 0) {
-                    printf("Failed to open shell\n");
+                    LOG_ERROR("ssh", "Failed to open shell");
                     rc = -1;
                     ctx->is_connected = false;
                 }
             }
         } else {
-            printf("Authentication failed\n");
+            LOG_ERROR("ssh", "Authentication failed");
             rc = -1;
         }
     } else {
-        printf("Connection failed: %s\n", ssh_get_error(ctx->session));
+        LOG_ERROR("ssh", "Connection failed: %s", ssh_get_error(ctx->session));
         rc = -1;
     }
 
     if (ctx->proxy_fd != -1) {
-        printf("Stopping proxy pump thread\n");
         args.running = false;
         pthread_join(thread, NULL);
     }
 
-    return rc;
+    return phase_finish(&clock, rc);
 }
 
 void ssh_proxy_poll(SSHContext* ctx) {
@@ -239,16 +498,223 @@ int ssh_open_shell(SSHContext* ctx) {
 
 int ssh_read_nonblocking(SSHContext* ctx, char* buffer, size_t max_len) {
     if (!ctx || !ctx->channel) return -1;
-    return ssh_channel_read_nonblocking(ctx->channel, buffer, max_len, 0);
+    int nbytes = ssh_channel_read_nonblocking(ctx->channel, buffer, max_len, 0);
+
+    SSHStats *st = &ctx->stats;
+    ssh_stats_add(&st->polls, 1);
+    if (nbytes > 0) {
+        ssh_stats_add(&st->reads, 1);
+        ssh_stats_add(&st->bytes_in, nbytes);
+        int64_t sent = atomic_exchange_explicit(&st->keystroke_at_us, 0, memory_order_relaxed);
+        if (sent > 0) {
+            int64_t rtt = trace_now_us() - sent;
+            atomic_store_explicit(&st->echo_last_us, rtt, memory_order_relaxed);
+            ssh_stats_add(&st->echo_sum_us, rtt);
+            ssh_stats_add(&st->echo_samples, 1);
+            pthread_mutex_lock(&ctx->echo_lock);
+            latency_histogram_record(&ctx->echo, rtt);
+            pthread_mutex_unlock(&ctx->echo_lock);
+        }
+    }
+    return nbytes;
 }
 
 int ssh_write_data(SSHContext* ctx, const char* buffer, size_t len) {
     if (!ctx || !ctx->channel) return -1;
-    return ssh_channel_write(ctx->channel, buffer, len);
+
+    SSHStats *st = &ctx->stats;
+    int depth = atomic_fetch_add_explicit(&st->write_queue, 1, memory_order_relaxed) + 1;
+    int max = atomic_load_explicit(&st->write_queue_max, memory_order_relaxed);
+    while (depth > max && !atomic_compare_exchange_weak_explicit(&st->write_queue_max, &max, depth, memory_order_relaxed, memory_order_relaxed)) {
+    }
+
+    // ssh_channel_write blocks until the peer opens its window wide enough
+    bool stalled = ssh_channel_window_size(ctx->channel) < len;
+    int64_t start = stalled ? trace_now_us() : 0;
+    int rc = ssh_channel_write(ctx->channel, buffer, len);
+    if (stalled) {
+        ssh_stats_add(&st->window_stalls, 1);
+        ssh_stats_add(&st->stall_us, trace_now_us() - start);
+    }
+
+    atomic_fetch_sub_explicit(&st->write_queue, 1, memory_order_relaxed);
+    ssh_stats_add(&st->writes, 1);
+    if (rc > 0) ssh_stats_add(&st->bytes_out, rc);
+    return rc;
+}
+
+void ssh_stats_keystroke(SSHContext* ctx) {
+    if (!ctx) return;
+    // Only the first key of a burst is timed, until its echo comes back
+    int64_t none = 0;
+    atomic_compare_exchange_strong_explicit(&ctx->stats.keystroke_at_us, &none, trace_now_us(), memory_order_relaxed, memory_order_relaxed);
+}
+
+void ssh_stats_echo_histogram(SSHContext* ctx, LatencyHistogram* out) {
+    if (!ctx) {
+        latency_histogram_reset(out);
+        return;
+    }
+    pthread_mutex_lock(&ctx->echo_lock);
+    *out = ctx->echo;
+    pthread_mutex_unlock(&ctx->echo_lock);
+}
+
+void ssh_stats_snapshot(SSHContext* ctx, SSHStatsSnapshot* out) {
+    memset(out, 0, sizeof(*out));
+    out->echo_last_us = -1;
+    out->echo_avg_us = -1;
+    if (!ctx) return;
+
+    SSHStats *st = &ctx->stats;
+    int64_t connected = atomic_load_explicit(&st->connected_at_us, memory_order_relaxed);
+    out->uptime_us = connected > 0 ? trace_now_us() - connected : 0;
+    out->bytes_in = atomic_load_explicit(&st->bytes_in, memory_order_relaxed);
+    out->bytes_out = atomic_load_explicit(&st->bytes_out, memory_order_relaxed);
+    out->polls = atomic_load_explicit(&st->polls, memory_order_relaxed);
+    out->reads = atomic_load_explicit(&st->reads, memory_order_relaxed);
+    out->feeds = atomic_load_explicit(&st->feeds, memory_order_relaxed);
+    out->writes = atomic_load_explicit(&st->writes, memory_order_relaxed);
+    out->write_queue = atomic_load_explicit(&st->write_queue, memory_order_relaxed);
+    out->write_queue_max = atomic_load_explicit(&st->write_queue_max, memory_order_relaxed);
+    out->window_stalls = atomic_load_explicit(&st->window_stalls, memory_order_relaxed);
+    out->stall_us = atomic_load_explicit(&st->stall_us, memory_order_relaxed);
+    out->echo_samples = atomic_load_explicit(&st->echo_samples, memory_order_relaxed);
+    if (out->echo_samples > 0) {
+        out->echo_last_us = atomic_load_explicit(&st->echo_last_us, memory_order_relaxed);
+        out->echo_avg_us = (int64_t)(atomic_load_explicit(&st->echo_sum_us, memory_order_relaxed) / out->echo_samples);
+    }
+}
+
+char* ssh_stats_json(const SSHStatsSnapshot* s) {
+    // Every field at its widest still fits
+    char *json = malloc(768);
+    if (json) snprintf(json, 768,
+                 "{\"uptime_us\":%lld,\"bytes_in\":%llu,\"bytes_out\":%llu,\"polls\":%llu,\"reads\":%llu,"
+                 "\"feeds\":%llu,\"writes\":%llu,\"write_queue\":%d,\"write_queue_max\":%d,"
+                 "\"window_stalls\":%llu,\"stall_us\":%llu,\"echo_last_us\":%lld,\"echo_avg_us\":%lld,\"echo_samples\":%llu}",
+                 (long long)s->uptime_us, (unsigned long long)s->bytes_in, (unsigned long long)s->bytes_out,
+                 (unsigned long long)s->polls, (unsigned long long)s->reads, (unsigned long long)s->feeds,
+                 (unsigned long long)s->writes, s->write_queue, s->write_queue_max,
+                 (unsigned long long)s->window_stalls, (unsigned long long)s->stall_us,
+                 (long long)s->echo_last_us, (long long)s->echo_avg_us, (unsigned long long)s->echo_samples);
+    return json;
+}
+
+// Wraps s in single quotes for a POSIX shell
+char* ssh_shell_quote(const char *s) {
+    size_t len = 2;
+    for (const char *c = s; *c; c++) len += (*c == '\'') ? 4 : 1;
+    char *out = malloc(len + 1);
+    char *o = out;
+    *o++ = '\'';
+    for (const char *c = s; *c; c++) {
+        if (*c == '\'') {
+            memcpy(o, "'\\''", 4);
+            o += 4;
+        } else {
+            *o++ = *c;
+        }
+    }
+    *o++ = '\'';
+    *o = '\0';
+    return out;
+}
+
+ssh_channel ssh_exec_open(SSHContext* ctx, const char* command) {
+    if (!ctx || !ctx->session || !ctx->is_connected || !command) return NULL;
+
+    ssh_channel channel = ssh_channel_new(ctx->session);
+    if (channel == NULL) return NULL;
+
+    if (ssh_channel_open_session(channel) != SSH_OK) {
+        ssh_channel_free(channel);
+        return NULL;
+    }
+
+    if (ssh_channel_request_exec(channel, command) != SSH_OK) {
+        ssh_channel_close(channel);
+        ssh_channel_free(channel);
+        return NULL;
+    }
+    return channel;
+}
+
+// Reads stdout and stderr in turns until the command is done. Reading one
+// stream to the end first stalls a command that fills the other one, since its
+// data is never consumed and the channel window stays closed.
+static int read_exec_streams(ssh_channel channel, SSHExecOutputFunc on_stdout, void* user_data) {
+    char buffer[16384];
+
+    while (!ssh_channel_is_eof(channel) && !ssh_channel_is_closed(channel)) {
+        bool got_data = false;
+        for (int is_stderr = 0; is_stderr <= 1; is_stderr++) {
+            int nbytes = ssh_channel_read_nonblocking(channel, buffer, sizeof(buffer), is_stderr);
+            if (nbytes == SSH_EOF) continue;
+            if (nbytes < 0) return -1;
+            if (nbytes == 0) continue;
+            got_data = true;
+            if (!is_stderr && on_stdout && on_stdout(buffer, (size_t)nbytes, user_data) != 0) return -1;
+        }
+        // Waiting on stdout also processes incoming stderr packets
+        if (!got_data && ssh_channel_poll_timeout(channel, 50, 0) == SSH_ERROR) return -1;
+    }
+    return 0;
+}
+
+static int finish_exec(ssh_channel channel) {
+    ssh_channel_send_eof(channel);
+    int status = ssh_channel_get_exit_status(channel);
+    ssh_channel_close(channel);
+    ssh_channel_free(channel);
+    return status;
+}
+
+int ssh_exec_read(ssh_channel channel, SSHExecOutputFunc on_stdout, void* user_data) {
+    if (!channel) return -1;
+    return read_exec_streams(channel, on_stdout, user_data);
+}
+
+int ssh_exec_close(ssh_channel channel) {
+    if (!channel) return -1;
+
+    // Drain both streams so the exit status can arrive
+    read_exec_streams(channel, NULL, NULL);
+    return finish_exec(channel);
+}
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t used;
+} ExecOutput;
+
+// Keeps what fits, the rest of the output is read and dropped
+static int copy_exec_output(const char* data, size_t len, void* user_data) {
+    ExecOutput* out = (ExecOutput*)user_data;
+    if (out->used + 1 >= out->len) return 0;
+    size_t n = len < out->len - out->used - 1 ? len : out->len - out->used - 1;
+    memcpy(out->data + out->used, data, n);
+    out->used += n;
+    out->data[out->used] = '\0';
+    return 0;
+}
+
+int ssh_exec_command(SSHContext* ctx, const char* command, char* output, size_t output_len) {
+    if (output && output_len > 0) output[0] = '\0';
+
+    ssh_channel channel = ssh_exec_open(ctx, command);
+    if (channel == NULL) return -1;
+
+    ExecOutput out = { output, output ? output_len : 0, 0 };
+    int rc = read_exec_streams(channel, copy_exec_output, &out);
+    int status = finish_exec(channel);
+    return rc < 0 ? -1 : status;
 }
 
 const char* ssh_get_error_msg(SSHContext* ctx) {
     if (!ctx || !ctx->session) return "No session";
+    if (ctx->error[0] != '\0') return ctx->error;
     return ssh_get_error(ctx->session);
 }
 
@@ -1,10 +1,29 @@
+#define _GNU_SOURCE
 #include "ssh_sftp.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#define TRANSFER_CHUNK_SIZE 16384
+#define SPARSE_BLOCK_SIZE 4096
+
+// Remote-to-remote copies keep at most PIPELINE_DEPTH chunks in memory and as
+// many read (and write, with libssh >= 0.11) requests in flight.
+#define PIPELINE_CHUNK_SIZE 32768
+#define PIPELINE_DEPTH 16
+
+// Fallback transports for servers without the SFTP subsystem
+static int probe_fallback_transport(SFTPContext *ctx);
+static SFTPFile** exec_list_directory(SFTPContext *ctx, const char *path, int *count);
+static int fallback_download_file(SFTPContext *ctx, const char *remote_path, const char *local_path);
+static int fallback_upload_file(SFTPContext *ctx, const char *local_path, const char *remote_path);
+static int exec_simple(SFTPContext *ctx, const char *format, const char *path);
 
 SFTPContext* sftp_context_new(SSHContext *ssh_ctx) {
     if (!ssh_ctx || !ssh_ctx->session) return NULL;
@@ -12,19 +31,39 @@ SFTPContext* sftp_context_new(SSHContext *ssh_ctx) {
     SFTPContext *ctx = malloc(sizeof(SFTPContext));
     ctx->ssh_ctx = ssh_ctx;
     ctx->sftp = NULL;
+    ctx->transport = SFTP_TRANSPORT_SFTP;
     ctx->is_initialized = false;
+    memset(&ctx->last_transfer, 0, sizeof(ctx->last_transfer));
+    atomic_init(&ctx->refs, 1);
+    
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&ctx->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
     return ctx;
 }
 
+void sftp_context_lock(SFTPContext *ctx) {
+    if (ctx) pthread_mutex_lock(&ctx->lock);
+}
+
+void sftp_context_unlock(SFTPContext *ctx) {
+    if (ctx) pthread_mutex_unlock(&ctx->lock);
+}
+
 int sftp_init_session(SFTPContext *ctx) {
     if (!ctx || !ctx->ssh_ctx) return -1;
     
     ctx->sftp = sftp_new(ctx->ssh_ctx->session);
-    if (!ctx->sftp) return -1;
-    
-    if (sftp_init(ctx->sftp) != SSH_OK) {
+    if (ctx->sftp && sftp_init(ctx->sftp) != SSH_OK) {
         sftp_free(ctx->sftp);
         ctx->sftp = NULL;
+    }
+    
+    if (ctx->sftp) {
+        ctx->transport = SFTP_TRANSPORT_SFTP;
+    } else if (probe_fallback_transport(ctx) != 0) {
         return -1;
     }
     
@@ -37,10 +76,23 @@ void sftp_context_free(SFTPContext *ctx) {
         if (ctx->sftp) {
             sftp_free(ctx->sftp);
         }
+        pthread_mutex_destroy(&ctx->lock);
         free(ctx);
     }
 }
 
+SFTPContext* sftp_context_ref(SFTPContext *ctx) {
+    if (ctx) atomic_fetch_add(&ctx->refs, 1);
+    return ctx;
+}
+
+void sftp_context_unref(SFTPContext *ctx) {
+    if (!ctx || atomic_fetch_sub(&ctx->refs, 1) != 1) return;
+    SSHContext *ssh_ctx = ctx->ssh_ctx;
+    sftp_context_free(ctx);
+    ssh_context_free(ssh_ctx);
+}
+
 static char* format_permissions(mode_t mode) {
     char *p = malloc(11);
     strcpy(p, "----------");
@@ -59,6 +111,9 @@ static char* format_permissions(mode_t mode) {
 }
 
 SFTPFile** sftp_list_directory(SFTPContext *ctx, const char *path, int *count) {
+    if (ctx && ctx->is_initialized && ctx->transport != SFTP_TRANSPORT_SFTP && path) {
+        return exec_list_directory(ctx, path, count);
+    }
     if (!ctx || !ctx->sftp || !path) {
         *count = 0;
         return NULL;
@@ -112,9 +167,36 @@ void sftp_free_file_list(SFTPFile **files, int count) {
     free(files);
 }
 
-int sftp_download_file(SFTPContext *ctx, const char *remote_path, const char *local_path) {
+static bool is_zero_block(const char *buf, size_t len) {
+    return len == 0 || (buf[0] == 0 && memcmp(buf, buf + 1, len - 1) == 0);
+}
+
+// Writes buf to fd at the current offset, seeking over zero blocks instead of
+// writing them so the local file stays sparse.
+static int write_sparse(int fd, const char *buf, size_t len, SFTPTransferStats *stats) {
+    size_t pos = 0;
+    while (pos < len) {
+        size_t block = len - pos < SPARSE_BLOCK_SIZE ? len - pos : SPARSE_BLOCK_SIZE;
+        if (is_zero_block(buf + pos, block)) {
+            if (lseek(fd, block, SEEK_CUR) < 0) return -1;
+            stats->skipped_bytes += block;
+        } else {
+            if (write(fd, buf + pos, block) != (ssize_t)block) return -1;
+        }
+        pos += block;
+    }
+    return 0;
+}
+
+static int download_file(SFTPContext *ctx, const char *remote_path, const char *local_path) {
+    if (ctx && ctx->is_initialized && ctx->transport != SFTP_TRANSPORT_SFTP) {
+        return fallback_download_file(ctx, remote_path, local_path);
+    }
     if (!ctx || !ctx->sftp) return -1;
     
+    SFTPTransferStats *stats = &ctx->last_transfer;
+    memset(stats, 0, sizeof(*stats));
+    
     sftp_file file = sftp_open(ctx->sftp, remote_path, O_RDONLY, 0);
     if (!file) return -1;
     
@@ -124,57 +206,716 @@ int sftp_download_file(SFTPContext *ctx, const char *remote_path, const char *lo
         return -1;
     }
     
-    char buffer[16384];
+    char buffer[TRANSFER_CHUNK_SIZE];
     int nbytes, rc = 0;
     while ((nbytes = sftp_read(file, buffer, sizeof(buffer))) > 0) {
-        if (write(fd, buffer, nbytes) != nbytes) {
+        ssh_stats_add(&ctx->ssh_ctx->stats.reads, 1);
+        ssh_stats_add(&ctx->ssh_ctx->stats.bytes_in, nbytes);
+        stats->transferred_bytes += nbytes;
+        stats->total_bytes += nbytes;
+        if (write_sparse(fd, buffer, nbytes, stats) != 0) {
             rc = -1;
             break;
         }
     }
+    if (nbytes < 0) rc = -1;
+    
+    // Trailing zero blocks were skipped, extend the file to its real size
+    if (rc == 0 && ftruncate(fd, stats->total_bytes) != 0) rc = -1;
     
     close(fd);
     sftp_close(file);
     return rc;
 }
 
-int sftp_upload_file(SFTPContext *ctx, const char *local_path, const char *remote_path) {
+int sftp_download_file(SFTPContext *ctx, const char *remote_path, const char *local_path) {
+    TraceSpan span = trace_span_begin("sftp", "download");
+    int rc = download_file(ctx, remote_path, local_path);
+    trace_span_end_detail(&span, "%s, %llu bytes%s", remote_path,
+                          ctx ? (unsigned long long)ctx->last_transfer.transferred_bytes : 0ULL, rc == 0 ? "" : ", failed");
+    return rc;
+}
+
+// The context lock is taken around each request only, so a transfer on a shared
+// context leaves room for the other users between two chunks.
+static int upload_range(SFTPContext *ctx, sftp_file file, int fd, off_t start, off_t end, SFTPTransferStats *stats) {
+    sftp_context_lock(ctx);
+    int rc = sftp_seek64(file, start);
+    sftp_context_unlock(ctx);
+    if (rc != 0) return -1;
+    
+    char buffer[TRANSFER_CHUNK_SIZE];
+    off_t offset = start;
+    while (offset < end) {
+        size_t want = end - offset < (off_t)sizeof(buffer) ? (size_t)(end - offset) : sizeof(buffer);
+        ssize_t nbytes = pread(fd, buffer, want, offset);
+        if (nbytes <= 0) return -1;
+        sftp_context_lock(ctx);
+        ssize_t written = sftp_write(file, buffer, nbytes);
+        sftp_context_unlock(ctx);
+        if (written != nbytes) return -1;
+        ssh_stats_add(&ctx->ssh_ctx->stats.writes, 1);
+        ssh_stats_add(&ctx->ssh_ctx->stats.bytes_out, nbytes);
+        stats->transferred_bytes += nbytes;
+        offset += nbytes;
+    }
+    return 0;
+}
+
+static int upload_file(SFTPContext *ctx, const char *local_path, const char *remote_path, SFTPTransferStats *stats) {
+    if (ctx && ctx->is_initialized && ctx->transport != SFTP_TRANSPORT_SFTP) {
+        sftp_context_lock(ctx);
+        int rc = fallback_upload_file(ctx, local_path, remote_path);
+        if (stats != &ctx->last_transfer) *stats = ctx->last_transfer;
+        sftp_context_unlock(ctx);
+        return rc;
+    }
     if (!ctx || !ctx->sftp) return -1;
     
+    memset(stats, 0, sizeof(*stats));
+    
     int fd = open(local_path, O_RDONLY);
     if (fd < 0) return -1;
     
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    stats->total_bytes = st.st_size;
+    
+    sftp_context_lock(ctx);
     sftp_file file = sftp_open(ctx->sftp, remote_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    sftp_context_unlock(ctx);
     if (!file) {
         close(fd);
         return -1;
     }
     
-    char buffer[16384];
-    int nbytes, rc = 0;
-    while ((nbytes = read(fd, buffer, sizeof(buffer))) > 0) {
-        if (sftp_write(file, buffer, nbytes) != nbytes) {
+    // Only send the data extents, the server leaves holes where we seek past
+    int rc = 0;
+    off_t offset = 0;
+    off_t written_end = 0;
+    while (offset < st.st_size) {
+        off_t data_start = offset;
+        off_t data_end = st.st_size;
+#ifdef SEEK_DATA
+        data_start = lseek(fd, offset, SEEK_DATA);
+        if (data_start < 0) {
+            if (errno == ENXIO) break; // Only a hole is left
+            data_start = offset; // Not supported by this filesystem
+        } else {
+            data_end = lseek(fd, data_start, SEEK_HOLE);
+            if (data_end < 0) data_end = st.st_size;
+        }
+#endif
+        if (upload_range(ctx, file, fd, data_start, data_end, stats) != 0) {
             rc = -1;
             break;
         }
+        written_end = data_end;
+        offset = data_end;
     }
     
+    sftp_context_lock(ctx);
     sftp_close(file);
     close(fd);
+    
+    // A trailing hole was never written, set the remote size explicitly
+    if (rc == 0 && written_end < st.st_size) {
+        struct sftp_attributes_struct attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.flags = SSH_FILEXFER_ATTR_SIZE;
+        attr.size = st.st_size;
+        if (sftp_setstat(ctx->sftp, remote_path, &attr) != 0) rc = -1;
+    }
+    sftp_context_unlock(ctx);
+    
+    if (rc == 0) stats->skipped_bytes = stats->total_bytes - stats->transferred_bytes;
     return rc;
 }
 
+int sftp_upload_file(SFTPContext *ctx, const char *local_path, const char *remote_path) {
+    return sftp_upload_file_shared(ctx, local_path, remote_path, ctx ? &ctx->last_transfer : NULL);
+}
+
+int sftp_upload_file_shared(SFTPContext *ctx, const char *local_path, const char *remote_path, SFTPTransferStats *stats) {
+    TraceSpan span = trace_span_begin("sftp", "upload");
+    int rc = stats ? upload_file(ctx, local_path, remote_path, stats) : -1;
+    trace_span_end_detail(&span, "%s, %llu bytes%s", remote_path,
+                          stats ? (unsigned long long)stats->transferred_bytes : 0ULL, rc == 0 ? "" : ", failed");
+    return rc;
+}
+
+typedef struct {
+    char *data;
+    int len;
+} PipelineChunk;
+
+typedef struct {
+    sftp_file file;
+    SSHStats *io;
+    PipelineChunk chunks[PIPELINE_DEPTH];
+    int head;
+    int count;
+    bool eof;
+    bool failed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} CopyPipeline;
+
+typedef struct {
+    int id;
+    uint64_t offset;
+    uint32_t len;
+} PendingRead;
+
+// Collects the replies of reads still in flight so none is left queued on the
+// session. sftp_async_read returns early once the file hit EOF, a seek clears that.
+// A failed read does not stop the drain, the later replies are still due.
+static void drain_pending_reads(sftp_file file, const PendingRead *pending, int head, int count) {
+    char *scratch = malloc(PIPELINE_CHUNK_SIZE);
+    for (int i = 0; i < count; i++) {
+        sftp_seek64(file, 0);
+        sftp_async_read(file, scratch, PIPELINE_CHUNK_SIZE, pending[(head + i) % PIPELINE_DEPTH].id);
+    }
+    free(scratch);
+}
+
+// Reader side: keeps PIPELINE_DEPTH async reads in flight on the source and
+// hands completed chunks to the writer in order.
+static void* pipeline_reader_func(void *arg) {
+    CopyPipeline *p = (CopyPipeline *)arg;
+    trace_set_thread_name("sftp-copy-read");
+    PendingRead pending[PIPELINE_DEPTH];
+    int pending_head = 0, pending_count = 0;
+    uint64_t next_offset = 0;
+    bool eof = false, failed = false;
+
+    while (!failed && !eof) {
+        while (pending_count < PIPELINE_DEPTH) {
+            PendingRead *r = &pending[(pending_head + pending_count) % PIPELINE_DEPTH];
+            r->offset = next_offset;
+            r->len = PIPELINE_CHUNK_SIZE;
+            r->id = sftp_async_read_begin(p->file, PIPELINE_CHUNK_SIZE);
+            if (r->id < 0) {
+                failed = true;
+                break;
+            }
+            next_offset += PIPELINE_CHUNK_SIZE;
+            pending_count++;
+        }
+        if (failed || pending_count == 0) break;
+
+        pthread_mutex_lock(&p->lock);
+        while (p->count == PIPELINE_DEPTH && !p->failed) {
+            pthread_cond_wait(&p->not_full, &p->lock);
+        }
+        PipelineChunk *chunk = &p->chunks[(p->head + p->count) % PIPELINE_DEPTH];
+        bool aborted = p->failed;
+        pthread_mutex_unlock(&p->lock);
+        if (aborted) break;
+
+        PendingRead *r = &pending[pending_head];
+        pending_head = (pending_head + 1) % PIPELINE_DEPTH;
+        pending_count--;
+
+        int nbytes = sftp_async_read(p->file, chunk->data, r->len, r->id);
+        if (nbytes < 0) {
+            failed = true;
+            break;
+        }
+        if (nbytes == 0) {
+            eof = true;
+            break;
+        }
+        if ((uint32_t)nbytes < r->len && pending_count > 0) {
+            // Short read in the middle of the file: fetch the gap synchronously
+            // so later in-flight chunks still line up.
+            sftp_seek64(p->file, r->offset + nbytes);
+            while ((uint32_t)nbytes < r->len) {
+                ssize_t extra = sftp_read(p->file, chunk->data + nbytes, r->len - nbytes);
+                if (extra <= 0) break;
+                nbytes += extra;
+            }
+            sftp_seek64(p->file, next_offset);
+        }
+        chunk->len = nbytes;
+        ssh_stats_add(&p->io->reads, 1);
+        ssh_stats_add(&p->io->bytes_in, nbytes);
+
+        pthread_mutex_lock(&p->lock);
+        p->count++;
+        pthread_cond_signal(&p->not_empty);
+        pthread_mutex_unlock(&p->lock);
+    }
+    drain_pending_reads(p->file, pending, pending_head, pending_count);
+
+    pthread_mutex_lock(&p->lock);
+    p->eof = true;
+    if (failed) p->failed = true;
+    pthread_cond_signal(&p->not_empty);
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 11, 0)
+typedef struct {
+    sftp_aio aio[PIPELINE_DEPTH];
+    int head;
+    int count;
+} WriteWindow;
+
+static int write_window_wait_oldest(WriteWindow *w) {
+    sftp_aio *aio = &w->aio[w->head];
+    w->head = (w->head + 1) % PIPELINE_DEPTH;
+    w->count--;
+    return sftp_aio_wait_write(aio) < 0 ? -1 : 0;
+}
+
+static int pipeline_write(sftp_file file, WriteWindow *w, const char *data, int len) {
+    if (w->count == PIPELINE_DEPTH && write_window_wait_oldest(w) != 0) return -1;
+    sftp_aio *aio = &w->aio[(w->head + w->count) % PIPELINE_DEPTH];
+    if (sftp_aio_begin_write(file, data, len, aio) != len) return -1;
+    w->count++;
+    return 0;
+}
+
+static int pipeline_flush(WriteWindow *w) {
+    int rc = 0;
+    while (w->count > 0) {
+        if (write_window_wait_oldest(w) != 0) rc = -1;
+    }
+    return rc;
+}
+#else
+typedef struct {
+    int unused;
+} WriteWindow;
+
+static int pipeline_write(sftp_file file, WriteWindow *w, const char *data, int len) {
+    (void)w;
+    return sftp_write(file, data, len) == len ? 0 : -1;
+}
+
+static int pipeline_flush(WriteWindow *w) {
+    (void)w;
+    return 0;
+}
+#endif
+
+static int copy_remote(SFTPContext *src, const char *src_path, SFTPContext *dst, const char *dst_path) {
+    if (!src || !src->sftp || !dst || !dst->sftp) return -1;
+    // libssh sessions are not thread-safe, the two ends must not share one
+    if (src->ssh_ctx == dst->ssh_ctx) return -1;
+
+    SFTPTransferStats *stats = &dst->last_transfer;
+    memset(stats, 0, sizeof(*stats));
+
+    sftp_file in = sftp_open(src->sftp, src_path, O_RDONLY, 0);
+    if (!in) return -1;
+
+    mode_t mode = 0644;
+    sftp_attributes attr = sftp_fstat(in);
+    if (attr) {
+        stats->total_bytes = attr->size;
+        mode = attr->permissions & 0777;
+        sftp_attributes_free(attr);
+    }
+
+    sftp_file out = sftp_open(dst->sftp, dst_path, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if (!out) {
+        sftp_close(in);
+        return -1;
+    }
+
+    CopyPipeline p;
+    memset(&p, 0, sizeof(p));
+    p.file = in;
+    p.io = &src->ssh_ctx->stats;
+    char *buffers = malloc((size_t)PIPELINE_DEPTH * PIPELINE_CHUNK_SIZE);
+    for (int i = 0; i < PIPELINE_DEPTH; i++) {
+        p.chunks[i].data = buffers + (size_t)i * PIPELINE_CHUNK_SIZE;
+    }
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.not_empty, NULL);
+    pthread_cond_init(&p.not_full, NULL);
+
+    pthread_t reader;
+    int rc = 0;
+    if (pthread_create(&reader, NULL, pipeline_reader_func, &p) != 0) {
+        rc = -1;
+    } else {
+        WriteWindow window;
+        memset(&window, 0, sizeof(window));
+
+        for (;;) {
+            pthread_mutex_lock(&p.lock);
+            while (p.count == 0 && !p.eof) {
+                pthread_cond_wait(&p.not_empty, &p.lock);
+            }
+            if (p.count == 0) {
+                pthread_mutex_unlock(&p.lock);
+                break;
+            }
+            PipelineChunk *chunk = &p.chunks[p.head];
+            pthread_mutex_unlock(&p.lock);
+
+            // The chunk is copied into the outgoing packet, its slot can be reused right away
+            if (pipeline_write(out, &window, chunk->data, chunk->len) != 0) {
+                rc = -1;
+            } else {
+                stats->transferred_bytes += chunk->len;
+                ssh_stats_add(&dst->ssh_ctx->stats.writes, 1);
+                ssh_stats_add(&dst->ssh_ctx->stats.bytes_out, chunk->len);
+            }
+
+            pthread_mutex_lock(&p.lock);
+            p.head = (p.head + 1) % PIPELINE_DEPTH;
+            p.count--;
+            if (rc != 0) p.failed = true;
+            pthread_cond_signal(&p.not_full);
+            pthread_mutex_unlock(&p.lock);
+            if (rc != 0) break;
+        }
+
+        if (pipeline_flush(&window) != 0) rc = -1;
+        pthread_join(reader, NULL);
+        if (p.failed) rc = -1;
+    }
+
+    pthread_cond_destroy(&p.not_full);
+    pthread_cond_destroy(&p.not_empty);
+    pthread_mutex_destroy(&p.lock);
+    free(buffers);
+
+    sftp_close(out);
+    sftp_close(in);
+    if (rc == 0) stats->total_bytes = stats->transferred_bytes;
+    return rc;
+}
+
+int sftp_copy_remote(SFTPContext *src, const char *src_path, SFTPContext *dst, const char *dst_path) {
+    TraceSpan span = trace_span_begin("sftp", "copy");
+    int rc = copy_remote(src, src_path, dst, dst_path);
+    trace_span_end_detail(&span, "%s, %llu bytes%s", dst_path,
+                          dst ? (unsigned long long)dst->last_transfer.transferred_bytes : 0ULL, rc == 0 ? "" : ", failed");
+    return rc;
+}
+
+int sftp_copy_remote_direct(SFTPContext *src, const char *src_path, const char *dst_user, const char *dst_host, int dst_port, const char *dst_path) {
+    if (!src || !src->ssh_ctx || !src_path || !dst_host || !dst_path) return -1;
+
+    memset(&src->last_transfer, 0, sizeof(src->last_transfer));
+
+    char target[1024];
+    if (dst_user && dst_user[0] != '\0') {
+        snprintf(target, sizeof(target), "%s@%s:%s", dst_user, dst_host, dst_path);
+    } else {
+        snprintf(target, sizeof(target), "%s:%s", dst_host, dst_path);
+    }
+
+    char *q_src = ssh_shell_quote(src_path);
+    char *q_target = ssh_shell_quote(target);
+    char command[2560];
+    // BatchMode makes scp fail fast instead of waiting for a password nobody can type
+    snprintf(command, sizeof(command), "scp -q -p -o BatchMode=yes -P %d -- %s %s",
+             dst_port > 0 ? dst_port : 22, q_src, q_target);
+    free(q_src);
+    free(q_target);
+
+    return ssh_exec_command(src->ssh_ctx, command, NULL, 0) == 0 ? 0 : -1;
+}
+
 int sftp_create_directory(SFTPContext *ctx, const char *path) {
+    if (ctx && ctx->is_initialized && ctx->transport != SFTP_TRANSPORT_SFTP) {
+        return exec_simple(ctx, "mkdir -- %s", path);
+    }
     if (!ctx || !ctx->sftp) return -1;
     return sftp_mkdir(ctx->sftp, path, 0755);
 }
 
 int sftp_delete_file(SFTPContext *ctx, const char *path) {
+    if (ctx && ctx->is_initialized && ctx->transport != SFTP_TRANSPORT_SFTP) {
+        return exec_simple(ctx, "rm -f -- %s", path);
+    }
     if (!ctx || !ctx->sftp) return -1;
     return sftp_unlink(ctx->sftp, path);
 }
 
 char* sftp_get_cwd(SFTPContext *ctx) {
+     if (ctx && ctx->is_initialized && ctx->transport != SFTP_TRANSPORT_SFTP) {
+         char output[4096];
+         if (ssh_exec_command(ctx->ssh_ctx, "pwd", output, sizeof(output)) != 0) return NULL;
+         output[strcspn(output, "\n")] = '\0';
+         return strdup(output);
+     }
      if (!ctx || !ctx->sftp) return NULL;
      return sftp_canonicalize_path(ctx->sftp, ".");
 }
+
+// --- Fallback transports ---
+
+static int probe_fallback_transport(SFTPContext *ctx) {
+    if (ssh_exec_command(ctx->ssh_ctx, "command -v scp >/dev/null 2>&1", NULL, 0) == 0) {
+        ctx->transport = SFTP_TRANSPORT_SCP;
+        return 0;
+    }
+    // No scp either, plain cat over exec channels still works on any shell
+    if (ssh_exec_command(ctx->ssh_ctx, "true", NULL, 0) == 0) {
+        ctx->transport = SFTP_TRANSPORT_EXEC;
+        return 0;
+    }
+    return -1;
+}
+
+static int exec_simple(SFTPContext *ctx, const char *format, const char *path) {
+    char *quoted = ssh_shell_quote(path);
+    size_t len = strlen(format) + strlen(quoted) + 1;
+    char *command = malloc(len);
+    snprintf(command, len, format, quoted);
+    int rc = ssh_exec_command(ctx->ssh_ctx, command, NULL, 0) == 0 ? 0 : -1;
+    free(command);
+    free(quoted);
+    return rc;
+}
+
+typedef struct {
+    char *data;
+    size_t capacity;
+    size_t used;
+} ListingOutput;
+
+static int append_listing(const char *data, size_t len, void *user_data) {
+    ListingOutput *out = (ListingOutput *)user_data;
+    if (out->used + len + 1 > out->capacity) {
+        while (out->used + len + 1 > out->capacity) out->capacity *= 2;
+        out->data = realloc(out->data, out->capacity);
+    }
+    memcpy(out->data + out->used, data, len);
+    out->used += len;
+    return 0;
+}
+
+// One "<mode in hex> <size> <mtime> <name>" line per entry, from stat(1) in
+// coreutils and busybox alike. Names containing newlines are skipped.
+static SFTPFile** exec_list_directory(SFTPContext *ctx, const char *path, int *count) {
+    *count = 0;
+    char *quoted = ssh_shell_quote(path);
+    size_t len = strlen(quoted) + 160;
+    char *command = malloc(len);
+    snprintf(command, len,
+             "cd -- %s && for f in .* *; do { [ -e \"$f\" ] || [ -L \"$f\" ]; } && LC_ALL=C stat -c '%%f %%s %%Y %%n' -- \"$f\"; done",
+             quoted);
+    free(quoted);
+
+    ssh_channel channel = ssh_exec_open(ctx->ssh_ctx, command);
+    free(command);
+    if (!channel) return NULL;
+
+    ListingOutput out = { malloc(65536), 65536, 0 };
+    int rc = ssh_exec_read(channel, append_listing, &out);
+    out.data[out.used] = '\0';
+    // The loop's status is that of its last test, only a failed cd matters
+    ssh_exec_close(channel);
+    char *output = out.data;
+    if (rc < 0 || out.used == 0) {
+        free(output);
+        return NULL;
+    }
+
+    int size = 0;
+    int capacity_files = 20;
+    SFTPFile **files = malloc(sizeof(SFTPFile*) * capacity_files);
+    char *save = NULL;
+    for (char *line = strtok_r(output, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        unsigned int mode;
+        unsigned long long fsize, mtime;
+        int name_off = 0;
+        if (sscanf(line, "%x %llu %llu %n", &mode, &fsize, &mtime, &name_off) != 3 || name_off == 0) continue;
+
+        if (size >= capacity_files) {
+            capacity_files *= 2;
+            files = realloc(files, sizeof(SFTPFile*) * capacity_files);
+        }
+        SFTPFile *f = malloc(sizeof(SFTPFile));
+        f->name = strdup(line + name_off);
+        f->size = fsize;
+        f->mtime = mtime;
+        if (S_ISDIR(mode)) f->type = SFTP_TYPE_DIRECTORY;
+        else if (S_ISLNK(mode)) f->type = SFTP_TYPE_SYMLINK;
+        else f->type = SFTP_TYPE_REGULAR;
+        f->permissions = format_permissions(mode);
+        files[size++] = f;
+    }
+    free(output);
+
+    *count = size;
+    return files;
+}
+
+static int scp_download(SFTPContext *ctx, const char *remote_path, int fd, SFTPTransferStats *stats) {
+    ssh_scp scp = ssh_scp_new(ctx->ssh_ctx->session, SSH_SCP_READ, remote_path);
+    if (!scp) return -1;
+    if (ssh_scp_init(scp) != SSH_OK || ssh_scp_pull_request(scp) != SSH_SCP_REQUEST_NEWFILE) {
+        ssh_scp_free(scp);
+        return -1;
+    }
+
+    uint64_t size = ssh_scp_request_get_size64(scp);
+    stats->total_bytes = size;
+    ssh_scp_accept_request(scp);
+
+    char buffer[PIPELINE_CHUNK_SIZE];
+    int rc = 0;
+    while (stats->transferred_bytes < size) {
+        uint64_t left = size - stats->transferred_bytes;
+        int nbytes = ssh_scp_read(scp, buffer, left < sizeof(buffer) ? left : sizeof(buffer));
+        if (nbytes <= 0 || write_sparse(fd, buffer, nbytes, stats) != 0) {
+            rc = -1;
+            break;
+        }
+        stats->transferred_bytes += nbytes;
+    }
+    if (rc == 0 && ssh_scp_pull_request(scp) != SSH_SCP_REQUEST_EOF) rc = -1;
+
+    ssh_scp_close(scp);
+    ssh_scp_free(scp);
+    return rc;
+}
+
+typedef struct {
+    int fd;
+    SFTPTransferStats *stats;
+} CatDownload;
+
+static int write_cat_output(const char *data, size_t len, void *user_data) {
+    CatDownload *download = (CatDownload *)user_data;
+    if (write_sparse(download->fd, data, len, download->stats) != 0) return -1;
+    download->stats->transferred_bytes += len;
+    download->stats->total_bytes += len;
+    return 0;
+}
+
+static int cat_download(SFTPContext *ctx, const char *remote_path, int fd, SFTPTransferStats *stats) {
+    char *quoted = ssh_shell_quote(remote_path);
+    size_t len = strlen(quoted) + 16;
+    char *command = malloc(len);
+    snprintf(command, len, "cat -- %s", quoted);
+    free(quoted);
+
+    ssh_channel channel = ssh_exec_open(ctx->ssh_ctx, command);
+    free(command);
+    if (!channel) return -1;
+
+    CatDownload download = { fd, stats };
+    int rc = ssh_exec_read(channel, write_cat_output, &download);
+    if (ssh_exec_close(channel) != 0) rc = -1;
+    return rc;
+}
+
+static int fallback_download_file(SFTPContext *ctx, const char *remote_path, const char *local_path) {
+    SFTPTransferStats *stats = &ctx->last_transfer;
+    memset(stats, 0, sizeof(*stats));
+
+    int fd = open(local_path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+
+    int rc = ctx->transport == SFTP_TRANSPORT_SCP
+        ? scp_download(ctx, remote_path, fd, stats)
+        : cat_download(ctx, remote_path, fd, stats);
+
+    // Trailing zero blocks were skipped, extend the file to its real size
+    if (rc == 0 && ftruncate(fd, stats->transferred_bytes) != 0) rc = -1;
+    close(fd);
+    return rc;
+}
+
+static int scp_upload(SFTPContext *ctx, const char *remote_path, int fd, const struct stat *st, SFTPTransferStats *stats) {
+    // scp -t runs in the parent directory and gets the name with the file header
+    char *dir = strdup(remote_path);
+    char *slash = strrchr(dir, '/');
+    const char *name = remote_path;
+    if (slash) {
+        name = remote_path + (slash - dir) + 1;
+        if (slash == dir) slash[1] = '\0';
+        else *slash = '\0';
+    } else {
+        strcpy(dir, ".");
+    }
+
+    ssh_scp scp = ssh_scp_new(ctx->ssh_ctx->session, SSH_SCP_WRITE, dir);
+    free(dir);
+    if (!scp) return -1;
+    if (ssh_scp_init(scp) != SSH_OK || ssh_scp_push_file64(scp, name, st->st_size, st->st_mode & 0777) != SSH_OK) {
+        ssh_scp_free(scp);
+        return -1;
+    }
+
+    char buffer[PIPELINE_CHUNK_SIZE];
+    ssize_t nbytes;
+    int rc = 0;
+    while ((nbytes = read(fd, buffer, sizeof(buffer))) > 0) {
+        if (ssh_scp_write(scp, buffer, nbytes) != SSH_OK) {
+            rc = -1;
+            break;
+        }
+        stats->transferred_bytes += nbytes;
+    }
+    if (nbytes < 0) rc = -1;
+
+    if (ssh_scp_close(scp) != SSH_OK) rc = -1;
+    ssh_scp_free(scp);
+    return rc;
+}
+
+static int cat_upload(SFTPContext *ctx, const char *remote_path, int fd, SFTPTransferStats *stats) {
+    char *quoted = ssh_shell_quote(remote_path);
+    size_t len = strlen(quoted) + 16;
+    char *command = malloc(len);
+    snprintf(command, len, "cat > %s", quoted);
+    free(quoted);
+
+    ssh_channel channel = ssh_exec_open(ctx->ssh_ctx, command);
+    free(command);
+    if (!channel) return -1;
+
+    char buffer[PIPELINE_CHUNK_SIZE];
+    ssize_t nbytes;
+    int rc = 0;
+    while ((nbytes = read(fd, buffer, sizeof(buffer))) > 0) {
+        if (ssh_channel_write(channel, buffer, nbytes) != nbytes) {
+            rc = -1;
+            break;
+        }
+        stats->transferred_bytes += nbytes;
+    }
+    if (nbytes < 0) rc = -1;
+
+    // EOF on stdin lets cat finish before we wait for its status
+    ssh_channel_send_eof(channel);
+    if (ssh_exec_close(channel) != 0) rc = -1;
+    return rc;
+}
+
+static int fallback_upload_file(SFTPContext *ctx, const char *local_path, const char *remote_path) {
+    SFTPTransferStats *stats = &ctx->last_transfer;
+    memset(stats, 0, sizeof(*stats));
+
+    int fd = open(local_path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    stats->total_bytes = st.st_size;
+
+    int rc = ctx->transport == SFTP_TRANSPORT_SCP
+        ? scp_upload(ctx, remote_path, fd, &st, stats)
+        : cat_upload(ctx, remote_path, fd, stats);
+    close(fd);
+    return rc;
+}
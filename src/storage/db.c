@@ -1,59 +1,363 @@
 #include "db.h"
+#include "secret_store.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <math.h>
+#include <time.h>
 
+// Only the storage worker thread opens queries (see db_worker.h), so one
+// connection is enough: the UI reads hosts from host_repo's in-memory copy.
 static sqlite3 *db = NULL;
 
+// Statements are prepared once and reused. Access is serialized by db_lock,
+// as a prepared statement must not be stepped from two threads at a time.
+typedef enum {
+    STMT_BEGIN,
+    STMT_COMMIT,
+    STMT_ROLLBACK,
+    STMT_ADD_HOST,
+    STMT_UPDATE_HOST,
+    STMT_GET_ALL_HOSTS,
+    STMT_GET_HOST,
+    STMT_HOST_EXISTS,
+    STMT_GET_PASSWORD,
+    STMT_SET_PASSWORD,
+    STMT_DELETE_HOST,
+    STMT_FIND_HOST,
+    STMT_SET_PROXY,
+    STMT_ADD_GROUP,
+    STMT_FIND_GROUP,
+    STMT_GET_ALL_GROUPS,
+    STMT_UNGROUP_HOSTS,
+    STMT_DELETE_GROUP,
+    STMT_ADD_HISTORY,
+    STMT_RECENT_HISTORY,
+    STMT_ADD_CONNECTION_STATS,
+    STMT_TRIM_CONNECTION_STATS,
+    STMT_DELETE_CONNECTION_STATS,
+    STMT_CONNECTION_STATS,
+    STMT_FIND_ECHO_LATENCY,
+    STMT_SET_ECHO_LATENCY,
+    STMT_DELETE_ECHO_LATENCY,
+    STMT_ECHO_LATENCY,
+    STMT_COUNT
+} StmtId;
+
+// Only whether a password exists, it is decrypted on demand by db_get_host_password
+#define HOST_COLUMNS "id, name, hostname, port, username, IFNULL(password, '') <> '', key_path, protocol, group_id, proxy_host_id"
+
+#define ECHO_LATENCY_COLUMNS "samples, sum_us, min_us, max_us, counts"
+
+static const char *stmt_sql[STMT_COUNT] = {
+    [STMT_BEGIN] = "BEGIN IMMEDIATE",
+    [STMT_COMMIT] = "COMMIT",
+    [STMT_ROLLBACK] = "ROLLBACK",
+    [STMT_ADD_HOST] = "INSERT INTO hosts (name, hostname, port, username, password, key_path, protocol, group_id, proxy_host_id) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)",
+    [STMT_UPDATE_HOST] = "UPDATE hosts SET name=?, hostname=?, port=?, username=?, password=IFNULL(?, password), key_path=?, protocol=?, group_id=?, proxy_host_id=? WHERE id=?",
+    [STMT_GET_ALL_HOSTS] = "SELECT " HOST_COLUMNS " FROM hosts ORDER BY name ASC",
+    [STMT_GET_HOST] = "SELECT " HOST_COLUMNS " FROM hosts WHERE id = ?",
+    [STMT_HOST_EXISTS] = "SELECT COUNT(*) FROM hosts WHERE name = ?",
+    [STMT_GET_PASSWORD] = "SELECT password FROM hosts WHERE id = ?",
+    [STMT_SET_PASSWORD] = "UPDATE hosts SET password = ? WHERE id = ?",
+    [STMT_DELETE_HOST] = "DELETE FROM hosts WHERE id = ?",
+    // Import lookups, they see the rows of the running transaction
+    [STMT_FIND_HOST] = "SELECT id FROM hosts WHERE name = ? LIMIT 1",
+    [STMT_SET_PROXY] = "UPDATE hosts SET proxy_host_id = ? WHERE id = ?",
+    [STMT_ADD_GROUP] = "INSERT INTO groups (name) VALUES (?)",
+    [STMT_FIND_GROUP] = "SELECT id FROM groups WHERE name = ? LIMIT 1",
+    [STMT_GET_ALL_GROUPS] = "SELECT id, name FROM groups ORDER BY name ASC",
+    [STMT_UNGROUP_HOSTS] = "UPDATE hosts SET group_id = 0 WHERE group_id = ?",
+    [STMT_DELETE_GROUP] = "DELETE FROM groups WHERE id = ?",
+    // One row per target, a repeat use only bumps its counters
+    [STMT_ADD_HISTORY] = "INSERT INTO history (hostname, username, protocol, use_count, last_used, frecency) VALUES (?, ?, ?, 1, ?, ?) "
+                         "ON CONFLICT(hostname, username, protocol) DO UPDATE SET use_count = use_count + 1, "
+                         "last_used = excluded.last_used, frecency = frecency_add(frecency, excluded.frecency)",
+    [STMT_RECENT_HISTORY] = "SELECT id, hostname, username, protocol, last_used, use_count FROM history ORDER BY frecency DESC LIMIT ?",
+    [STMT_ADD_CONNECTION_STATS] = "INSERT INTO connection_stats (host_id, proxy_host_id, started_at, dns_us, tcp_us, proxy_us, kex_us, auth_us, channel_us, total_us, publickey_us, auth_method, failed_phase) "
+                                  "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+    [STMT_TRIM_CONNECTION_STATS] = "DELETE FROM connection_stats WHERE host_id = ?1 AND id <= "
+                                   "(SELECT id FROM connection_stats WHERE host_id = ?1 ORDER BY id DESC LIMIT 1 OFFSET ?2)",
+    [STMT_DELETE_CONNECTION_STATS] = "DELETE FROM connection_stats WHERE host_id = ?",
+    [STMT_CONNECTION_STATS] = "SELECT started_at, dns_us, tcp_us, proxy_us, kex_us, auth_us, channel_us, total_us, publickey_us, auth_method, failed_phase "
+                              "FROM connection_stats WHERE host_id = ? ORDER BY id DESC LIMIT ?",
+    // Merge lookup, on the write connection inside the transaction
+    [STMT_FIND_ECHO_LATENCY] = "SELECT " ECHO_LATENCY_COLUMNS " FROM echo_latency WHERE host_id = ? AND proxy_host_id = ?",
+    [STMT_SET_ECHO_LATENCY] = "INSERT OR REPLACE INTO echo_latency (host_id, proxy_host_id, " ECHO_LATENCY_COLUMNS ", updated_at) VALUES (?, ?, ?, ?, ?, ?, ?, ?)",
+    [STMT_DELETE_ECHO_LATENCY] = "DELETE FROM echo_latency WHERE host_id = ?",
+    [STMT_ECHO_LATENCY] = "SELECT " ECHO_LATENCY_COLUMNS " FROM echo_latency WHERE host_id = ? AND proxy_host_id = ?",
+};
+
+static sqlite3_stmt *stmts[STMT_COUNT];
+static pthread_mutex_t db_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Returns the cached statement, reset and unbound. Call with db_lock held.
+static sqlite3_stmt* get_stmt(StmtId id) {
+    if (!stmts[id]) {
+        if (sqlite3_prepare_v3(db, stmt_sql[id], -1, SQLITE_PREPARE_PERSISTENT, &stmts[id], NULL) != SQLITE_OK) {
+            LOG_ERROR("db", "SQL error: %s", sqlite3_errmsg(db));
+            stmts[id] = NULL;
+            return NULL;
+        }
+    }
+    sqlite3_reset(stmts[id]);
+    sqlite3_clear_bindings(stmts[id]);
+    return stmts[id];
+}
+
+// Steps a statement that returns no rows
+static bool run_stmt(sqlite3_stmt *stmt) {
+    if (!stmt) return false;
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_DONE) {
+        LOG_ERROR("db", "SQL error: %s", sqlite3_errmsg(db));
+        return false;
+    }
+    return true;
+}
+
+static bool begin_transaction() {
+    return run_stmt(get_stmt(STMT_BEGIN));
+}
+
+static bool end_transaction(bool ok) {
+    if (ok) ok = run_stmt(get_stmt(STMT_COMMIT));
+    if (!ok) run_stmt(get_stmt(STMT_ROLLBACK));
+    return ok;
+}
+
+static char* column_strdup(sqlite3_stmt *stmt, int col) {
+    const char *text = (const char*)sqlite3_column_text(stmt, col);
+    return strdup(text ? text : "");
+}
+
+// --- Frecency ---
+// Each use is worth 1, halving every week. The stored score is the log of the
+// sum of 2^(t / half-life) over all uses, so the current value of every row is
+// the same factor away from it and the ranking never needs recomputing.
+#define FRECENCY_HALF_LIFE (7 * 86400.0)
+
+static double frecency_weight(double timestamp) {
+    return timestamp / FRECENCY_HALF_LIFE * M_LN2;
+}
+
+// log(exp(a) + exp(b)) without overflow
+static double log_add(double a, double b) {
+    double hi = a > b ? a : b;
+    double lo = a > b ? b : a;
+    return hi + log1p(exp(lo - hi));
+}
+
+static void sql_frecency_add(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    sqlite3_result_double(ctx, log_add(sqlite3_value_double(argv[0]), sqlite3_value_double(argv[1])));
+}
+
+// Score of count uses at timestamp, for rows migrated from the old layout
+static void sql_frecency_seed(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    double count = sqlite3_value_double(argv[1]);
+    sqlite3_result_double(ctx, frecency_weight(sqlite3_value_double(argv[0])) + log(count > 1 ? count : 1));
+}
+
+// --- Schema migrations ---
+// PRAGMA user_version holds the number of migrations applied. Each one runs
+// once, in its own transaction together with the version bump, so startup only
+// reads the pragma once the schema is current. Append new steps, never edit
+// the ones already shipped.
+
+// Adds a column unless an older build already did (they used to be added on every launch)
+static bool add_column(const char *table, const char *column, const char *decl) {
+    char sql[256];
+    snprintf(sql, sizeof(sql), "SELECT 1 FROM pragma_table_info('%s') WHERE name = '%s'", table, column);
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) return false;
+    bool exists = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    if (exists) return true;
+
+    snprintf(sql, sizeof(sql), "ALTER TABLE %s ADD COLUMN %s %s", table, column, decl);
+    return sqlite3_exec(db, sql, 0, 0, 0) == SQLITE_OK;
+}
+
+// Databases created before migrations may miss the later host columns
+static bool migrate_host_columns() {
+    return add_column("hosts", "password", "TEXT") &&
+           add_column("hosts", "key_path", "TEXT") &&
+           add_column("hosts", "group_id", "INTEGER DEFAULT 0") &&
+           add_column("hosts", "proxy_host_id", "INTEGER DEFAULT 0");
+}
+
+// Older databases kept one row per use, fold them into one row per target
+static bool migrate_history() {
+    sqlite3_stmt *probe = NULL;
+    bool migrated = sqlite3_prepare_v2(db, "SELECT frecency FROM history LIMIT 0", -1, &probe, NULL) == SQLITE_OK;
+    sqlite3_finalize(probe);
+    if (migrated) return true;
+
+    const char *sql = "ALTER TABLE history RENAME TO history_old;"
+                      "CREATE TABLE history ("
+                      "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                      "hostname TEXT NOT NULL,"
+                      "username TEXT NOT NULL DEFAULT '',"
+                      "protocol TEXT NOT NULL DEFAULT 'ssh',"
+                      "use_count INTEGER NOT NULL DEFAULT 1,"
+                      "last_used INTEGER NOT NULL,"
+                      "frecency REAL NOT NULL);"
+                      "INSERT INTO history (hostname, username, protocol, use_count, last_used, frecency) "
+                      "SELECT hostname, IFNULL(username, ''), IFNULL(protocol, 'ssh'), COUNT(*), MAX(timestamp), frecency_seed(MAX(timestamp), COUNT(*)) "
+                      "FROM history_old GROUP BY 1, 2, 3;"
+                      "DROP TABLE history_old;";
+    return sqlite3_exec(db, sql, 0, 0, 0) == SQLITE_OK;
+}
+
+typedef struct {
+    const char *sql;            // Either a script
+    bool (*run)();              // or a function, called inside the transaction
+} Migration;
+
+static const Migration migrations[] = {
+    // 1: tables, in their current layout for new databases
+    { "CREATE TABLE IF NOT EXISTS hosts ("
+      "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+      "name TEXT NOT NULL,"
+      "hostname TEXT NOT NULL,"
+      "port INTEGER DEFAULT 22,"
+      "username TEXT,"
+      "password TEXT,"
+      "key_path TEXT,"
+      "protocol TEXT DEFAULT 'ssh',"
+      "group_id INTEGER DEFAULT 0,"
+      "proxy_host_id INTEGER DEFAULT 0);"
+      "CREATE TABLE IF NOT EXISTS groups ("
+      "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+      "name TEXT NOT NULL);"
+      "CREATE TABLE IF NOT EXISTS history ("
+      "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+      "hostname TEXT NOT NULL,"
+      "username TEXT NOT NULL DEFAULT '',"
+      "protocol TEXT NOT NULL DEFAULT 'ssh',"
+      "use_count INTEGER NOT NULL DEFAULT 1,"
+      "last_used INTEGER NOT NULL,"
+      "frecency REAL NOT NULL);", NULL },
+    // 2, 3: bring databases of older builds up to that layout
+    { NULL, migrate_host_columns },
+    { NULL, migrate_history },
+    // 4: indexes of the lookups by name, the group listings and the history upsert
+    { "CREATE INDEX IF NOT EXISTS hosts_name ON hosts (name);"
+      "CREATE INDEX IF NOT EXISTS hosts_group ON hosts (group_id, name);"
+      "CREATE INDEX IF NOT EXISTS groups_name ON groups (name);"
+      "CREATE UNIQUE INDEX IF NOT EXISTS history_target ON history (hostname, username, protocol);"
+      "CREATE INDEX IF NOT EXISTS history_frecency ON history (frecency DESC);", NULL },
+    // 5: phase timings of past connections, NULL for a phase that did not run
+    { "CREATE TABLE IF NOT EXISTS connection_stats ("
+      "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+      "host_id INTEGER NOT NULL,"
+      "proxy_host_id INTEGER NOT NULL DEFAULT 0,"
+      "started_at INTEGER NOT NULL,"
+      "dns_us INTEGER,"
+      "tcp_us INTEGER,"
+      "proxy_us INTEGER,"
+      "kex_us INTEGER,"
+      "auth_us INTEGER,"
+      "channel_us INTEGER,"
+      "total_us INTEGER,"
+      "publickey_us INTEGER,"
+      "auth_method TEXT NOT NULL DEFAULT '',"
+      "failed_phase INTEGER NOT NULL DEFAULT -1);"
+      "CREATE INDEX IF NOT EXISTS connection_stats_host ON connection_stats (host_id, id);"
+      "CREATE INDEX IF NOT EXISTS connection_stats_proxy ON connection_stats (proxy_host_id, id) WHERE proxy_host_id > 0;", NULL },
+    // 6: keystroke echo histogram of each host and jump host, counts is a LatencyHistogram bucket array
+    { "CREATE TABLE IF NOT EXISTS echo_latency ("
+      "host_id INTEGER NOT NULL,"
+      "proxy_host_id INTEGER NOT NULL DEFAULT 0,"
+      "samples INTEGER NOT NULL,"
+      "sum_us INTEGER NOT NULL,"
+      "min_us INTEGER NOT NULL,"
+      "max_us INTEGER NOT NULL,"
+      "counts BLOB NOT NULL,"
+      "updated_at INTEGER NOT NULL,"
+      "PRIMARY KEY (host_id, proxy_host_id));", NULL },
+};
+
+#define SCHEMA_VERSION ((int)(sizeof(migrations) / sizeof(migrations[0])))
+
+static int schema_version() {
+    sqlite3_stmt *stmt = NULL;
+    int version = -1;
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version", -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return version;
+}
+
+static bool migrate() {
+    int version = schema_version();
+    if (version < 0) return false;
+    // Current, or written by a newer build that kept compatibility
+    if (version >= SCHEMA_VERSION) return true;
+
+    while (version < SCHEMA_VERSION) {
+        if (sqlite3_exec(db, "BEGIN IMMEDIATE;", 0, 0, 0) != SQLITE_OK) return false;
+        // Another instance may have migrated while we waited for the lock
+        version = schema_version();
+        if (version < 0 || version >= SCHEMA_VERSION) {
+            sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+            return version >= 0;
+        }
+
+        const Migration *m = &migrations[version];
+        char *errMsg = 0;
+        bool ok = m->sql ? sqlite3_exec(db, m->sql, 0, 0, &errMsg) == SQLITE_OK : m->run();
+        if (ok) {
+            char bump[64];
+            snprintf(bump, sizeof(bump), "PRAGMA user_version = %d;", version + 1);
+            ok = sqlite3_exec(db, bump, 0, 0, &errMsg) == SQLITE_OK;
+        }
+        if (ok) ok = sqlite3_exec(db, "COMMIT;", 0, 0, &errMsg) == SQLITE_OK;
+        if (!ok) {
+            LOG_ERROR("db", "Migration %d failed: %s", version + 1, errMsg ? errMsg : sqlite3_errmsg(db));
+            sqlite3_free(errMsg);
+            sqlite3_exec(db, "ROLLBACK;", 0, 0, 0);
+            return false;
+        }
+        version++;
+    }
+    return true;
+}
+
 bool db_init() {
     int rc = sqlite3_open("hosts.db", &db);
     if (rc) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+        LOG_ERROR("db", "Can't open database: %s", sqlite3_errmsg(db));
         return false;
     }
 
-    char *sql = "CREATE TABLE IF NOT EXISTS hosts ("
-                "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                "name TEXT NOT NULL,"
-                "hostname TEXT NOT NULL,"
-                "port INTEGER DEFAULT 22,"
-                "username TEXT,"
-                "password TEXT,"
-                "key_path TEXT,"
-                "protocol TEXT DEFAULT 'ssh',"
-                "group_id INTEGER DEFAULT 0);"
-                
-                "CREATE TABLE IF NOT EXISTS groups ("
-                "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                "name TEXT NOT NULL);"
-                
-                "CREATE TABLE IF NOT EXISTS history ("
-                "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                "hostname TEXT NOT NULL,"
-                "username TEXT,"
-                "protocol TEXT,"
-                "timestamp INTEGER);";
-
-    char *errMsg = 0;
-    rc = sqlite3_exec(db, sql, 0, 0, &errMsg);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
-        return false;
-    }
-    
-    // Simple migration
-    sqlite3_exec(db, "ALTER TABLE hosts ADD COLUMN password TEXT;", 0, 0, 0);
-    sqlite3_exec(db, "ALTER TABLE hosts ADD COLUMN key_path TEXT;", 0, 0, 0);
-    sqlite3_exec(db, "ALTER TABLE hosts ADD COLUMN group_id INTEGER DEFAULT 0;", 0, 0, 0);
-    sqlite3_exec(db, "ALTER TABLE hosts ADD COLUMN proxy_host_id INTEGER DEFAULT 0;", 0, 0, 0);
+    sqlite3_create_function(db, "frecency_add", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL, sql_frecency_add, NULL, NULL);
+    sqlite3_create_function(db, "frecency_seed", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL, sql_frecency_seed, NULL, NULL);
+    sqlite3_busy_timeout(db, 5000);
+
+    if (!migrate()) return false;
+
+    // WAL with synchronous=NORMAL only fsyncs at checkpoints, commits stay cheap
+    sqlite3_exec(db, "PRAGMA journal_mode=WAL;", 0, 0, 0);
+    sqlite3_exec(db, "PRAGMA synchronous=NORMAL;", 0, 0, 0);
 
     return true;
 }
 
 void db_close() {
     if (db) {
+        pthread_mutex_lock(&db_lock);
+        for (int i = 0; i < STMT_COUNT; i++) {
+            sqlite3_finalize(stmts[i]);
+            stmts[i] = NULL;
+        }
         sqlite3_close(db);
+        db = NULL;
+        pthread_mutex_unlock(&db_lock);
     }
 }
 
@@ -70,86 +374,132 @@ static char* simple_encrypt(const char* input) {
     return output;
 }
 
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return 0;
+}
+
 static char* simple_decrypt(const char* input) {
     if (!input) return NULL;
     size_t len = strlen(input) / 2;
     char *output = malloc(len + 1);
     for(size_t i=0; i<len; i++) {
-        unsigned int val;
-        sscanf(input + (i*2), "%02x", &val);
-        output[i] = (char)(val ^ 0x42);
+        output[i] = (char)(((hex_value(input[i*2]) << 4) | hex_value(input[i*2 + 1])) ^ 0x42);
     }
     output[len] = '\0';
     return output;
 }
 
-bool db_add_host(const char* name, const char* hostname, int port, const char* user, const char* password, const char* key_path, const char* protocol, int group_id, int proxy_host_id) {
-    if (!db) return false;
-    
-    char *enc_pass = simple_encrypt(password);
-    
-    char *sql = sqlite3_mprintf("INSERT INTO hosts (name, hostname, port, username, password, key_path, protocol, group_id, proxy_host_id) VALUES ('%q', '%q', %d, '%q', '%q', '%q', '%q', %d, %d);", 
-                                name, hostname, port, user, enc_pass ? enc_pass : "", key_path ? key_path : "", protocol, group_id, proxy_host_id);
-    
-    if (enc_pass) free(enc_pass);
-    
-    char *errMsg = 0;
-    int rc = sqlite3_exec(db, sql, 0, 0, &errMsg);
-    sqlite3_free(sql);
-    
-    if (rc != SQLITE_OK) {
-        // If the error is due to the missing column (simple migration)
-        if (strstr(errMsg, "no such column: proxy_host_id")) {
-             sqlite3_exec(db, "ALTER TABLE hosts ADD COLUMN proxy_host_id INTEGER DEFAULT 0;", NULL, NULL, NULL);
-             // Retry
-             rc = sqlite3_exec(db, sql, 0, 0, NULL); // Need to regenerate sql but let's just fail for now or assume init handles it
-             // Actually let's just rely on db_init to have created it or user to have fresh db
+// Column value of a password kept in the keyring, never valid hex
+#define PASSWORD_IN_KEYRING "@keyring"
+
+// Value to store in the password column: the keyring marker when the keyring
+// took the password, the obfuscated password otherwise.
+static char* store_password(int id, const char* password) {
+    if (!password || !password[0]) {
+        secret_store_delete(id);
+        return strdup("");
+    }
+    if (secret_store_save(id, password)) return strdup(PASSWORD_IN_KEYRING);
+    // XOR is obfuscation only, anyone who can read hosts.db gets the password back
+    LOG_WARN("db", "No keyring available, the password of host %d is stored obfuscated, not encrypted", id);
+    return simple_encrypt(password);
+}
+
+// Binds the fields shared by insert and update, starting at parameter 1
+static void bind_host(sqlite3_stmt *stmt, const char* name, const char* hostname, int port, const char* user, const char* enc_pass, const char* key_path, const char* protocol, int group_id, int proxy_host_id) {
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, hostname, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, port);
+    sqlite3_bind_text(stmt, 4, user ? user : "", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, enc_pass, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 6, key_path ? key_path : "", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 7, protocol, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 8, group_id);
+    sqlite3_bind_int(stmt, 9, proxy_host_id);
+}
+
+int db_add_host(const char* name, const char* hostname, int port, const char* user, const char* password, const char* key_path, const char* protocol, int group_id, int proxy_host_id) {
+    if (!db) return -1;
+    
+    pthread_mutex_lock(&db_lock);
+    bool ok = begin_transaction();
+    sqlite3_stmt *stmt = ok ? get_stmt(STMT_ADD_HOST) : NULL;
+    if (stmt) bind_host(stmt, name, hostname, port, user, "", key_path, protocol, group_id, proxy_host_id);
+    ok = ok && run_stmt(stmt);
+    int id = ok ? (int)sqlite3_last_insert_rowid(db) : -1;
+    
+    // The keyring entry is keyed by the new id, so the password follows the row.
+    // Storing it inside the transaction means a failure leaves neither behind.
+    bool has_password = ok && password && password[0];
+    if (has_password) {
+        char *enc_pass = store_password(id, password);
+        stmt = get_stmt(STMT_SET_PASSWORD);
+        if (stmt) {
+            sqlite3_bind_text(stmt, 1, enc_pass, -1, SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 2, id);
         }
-        fprintf(stderr, "SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
-        return false;
+        ok = run_stmt(stmt);
+        free(enc_pass);
     }
-    return true;
+    ok = end_transaction(ok);
+    pthread_mutex_unlock(&db_lock);
+    
+    if (!ok) {
+        // The rolled back id will be handed out again, its keyring entry must go
+        if (has_password) secret_store_delete(id);
+        return -1;
+    }
+    return id;
 }
 
 bool db_update_host(int id, const char* name, const char* hostname, int port, const char* user, const char* password, const char* key_path, const char* protocol, int group_id, int proxy_host_id) {
     if (!db) return false;
     
-    char *enc_pass = simple_encrypt(password);
+    char *enc_pass = password ? store_password(id, password) : NULL;
     
-    char *sql = sqlite3_mprintf("UPDATE hosts SET name='%q', hostname='%q', port=%d, username='%q', password='%q', key_path='%q', protocol='%q', group_id=%d, proxy_host_id=%d WHERE id=%d;", 
-                                name, hostname, port, user, enc_pass ? enc_pass : "", key_path ? key_path : "", protocol, group_id, proxy_host_id, id);
+    pthread_mutex_lock(&db_lock);
+    sqlite3_stmt *stmt = get_stmt(STMT_UPDATE_HOST);
+    if (stmt) {
+        bind_host(stmt, name, hostname, port, user, enc_pass, key_path, protocol, group_id, proxy_host_id);
+        sqlite3_bind_int(stmt, 10, id);
+    }
+    bool ok = run_stmt(stmt);
+    pthread_mutex_unlock(&db_lock);
     
     if (enc_pass) free(enc_pass);
-    
-    char *errMsg = 0;
-    int rc = sqlite3_exec(db, sql, 0, 0, &errMsg);
-    sqlite3_free(sql);
-    
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
-        return false;
-    }
-    return true;
+    return ok;
+}
+
+static Host* read_host_row(sqlite3_stmt *stmt) {
+    Host *h = malloc(sizeof(Host));
+    h->id = sqlite3_column_int(stmt, 0);
+    h->name = column_strdup(stmt, 1);
+    h->hostname = column_strdup(stmt, 2);
+    h->port = sqlite3_column_int(stmt, 3);
+    h->username = column_strdup(stmt, 4);
+    h->password = NULL;
+    h->has_password = sqlite3_column_int(stmt, 5) != 0;
+    h->key_path = column_strdup(stmt, 6);
+    h->protocol = column_strdup(stmt, 7);
+    h->group_id = sqlite3_column_int(stmt, 8);
+    h->proxy_host_id = sqlite3_column_int(stmt, 9);
+    return h;
 }
 
 Host** db_get_all_hosts(int *count) {
-    if (!db) {
-        *count = 0;
-        return NULL;
-    }
+    *count = 0;
+    if (!db) return NULL;
 
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT id, name, hostname, port, username, password, key_path, protocol, group_id, proxy_host_id FROM hosts ORDER BY name ASC";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        *count = 0;
+    pthread_mutex_lock(&db_lock);
+    sqlite3_stmt *stmt = get_stmt(STMT_GET_ALL_HOSTS);
+    if (!stmt) {
+        pthread_mutex_unlock(&db_lock);
         return NULL;
     }
 
-    // Count first (naive method, could use SELECT COUNT)
-    // Here we use a resizable dynamic array
     int capacity = 10;
     int size = 0;
     Host **hosts = malloc(sizeof(Host*) * capacity);
@@ -159,26 +509,11 @@ Host** db_get_all_hosts(int *count) {
             capacity *= 2;
             hosts = realloc(hosts, sizeof(Host*) * capacity);
         }
-
-        Host *h = malloc(sizeof(Host));
-        h->id = sqlite3_column_int(stmt, 0);
-        h->name = strdup((const char*)sqlite3_column_text(stmt, 1));
-        h->hostname = strdup((const char*)sqlite3_column_text(stmt, 2));
-        h->port = sqlite3_column_int(stmt, 3);
-        h->username = strdup((const char*)sqlite3_column_text(stmt, 4));
-        
-        const char *enc_pass = (const char*)sqlite3_column_text(stmt, 5);
-        h->password = simple_decrypt(enc_pass);
-        
-        h->key_path = strdup((const char*)sqlite3_column_text(stmt, 6));
-        h->protocol = strdup((const char*)sqlite3_column_text(stmt, 7));
-        h->group_id = sqlite3_column_int(stmt, 8);
-        h->proxy_host_id = sqlite3_column_int(stmt, 9);
-
-        hosts[size++] = h;
+        hosts[size++] = read_host_row(stmt);
     }
 
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
+    pthread_mutex_unlock(&db_lock);
     *count = size;
     return hosts;
 }
@@ -186,73 +521,171 @@ Host** db_get_all_hosts(int *count) {
 Host* db_get_host_by_id(int id) {
     if (!db) return NULL;
     
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT id, name, hostname, port, username, password, key_path, protocol, group_id, proxy_host_id FROM hosts WHERE id = ?";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return NULL;
-    }
-    
-    sqlite3_bind_int(stmt, 1, id);
-    
+    pthread_mutex_lock(&db_lock);
+    sqlite3_stmt *stmt = get_stmt(STMT_GET_HOST);
     Host *h = NULL;
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        h = malloc(sizeof(Host));
-        h->id = sqlite3_column_int(stmt, 0);
-        h->name = strdup((const char*)sqlite3_column_text(stmt, 1));
-        h->hostname = strdup((const char*)sqlite3_column_text(stmt, 2));
-        h->port = sqlite3_column_int(stmt, 3);
-        h->username = strdup((const char*)sqlite3_column_text(stmt, 4));
-        
-        const char *enc_pass = (const char*)sqlite3_column_text(stmt, 5);
-        h->password = simple_decrypt(enc_pass);
-        
-        h->key_path = strdup((const char*)sqlite3_column_text(stmt, 6));
-        h->protocol = strdup((const char*)sqlite3_column_text(stmt, 7));
-        h->group_id = sqlite3_column_int(stmt, 8);
-        h->proxy_host_id = sqlite3_column_int(stmt, 9);
+    if (stmt) {
+        sqlite3_bind_int(stmt, 1, id);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            h = read_host_row(stmt);
+        }
+        sqlite3_reset(stmt);
     }
-    
-    sqlite3_finalize(stmt);
+    pthread_mutex_unlock(&db_lock);
     return h;
 }
 
 bool db_host_exists(const char* name) {
     if (!db || !name) return false;
     
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT COUNT(*) FROM hosts WHERE name = ?";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return false;
-    }
-    
-    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
-    
+    pthread_mutex_lock(&db_lock);
+    sqlite3_stmt *stmt = get_stmt(STMT_HOST_EXISTS);
     bool exists = false;
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        exists = sqlite3_column_int(stmt, 0) > 0;
+    if (stmt) {
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            exists = sqlite3_column_int(stmt, 0) > 0;
+        }
+        sqlite3_reset(stmt);
     }
-    
-    sqlite3_finalize(stmt);
+    pthread_mutex_unlock(&db_lock);
     return exists;
 }
 
+char* db_get_host_password(int id) {
+    if (!db) return NULL;
+    
+    pthread_mutex_lock(&db_lock);
+    sqlite3_stmt *stmt = get_stmt(STMT_GET_PASSWORD);
+    char *stored = NULL;
+    if (stmt) {
+        sqlite3_bind_int(stmt, 1, id);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char *text = (const char*)sqlite3_column_text(stmt, 0);
+            if (text && text[0]) stored = strdup(text);
+        }
+        sqlite3_reset(stmt);
+    }
+    pthread_mutex_unlock(&db_lock);
+    
+    if (!stored) return NULL;
+    bool in_keyring = strcmp(stored, PASSWORD_IN_KEYRING) == 0;
+    char *password = in_keyring ? secret_store_lookup(id) : simple_decrypt(stored);
+    if (in_keyring && !password) LOG_ERROR("db", "The keyring did not return the password of host %d", id);
+    free(stored);
+    return password;
+}
+
+void db_free_password(char* password) {
+    if (!password) return;
+    explicit_bzero(password, strlen(password));
+    free(password);
+}
+
 bool db_delete_host(int id) {
     if (!db) return false;
     
-    char *sql = sqlite3_mprintf("DELETE FROM hosts WHERE id = %d;", id);
-    
-    char *errMsg = 0;
-    int rc = sqlite3_exec(db, sql, 0, 0, &errMsg);
-    sqlite3_free(sql);
+    // The host goes with its statistics, in one transaction
+    pthread_mutex_lock(&db_lock);
+    bool ok = begin_transaction();
+    if (ok) {
+        sqlite3_stmt *stmt = get_stmt(STMT_DELETE_HOST);
+        if (stmt) sqlite3_bind_int(stmt, 1, id);
+        ok = run_stmt(stmt);
+    }
+    if (ok) {
+        sqlite3_stmt *stmt = get_stmt(STMT_DELETE_CONNECTION_STATS);
+        if (stmt) sqlite3_bind_int(stmt, 1, id);
+        ok = run_stmt(stmt);
+    }
+    if (ok) {
+        sqlite3_stmt *stmt = get_stmt(STMT_DELETE_ECHO_LATENCY);
+        if (stmt) sqlite3_bind_int(stmt, 1, id);
+        ok = run_stmt(stmt);
+    }
+    ok = end_transaction(ok);
+    pthread_mutex_unlock(&db_lock);
     
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
-        return false;
+    if (ok) secret_store_delete(id);
+    return ok;
+}
+
+// Id of the row found by a single-column lookup, -1 if none
+static int find_id(StmtId id, const char *name) {
+    sqlite3_stmt *stmt = get_stmt(id);
+    if (!stmt) return -1;
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    int found = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : -1;
+    sqlite3_reset(stmt);
+    return found;
+}
+
+static int find_or_add_group(const char *name) {
+    int id = find_id(STMT_FIND_GROUP, name);
+    if (id >= 0) return id;
+    sqlite3_stmt *stmt = get_stmt(STMT_ADD_GROUP);
+    if (stmt) sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    return run_stmt(stmt) ? (int)sqlite3_last_insert_rowid(db) : -1;
+}
+
+int db_import_hosts(const HostImport *hosts, int count) {
+    if (!db) return -1;
+    if (count <= 0) return 0;
+
+    // Row id of each new host, 0 when skipped
+    int *ids = calloc(count, sizeof(int));
+    int added = 0;
+
+    pthread_mutex_lock(&db_lock);
+    bool ok = begin_transaction();
+
+    // Imports come grouped, remember the last group instead of looking it up per host
+    const char *last_group = NULL;
+    int last_group_id = 0;
+
+    for (int i = 0; ok && i < count; i++) {
+        const HostImport *h = &hosts[i];
+        if (!h->name || !h->hostname || find_id(STMT_FIND_HOST, h->name) >= 0) continue;
+
+        int group_id = 0;
+        if (h->group && h->group[0]) {
+            if (!last_group || strcmp(last_group, h->group) != 0) {
+                last_group_id = find_or_add_group(h->group);
+                last_group = h->group;
+            }
+            if (last_group_id < 0) {
+                ok = false;
+                break;
+            }
+            group_id = last_group_id;
+        }
+
+        sqlite3_stmt *stmt = get_stmt(STMT_ADD_HOST);
+        if (stmt) bind_host(stmt, h->name, h->hostname, h->port > 0 ? h->port : 22, h->username, NULL, h->key_path, "ssh", group_id, 0);
+        ok = run_stmt(stmt);
+        if (ok) {
+            ids[i] = (int)sqlite3_last_insert_rowid(db);
+            added++;
+        }
     }
-    return true;
+
+    // Jump hosts may come later in the list, link them once every row exists
+    for (int i = 0; ok && i < count; i++) {
+        if (ids[i] == 0 || !hosts[i].proxy) continue;
+        int proxy_id = find_id(STMT_FIND_HOST, hosts[i].proxy);
+        if (proxy_id < 0 || proxy_id == ids[i]) continue;
+        sqlite3_stmt *stmt = get_stmt(STMT_SET_PROXY);
+        if (stmt) {
+            sqlite3_bind_int(stmt, 1, proxy_id);
+            sqlite3_bind_int(stmt, 2, ids[i]);
+        }
+        ok = run_stmt(stmt);
+    }
+
+    ok = end_transaction(ok);
+    pthread_mutex_unlock(&db_lock);
+    free(ids);
+    return ok ? added : -1;
 }
 
 void db_free_hosts(Host** hosts, int count) {
@@ -263,46 +696,49 @@ void db_free_hosts(Host** hosts, int count) {
     free(hosts);
 }
 
+Host* db_dup_host(const Host* host) {
+    Host *copy = malloc(sizeof(Host));
+    *copy = *host;
+    copy->name = strdup(host->name);
+    copy->hostname = strdup(host->hostname);
+    copy->username = strdup(host->username);
+    copy->password = host->password ? strdup(host->password) : NULL;
+    copy->key_path = host->key_path ? strdup(host->key_path) : NULL;
+    copy->protocol = strdup(host->protocol ? host->protocol : "ssh");
+    return copy;
+}
+
 void db_free_host(Host* host) {
     if (!host) return;
     free(host->name);
     free(host->hostname);
     free(host->username);
-    if (host->password) free(host->password);
+    db_free_password(host->password);
     if (host->key_path) free(host->key_path);
     free(host->protocol);
     free(host);
 }
 
 // --- GROUPS ---
-bool db_add_group(const char* name) {
-    if (!db) return false;
-    
-    char *sql = sqlite3_mprintf("INSERT INTO groups (name) VALUES ('%q');", name);
-    
-    char *errMsg = 0;
-    int rc = sqlite3_exec(db, sql, 0, 0, &errMsg);
-    sqlite3_free(sql);
-    
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
-        return false;
-    }
-    return true;
+int db_add_group(const char* name) {
+    if (!db) return -1;
+    
+    pthread_mutex_lock(&db_lock);
+    sqlite3_stmt *stmt = get_stmt(STMT_ADD_GROUP);
+    if (stmt) sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    int id = run_stmt(stmt) ? (int)sqlite3_last_insert_rowid(db) : -1;
+    pthread_mutex_unlock(&db_lock);
+    return id;
 }
 
 Group** db_get_all_groups(int *count) {
-    if (!db) {
-        *count = 0;
-        return NULL;
-    }
+    *count = 0;
+    if (!db) return NULL;
 
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT id, name FROM groups ORDER BY name ASC";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        *count = 0;
+    pthread_mutex_lock(&db_lock);
+    sqlite3_stmt *stmt = get_stmt(STMT_GET_ALL_GROUPS);
+    if (!stmt) {
+        pthread_mutex_unlock(&db_lock);
         return NULL;
     }
 
@@ -318,12 +754,13 @@ Group** db_get_all_groups(int *count) {
 
         Group *g = malloc(sizeof(Group));
         g->id = sqlite3_column_int(stmt, 0);
-        g->name = strdup((const char*)sqlite3_column_text(stmt, 1));
+        g->name = column_strdup(stmt, 1);
 
         groups[size++] = g;
     }
 
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
+    pthread_mutex_unlock(&db_lock);
     *count = size;
     return groups;
 }
@@ -341,88 +778,73 @@ void db_free_groups(Group** groups, int count) {
 bool db_delete_group(int id) {
     if (!db) return false;
     
-    // 1. Move hosts in this group to default group (0)
-    char *sql_update = sqlite3_mprintf("UPDATE hosts SET group_id = 0 WHERE group_id = %d;", id);
-    sqlite3_exec(db, sql_update, 0, 0, 0);
-    sqlite3_free(sql_update);
-    
-    // 2. Delete the group
-    char *sql_del = sqlite3_mprintf("DELETE FROM groups WHERE id = %d;", id);
-    
-    char *errMsg = 0;
-    int rc = sqlite3_exec(db, sql_del, 0, 0, &errMsg);
-    sqlite3_free(sql_del);
-    
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
-        return false;
+    // Hosts of the group move to the default group (0) in the same transaction
+    pthread_mutex_lock(&db_lock);
+    bool ok = begin_transaction();
+    if (ok) {
+        sqlite3_stmt *stmt = get_stmt(STMT_UNGROUP_HOSTS);
+        if (stmt) sqlite3_bind_int(stmt, 1, id);
+        ok = run_stmt(stmt);
     }
-    return true;
+    if (ok) {
+        sqlite3_stmt *stmt = get_stmt(STMT_DELETE_GROUP);
+        if (stmt) sqlite3_bind_int(stmt, 1, id);
+        ok = run_stmt(stmt);
+    }
+    ok = end_transaction(ok);
+    pthread_mutex_unlock(&db_lock);
+    return ok;
 }
 
 // --- HISTORY ---
-#include <time.h>
-
 bool db_add_history(const char* hostname, const char* username, const char* protocol) {
     if (!db) return false;
     
-    // First, remove any existing entry for this host/user to prevent duplicates
-    // and ensure the latest is the one we insert (with new timestamp)
-    char *sql_del = sqlite3_mprintf("DELETE FROM history WHERE hostname='%q' AND username='%q';", hostname, username);
-    sqlite3_exec(db, sql_del, 0, 0, 0);
-    sqlite3_free(sql_del);
-    
-    long timestamp = (long)time(NULL);
-    
-    char *sql = sqlite3_mprintf("INSERT INTO history (hostname, username, protocol, timestamp) VALUES ('%q', '%q', '%q', %ld);", 
-                                hostname, username, protocol, timestamp);
-    
-    char *errMsg = 0;
-    int rc = sqlite3_exec(db, sql, 0, 0, &errMsg);
-    sqlite3_free(sql);
-    
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
-        return false;
+    time_t now = time(NULL);
+    pthread_mutex_lock(&db_lock);
+    sqlite3_stmt *stmt = get_stmt(STMT_ADD_HISTORY);
+    if (stmt) {
+        sqlite3_bind_text(stmt, 1, hostname, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, username ? username : "", -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, protocol ? protocol : "ssh", -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 4, (sqlite3_int64)now);
+        sqlite3_bind_double(stmt, 5, frecency_weight((double)now));
     }
-    return true;
+    bool ok = run_stmt(stmt);
+    pthread_mutex_unlock(&db_lock);
+    return ok;
 }
 
 HistoryEntry** db_get_recent_history(int limit, int *count) {
-    if (!db) {
-        *count = 0;
-        return NULL;
-    }
+    *count = 0;
+    if (!db || limit <= 0) return NULL;
 
-    sqlite3_stmt *stmt;
-    // Use GROUP BY to ensure uniqueness, picking the most recent timestamp
-    char *sql = sqlite3_mprintf("SELECT MAX(id), hostname, username, protocol, MAX(timestamp) FROM history GROUP BY hostname, username ORDER BY timestamp DESC LIMIT %d", limit);
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        sqlite3_free(sql);
-        *count = 0;
+    pthread_mutex_lock(&db_lock);
+    sqlite3_stmt *stmt = get_stmt(STMT_RECENT_HISTORY);
+    if (!stmt) {
+        pthread_mutex_unlock(&db_lock);
         return NULL;
     }
-    sqlite3_free(sql);
+    sqlite3_bind_int(stmt, 1, limit);
 
     int capacity = limit;
     int size = 0;
     HistoryEntry **entries = malloc(sizeof(HistoryEntry*) * capacity);
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
+    while (size < capacity && sqlite3_step(stmt) == SQLITE_ROW) {
         HistoryEntry *e = malloc(sizeof(HistoryEntry));
         e->id = sqlite3_column_int(stmt, 0);
-        e->hostname = strdup((const char*)sqlite3_column_text(stmt, 1));
-        e->username = strdup((const char*)sqlite3_column_text(stmt, 2));
-        e->protocol = strdup((const char*)sqlite3_column_text(stmt, 3));
+        e->hostname = column_strdup(stmt, 1);
+        e->username = column_strdup(stmt, 2);
+        e->protocol = column_strdup(stmt, 3);
         e->timestamp = (long)sqlite3_column_int64(stmt, 4);
+        e->use_count = sqlite3_column_int(stmt, 5);
 
         entries[size++] = e;
     }
 
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
+    pthread_mutex_unlock(&db_lock);
     *count = size;
     return entries;
 }
@@ -437,3 +859,142 @@ void db_free_history(HistoryEntry** entries, int count) {
     }
     free(entries);
 }
+
+// --- CONNECTION STATS ---
+static void bind_duration(sqlite3_stmt *stmt, int col, int64_t us) {
+    if (us < 0) sqlite3_bind_null(stmt, col);
+    else sqlite3_bind_int64(stmt, col, us);
+}
+
+static int64_t column_duration(sqlite3_stmt *stmt, int col) {
+    return sqlite3_column_type(stmt, col) == SQLITE_NULL ? -1 : sqlite3_column_int64(stmt, col);
+}
+
+bool db_add_connection_stats(int host_id, int proxy_host_id, const ConnectTiming *timing) {
+    if (!db) return false;
+
+    pthread_mutex_lock(&db_lock);
+    bool ok = begin_transaction();
+    sqlite3_stmt *stmt = ok ? get_stmt(STMT_ADD_CONNECTION_STATS) : NULL;
+    if (stmt) {
+        sqlite3_bind_int(stmt, 1, host_id);
+        sqlite3_bind_int(stmt, 2, proxy_host_id);
+        sqlite3_bind_int64(stmt, 3, timing->started_at);
+        for (int i = 0; i < CONNECT_PHASE_COUNT; i++) {
+            bind_duration(stmt, 4 + i, timing->phase_us[i]);
+        }
+        bind_duration(stmt, 10, timing->total_us);
+        bind_duration(stmt, 11, timing->publickey_us);
+        sqlite3_bind_text(stmt, 12, timing->auth_method, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 13, timing->failed_phase);
+    }
+    ok = ok && run_stmt(stmt);
+    if (ok) {
+        stmt = get_stmt(STMT_TRIM_CONNECTION_STATS);
+        if (stmt) {
+            sqlite3_bind_int(stmt, 1, host_id);
+            sqlite3_bind_int(stmt, 2, CONNECTION_STATS_KEEP);
+        }
+        ok = run_stmt(stmt);
+    }
+    ok = end_transaction(ok);
+    pthread_mutex_unlock(&db_lock);
+    return ok;
+}
+
+ConnectTiming* db_get_connection_stats(int host_id, int limit, int *count) {
+    *count = 0;
+    if (!db || limit <= 0) return NULL;
+
+    pthread_mutex_lock(&db_lock);
+    sqlite3_stmt *stmt = get_stmt(STMT_CONNECTION_STATS);
+    if (!stmt) {
+        pthread_mutex_unlock(&db_lock);
+        return NULL;
+    }
+    sqlite3_bind_int(stmt, 1, host_id);
+    sqlite3_bind_int(stmt, 2, limit);
+
+    int size = 0;
+    ConnectTiming *stats = malloc(sizeof(ConnectTiming) * limit);
+    while (size < limit && sqlite3_step(stmt) == SQLITE_ROW) {
+        ConnectTiming *t = &stats[size++];
+        connect_timing_reset(t);
+        t->started_at = sqlite3_column_int64(stmt, 0);
+        for (int i = 0; i < CONNECT_PHASE_COUNT; i++) {
+            t->phase_us[i] = column_duration(stmt, 1 + i);
+        }
+        t->total_us = column_duration(stmt, 7);
+        t->publickey_us = column_duration(stmt, 8);
+        const char *method = (const char*)sqlite3_column_text(stmt, 9);
+        snprintf(t->auth_method, sizeof(t->auth_method), "%s", method ? method : "");
+        t->failed_phase = sqlite3_column_int(stmt, 10);
+    }
+
+    sqlite3_reset(stmt);
+    pthread_mutex_unlock(&db_lock);
+    *count = size;
+    return stats;
+}
+
+// Reads a row of ECHO_LATENCY_COLUMNS, false if the stored buckets don't match this build
+static bool column_histogram(sqlite3_stmt *stmt, LatencyHistogram *h) {
+    latency_histogram_reset(h);
+    if (sqlite3_column_bytes(stmt, 4) != (int)sizeof(h->counts)) return false;
+    h->samples = (uint64_t)sqlite3_column_int64(stmt, 0);
+    h->sum_us = (uint64_t)sqlite3_column_int64(stmt, 1);
+    h->min_us = sqlite3_column_int64(stmt, 2);
+    h->max_us = sqlite3_column_int64(stmt, 3);
+    memcpy(h->counts, sqlite3_column_blob(stmt, 4), sizeof(h->counts));
+    return true;
+}
+
+bool db_merge_echo_latency(int host_id, int proxy_host_id, const LatencyHistogram *session) {
+    if (!db) return false;
+    if (session->samples == 0) return true;
+
+    LatencyHistogram total;
+    pthread_mutex_lock(&db_lock);
+    bool ok = begin_transaction();
+    sqlite3_stmt *stmt = ok ? get_stmt(STMT_FIND_ECHO_LATENCY) : NULL;
+    if (stmt) {
+        sqlite3_bind_int(stmt, 1, host_id);
+        sqlite3_bind_int(stmt, 2, proxy_host_id);
+        if (sqlite3_step(stmt) != SQLITE_ROW || !column_histogram(stmt, &total)) latency_histogram_reset(&total);
+        sqlite3_reset(stmt);
+    }
+    latency_histogram_merge(&total, session);
+
+    stmt = stmt ? get_stmt(STMT_SET_ECHO_LATENCY) : NULL;
+    if (stmt) {
+        sqlite3_bind_int(stmt, 1, host_id);
+        sqlite3_bind_int(stmt, 2, proxy_host_id);
+        sqlite3_bind_int64(stmt, 3, (sqlite3_int64)total.samples);
+        sqlite3_bind_int64(stmt, 4, (sqlite3_int64)total.sum_us);
+        sqlite3_bind_int64(stmt, 5, total.min_us);
+        sqlite3_bind_int64(stmt, 6, total.max_us);
+        sqlite3_bind_blob(stmt, 7, total.counts, sizeof(total.counts), SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 8, (sqlite3_int64)time(NULL));
+    }
+    ok = ok && run_stmt(stmt);
+    ok = end_transaction(ok);
+    pthread_mutex_unlock(&db_lock);
+    return ok;
+}
+
+bool db_get_echo_latency(int host_id, int proxy_host_id, LatencyHistogram *out) {
+    latency_histogram_reset(out);
+    if (!db) return false;
+
+    pthread_mutex_lock(&db_lock);
+    sqlite3_stmt *stmt = get_stmt(STMT_ECHO_LATENCY);
+    bool ok = stmt != NULL;
+    if (stmt) {
+        sqlite3_bind_int(stmt, 1, host_id);
+        sqlite3_bind_int(stmt, 2, proxy_host_id);
+        if (sqlite3_step(stmt) == SQLITE_ROW) column_histogram(stmt, out);
+        sqlite3_reset(stmt);
+    }
+    pthread_mutex_unlock(&db_lock);
+    return ok;
+}
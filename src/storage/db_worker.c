@@ -0,0 +1,351 @@
+#include "db_worker.h"
+#include "host_import.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    REQ_ADD_HOST,
+    REQ_UPDATE_HOST,
+    REQ_DELETE_HOST,
+    REQ_ADD_GROUP,
+    REQ_DELETE_GROUP,
+    REQ_IMPORT_HOSTS,
+    REQ_ADD_HISTORY,
+    REQ_LOAD_HOSTS,
+    REQ_GET_PASSWORDS,
+    REQ_RECENT_HISTORY,
+    REQ_ADD_CONNECTION_STATS,
+    REQ_CONNECTION_STATS,
+    REQ_MERGE_ECHO_LATENCY,
+    REQ_ECHO_LATENCY,
+    REQ_STOP
+} RequestType;
+
+typedef struct {
+    RequestType type;
+    
+    // Arguments
+    int id;
+    Host host;
+    char *hostname;
+    char *username;
+    char *protocol;
+    int limit;
+    char *path;
+    ConnectTiming timing;
+    LatencyHistogram *latency;  // Argument of a merge, result of a get
+    
+    // Results
+    bool ok;
+    Host *result_host;
+    Group *result_group;
+    Host **hosts;
+    int host_count;
+    Group **groups;
+    int group_count;
+    HistoryEntry **entries;
+    int entry_count;
+    char *password;
+    char *proxy_password;
+    ConnectTiming *stats;
+    int stats_count;
+    
+    GCallback done;
+    gpointer user_data;
+} DbRequest;
+
+static GThread *worker = NULL;
+static GAsyncQueue *queue = NULL;
+
+static void request_free(DbRequest *req) {
+    g_free(req->host.name);
+    g_free(req->host.hostname);
+    g_free(req->host.username);
+    db_free_password(req->host.password);
+    g_free(req->host.key_path);
+    g_free(req->host.protocol);
+    g_free(req->hostname);
+    g_free(req->username);
+    g_free(req->protocol);
+    g_free(req->path);
+    db_free_password(req->password);
+    db_free_password(req->proxy_password);
+    free(req->stats);
+    g_free(req->latency);
+    g_free(req);
+}
+
+static gboolean complete_request(gpointer user_data) {
+    DbRequest *req = (DbRequest *)user_data;
+    
+    switch (req->type) {
+        case REQ_LOAD_HOSTS:
+            ((DbHostsFunc)req->done)(req->hosts, req->host_count, req->groups, req->group_count, req->user_data);
+            break;
+        case REQ_RECENT_HISTORY:
+            ((DbHistoryFunc)req->done)(req->entries, req->entry_count, req->user_data);
+            break;
+        case REQ_CONNECTION_STATS:
+            ((DbStatsFunc)req->done)(req->stats, req->stats_count, req->user_data);
+            req->stats = NULL;
+            break;
+        case REQ_ECHO_LATENCY:
+            ((DbLatencyFunc)req->done)(req->latency, req->user_data);
+            break;
+        case REQ_ADD_HOST:
+        case REQ_UPDATE_HOST:
+            ((DbHostFunc)req->done)(req->result_host, req->user_data);
+            break;
+        case REQ_ADD_GROUP:
+            ((DbGroupFunc)req->done)(req->result_group, req->user_data);
+            break;
+        case REQ_IMPORT_HOSTS:
+            ((DbCountFunc)req->done)(req->id, req->user_data);
+            break;
+        case REQ_GET_PASSWORDS:
+            // Handed over to the callback
+            ((DbPasswordFunc)req->done)(req->password, req->proxy_password, req->user_data);
+            req->password = req->proxy_password = NULL;
+            break;
+        default:
+            ((DbDoneFunc)req->done)(req->ok, req->user_data);
+            break;
+    }
+    request_free(req);
+    return G_SOURCE_REMOVE;
+}
+
+static void run_request(DbRequest *req) {
+    Host *h = &req->host;
+    switch (req->type) {
+        case REQ_ADD_HOST:
+            req->id = db_add_host(h->name, h->hostname, h->port, h->username, h->password, h->key_path, h->protocol, h->group_id, h->proxy_host_id);
+            req->ok = req->id >= 0;
+            // Read the row back so the caller sees exactly what was stored
+            if (req->ok && req->done) req->result_host = db_get_host_by_id(req->id);
+            break;
+        case REQ_UPDATE_HOST:
+            req->ok = db_update_host(req->id, h->name, h->hostname, h->port, h->username, h->password, h->key_path, h->protocol, h->group_id, h->proxy_host_id);
+            if (req->ok && req->done) req->result_host = db_get_host_by_id(req->id);
+            break;
+        case REQ_DELETE_HOST:
+            req->ok = db_delete_host(req->id);
+            break;
+        case REQ_ADD_GROUP:
+            req->id = db_add_group(h->name);
+            req->ok = req->id >= 0;
+            if (req->ok && req->done) {
+                req->result_group = malloc(sizeof(Group));
+                req->result_group->id = req->id;
+                req->result_group->name = strdup(h->name);
+            }
+            break;
+        case REQ_DELETE_GROUP:
+            req->ok = db_delete_group(req->id);
+            break;
+        case REQ_IMPORT_HOSTS: {
+            HostImportList *list = host_import_list_new();
+            req->ok = req->path ? host_import_file(list, req->path) : host_import_ssh_dir(list);
+            int count = 0;
+            HostImport *hosts = host_import_list_take(list, &count);
+            // Number of hosts added
+            req->id = req->ok ? db_import_hosts(hosts, count) : -1;
+            req->ok = req->id >= 0;
+            host_import_free(hosts, count);
+            host_import_list_free(list);
+            break;
+        }
+        case REQ_ADD_HISTORY:
+            req->ok = db_add_history(req->hostname, req->username, req->protocol);
+            break;
+        case REQ_LOAD_HOSTS:
+            req->hosts = db_get_all_hosts(&req->host_count);
+            req->groups = db_get_all_groups(&req->group_count);
+            req->ok = true;
+            break;
+        case REQ_GET_PASSWORDS:
+            req->password = db_get_host_password(req->id);
+            if (h->proxy_host_id > 0) req->proxy_password = db_get_host_password(h->proxy_host_id);
+            req->ok = true;
+            break;
+        case REQ_RECENT_HISTORY:
+            req->entries = db_get_recent_history(req->limit, &req->entry_count);
+            req->ok = true;
+            break;
+        case REQ_ADD_CONNECTION_STATS:
+            req->ok = db_add_connection_stats(req->id, h->proxy_host_id, &req->timing);
+            break;
+        case REQ_CONNECTION_STATS:
+            req->stats = db_get_connection_stats(req->id, req->limit, &req->stats_count);
+            req->ok = true;
+            break;
+        case REQ_MERGE_ECHO_LATENCY:
+            req->ok = db_merge_echo_latency(req->id, h->proxy_host_id, req->latency);
+            break;
+        case REQ_ECHO_LATENCY:
+            req->latency = g_new(LatencyHistogram, 1);
+            req->ok = db_get_echo_latency(req->id, h->proxy_host_id, req->latency);
+            break;
+        case REQ_STOP:
+            break;
+    }
+    
+    if (req->done) {
+        g_idle_add(complete_request, req);
+    } else {
+        request_free(req);
+    }
+}
+
+static gpointer worker_func(gpointer user_data) {
+    trace_set_thread_name("db-worker");
+    while (TRUE) {
+        DbRequest *req = g_async_queue_pop(queue);
+        if (req->type == REQ_STOP) {
+            request_free(req);
+            break;
+        }
+        run_request(req);
+    }
+    return NULL;
+}
+
+static void submit(DbRequest *req) {
+    // Without a worker the request runs here, its callback still comes from the main loop
+    if (worker) {
+        g_async_queue_push(queue, req);
+    } else {
+        run_request(req);
+    }
+}
+
+static DbRequest* request_new(RequestType type, GCallback done, gpointer user_data) {
+    DbRequest *req = g_new0(DbRequest, 1);
+    req->type = type;
+    req->done = done;
+    req->user_data = user_data;
+    return req;
+}
+
+static void set_host(DbRequest *req, const char* name, const char* hostname, int port, const char* user, const char* password, const char* key_path, const char* protocol, int group_id, int proxy_host_id) {
+    req->host.name = g_strdup(name);
+    req->host.hostname = g_strdup(hostname);
+    req->host.port = port;
+    req->host.username = g_strdup(user);
+    req->host.password = g_strdup(password);
+    req->host.key_path = g_strdup(key_path);
+    req->host.protocol = g_strdup(protocol);
+    req->host.group_id = group_id;
+    req->host.proxy_host_id = proxy_host_id;
+}
+
+bool db_worker_start() {
+    if (worker) return true;
+    queue = g_async_queue_new();
+    worker = g_thread_try_new("db-worker", worker_func, NULL, NULL);
+    return worker != NULL;
+}
+
+void db_worker_stop() {
+    if (!worker) return;
+    g_async_queue_push(queue, request_new(REQ_STOP, NULL, NULL));
+    g_thread_join(worker);
+    worker = NULL;
+    g_async_queue_unref(queue);
+    queue = NULL;
+}
+
+void db_async_add_host(const char* name, const char* hostname, int port, const char* user, const char* password, const char* key_path, const char* protocol, int group_id, int proxy_host_id,
+                       DbHostFunc done, gpointer user_data) {
+    DbRequest *req = request_new(REQ_ADD_HOST, G_CALLBACK(done), user_data);
+    set_host(req, name, hostname, port, user, password, key_path, protocol, group_id, proxy_host_id);
+    submit(req);
+}
+
+void db_async_update_host(int id, const char* name, const char* hostname, int port, const char* user, const char* password, const char* key_path, const char* protocol, int group_id, int proxy_host_id,
+                          DbHostFunc done, gpointer user_data) {
+    DbRequest *req = request_new(REQ_UPDATE_HOST, G_CALLBACK(done), user_data);
+    req->id = id;
+    set_host(req, name, hostname, port, user, password, key_path, protocol, group_id, proxy_host_id);
+    submit(req);
+}
+
+void db_async_delete_host(int id, DbDoneFunc done, gpointer user_data) {
+    DbRequest *req = request_new(REQ_DELETE_HOST, G_CALLBACK(done), user_data);
+    req->id = id;
+    submit(req);
+}
+
+void db_async_add_group(const char* name, DbGroupFunc done, gpointer user_data) {
+    DbRequest *req = request_new(REQ_ADD_GROUP, G_CALLBACK(done), user_data);
+    req->host.name = g_strdup(name);
+    submit(req);
+}
+
+void db_async_delete_group(int id, DbDoneFunc done, gpointer user_data) {
+    DbRequest *req = request_new(REQ_DELETE_GROUP, G_CALLBACK(done), user_data);
+    req->id = id;
+    submit(req);
+}
+
+void db_async_import_hosts(const char *path, DbCountFunc done, gpointer user_data) {
+    DbRequest *req = request_new(REQ_IMPORT_HOSTS, G_CALLBACK(done), user_data);
+    req->path = g_strdup(path);
+    submit(req);
+}
+
+void db_async_add_history(const char* hostname, const char* username, const char* protocol) {
+    DbRequest *req = request_new(REQ_ADD_HISTORY, NULL, NULL);
+    req->hostname = g_strdup(hostname);
+    req->username = g_strdup(username);
+    req->protocol = g_strdup(protocol);
+    submit(req);
+}
+
+void db_async_load_hosts(DbHostsFunc done, gpointer user_data) {
+    submit(request_new(REQ_LOAD_HOSTS, G_CALLBACK(done), user_data));
+}
+
+void db_async_get_passwords(int host_id, int proxy_host_id, DbPasswordFunc done, gpointer user_data) {
+    DbRequest *req = request_new(REQ_GET_PASSWORDS, G_CALLBACK(done), user_data);
+    req->id = host_id;
+    req->host.proxy_host_id = proxy_host_id;
+    submit(req);
+}
+
+void db_async_get_recent_history(int limit, DbHistoryFunc done, gpointer user_data) {
+    DbRequest *req = request_new(REQ_RECENT_HISTORY, G_CALLBACK(done), user_data);
+    req->limit = limit;
+    submit(req);
+}
+
+void db_async_add_connection_stats(int host_id, int proxy_host_id, const ConnectTiming *timing) {
+    DbRequest *req = request_new(REQ_ADD_CONNECTION_STATS, NULL, NULL);
+    req->id = host_id;
+    req->host.proxy_host_id = proxy_host_id;
+    req->timing = *timing;
+    submit(req);
+}
+
+void db_async_get_connection_stats(int host_id, int limit, DbStatsFunc done, gpointer user_data) {
+    DbRequest *req = request_new(REQ_CONNECTION_STATS, G_CALLBACK(done), user_data);
+    req->id = host_id;
+    req->limit = limit;
+    submit(req);
+}
+
+void db_async_merge_echo_latency(int host_id, int proxy_host_id, const LatencyHistogram *session) {
+    DbRequest *req = request_new(REQ_MERGE_ECHO_LATENCY, NULL, NULL);
+    req->id = host_id;
+    req->host.proxy_host_id = proxy_host_id;
+    req->latency = g_memdup2(session, sizeof(*session));
+    submit(req);
+}
+
+void db_async_get_echo_latency(int host_id, int proxy_host_id, DbLatencyFunc done, gpointer user_data) {
+    DbRequest *req = request_new(REQ_ECHO_LATENCY, G_CALLBACK(done), user_data);
+    req->id = host_id;
+    req->host.proxy_host_id = proxy_host_id;
+    submit(req);
+}
@@ -0,0 +1,311 @@
+#include "host_repo.h"
+#include "db_worker.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    guint handle;
+    HostRepoListener func;
+    gpointer user_data;
+} Listener;
+
+// hosts_by_id and groups_by_id own the rows, the arrays only point into them
+static GHashTable *hosts_by_id = NULL;
+static GHashTable *group_hosts = NULL;   // group id -> GPtrArray of Host*, sorted
+static GPtrArray *hosts_by_name = NULL;
+static GHashTable *groups_by_id = NULL;
+static GPtrArray *groups_sorted = NULL;
+static bool loaded = false;
+
+static GArray *listeners = NULL;
+static guint next_handle = 1;
+
+static void free_group(Group *g) {
+    free(g->name);
+    free(g);
+}
+
+static void ensure_tables() {
+    if (hosts_by_id) return;
+    hosts_by_id = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)db_free_host);
+    group_hosts = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_ptr_array_unref);
+    hosts_by_name = g_ptr_array_new();
+    groups_by_id = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)free_group);
+    groups_sorted = g_ptr_array_new();
+}
+
+static void emit(HostRepoEvent event, int id) {
+    if (!listeners) return;
+    for (guint i = 0; i < listeners->len; i++) {
+        Listener *l = &g_array_index(listeners, Listener, i);
+        l->func(event, id, l->user_data);
+    }
+}
+
+// Same order as the ORDER BY name of the queries, ties broken by id
+static int compare_hosts(gconstpointer a, gconstpointer b) {
+    const Host *ha = a, *hb = b;
+    int c = strcmp(ha->name, hb->name);
+    if (c != 0) return c;
+    return (ha->id > hb->id) - (ha->id < hb->id);
+}
+
+static int compare_groups(gconstpointer a, gconstpointer b) {
+    const Group *ga = a, *gb = b;
+    int c = strcmp(ga->name, gb->name);
+    if (c != 0) return c;
+    return (ga->id > gb->id) - (ga->id < gb->id);
+}
+
+// First index whose element is not less than item
+static guint lower_bound(GPtrArray *arr, gconstpointer item, GCompareFunc cmp) {
+    guint lo = 0, hi = arr->len;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        if (cmp(g_ptr_array_index(arr, mid), item) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static int sorted_find(GPtrArray *arr, gconstpointer item, GCompareFunc cmp) {
+    guint i = lower_bound(arr, item, cmp);
+    if (i < arr->len && g_ptr_array_index(arr, i) == item) return (int)i;
+    return -1;
+}
+
+static void sorted_insert(GPtrArray *arr, gpointer item, GCompareFunc cmp) {
+    g_ptr_array_insert(arr, (gint)lower_bound(arr, item, cmp), item);
+}
+
+static void sorted_remove(GPtrArray *arr, gconstpointer item, GCompareFunc cmp) {
+    int i = sorted_find(arr, item, cmp);
+    if (i >= 0) g_ptr_array_remove_index(arr, (guint)i);
+}
+
+static GPtrArray* get_group_array(int group_id, bool create) {
+    GPtrArray *arr = g_hash_table_lookup(group_hosts, GINT_TO_POINTER(group_id));
+    if (!arr && create) {
+        arr = g_ptr_array_new();
+        g_hash_table_insert(group_hosts, GINT_TO_POINTER(group_id), arr);
+    }
+    return arr;
+}
+
+static void index_host(Host *h) {
+    g_hash_table_insert(hosts_by_id, GINT_TO_POINTER(h->id), h);
+    sorted_insert(hosts_by_name, h, compare_hosts);
+    sorted_insert(get_group_array(h->group_id, true), h, compare_hosts);
+}
+
+// Drops the host from every index and frees it
+static void remove_host(Host *h) {
+    GPtrArray *arr = get_group_array(h->group_id, false);
+    if (arr) sorted_remove(arr, h, compare_hosts);
+    sorted_remove(hosts_by_name, h, compare_hosts);
+    g_hash_table_remove(hosts_by_id, GINT_TO_POINTER(h->id));
+}
+
+guint host_repo_add_listener(HostRepoListener listener, gpointer user_data) {
+    if (!listeners) listeners = g_array_new(FALSE, FALSE, sizeof(Listener));
+    Listener l = { next_handle++, listener, user_data };
+    g_array_append_val(listeners, l);
+    return l.handle;
+}
+
+void host_repo_remove_listener(guint handle) {
+    if (!listeners) return;
+    for (guint i = 0; i < listeners->len; i++) {
+        if (g_array_index(listeners, Listener, i).handle == handle) {
+            g_array_remove_index(listeners, i);
+            return;
+        }
+    }
+}
+
+static void on_loaded(Host **hosts, int host_count, Group **groups, int group_count, gpointer user_data) {
+    ensure_tables();
+    g_ptr_array_set_size(hosts_by_name, 0);
+    g_ptr_array_set_size(groups_sorted, 0);
+    g_hash_table_remove_all(group_hosts);
+    g_hash_table_remove_all(hosts_by_id);
+    g_hash_table_remove_all(groups_by_id);
+
+    // Rows arrive sorted by name, so the sorted inserts are appends
+    for (int i = 0; i < host_count; i++) {
+        index_host(hosts[i]);
+    }
+    for (int i = 0; i < group_count; i++) {
+        g_hash_table_insert(groups_by_id, GINT_TO_POINTER(groups[i]->id), groups[i]);
+        sorted_insert(groups_sorted, groups[i], compare_groups);
+    }
+    // The rows now belong to the tables
+    free(hosts);
+    free(groups);
+
+    loaded = true;
+    emit(HOST_REPO_RELOADED, 0);
+}
+
+void host_repo_load() {
+    db_async_load_hosts(on_loaded, NULL);
+}
+
+bool host_repo_is_loaded() {
+    return loaded;
+}
+
+const Host* host_repo_get_host(int id) {
+    if (!hosts_by_id) return NULL;
+    return g_hash_table_lookup(hosts_by_id, GINT_TO_POINTER(id));
+}
+
+const Host* host_repo_find_host_by_name(const char *name) {
+    if (!hosts_by_name || !name) return NULL;
+    Host key = { .id = G_MININT, .name = (char *)name };
+    guint i = lower_bound(hosts_by_name, &key, compare_hosts);
+    if (i < hosts_by_name->len) {
+        Host *h = g_ptr_array_index(hosts_by_name, i);
+        if (strcmp(h->name, name) == 0) return h;
+    }
+    return NULL;
+}
+
+const Host* const* host_repo_get_hosts(int *count) {
+    *count = hosts_by_name ? (int)hosts_by_name->len : 0;
+    return hosts_by_name ? (const Host* const*)hosts_by_name->pdata : NULL;
+}
+
+const Host* const* host_repo_get_group_hosts(int group_id, int *count) {
+    *count = 0;
+    if (!group_hosts) return NULL;
+    GPtrArray *arr = get_group_array(group_id, false);
+    if (!arr) return NULL;
+    *count = (int)arr->len;
+    return (const Host* const*)arr->pdata;
+}
+
+int host_repo_get_host_position(int id) {
+    const Host *h = host_repo_get_host(id);
+    if (!h) return -1;
+    GPtrArray *arr = get_group_array(h->group_id, false);
+    return arr ? sorted_find(arr, h, compare_hosts) : -1;
+}
+
+const Group* host_repo_get_group(int id) {
+    if (!groups_by_id) return NULL;
+    return g_hash_table_lookup(groups_by_id, GINT_TO_POINTER(id));
+}
+
+const Group* const* host_repo_get_groups(int *count) {
+    *count = groups_sorted ? (int)groups_sorted->len : 0;
+    return groups_sorted ? (const Group* const*)groups_sorted->pdata : NULL;
+}
+
+int host_repo_get_group_position(int id) {
+    const Group *g = host_repo_get_group(id);
+    return g ? sorted_find(groups_sorted, g, compare_groups) : -1;
+}
+
+// --- Writes ---
+
+static void on_host_written(Host *host, gpointer user_data) {
+    if (!host) {
+        LOG_ERROR("hosts", "Failed to save host");
+        return;
+    }
+    ensure_tables();
+
+    Host *old = g_hash_table_lookup(hosts_by_id, GINT_TO_POINTER(host->id));
+    bool existed = old != NULL;
+    if (old) remove_host(old);
+    index_host(host);
+    emit(existed ? HOST_REPO_HOST_CHANGED : HOST_REPO_HOST_ADDED, host->id);
+}
+
+static void on_host_deleted(bool ok, gpointer user_data) {
+    int id = GPOINTER_TO_INT(user_data);
+    Host *h = hosts_by_id ? g_hash_table_lookup(hosts_by_id, GINT_TO_POINTER(id)) : NULL;
+    if (!ok || !h) return;
+
+    remove_host(h);
+    emit(HOST_REPO_HOST_REMOVED, id);
+}
+
+static void on_group_added(Group *group, gpointer user_data) {
+    if (!group) {
+        LOG_ERROR("hosts", "Failed to add group");
+        return;
+    }
+    ensure_tables();
+
+    g_hash_table_insert(groups_by_id, GINT_TO_POINTER(group->id), group);
+    sorted_insert(groups_sorted, group, compare_groups);
+    emit(HOST_REPO_GROUP_ADDED, group->id);
+}
+
+static void on_group_deleted(bool ok, gpointer user_data) {
+    int id = GPOINTER_TO_INT(user_data);
+    Group *g = groups_by_id ? g_hash_table_lookup(groups_by_id, GINT_TO_POINTER(id)) : NULL;
+    if (!ok || !g) return;
+
+    // Mirror db_delete_group: the members become ungrouped
+    GPtrArray *members = get_group_array(id, false);
+    if (members) {
+        g_ptr_array_ref(members);
+        g_hash_table_remove(group_hosts, GINT_TO_POINTER(id));
+        GPtrArray *ungrouped = get_group_array(0, true);
+        for (guint i = 0; i < members->len; i++) {
+            Host *h = g_ptr_array_index(members, i);
+            h->group_id = 0;
+            sorted_insert(ungrouped, h, compare_hosts);
+            emit(HOST_REPO_HOST_CHANGED, h->id);
+        }
+        g_ptr_array_unref(members);
+    }
+
+    sorted_remove(groups_sorted, g, compare_groups);
+    g_hash_table_remove(groups_by_id, GINT_TO_POINTER(id));
+    emit(HOST_REPO_GROUP_REMOVED, id);
+}
+
+void host_repo_add_host(const char* name, const char* hostname, int port, const char* user, const char* password, const char* key_path, const char* protocol, int group_id, int proxy_host_id) {
+    db_async_add_host(name, hostname, port, user, password, key_path, protocol, group_id, proxy_host_id, on_host_written, NULL);
+}
+
+void host_repo_update_host(int id, const char* name, const char* hostname, int port, const char* user, const char* password, const char* key_path, const char* protocol, int group_id, int proxy_host_id) {
+    db_async_update_host(id, name, hostname, port, user, password, key_path, protocol, group_id, proxy_host_id, on_host_written, NULL);
+}
+
+void host_repo_delete_host(int id) {
+    db_async_delete_host(id, on_host_deleted, GINT_TO_POINTER(id));
+}
+
+void host_repo_add_group(const char* name) {
+    db_async_add_group(name, on_group_added, NULL);
+}
+
+void host_repo_delete_group(int id) {
+    db_async_delete_group(id, on_group_deleted, GINT_TO_POINTER(id));
+}
+
+typedef struct {
+    void (*done)(int added, gpointer user_data);
+    gpointer user_data;
+} ImportCall;
+
+static void on_imported(int added, gpointer user_data) {
+    ImportCall *call = user_data;
+    // New groups and proxies came with the rows, a full reload is cheaper than one event per host
+    if (added > 0) host_repo_load();
+    if (call->done) call->done(added, call->user_data);
+    g_free(call);
+}
+
+void host_repo_import(const char *path, void (*done)(int added, gpointer user_data), gpointer user_data) {
+    ImportCall *call = g_new0(ImportCall, 1);
+    call->done = done;
+    call->user_data = user_data;
+    db_async_import_hosts(path, on_imported, call);
+}
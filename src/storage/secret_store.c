@@ -0,0 +1,65 @@
+#include "secret_store.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_LIBSECRET
+#include <libsecret/secret.h>
+
+static const SecretSchema* host_schema() {
+    static const SecretSchema schema = {
+        "io.github.benladamm.ssh_client.Host", SECRET_SCHEMA_NONE,
+        {
+            { "host_id", SECRET_SCHEMA_ATTRIBUTE_INTEGER },
+            { NULL, 0 },
+        }
+    };
+    return &schema;
+}
+
+bool secret_store_save(int host_id, const char *password) {
+    char label[64];
+    snprintf(label, sizeof(label), "Modern SSH host %d", host_id);
+    GError *error = NULL;
+    bool ok = secret_password_store_sync(host_schema(), SECRET_COLLECTION_DEFAULT, label, password, NULL, &error,
+                                         "host_id", host_id, NULL);
+    if (error) {
+        LOG_WARN("db", "Keyring save failed: %s", error->message);
+        g_error_free(error);
+    }
+    return ok;
+}
+
+char* secret_store_lookup(int host_id) {
+    GError *error = NULL;
+    gchar *secret = secret_password_lookup_sync(host_schema(), NULL, &error, "host_id", host_id, NULL);
+    if (error) {
+        LOG_WARN("db", "Keyring lookup failed: %s", error->message);
+        g_error_free(error);
+    }
+    if (!secret) return NULL;
+    // Handed out as a plain malloc string, the keyring copy is wiped here
+    char *password = strdup(secret);
+    secret_password_free(secret);
+    return password;
+}
+
+void secret_store_delete(int host_id) {
+    secret_password_clear_sync(host_schema(), NULL, NULL, "host_id", host_id, NULL);
+}
+
+#else
+
+bool secret_store_save(int host_id, const char *password) {
+    return false;
+}
+
+char* secret_store_lookup(int host_id) {
+    return NULL;
+}
+
+void secret_store_delete(int host_id) {
+}
+
+#endif
@@ -0,0 +1,420 @@
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define RING_SIZE 512               // Records per thread, a power of two
+#define TEXT_MAX 96
+#define FLUSH_INTERVAL_MS 200
+#define THREAD_NAMES_MAX 256
+
+typedef enum {
+    RECORD_LOG,
+    RECORD_SPAN,
+    RECORD_THREAD_NAME
+} RecordKind;
+
+typedef struct {
+    int64_t ts_us;
+    int64_t dur_us;
+    const char *category;
+    const char *name;
+    int tid;
+    uint8_t kind;
+    uint8_t level;
+    char text[TEXT_MAX];
+} TraceRecord;
+
+// Single producer (the owner thread), single consumer (whoever holds drain_lock)
+typedef struct TraceRing {
+    TraceRecord records[RING_SIZE];
+    atomic_uint head;               // Next slot the owner writes
+    atomic_uint tail;               // Next slot the flusher reads
+    atomic_uint dropped;            // Records lost while the ring was full
+    unsigned dropped_reported;
+    atomic_bool dead;               // Owner thread exited
+    int tid;
+    struct TraceRing *next;         // Only changed by the flusher once published
+} TraceRing;
+
+atomic_int trace_runtime_level = TRACE_LEVEL_WARN;
+atomic_bool trace_spans_enabled = false;
+
+static const char *level_names[] = { "ERROR", "WARN", "INFO", "DEBUG", "TRACE" };
+
+// New rings are pushed in front, so producers never wait for each other
+static _Atomic(TraceRing*) rings = NULL;
+static __thread TraceRing *local_ring = NULL;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+// Consumer state, all under drain_lock
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static bool stopping = false;
+static FILE *log_file = NULL;
+static bool log_file_owned = false;
+static int64_t start_us = 0;
+// Latest spans and log lines, oldest overwritten first
+static TraceRecord *timeline = NULL;
+static int timeline_size = 0;
+static int timeline_count = 0;
+static int timeline_next = 0;
+static struct {
+    int tid;
+    char name[32];
+} thread_names[THREAD_NAMES_MAX];
+static int thread_name_count = 0;
+
+static pthread_t flusher;
+static atomic_bool running = false;
+
+int64_t trace_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// The ring outlives its thread until the flusher has drained it
+static void ring_release(void *data) {
+    TraceRing *ring = (TraceRing *)data;
+    local_ring = NULL;
+    atomic_store_explicit(&ring->dead, true, memory_order_release);
+}
+
+static void make_ring_key() {
+    pthread_key_create(&ring_key, ring_release);
+}
+
+static TraceRing* get_ring() {
+    if (local_ring) return local_ring;
+
+    pthread_once(&ring_key_once, make_ring_key);
+    TraceRing *ring = calloc(1, sizeof(TraceRing));
+    if (!ring) return NULL;
+    ring->tid = (int)syscall(SYS_gettid);
+    pthread_setspecific(ring_key, ring);
+
+    ring->next = atomic_load_explicit(&rings, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&rings, &ring->next, ring, memory_order_release, memory_order_relaxed)) {
+    }
+    local_ring = ring;
+    return ring;
+}
+
+// Slot for the next record of the calling thread, NULL (and counted) when its ring is full
+static TraceRecord* ring_reserve(TraceRing **out) {
+    TraceRing *ring = get_ring();
+    if (!ring) return NULL;
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return NULL;
+    }
+    *out = ring;
+    TraceRecord *r = &ring->records[head & (RING_SIZE - 1)];
+    r->tid = ring->tid;
+    r->name = NULL;
+    r->dur_us = 0;
+    return r;
+}
+
+static void ring_commit(TraceRing *ring) {
+    atomic_fetch_add_explicit(&ring->head, 1, memory_order_release);
+}
+
+void trace_log(TraceLevel level, const char *category, const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+
+    if (!atomic_load_explicit(&running, memory_order_acquire)) {
+        // Nothing drains the rings yet
+        fprintf(stderr, "%-5s %s: ", level_names[level], category);
+        vfprintf(stderr, format, ap);
+        fputc('\n', stderr);
+        va_end(ap);
+        return;
+    }
+
+    TraceRing *ring = NULL;
+    TraceRecord *r = ring_reserve(&ring);
+    if (r) {
+        r->kind = RECORD_LOG;
+        r->level = level;
+        r->category = category;
+        r->ts_us = trace_now_us();
+        vsnprintf(r->text, sizeof(r->text), format, ap);
+        ring_commit(ring);
+    }
+    va_end(ap);
+}
+
+void trace_span_record(const char *category, const char *name, int64_t start, int64_t duration_us, const char *detail) {
+    if (!atomic_load_explicit(&trace_spans_enabled, memory_order_relaxed)) return;
+
+    TraceRing *ring = NULL;
+    TraceRecord *r = ring_reserve(&ring);
+    if (!r) return;
+    r->kind = RECORD_SPAN;
+    r->category = category;
+    r->name = name;
+    r->ts_us = start;
+    r->dur_us = duration_us;
+    snprintf(r->text, sizeof(r->text), "%s", detail ? detail : "");
+    ring_commit(ring);
+}
+
+void trace_span_end(TraceSpan *span) {
+    if (span->start_us < 0) return;
+    trace_span_record(span->category, span->name, span->start_us, trace_now_us() - span->start_us, NULL);
+    span->start_us = -1;
+}
+
+void trace_span_end_detail(TraceSpan *span, const char *format, ...) {
+    if (span->start_us < 0) return;
+    int64_t end = trace_now_us();
+
+    TraceRing *ring = NULL;
+    TraceRecord *r = ring_reserve(&ring);
+    if (r) {
+        r->kind = RECORD_SPAN;
+        r->category = span->category;
+        r->name = span->name;
+        r->ts_us = span->start_us;
+        r->dur_us = end - span->start_us;
+        va_list ap;
+        va_start(ap, format);
+        vsnprintf(r->text, sizeof(r->text), format, ap);
+        va_end(ap);
+        ring_commit(ring);
+    }
+    span->start_us = -1;
+}
+
+void trace_set_thread_name(const char *name) {
+    if (!atomic_load_explicit(&running, memory_order_acquire)) return;
+
+    TraceRing *ring = NULL;
+    TraceRecord *r = ring_reserve(&ring);
+    if (!r) return;
+    r->kind = RECORD_THREAD_NAME;
+    r->ts_us = trace_now_us();
+    snprintf(r->text, sizeof(r->text), "%s", name);
+    ring_commit(ring);
+}
+
+void trace_set_level(TraceLevel level) {
+    atomic_store_explicit(&trace_runtime_level, (int)level, memory_order_relaxed);
+}
+
+TraceLevel trace_level_from_name(const char *name, TraceLevel fallback) {
+    if (!name) return fallback;
+    static const char *names[] = { "error", "warn", "info", "debug", "trace" };
+    for (int i = 0; i <= TRACE_LEVEL_TRACE; i++) {
+        if (strcasecmp(name, names[i]) == 0) return (TraceLevel)i;
+    }
+    return fallback;
+}
+
+// --- Consumer side, drain_lock held ---
+static void remember_thread_name(int tid, const char *name) {
+    int i = 0;
+    while (i < thread_name_count && thread_names[i].tid != tid) i++;
+    if (i == THREAD_NAMES_MAX) return;
+    if (i == thread_name_count) thread_name_count++;
+    thread_names[i].tid = tid;
+    snprintf(thread_names[i].name, sizeof(thread_names[i].name), "%s", name);
+}
+
+static void handle_record(const TraceRecord *r) {
+    if (r->kind == RECORD_THREAD_NAME) {
+        remember_thread_name(r->tid, r->text);
+        return;
+    }
+    if (r->kind == RECORD_LOG && log_file) {
+        fprintf(log_file, "%12.6f %-5s [%d] %s: %s\n", (r->ts_us - start_us) / 1e6, level_names[r->level], r->tid, r->category, r->text);
+    }
+    if (timeline) {
+        timeline[timeline_next] = *r;
+        timeline_next = (timeline_next + 1) % timeline_size;
+        if (timeline_count < timeline_size) timeline_count++;
+    }
+}
+
+static void drain_ring(TraceRing *ring) {
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    for (; tail != head; tail++) {
+        handle_record(&ring->records[tail & (RING_SIZE - 1)]);
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+    unsigned dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    if (dropped != ring->dropped_reported && log_file) {
+        fprintf(log_file, "%12.6f WARN  [%d] trace: %u records dropped, ring full\n",
+                (trace_now_us() - start_us) / 1e6, ring->tid, dropped - ring->dropped_reported);
+    }
+    ring->dropped_reported = dropped;
+}
+
+static void drain_all() {
+    TraceRing *prev = NULL;
+    TraceRing *ring = atomic_load_explicit(&rings, memory_order_acquire);
+    while (ring) {
+        // Read before draining, so the last records of a finished thread are seen
+        bool dead = atomic_load_explicit(&ring->dead, memory_order_acquire);
+        drain_ring(ring);
+        TraceRing *next = ring->next;
+        // The list head stays: new rings are being pushed in front of it
+        if (dead && prev) {
+            prev->next = next;
+            free(ring);
+        } else {
+            prev = ring;
+        }
+        ring = next;
+    }
+    if (log_file) fflush(log_file);
+}
+
+static void* flusher_func(void *arg) {
+    trace_set_thread_name("trace-flush");
+    pthread_mutex_lock(&drain_lock);
+    while (!stopping) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += FLUSH_INTERVAL_MS * 1000000L;
+        until.tv_sec += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&wake, &drain_lock, &until);
+        drain_all();
+    }
+    pthread_mutex_unlock(&drain_lock);
+    return NULL;
+}
+
+bool trace_start(TraceLevel level, const char *log_path, int timeline_events) {
+    if (atomic_load(&running)) return true;
+
+    pthread_mutex_lock(&drain_lock);
+    start_us = trace_now_us();
+    stopping = false;
+    log_file = stderr;
+    log_file_owned = false;
+    FILE *f = log_path && log_path[0] ? fopen(log_path, "a") : NULL;
+    if (f) {
+        log_file = f;
+        log_file_owned = true;
+    }
+    free(timeline);
+    timeline = timeline_events > 0 ? calloc(timeline_events, sizeof(TraceRecord)) : NULL;
+    timeline_size = timeline ? timeline_events : 0;
+    timeline_count = timeline_next = 0;
+    pthread_mutex_unlock(&drain_lock);
+
+    trace_set_level(level);
+    atomic_store(&running, true);
+    if (pthread_create(&flusher, NULL, flusher_func, NULL) != 0) {
+        atomic_store(&running, false);
+        return false;
+    }
+    atomic_store(&trace_spans_enabled, timeline != NULL);
+
+    if (log_path && log_path[0] && !f) LOG_WARN("trace", "Could not open %s, logging to stderr", log_path);
+    return true;
+}
+
+void trace_stop() {
+    if (!atomic_load(&running)) return;
+    atomic_store(&trace_spans_enabled, false);
+
+    pthread_mutex_lock(&drain_lock);
+    stopping = true;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&drain_lock);
+    pthread_join(flusher, NULL);
+    atomic_store(&running, false);
+
+    // Whatever came in while the flusher was exiting
+    pthread_mutex_lock(&drain_lock);
+    drain_all();
+    if (log_file_owned) fclose(log_file);
+    log_file = NULL;
+    log_file_owned = false;
+    pthread_mutex_unlock(&drain_lock);
+}
+
+// Length of s without a multibyte character cut short by the fixed-size text
+static size_t whole_utf8_len(const char *s) {
+    size_t len = strlen(s);
+    size_t start = len;
+    while (start > 0 && len - start < 3 && ((unsigned char)s[start - 1] & 0xC0) == 0x80) start--;
+    if (start == 0) return len;
+    unsigned char lead = (unsigned char)s[start - 1];
+    if (lead < 0xC0) return len;
+    size_t need = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : 2;
+    return len - (start - 1) >= need ? len : start - 1;
+}
+
+static void write_json_string(FILE *f, const char *s) {
+    size_t len = whole_utf8_len(s);
+    fputc('"', f);
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+bool trace_export_chrome(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return false;
+    int pid = (int)getpid();
+
+    pthread_mutex_lock(&drain_lock);
+    if (atomic_load(&running)) drain_all();
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    const char *sep = "\n";
+    for (int i = 0; i < thread_name_count; i++) {
+        fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", sep, pid, thread_names[i].tid);
+        write_json_string(f, thread_names[i].name);
+        fprintf(f, "}}");
+        sep = ",\n";
+    }
+
+    int first = (timeline_next - timeline_count + timeline_size) % (timeline_size ? timeline_size : 1);
+    for (int i = 0; i < timeline_count; i++) {
+        const TraceRecord *r = &timeline[(first + i) % timeline_size];
+        fprintf(f, "%s{\"pid\":%d,\"tid\":%d,\"ts\":%lld,\"cat\":", sep, pid, r->tid, (long long)(r->ts_us - start_us));
+        write_json_string(f, r->category);
+        if (r->kind == RECORD_SPAN) {
+            fprintf(f, ",\"ph\":\"X\",\"dur\":%lld,\"name\":", (long long)r->dur_us);
+            write_json_string(f, r->name);
+            if (r->text[0]) {
+                fprintf(f, ",\"args\":{\"detail\":");
+                write_json_string(f, r->text);
+                fputc('}', f);
+            }
+        } else {
+            fprintf(f, ",\"ph\":\"i\",\"s\":\"t\",\"name\":");
+            write_json_string(f, r->text);
+            fprintf(f, ",\"args\":{\"level\":\"%s\"}", level_names[r->level]);
+        }
+        fputc('}', f);
+        sep = ",\n";
+    }
+    fprintf(f, "\n]}\n");
+    pthread_mutex_unlock(&drain_lock);
+
+    bool ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
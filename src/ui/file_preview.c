@@ -0,0 +1,465 @@
+#define _GNU_SOURCE
+#include "file_preview.h"
+#include "sftp_range.h"
+#include <string.h>
+
+// Bytes kept in the text buffer, loaded and dropped a chunk of whole lines at a time
+#define PREVIEW_WINDOW (256 * 1024)
+#define PREVIEW_CHUNK (64 * 1024)
+#define FOLLOW_POLL_MS 1000
+
+typedef struct {
+    uint64_t bytes;
+    int chars;
+} PreviewChunk;
+
+// What a fetch brings into the buffer: a new window at offset (or at the end of
+// the file), one more chunk at either end, or what follow mode found appended.
+typedef enum {
+    FETCH_NONE = 0,
+    FETCH_AT,
+    FETCH_END,
+    FETCH_NEXT,
+    FETCH_PREV,
+    FETCH_FOLLOW
+} FetchKind;
+
+typedef struct {
+    GtkWidget *window;
+    GtkWidget *text_view;
+    GtkTextBuffer *buffer;
+    GtkWidget *status_label;
+    GtkWidget *btn_follow;
+    
+    SFTPRangeReader *reader;
+    
+    // File range shown in the buffer, as a queue of PreviewChunk
+    uint64_t win_start;
+    uint64_t win_end;
+    GQueue chunks;
+    
+    // Set while a fetch thread owns the reader. A window or end request made
+    // meanwhile is kept in queued and started when the fetch completes.
+    gboolean busy;
+    FetchKind queued;
+    uint64_t queued_offset;
+    gboolean closed;
+    
+    gboolean following;
+    guint follow_timer;
+} PreviewData;
+
+typedef struct {
+    uint64_t start;
+    size_t len;
+    char *raw;
+} FetchedLines;
+
+typedef struct {
+    PreviewData *p;
+    FetchKind kind;
+    uint64_t offset;
+    uint64_t win_start;
+    uint64_t win_end;
+    gboolean following;
+    
+    // Results: whether the window is replaced (at offset) and the lines read, in order
+    gboolean reset;
+    GPtrArray *lines;
+} PreviewFetch;
+
+static void fetched_lines_free(gpointer item) {
+    FetchedLines *l = (FetchedLines *)item;
+    g_free(l->raw);
+    g_free(l);
+}
+
+static void update_status(PreviewData *p) {
+    char *pos = g_format_size(p->win_start);
+    char *size = g_format_size(sftp_range_get_size(p->reader));
+    char *fetched = g_format_size(sftp_range_get_fetched_bytes(p->reader));
+    char *text = g_strdup_printf("%s / %s  ·  fetched %s", pos, size, fetched);
+    gtk_label_set_text(GTK_LABEL(p->status_label), text);
+    g_free(text);
+    g_free(fetched);
+    g_free(size);
+    g_free(pos);
+}
+
+// Reads whole lines after (or before) offset. Returns NULL when nothing can be shown.
+// Runs on the fetch thread.
+static char* read_lines(SFTPRangeReader *reader, gboolean following, uint64_t offset, gboolean backwards, uint64_t *out_start, size_t *out_len) {
+    uint64_t size = sftp_range_get_size(reader);
+    uint64_t start = offset;
+    size_t want = PREVIEW_CHUNK;
+    if (backwards) {
+        start = offset > PREVIEW_CHUNK ? offset - PREVIEW_CHUNK : 0;
+        want = offset - start;
+    }
+    if (want == 0 || start >= size) return NULL;
+    
+    char *buf = g_malloc(want);
+    ssize_t n = sftp_range_read(reader, start, buf, want);
+    if (n <= 0) {
+        g_free(buf);
+        return NULL;
+    }
+    
+    size_t begin = 0;
+    size_t end = n;
+    if (backwards) {
+        // Drop the partial first line, unless the chunk is all one line
+        char *nl = start > 0 ? memchr(buf, '\n', n) : NULL;
+        if (nl && (size_t)(nl - buf + 1) < (size_t)n) begin = nl - buf + 1;
+    } else {
+        gboolean at_eof = start + n >= size;
+        if (!at_eof || following) {
+            char *nl = memrchr(buf, '\n', n);
+            if (nl) end = nl - buf + 1;
+            else if (at_eof) end = 0; // Incomplete last line, wait for the rest
+        }
+    }
+    if (end <= begin) {
+        g_free(buf);
+        return NULL;
+    }
+    
+    memmove(buf, buf + begin, end - begin);
+    *out_start = start + begin;
+    *out_len = end - begin;
+    return buf;
+}
+
+static gboolean fetch_lines(PreviewFetch *f, uint64_t offset, gboolean backwards) {
+    FetchedLines *l = g_new(FetchedLines, 1);
+    l->raw = read_lines(f->p->reader, f->following, offset, backwards, &l->start, &l->len);
+    if (!l->raw) {
+        g_free(l);
+        return FALSE;
+    }
+    g_ptr_array_add(f->lines, l);
+    return TRUE;
+}
+
+// Fills a new window with the lines starting at (or just after) offset
+static void fetch_window(PreviewFetch *f, uint64_t offset) {
+    if (offset > 0) {
+        // Start on a line boundary
+        char buf[4096];
+        ssize_t n = sftp_range_read(f->p->reader, offset - 1, buf, sizeof(buf));
+        char *nl = n > 0 ? memchr(buf, '\n', n) : NULL;
+        if (nl) offset += nl - buf;
+    }
+    f->reset = TRUE;
+    f->offset = offset;
+    
+    for (int i = 0; i < PREVIEW_WINDOW / PREVIEW_CHUNK / 2; i++) {
+        if (!fetch_lines(f, offset, FALSE)) break;
+        FetchedLines *l = g_ptr_array_index(f->lines, f->lines->len - 1);
+        offset = l->start + l->len;
+    }
+}
+
+static void fetch_end(PreviewFetch *f) {
+    uint64_t size = sftp_range_get_size(f->p->reader);
+    fetch_window(f, size > PREVIEW_WINDOW / 2 ? size - PREVIEW_WINDOW / 2 : 0);
+}
+
+static gboolean on_fetch_done_idle(gpointer user_data);
+
+static gpointer fetch_thread_func(gpointer user_data) {
+    PreviewFetch *f = (PreviewFetch *)user_data;
+    SFTPRangeReader *reader = f->p->reader;
+    
+    switch (f->kind) {
+    case FETCH_AT:
+        fetch_window(f, f->offset);
+        break;
+    case FETCH_END:
+        if (f->following) sftp_range_update_size(reader);
+        fetch_end(f);
+        break;
+    case FETCH_NEXT:
+        fetch_lines(f, f->win_end, FALSE);
+        break;
+    case FETCH_PREV:
+        fetch_lines(f, f->win_start, TRUE);
+        break;
+    case FETCH_FOLLOW: {
+        uint64_t old_size = sftp_range_get_size(reader);
+        uint64_t size = sftp_range_update_size(reader);
+        if (size < old_size || size - f->win_end > PREVIEW_WINDOW) {
+            // Truncated (rotated log) or scrolled far away: start again from the end
+            f->kind = FETCH_END;
+            fetch_end(f);
+        } else if (size > old_size) {
+            // Only the appended bytes are read, an unfinished last line waits for its newline
+            uint64_t offset = f->win_end;
+            while (fetch_lines(f, offset, FALSE)) {
+                FetchedLines *l = g_ptr_array_index(f->lines, f->lines->len - 1);
+                offset = l->start + l->len;
+            }
+        }
+        break;
+    }
+    case FETCH_NONE:
+        break;
+    }
+    
+    g_idle_add(on_fetch_done_idle, f);
+    return NULL;
+}
+
+static void start_fetch(PreviewData *p, FetchKind kind, uint64_t offset) {
+    PreviewFetch *f = g_new0(PreviewFetch, 1);
+    f->p = p;
+    f->kind = kind;
+    f->offset = offset;
+    f->win_start = p->win_start;
+    f->win_end = p->win_end;
+    f->following = p->following;
+    f->lines = g_ptr_array_new_with_free_func(fetched_lines_free);
+    
+    p->busy = TRUE;
+    GThread *thread = g_thread_new("sftp-preview", fetch_thread_func, f);
+    g_thread_unref(thread);
+}
+
+// Window moves are never lost: the last one asked for during a fetch runs after it
+static void request_window(PreviewData *p, FetchKind kind, uint64_t offset) {
+    if (p->busy) {
+        p->queued = kind;
+        p->queued_offset = offset;
+        return;
+    }
+    start_fetch(p, kind, offset);
+}
+
+static void drop_chunk(PreviewData *p, gboolean from_end) {
+    PreviewChunk *chunk = from_end ? g_queue_pop_tail(&p->chunks) : g_queue_pop_head(&p->chunks);
+    if (!chunk) return;
+    
+    GtkTextIter a, b;
+    if (from_end) {
+        gtk_text_buffer_get_end_iter(p->buffer, &b);
+        a = b;
+        gtk_text_iter_backward_chars(&a, chunk->chars);
+        p->win_end -= chunk->bytes;
+    } else {
+        gtk_text_buffer_get_start_iter(p->buffer, &a);
+        b = a;
+        gtk_text_iter_forward_chars(&b, chunk->chars);
+        p->win_start += chunk->bytes;
+    }
+    gtk_text_buffer_delete(p->buffer, &a, &b);
+    g_free(chunk);
+}
+
+// Adds fetched lines at one end and drops from the other end past PREVIEW_WINDOW
+static void insert_chunk(PreviewData *p, const FetchedLines *l, gboolean backwards) {
+    char *text = g_utf8_make_valid(l->raw, l->len);
+    PreviewChunk *chunk = g_new(PreviewChunk, 1);
+    chunk->bytes = l->len;
+    chunk->chars = g_utf8_strlen(text, -1);
+    
+    // Keep the first visible line in place while the buffer changes around it
+    GdkRectangle rect;
+    GtkTextIter top;
+    gtk_text_view_get_visible_rect(GTK_TEXT_VIEW(p->text_view), &rect);
+    gtk_text_view_get_iter_at_location(GTK_TEXT_VIEW(p->text_view), &top, rect.x, rect.y);
+    GtkTextMark *anchor = gtk_text_buffer_create_mark(p->buffer, NULL, &top, TRUE);
+    
+    GtkTextIter iter;
+    if (backwards) {
+        gtk_text_buffer_get_start_iter(p->buffer, &iter);
+        gtk_text_buffer_insert(p->buffer, &iter, text, -1);
+        g_queue_push_head(&p->chunks, chunk);
+        p->win_start = l->start;
+    } else {
+        gtk_text_buffer_get_end_iter(p->buffer, &iter);
+        gtk_text_buffer_insert(p->buffer, &iter, text, -1);
+        g_queue_push_tail(&p->chunks, chunk);
+        p->win_end = l->start + l->len;
+    }
+    g_free(text);
+    
+    while (p->win_end - p->win_start > PREVIEW_WINDOW && g_queue_get_length(&p->chunks) > 1) {
+        drop_chunk(p, backwards);
+    }
+    
+    if (!p->following) {
+        gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(p->text_view), anchor, 0.0, TRUE, 0.0, 0.0);
+    }
+    gtk_text_buffer_delete_mark(p->buffer, anchor);
+}
+
+static void scroll_to_end(PreviewData *p) {
+    GtkTextIter end;
+    gtk_text_buffer_get_end_iter(p->buffer, &end);
+    GtkTextMark *mark = gtk_text_buffer_create_mark(p->buffer, NULL, &end, FALSE);
+    gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(p->text_view), mark, 0.0, TRUE, 0.0, 1.0);
+    gtk_text_buffer_delete_mark(p->buffer, mark);
+}
+
+static void preview_free(PreviewData *p) {
+    g_queue_clear_full(&p->chunks, g_free);
+    sftp_range_close(p->reader);
+    g_free(p);
+}
+
+static gboolean on_fetch_done_idle(gpointer user_data) {
+    PreviewFetch *f = (PreviewFetch *)user_data;
+    PreviewData *p = f->p;
+    
+    if (p->closed) {
+        // The window went away during the fetch, the reader is free now
+        preview_free(p);
+    } else {
+        if (f->reset) {
+            gtk_text_buffer_set_text(p->buffer, "", -1);
+            g_queue_clear_full(&p->chunks, g_free);
+            p->win_start = p->win_end = f->offset;
+        }
+        gboolean backwards = f->kind == FETCH_PREV;
+        for (guint i = 0; i < f->lines->len; i++) {
+            insert_chunk(p, g_ptr_array_index(f->lines, i), backwards);
+        }
+        if (f->kind == FETCH_END || (f->kind == FETCH_FOLLOW && f->lines->len > 0)) {
+            scroll_to_end(p);
+        }
+        // Cleared last so the scrolling above does not start another fetch
+        p->busy = FALSE;
+        update_status(p);
+        
+        if (p->queued != FETCH_NONE) {
+            FetchKind kind = p->queued;
+            p->queued = FETCH_NONE;
+            start_fetch(p, kind, p->queued_offset);
+        }
+    }
+    
+    g_ptr_array_unref(f->lines);
+    g_free(f);
+    return G_SOURCE_REMOVE;
+}
+
+static void on_scrolled(GtkAdjustment *adj, gpointer user_data) {
+    PreviewData *p = (PreviewData *)user_data;
+    if (p->busy) return;
+    
+    double value = gtk_adjustment_get_value(adj);
+    double page = gtk_adjustment_get_page_size(adj);
+    double upper = gtk_adjustment_get_upper(adj);
+    
+    if (value + 2 * page >= upper && p->win_end < sftp_range_get_size(p->reader)) {
+        start_fetch(p, FETCH_NEXT, 0);
+    } else if (value <= page && p->win_start > 0) {
+        start_fetch(p, FETCH_PREV, 0);
+    }
+}
+
+static gboolean on_follow_tick(gpointer user_data) {
+    PreviewData *p = (PreviewData *)user_data;
+    // A slow fetch still running simply skips this poll
+    if (!p->busy) start_fetch(p, FETCH_FOLLOW, 0);
+    return G_SOURCE_CONTINUE;
+}
+
+static void on_follow_toggled(GtkToggleButton *btn, gpointer user_data) {
+    PreviewData *p = (PreviewData *)user_data;
+    p->following = gtk_toggle_button_get_active(btn);
+    
+    if (p->follow_timer) {
+        g_source_remove(p->follow_timer);
+        p->follow_timer = 0;
+    }
+    if (p->following) {
+        request_window(p, FETCH_END, 0);
+        p->follow_timer = g_timeout_add(FOLLOW_POLL_MS, on_follow_tick, p);
+    }
+}
+
+static void on_top_clicked(GtkButton *btn, gpointer user_data) {
+    PreviewData *p = (PreviewData *)user_data;
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(p->btn_follow), FALSE);
+    request_window(p, FETCH_AT, 0);
+}
+
+static void on_bottom_clicked(GtkButton *btn, gpointer user_data) {
+    request_window((PreviewData *)user_data, FETCH_END, 0);
+}
+
+static void on_preview_destroy(GtkWidget *widget, gpointer user_data) {
+    PreviewData *p = (PreviewData *)user_data;
+    if (p->follow_timer) g_source_remove(p->follow_timer);
+    
+    // A running fetch still uses the reader, its completion frees everything
+    p->closed = TRUE;
+    if (!p->busy) preview_free(p);
+}
+
+void show_file_preview(GtkWindow *parent, SFTPContext *ctx, const char *remote_path) {
+    if (!ctx) return;
+    
+    SFTPRangeReader *reader = sftp_range_open(ctx, remote_path);
+    if (!reader) return;
+    
+    PreviewData *p = g_new0(PreviewData, 1);
+    p->reader = reader;
+    g_queue_init(&p->chunks);
+    
+    char *title = g_path_get_basename(remote_path);
+    p->window = gtk_window_new();
+    gtk_window_set_title(GTK_WINDOW(p->window), title);
+    gtk_window_set_transient_for(GTK_WINDOW(p->window), parent);
+    gtk_window_set_default_size(GTK_WINDOW(p->window), 900, 600);
+    g_free(title);
+    
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+    gtk_window_set_child(GTK_WINDOW(p->window), box);
+    
+    GtkWidget *toolbar = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_widget_set_margin_top(toolbar, 5);
+    gtk_widget_set_margin_bottom(toolbar, 5);
+    gtk_widget_set_margin_start(toolbar, 10);
+    gtk_widget_set_margin_end(toolbar, 10);
+    gtk_box_append(GTK_BOX(box), toolbar);
+    
+    GtkWidget *btn_top = gtk_button_new_from_icon_name("go-top-symbolic");
+    gtk_widget_set_tooltip_text(btn_top, "Start of file");
+    g_signal_connect(btn_top, "clicked", G_CALLBACK(on_top_clicked), p);
+    gtk_box_append(GTK_BOX(toolbar), btn_top);
+    
+    GtkWidget *btn_bottom = gtk_button_new_from_icon_name("go-bottom-symbolic");
+    gtk_widget_set_tooltip_text(btn_bottom, "End of file");
+    g_signal_connect(btn_bottom, "clicked", G_CALLBACK(on_bottom_clicked), p);
+    gtk_box_append(GTK_BOX(toolbar), btn_bottom);
+    
+    p->btn_follow = gtk_toggle_button_new_with_label("Follow");
+    gtk_widget_set_tooltip_text(p->btn_follow, "Show appended data as it arrives");
+    g_signal_connect(p->btn_follow, "toggled", G_CALLBACK(on_follow_toggled), p);
+    gtk_box_append(GTK_BOX(toolbar), p->btn_follow);
+    
+    p->status_label = gtk_label_new("");
+    gtk_widget_set_hexpand(p->status_label, TRUE);
+    gtk_widget_set_halign(p->status_label, GTK_ALIGN_END);
+    gtk_widget_add_css_class(p->status_label, "dim-label");
+    gtk_box_append(GTK_BOX(toolbar), p->status_label);
+    
+    GtkWidget *scrolled = gtk_scrolled_window_new();
+    gtk_widget_set_vexpand(scrolled, TRUE);
+    gtk_box_append(GTK_BOX(box), scrolled);
+    
+    p->text_view = gtk_text_view_new();
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(p->text_view), FALSE);
+    gtk_text_view_set_monospace(GTK_TEXT_VIEW(p->text_view), TRUE);
+    p->buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(p->text_view));
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scrolled), p->text_view);
+    
+    GtkAdjustment *vadj = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(scrolled));
+    g_signal_connect(vadj, "value-changed", G_CALLBACK(on_scrolled), p);
+    g_signal_connect(p->window, "destroy", G_CALLBACK(on_preview_destroy), p);
+    
+    start_fetch(p, FETCH_AT, 0);
+    gtk_window_present(GTK_WINDOW(p->window));
+}
@@ -1,46 +1,11 @@
 #include "home_view.h"
-#include "db.h"
+#include "db_worker.h"
 #include <time.h>
 
-GtkWidget* create_home_view() {
-    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 24);
-    gtk_widget_add_css_class(box, "home-container");
-    gtk_widget_set_margin_top(box, 48);
-    gtk_widget_set_margin_bottom(box, 48);
-    gtk_widget_set_margin_start(box, 48);
-    gtk_widget_set_margin_end(box, 48);
-
-    GtkWidget *welcome_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 8);
-    gtk_widget_add_css_class(welcome_box, "welcome-section");
-    
-    GtkWidget *title = gtk_label_new("Welcome");
-    gtk_widget_add_css_class(title, "view-title");
-    gtk_widget_set_halign(title, GTK_ALIGN_START);
-    gtk_box_append(GTK_BOX(welcome_box), title);
-    
-    GtkWidget *desc = gtk_label_new("Manage your SSH connections with ease");
-    gtk_widget_add_css_class(desc, "view-description");
-    gtk_widget_set_halign(desc, GTK_ALIGN_START);
-    gtk_box_append(GTK_BOX(welcome_box), desc);
-    
-    gtk_box_append(GTK_BOX(box), welcome_box);
-
-    GtkWidget *subtitle = gtk_label_new("Recent Connections");
-    gtk_widget_add_css_class(subtitle, "view-subtitle");
-    gtk_widget_set_halign(subtitle, GTK_ALIGN_START);
-    gtk_box_append(GTK_BOX(box), subtitle);
-
-    GtkWidget *flow = gtk_flow_box_new();
-    gtk_flow_box_set_max_children_per_line(GTK_FLOW_BOX(flow), 4);
-    gtk_flow_box_set_min_children_per_line(GTK_FLOW_BOX(flow), 1);
-    gtk_flow_box_set_selection_mode(GTK_FLOW_BOX(flow), GTK_SELECTION_NONE);
-    gtk_flow_box_set_column_spacing(GTK_FLOW_BOX(flow), 16);
-    gtk_flow_box_set_row_spacing(GTK_FLOW_BOX(flow), 16);
-    gtk_flow_box_set_homogeneous(GTK_FLOW_BOX(flow), TRUE);
-    gtk_box_append(GTK_BOX(box), flow);
-
-    int count = 0;
-    HistoryEntry **entries = db_get_recent_history(8, &count);
+// Fills the view once the storage worker has read the history
+static void on_history_loaded(HistoryEntry **entries, int count, gpointer user_data) {
+    GtkWidget *box = GTK_WIDGET(user_data);
+    GtkWidget *flow = g_object_get_data(G_OBJECT(box), "flow");
     
     if (count == 0) {
         GtkWidget *empty_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 16);
@@ -95,7 +60,11 @@ GtkWidget* create_home_view() {
             else if (diff < 86400) snprintf(time_str, sizeof(time_str), "%d h ago", (int)(diff/3600));
             else snprintf(time_str, sizeof(time_str), "%d d ago", (int)(diff/86400));
             
-            GtkWidget *time_lbl = gtk_label_new(time_str);
+            char usage_str[96];
+            if (e->use_count > 1) snprintf(usage_str, sizeof(usage_str), "%s · %d connections", time_str, e->use_count);
+            else snprintf(usage_str, sizeof(usage_str), "%s", time_str);
+            
+            GtkWidget *time_lbl = gtk_label_new(usage_str);
             gtk_widget_add_css_class(time_lbl, "dim-label");
             gtk_widget_set_halign(time_lbl, GTK_ALIGN_CENTER);
 
@@ -106,8 +75,50 @@ GtkWidget* create_home_view() {
             
             gtk_flow_box_insert(GTK_FLOW_BOX(flow), card, -1);
         }
-        db_free_history(entries, count);
     }
+    db_free_history(entries, count);
+    g_object_unref(box);
+}
+
+GtkWidget* create_home_view() {
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 24);
+    gtk_widget_add_css_class(box, "home-container");
+    gtk_widget_set_margin_top(box, 48);
+    gtk_widget_set_margin_bottom(box, 48);
+    gtk_widget_set_margin_start(box, 48);
+    gtk_widget_set_margin_end(box, 48);
+
+    GtkWidget *welcome_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 8);
+    gtk_widget_add_css_class(welcome_box, "welcome-section");
+    
+    GtkWidget *title = gtk_label_new("Welcome");
+    gtk_widget_add_css_class(title, "view-title");
+    gtk_widget_set_halign(title, GTK_ALIGN_START);
+    gtk_box_append(GTK_BOX(welcome_box), title);
+    
+    GtkWidget *desc = gtk_label_new("Manage your SSH connections with ease");
+    gtk_widget_add_css_class(desc, "view-description");
+    gtk_widget_set_halign(desc, GTK_ALIGN_START);
+    gtk_box_append(GTK_BOX(welcome_box), desc);
+    
+    gtk_box_append(GTK_BOX(box), welcome_box);
+
+    GtkWidget *subtitle = gtk_label_new("Frequent Connections");
+    gtk_widget_add_css_class(subtitle, "view-subtitle");
+    gtk_widget_set_halign(subtitle, GTK_ALIGN_START);
+    gtk_box_append(GTK_BOX(box), subtitle);
+
+    GtkWidget *flow = gtk_flow_box_new();
+    gtk_flow_box_set_max_children_per_line(GTK_FLOW_BOX(flow), 4);
+    gtk_flow_box_set_min_children_per_line(GTK_FLOW_BOX(flow), 1);
+    gtk_flow_box_set_selection_mode(GTK_FLOW_BOX(flow), GTK_SELECTION_NONE);
+    gtk_flow_box_set_column_spacing(GTK_FLOW_BOX(flow), 16);
+    gtk_flow_box_set_row_spacing(GTK_FLOW_BOX(flow), 16);
+    gtk_flow_box_set_homogeneous(GTK_FLOW_BOX(flow), TRUE);
+    gtk_box_append(GTK_BOX(box), flow);
+
+    g_object_set_data(G_OBJECT(box), "flow", flow);
+    db_async_get_recent_history(8, on_history_loaded, g_object_ref(box));
 
     return box;
 }
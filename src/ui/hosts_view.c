@@ -1,22 +1,64 @@
 #include "hosts_view.h"
-#include "db.h"
+#include "host_repo.h"
+#include "db_worker.h"
+#include "host_monitor.h"
 #include "ssh_backend.h"
 #include "terminal_view.h"
 #include "sftp_view.h"
 #include <gtk/gtk.h>
 
+// One entry of the host list: a group section or a host inside it. Groups own
+// the model of their children, handed to the GtkTreeListModel on expansion.
+#define HOSTS_TYPE_ITEM (hosts_item_get_type())
+G_DECLARE_FINAL_TYPE(HostsItem, hosts_item, HOSTS, ITEM, GObject)
+
+struct _HostsItem {
+    GObject parent_instance;
+    bool is_group;
+    int id;             // host or group id
+    int group_id;       // hosts only
+    char *title;        // groups only
+    GListStore *children;
+};
+
+G_DEFINE_TYPE(HostsItem, hosts_item, G_TYPE_OBJECT)
+
+static void hosts_item_finalize(GObject *object) {
+    HostsItem *item = HOSTS_ITEM(object);
+    g_free(item->title);
+    g_clear_object(&item->children);
+    G_OBJECT_CLASS(hosts_item_parent_class)->finalize(object);
+}
+
+static void hosts_item_class_init(HostsItemClass *klass) {
+    G_OBJECT_CLASS(klass)->finalize = hosts_item_finalize;
+}
+
+static void hosts_item_init(HostsItem *item) {
+}
+
 typedef struct {
-    GtkWidget *list_box;
     GtkWidget *main_stack;
+    
+    // Top level of the tree, one item per group section
+    GListStore *groups;
+    // Items by id, so a change only touches its own row
+    GHashTable *host_items;    // host id -> HostsItem (owned by its group's children)
+    GHashTable *group_items;   // group id -> HostsItem (0 is the ungrouped section)
+    GHashTable *badges;        // host id -> status label of its bound row
+    guint listener;
+    guint status_timer;
 } HostsViewData;
 
-static void refresh_hosts_list(HostsViewData *data);
-static GtkWidget* create_host_row(Host *h, HostsViewData *data);
+#define DEFAULT_PROBE_INTERVAL 30
 
-static void on_connect_clicked(GtkWidget *btn, gpointer user_data) {
-    Host *host = (Host*)user_data;
-    GtkWidget *main_stack = GTK_WIDGET(g_object_get_data(G_OBJECT(btn), "main_stack"));
-    
+// Shared by every hosts view, probes the saved hosts in the background
+static HostMonitor *monitor = NULL;
+// Ids given to the monitor, so a reload only applies what changed
+static GHashTable *watched_ids = NULL;
+static int probe_interval = DEFAULT_PROBE_INTERVAL;
+
+static void connect_with_credentials(GtkWidget *main_stack, const Host *host, const Host *proxy) {
     if (g_strcmp0(host->protocol, "sftp") == 0) {
         // SFTP
         GtkWidget *sftp_view = gtk_stack_get_child_by_name(GTK_STACK(main_stack), "files");
@@ -26,25 +68,123 @@ static void on_connect_clicked(GtkWidget *btn, gpointer user_data) {
         // SSH / Telnet
         GtkWidget *term_view = gtk_stack_get_child_by_name(GTK_STACK(main_stack), "terminal");
         
-        Host *proxy = NULL;
-        if (host->proxy_host_id > 0) {
-            proxy = db_get_host_by_id(host->proxy_host_id);
-        }
-        
-        terminal_view_connect(term_view, host->hostname, host->port, host->username, host->password, host->key_path, host->protocol, proxy);
-        
-        if (proxy) {
-            db_free_host(proxy);
-        }
+        terminal_view_connect(term_view, host, proxy);
         
         gtk_stack_set_visible_child_name(GTK_STACK(main_stack), "terminal");
     }
 }
 
+typedef struct {
+    GtkWidget *main_stack;
+    Host *host;
+    Host *proxy;
+} PendingConnect;
+
+static void pending_connect_free(PendingConnect *pending) {
+    // The views keep their own copies, these are wiped on free
+    db_free_host(pending->host);
+    db_free_host(pending->proxy);
+    g_object_unref(pending->main_stack);
+    g_free(pending);
+}
+
+static void on_password_prompt_connect(GtkWidget *btn, gpointer user_data) {
+    GtkWidget *dialog = GTK_WIDGET(gtk_widget_get_root(btn));
+    PendingConnect *pending = g_object_get_data(G_OBJECT(dialog), "pending");
+    GtkWidget *host_entry = g_object_get_data(G_OBJECT(dialog), "host_entry");
+    GtkWidget *proxy_entry = g_object_get_data(G_OBJECT(dialog), "proxy_entry");
+    
+    if (host_entry) pending->host->password = strdup(gtk_editable_get_text(GTK_EDITABLE(host_entry)));
+    if (proxy_entry) pending->proxy->password = strdup(gtk_editable_get_text(GTK_EDITABLE(proxy_entry)));
+    connect_with_credentials(pending->main_stack, pending->host, pending->proxy);
+    gtk_window_destroy(GTK_WINDOW(dialog));
+}
+
+static GtkWidget* add_password_entry(GtkWidget *vbox, const Host *host) {
+    char *text = g_strdup_printf("Password for %s", host->name);
+    GtkWidget *label = gtk_label_new(text);
+    gtk_widget_set_halign(label, GTK_ALIGN_START);
+    gtk_box_append(GTK_BOX(vbox), label);
+    g_free(text);
+    
+    GtkWidget *entry = gtk_password_entry_new();
+    gtk_password_entry_set_show_peek_icon(GTK_PASSWORD_ENTRY(entry), TRUE);
+    gtk_box_append(GTK_BOX(vbox), entry);
+    return entry;
+}
+
+// A saved password the keyring did not give back (locked, or no keyring
+// running any more): ask for it instead of connecting without it
+static void prompt_missing_passwords(PendingConnect *pending, bool host_missing, bool proxy_missing) {
+    GtkWidget *dialog = gtk_window_new();
+    gtk_window_set_transient_for(GTK_WINDOW(dialog), GTK_WINDOW(gtk_widget_get_root(pending->main_stack)));
+    gtk_window_set_modal(GTK_WINDOW(dialog), TRUE);
+    gtk_window_set_title(GTK_WINDOW(dialog), "Password Required");
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 400, -1);
+    g_object_set_data_full(G_OBJECT(dialog), "pending", pending, (GDestroyNotify)pending_connect_free);
+    
+    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 12);
+    gtk_widget_set_margin_top(vbox, 24);
+    gtk_widget_set_margin_bottom(vbox, 24);
+    gtk_widget_set_margin_start(vbox, 24);
+    gtk_widget_set_margin_end(vbox, 24);
+    gtk_window_set_child(GTK_WINDOW(dialog), vbox);
+    
+    GtkWidget *info = gtk_label_new("The saved password could not be read from the keyring. "
+                                    "Is it locked? Enter the password to connect this time.");
+    gtk_label_set_wrap(GTK_LABEL(info), TRUE);
+    gtk_label_set_xalign(GTK_LABEL(info), 0);
+    gtk_box_append(GTK_BOX(vbox), info);
+    
+    if (host_missing) g_object_set_data(G_OBJECT(dialog), "host_entry", add_password_entry(vbox, pending->host));
+    if (proxy_missing) g_object_set_data(G_OBJECT(dialog), "proxy_entry", add_password_entry(vbox, pending->proxy));
+    
+    GtkWidget *btn_connect = gtk_button_new_with_label("Connect");
+    gtk_widget_add_css_class(btn_connect, "suggested-action");
+    g_signal_connect(btn_connect, "clicked", G_CALLBACK(on_password_prompt_connect), NULL);
+    gtk_box_append(GTK_BOX(vbox), btn_connect);
+    
+    gtk_window_present(GTK_WINDOW(dialog));
+}
+
+static void on_passwords_loaded(char *password, char *proxy_password, gpointer user_data) {
+    PendingConnect *pending = (PendingConnect *)user_data;
+    pending->host->password = password;
+    if (pending->proxy) {
+        pending->proxy->password = proxy_password;
+    } else {
+        db_free_password(proxy_password);
+    }
+    
+    bool host_missing = pending->host->has_password && !pending->host->password;
+    bool proxy_missing = pending->proxy && pending->proxy->has_password && !pending->proxy->password;
+    if (host_missing || proxy_missing) {
+        prompt_missing_passwords(pending, host_missing, proxy_missing);
+        return;
+    }
+    
+    connect_with_credentials(pending->main_stack, pending->host, pending->proxy);
+    pending_connect_free(pending);
+}
+
+void hosts_view_connect_host(GtkWidget *main_stack, const Host *host) {
+    const Host *proxy = host->proxy_host_id > 0 ? host_repo_get_host(host->proxy_host_id) : NULL;
+    if (!host->has_password && !(proxy && proxy->has_password)) {
+        connect_with_credentials(main_stack, host, proxy);
+        return;
+    }
+    
+    // Passwords are only decrypted now, on the db worker
+    PendingConnect *pending = g_new0(PendingConnect, 1);
+    pending->main_stack = g_object_ref(main_stack);
+    pending->host = db_dup_host(host);
+    pending->proxy = proxy ? db_dup_host(proxy) : NULL;
+    db_async_get_passwords(host->id, proxy && proxy->has_password ? proxy->id : 0, on_passwords_loaded, pending);
+}
+
 static void on_save_host(GtkWidget *btn, gpointer user_data) {
     GtkWidget *dialog = GTK_WIDGET(gtk_widget_get_root(btn));
     GtkWidget **entries = (GtkWidget**)user_data;
-    HostsViewData *view_data = g_object_get_data(G_OBJECT(dialog), "view_data");
     Host *host_to_edit = g_object_get_data(G_OBJECT(dialog), "host_to_edit");
     
     const char *name = gtk_editable_get_text(GTK_EDITABLE(entries[0]));
@@ -67,12 +207,11 @@ static void on_save_host(GtkWidget *btn, gpointer user_data) {
     }
     
     if (host_to_edit) {
-        db_update_host(host_to_edit->id, name, hostname, port, user, pass, key, proto, group_id, proxy_id);
+        host_repo_update_host(host_to_edit->id, name, hostname, port, user, strlen(pass) > 0 ? pass : NULL, key, proto, group_id, proxy_id);
     } else {
-        db_add_host(name, hostname, port, user, pass, key, proto, group_id, proxy_id);
+        host_repo_add_host(name, hostname, port, user, pass, key, proto, group_id, proxy_id);
     }
     
-    refresh_hosts_list(view_data);
     gtk_window_destroy(GTK_WINDOW(dialog));
     g_free(entries);
 }
@@ -85,7 +224,7 @@ static void show_host_dialog(GtkWidget *parent, HostsViewData *data, Host *host_
     gtk_window_set_default_size(GTK_WINDOW(dialog), 400, 550);
     
     g_object_set_data(G_OBJECT(dialog), "view_data", data);
-    g_object_set_data(G_OBJECT(dialog), "host_to_edit", host_to_edit);
+    g_object_set_data_full(G_OBJECT(dialog), "host_to_edit", host_to_edit, (GDestroyNotify)db_free_host);
     
     GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 12);
     gtk_widget_set_margin_top(vbox, 24);
@@ -149,13 +288,12 @@ static void show_host_dialog(GtkWidget *parent, HostsViewData *data, Host *host_
     gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(group_combo), "0", "None");
     
     int group_count = 0;
-    Group **groups = db_get_all_groups(&group_count);
+    const Group* const* groups = host_repo_get_groups(&group_count);
     for(int i=0; i<group_count; i++) {
         char id_str[32];
         sprintf(id_str, "%d", groups[i]->id);
         gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(group_combo), id_str, groups[i]->name);
     }
-    db_free_groups(groups, group_count);
     
     gtk_combo_box_set_active_id(GTK_COMBO_BOX(group_combo), "0");
     gtk_box_append(GTK_BOX(vbox), group_combo);
@@ -167,14 +305,13 @@ static void show_host_dialog(GtkWidget *parent, HostsViewData *data, Host *host_
     gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(proxy_combo), "0", "None");
     
     int host_count = 0;
-    Host **hosts = db_get_all_hosts(&host_count);
+    const Host* const* hosts = host_repo_get_hosts(&host_count);
     for(int i=0; i<host_count; i++) {
         if (host_to_edit && hosts[i]->id == host_to_edit->id) continue; // Don't proxy to self
         char id_str[32];
         sprintf(id_str, "%d", hosts[i]->id);
         gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(proxy_combo), id_str, hosts[i]->name);
     }
-    db_free_hosts(hosts, host_count);
     
     gtk_combo_box_set_active_id(GTK_COMBO_BOX(proxy_combo), "0");
     gtk_box_append(GTK_BOX(vbox), proxy_combo);
@@ -188,7 +325,8 @@ static void show_host_dialog(GtkWidget *parent, HostsViewData *data, Host *host_
         sprintf(port_buf, "%d", host_to_edit->port);
         gtk_editable_set_text(GTK_EDITABLE(entries[2]), port_buf);
         gtk_editable_set_text(GTK_EDITABLE(entries[3]), host_to_edit->username);
-        if (host_to_edit->password) gtk_editable_set_text(GTK_EDITABLE(entries[4]), host_to_edit->password);
+        // The saved password is never loaded here, leaving the field empty keeps it
+        if (host_to_edit->has_password) gtk_entry_set_placeholder_text(GTK_ENTRY(entries[4]), "Unchanged");
         if (host_to_edit->key_path) gtk_editable_set_text(GTK_EDITABLE(entries[5]), host_to_edit->key_path);
         if (host_to_edit->protocol) gtk_combo_box_set_active_id(GTK_COMBO_BOX(proto_combo), host_to_edit->protocol);
         
@@ -213,38 +351,13 @@ static void on_add_host_clicked(GtkWidget *btn, gpointer user_data) {
     show_host_dialog(btn, (HostsViewData*)user_data, NULL);
 }
 
-static void on_edit_host_clicked(GtkWidget *btn, gpointer user_data) {
-    int id = GPOINTER_TO_INT(user_data);
-    HostsViewData *data = g_object_get_data(G_OBJECT(btn), "view_data");
-    Host *h = db_get_host_by_id(id);
-    if (h) {
-        show_host_dialog(btn, data, h);
-    }
-}
-
-static void on_delete_host_clicked(GtkWidget *btn, gpointer user_data) {
-    int id = GPOINTER_TO_INT(user_data);
-    HostsViewData *data = g_object_get_data(G_OBJECT(btn), "view_data");
-    db_delete_host(id);
-    refresh_hosts_list(data);
-}
-
-static void on_delete_group_clicked(GtkWidget *btn, gpointer user_data) {
-    int id = GPOINTER_TO_INT(user_data);
-    HostsViewData *data = g_object_get_data(G_OBJECT(btn), "view_data");
-    db_delete_group(id);
-    refresh_hosts_list(data);
-}
-
 static void on_save_group(GtkWidget *btn, gpointer user_data) {
     GtkWidget *entry = GTK_WIDGET(user_data);
     GtkWidget *dialog = GTK_WIDGET(gtk_widget_get_root(btn));
-    HostsViewData *view_data = g_object_get_data(G_OBJECT(dialog), "view_data");
     
     const char *name = gtk_editable_get_text(GTK_EDITABLE(entry));
     if (strlen(name) > 0) {
-        db_add_group(name);
-        refresh_hosts_list(view_data);
+        host_repo_add_group(name);
     }
     gtk_window_destroy(GTK_WINDOW(dialog));
 }
@@ -278,18 +391,435 @@ static void on_add_group_clicked(GtkWidget *btn, gpointer user_data) {
     gtk_window_present(GTK_WINDOW(dialog));
 }
 
-static GtkWidget* create_host_row(Host *h, HostsViewData *data) {
-    GtkWidget *row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 12);
-    gtk_widget_add_css_class(row, "host-row");
+// --- Import ---
+
+static void on_import_done(int added, gpointer user_data) {
+    GtkWidget *box = GTK_WIDGET(user_data);
+    GtkRoot *root = gtk_widget_get_root(box);
+    
+    GtkAlertDialog *alert = NULL;
+    if (added < 0) {
+        alert = gtk_alert_dialog_new("Import failed");
+        gtk_alert_dialog_set_detail(alert, "The file could not be read, has a host range that is too large, or the hosts could not be saved.");
+    } else if (added == 0) {
+        alert = gtk_alert_dialog_new("No new servers");
+        gtk_alert_dialog_set_detail(alert, "Every server found is already in the list.");
+    } else {
+        alert = gtk_alert_dialog_new("%d server%s imported", added, added == 1 ? "" : "s");
+    }
+    if (GTK_IS_WINDOW(root)) gtk_alert_dialog_show(alert, GTK_WINDOW(root));
+    g_object_unref(alert);
+    g_object_unref(box);
+}
+
+static void on_import_ssh_clicked(GtkWidget *btn, gpointer user_data) {
+    GtkWidget *popover = gtk_widget_get_ancestor(btn, GTK_TYPE_POPOVER);
+    if (popover) gtk_popover_popdown(GTK_POPOVER(popover));
+    host_repo_import(NULL, on_import_done, g_object_ref(user_data));
+}
+
+static void on_import_file_selected(GObject *source, GAsyncResult *res, gpointer user_data) {
+    GFile *file = gtk_file_dialog_open_finish(GTK_FILE_DIALOG(source), res, NULL);
+    char *path = file ? g_file_get_path(file) : NULL;
+    if (path) {
+        host_repo_import(path, on_import_done, user_data);
+    } else {
+        g_object_unref(user_data);
+    }
+    g_free(path);
+    if (file) g_object_unref(file);
+}
+
+static void on_import_file_clicked(GtkWidget *btn, gpointer user_data) {
+    GtkWidget *popover = gtk_widget_get_ancestor(btn, GTK_TYPE_POPOVER);
+    if (popover) gtk_popover_popdown(GTK_POPOVER(popover));
+    
+    GtkFileDialog *dialog = gtk_file_dialog_new();
+    gtk_file_dialog_set_title(dialog, "Import ssh_config, known_hosts or inventory");
+    gtk_file_dialog_open(dialog, GTK_WINDOW(gtk_widget_get_root(GTK_WIDGET(user_data))), NULL, on_import_file_selected, g_object_ref(user_data));
+    g_object_unref(dialog);
+}
+
+// Popover of the Import button, callbacks get the view box
+static GtkWidget* create_import_menu(GtkWidget *box) {
+    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 4);
+    
+    GtkWidget *btn_ssh = gtk_button_new_with_label("From ~/.ssh");
+    gtk_widget_set_tooltip_text(btn_ssh, "Hosts of ~/.ssh/config and ~/.ssh/known_hosts");
+    gtk_widget_add_css_class(btn_ssh, "flat");
+    g_signal_connect(btn_ssh, "clicked", G_CALLBACK(on_import_ssh_clicked), box);
+    gtk_box_append(GTK_BOX(vbox), btn_ssh);
     
-    const char *icon_name = "network-server-symbolic";
-    if (g_strcmp0(h->protocol, "ftp") == 0 || g_strcmp0(h->protocol, "sftp") == 0) {
-        icon_name = "folder-remote-symbolic";
-    } else if (g_strcmp0(h->protocol, "telnet") == 0) {
-        icon_name = "utilities-terminal-symbolic";
+    GtkWidget *btn_file = gtk_button_new_with_label("From File…");
+    gtk_widget_set_tooltip_text(btn_file, "ssh_config, known_hosts, Ansible INI inventory or CSV");
+    gtk_widget_add_css_class(btn_file, "flat");
+    g_signal_connect(btn_file, "clicked", G_CALLBACK(on_import_file_clicked), box);
+    gtk_box_append(GTK_BOX(vbox), btn_file);
+    
+    GtkWidget *popover = gtk_popover_new();
+    gtk_popover_set_child(GTK_POPOVER(popover), vbox);
+    return popover;
+}
+
+// --- Reachability ---
+
+void hosts_view_set_probe_interval(int seconds) {
+    probe_interval = seconds;
+    if (monitor) host_monitor_set_interval(monitor, seconds * 1000);
+}
+
+int hosts_view_get_probe_interval() {
+    return probe_interval;
+}
+
+void hosts_view_shutdown() {
+    host_monitor_stop(monitor);
+    monitor = NULL;
+    if (watched_ids) g_hash_table_unref(watched_ids);
+    watched_ids = NULL;
+}
+
+// Hosts behind a jump host are usually not reachable from here, a direct
+// probe would only ever report them down
+static void watch_host(const Host *h) {
+    if (!monitor) return;
+    if (h->proxy_host_id > 0) {
+        host_monitor_unwatch(monitor, h->id);
+        g_hash_table_remove(watched_ids, GINT_TO_POINTER(h->id));
+        return;
     }
+    host_monitor_watch(monitor, h->id, h->hostname, h->port);
+    g_hash_table_add(watched_ids, GINT_TO_POINTER(h->id));
+}
+
+static void unwatch_host(int id) {
+    if (!monitor) return;
+    host_monitor_unwatch(monitor, id);
+    g_hash_table_remove(watched_ids, GINT_TO_POINTER(id));
+}
+
+// Only the differences are applied, hosts still there keep their probe history
+static void monitor_all_hosts() {
+    if (!monitor) return;
+    GHashTable *previous = watched_ids;
+    watched_ids = g_hash_table_new(g_direct_hash, g_direct_equal);
     
-    GtkWidget *icon = gtk_image_new_from_icon_name(icon_name);
+    int count = 0;
+    const Host* const* hosts = host_repo_get_hosts(&count);
+    for (int i = 0; i < count; i++) {
+        watch_host(hosts[i]);
+        if (previous) g_hash_table_remove(previous, GINT_TO_POINTER(hosts[i]->id));
+    }
+    if (previous) {
+        GHashTableIter iter;
+        gpointer key;
+        g_hash_table_iter_init(&iter, previous);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+            host_monitor_unwatch(monitor, GPOINTER_TO_INT(key));
+        }
+        g_hash_table_unref(previous);
+    }
+}
+
+static void update_badge(GtkWidget *badge, int host_id) {
+    HostStatus status;
+    const Host *host = host_repo_get_host(host_id);
+    if (probe_interval > 0 && monitor && host && host->proxy_host_id > 0) {
+        gtk_widget_set_visible(badge, TRUE);
+        gtk_widget_remove_css_class(badge, "status-up");
+        gtk_widget_remove_css_class(badge, "status-down");
+        gtk_label_set_text(GTK_LABEL(badge), "via jump host");
+        gtk_widget_set_tooltip_text(badge, "Reached through a jump host, not checked from here");
+        return;
+    }
+    if (probe_interval <= 0 || !monitor || !host_monitor_get_status(monitor, host_id, &status)) {
+        gtk_widget_set_visible(badge, FALSE);
+        return;
+    }
+    gtk_widget_set_visible(badge, TRUE);
+    gtk_widget_remove_css_class(badge, "status-up");
+    gtk_widget_remove_css_class(badge, "status-down");
+    
+    char text[32];
+    char *tip = NULL;
+    if (status.state == HOST_STATE_UP) {
+        snprintf(text, sizeof(text), "● %d ms", (status.rtt_us + 500) / 1000);
+        gtk_widget_add_css_class(badge, "status-up");
+        int failed = 0;
+        for (int i = 0; i < status.history_count; i++) {
+            if (status.history[i] < 0) failed++;
+        }
+        tip = g_strdup_printf("Reachable, %.1f ms on average over the last %d checks (%d failed)",
+                              status.avg_rtt_us / 1000.0, status.history_count, failed);
+    } else if (status.state == HOST_STATE_DOWN) {
+        snprintf(text, sizeof(text), "● down");
+        gtk_widget_add_css_class(badge, "status-down");
+        tip = g_strdup("The port did not accept a connection");
+    } else {
+        snprintf(text, sizeof(text), "●");
+        tip = g_strdup("Not checked yet");
+    }
+    gtk_label_set_text(GTK_LABEL(badge), text);
+    gtk_widget_set_tooltip_text(badge, tip);
+    g_free(tip);
+}
+
+static void hide_badge(gpointer key, gpointer value, gpointer user_data) {
+    gtk_widget_set_visible(GTK_WIDGET(value), FALSE);
+}
+
+// Only the rows on screen have a badge to update
+static gboolean on_status_timer(gpointer user_data) {
+    HostsViewData *data = (HostsViewData *)user_data;
+    if (probe_interval <= 0 || !monitor) {
+        // Turned off in the settings
+        g_hash_table_foreach(data->badges, hide_badge, NULL);
+        return G_SOURCE_CONTINUE;
+    }
+    
+    int ids[256];
+    int n;
+    do {
+        n = host_monitor_take_changes(monitor, ids, 256);
+        for (int i = 0; i < n; i++) {
+            GtkWidget *badge = g_hash_table_lookup(data->badges, GINT_TO_POINTER(ids[i]));
+            if (badge) update_badge(badge, ids[i]);
+        }
+    } while (n == 256);
+    return G_SOURCE_CONTINUE;
+}
+
+// --- List model ---
+
+static HostsItem* hosts_item_new_host(const Host *h) {
+    HostsItem *item = g_object_new(HOSTS_TYPE_ITEM, NULL);
+    item->id = h->id;
+    item->group_id = h->group_id;
+    return item;
+}
+
+static HostsItem* hosts_item_new_group(HostsViewData *data, int group_id, const char *title) {
+    HostsItem *item = g_object_new(HOSTS_TYPE_ITEM, NULL);
+    item->is_group = true;
+    item->id = group_id;
+    item->title = g_strdup(title);
+    item->children = g_list_store_new(HOSTS_TYPE_ITEM);
+    
+    // Filled in one splice, so the tree sees a single change
+    int count = 0;
+    const Host* const* hosts = host_repo_get_group_hosts(group_id, &count);
+    gpointer *children = g_new(gpointer, count > 0 ? count : 1);
+    for (int i = 0; i < count; i++) {
+        children[i] = hosts_item_new_host(hosts[i]);
+        g_hash_table_insert(data->host_items, GINT_TO_POINTER(hosts[i]->id), children[i]);
+    }
+    g_list_store_splice(item->children, 0, 0, children, count);
+    for (int i = 0; i < count; i++) {
+        g_object_unref(children[i]);
+    }
+    g_free(children);
+    
+    g_hash_table_insert(data->group_items, GINT_TO_POINTER(group_id), item);
+    return item;
+}
+
+static GListModel* create_children_model(gpointer object, gpointer user_data) {
+    HostsItem *item = HOSTS_ITEM(object);
+    return item->is_group ? G_LIST_MODEL(g_object_ref(item->children)) : NULL;
+}
+
+// Makes the views rebind a group header (title or empty state changed)
+static void refresh_group_item(HostsViewData *data, HostsItem *item) {
+    guint pos;
+    if (!g_list_store_find(data->groups, item, &pos)) return;
+    g_object_ref(item);
+    g_list_store_splice(data->groups, pos, 1, (gpointer *)&item, 1);
+    g_object_unref(item);
+}
+
+static void remove_group_item(HostsViewData *data, int group_id) {
+    HostsItem *item = g_hash_table_lookup(data->group_items, GINT_TO_POINTER(group_id));
+    if (!item) return;
+    
+    guint n = g_list_model_get_n_items(G_LIST_MODEL(item->children));
+    for (guint i = 0; i < n; i++) {
+        HostsItem *child = g_list_model_get_item(G_LIST_MODEL(item->children), i);
+        g_hash_table_remove(data->host_items, GINT_TO_POINTER(child->id));
+        g_object_unref(child);
+    }
+    
+    guint pos;
+    g_hash_table_remove(data->group_items, GINT_TO_POINTER(group_id));
+    if (g_list_store_find(data->groups, item, &pos)) {
+        g_list_store_remove(data->groups, pos);
+    }
+}
+
+// The ungrouped section is shown last when it has hosts or when there are no
+// groups at all; its title depends on whether named groups exist.
+static void sync_ungrouped_section(HostsViewData *data) {
+    int group_count = 0, ungrouped = 0;
+    host_repo_get_groups(&group_count);
+    host_repo_get_group_hosts(0, &ungrouped);
+    const char *title = group_count > 0 ? "Others" : "My Servers";
+    
+    HostsItem *item = g_hash_table_lookup(data->group_items, GINT_TO_POINTER(0));
+    if (ungrouped == 0 && group_count > 0) {
+        remove_group_item(data, 0);
+    } else if (!item) {
+        item = hosts_item_new_group(data, 0, title);
+        g_list_store_append(data->groups, item);
+        g_object_unref(item);
+    } else if (strcmp(item->title, title) != 0) {
+        g_free(item->title);
+        item->title = g_strdup(title);
+        refresh_group_item(data, item);
+    }
+}
+
+static void insert_host_item(HostsViewData *data, int id) {
+    const Host *h = host_repo_get_host(id);
+    if (!h || g_hash_table_contains(data->host_items, GINT_TO_POINTER(id))) return;
+    
+    HostsItem *group = g_hash_table_lookup(data->group_items, GINT_TO_POINTER(h->group_id));
+    if (!group) {
+        // A new ungrouped section is built with its hosts already in it
+        sync_ungrouped_section(data);
+        return;
+    }
+    
+    HostsItem *item = hosts_item_new_host(h);
+    g_list_store_insert(group->children, host_repo_get_host_position(id), item);
+    g_hash_table_insert(data->host_items, GINT_TO_POINTER(id), item);
+    g_object_unref(item);
+    
+    if (g_list_model_get_n_items(G_LIST_MODEL(group->children)) == 1) {
+        refresh_group_item(data, group);
+    }
+}
+
+static void remove_host_item(HostsViewData *data, int id) {
+    HostsItem *item = g_hash_table_lookup(data->host_items, GINT_TO_POINTER(id));
+    if (!item) return;
+    
+    HostsItem *group = g_hash_table_lookup(data->group_items, GINT_TO_POINTER(item->group_id));
+    g_hash_table_remove(data->host_items, GINT_TO_POINTER(id));
+    
+    guint pos;
+    if (group && g_list_store_find(group->children, item, &pos)) {
+        g_list_store_remove(group->children, pos);
+        if (g_list_model_get_n_items(G_LIST_MODEL(group->children)) == 0) {
+            refresh_group_item(data, group);
+        }
+    }
+}
+
+static void rebuild_hosts_list(HostsViewData *data) {
+    g_list_store_remove_all(data->groups);
+    g_hash_table_remove_all(data->host_items);
+    g_hash_table_remove_all(data->group_items);
+    
+    // 1. Named Groups
+    int group_count = 0;
+    const Group* const* groups = host_repo_get_groups(&group_count);
+    for (int g = 0; g < group_count; g++) {
+        HostsItem *item = hosts_item_new_group(data, groups[g]->id, groups[g]->name);
+        g_list_store_append(data->groups, item);
+        g_object_unref(item);
+    }
+    
+    // 2. "Other" Group (id 0)
+    sync_ungrouped_section(data);
+}
+
+static void on_repo_changed(HostRepoEvent event, int id, gpointer user_data) {
+    HostsViewData *data = (HostsViewData *)user_data;
+    
+    switch (event) {
+        case HOST_REPO_RELOADED:
+            monitor_all_hosts();
+            rebuild_hosts_list(data);
+            break;
+        case HOST_REPO_HOST_ADDED:
+        case HOST_REPO_HOST_CHANGED: {
+            const Host *h = host_repo_get_host(id);
+            if (h) watch_host(h);
+            // Replacing the item rebinds its row, it may also have moved to another group
+            remove_host_item(data, id);
+            insert_host_item(data, id);
+            sync_ungrouped_section(data);
+            break;
+        }
+        case HOST_REPO_HOST_REMOVED:
+            unwatch_host(id);
+            remove_host_item(data, id);
+            sync_ungrouped_section(data);
+            break;
+        case HOST_REPO_GROUP_ADDED: {
+            const Group *g = host_repo_get_group(id);
+            if (g) {
+                HostsItem *item = hosts_item_new_group(data, id, g->name);
+                g_list_store_insert(data->groups, host_repo_get_group_position(id), item);
+                g_object_unref(item);
+            }
+            sync_ungrouped_section(data);
+            break;
+        }
+        case HOST_REPO_GROUP_REMOVED:
+            remove_group_item(data, id);
+            sync_ungrouped_section(data);
+            break;
+    }
+}
+
+// --- Rows ---
+
+// The item shown by a list item, or NULL. Release with g_object_unref.
+static HostsItem* get_row_item(GtkListItem *list_item) {
+    GtkTreeListRow *tree_row = gtk_list_item_get_item(list_item);
+    return tree_row ? gtk_tree_list_row_get_item(tree_row) : NULL;
+}
+
+static void on_row_connect_clicked(GtkWidget *btn, gpointer user_data) {
+    HostsViewData *data = g_object_get_data(G_OBJECT(btn), "view_data");
+    HostsItem *item = get_row_item(GTK_LIST_ITEM(user_data));
+    if (!item) return;
+    
+    const Host *h = host_repo_get_host(item->id);
+    if (h) hosts_view_connect_host(data->main_stack, h);
+    g_object_unref(item);
+}
+
+static void on_row_edit_clicked(GtkWidget *btn, gpointer user_data) {
+    HostsViewData *data = g_object_get_data(G_OBJECT(btn), "view_data");
+    HostsItem *item = get_row_item(GTK_LIST_ITEM(user_data));
+    if (!item) return;
+    
+    const Host *h = host_repo_get_host(item->id);
+    if (h) show_host_dialog(btn, data, db_dup_host(h));
+    g_object_unref(item);
+}
+
+static void on_row_delete_clicked(GtkWidget *btn, gpointer user_data) {
+    HostsItem *item = get_row_item(GTK_LIST_ITEM(user_data));
+    if (!item) return;
+    
+    if (item->is_group) {
+        host_repo_delete_group(item->id);
+    } else {
+        host_repo_delete_host(item->id);
+    }
+    g_object_unref(item);
+}
+
+// Rows are recycled between groups and hosts, so one layout serves both
+static void on_row_setup(GtkSignalListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    HostsViewData *data = (HostsViewData *)user_data;
+    
+    GtkWidget *expander = gtk_tree_expander_new();
+    GtkWidget *row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 12);
+    
+    GtkWidget *icon = gtk_image_new();
     gtk_image_set_pixel_size(GTK_IMAGE(icon), 32);
     gtk_widget_add_css_class(icon, "card-icon");
     gtk_box_append(GTK_BOX(row), icon);
@@ -297,13 +827,10 @@ static GtkWidget* create_host_row(Host *h, HostsViewData *data) {
     GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 4);
     gtk_widget_set_valign(vbox, GTK_ALIGN_CENTER);
     
-    GtkWidget *lbl_name = gtk_label_new(h->name);
-    gtk_widget_add_css_class(lbl_name, "card-title");
+    GtkWidget *lbl_name = gtk_label_new(NULL);
     gtk_widget_set_halign(lbl_name, GTK_ALIGN_START);
     
-    char sub[256];
-    snprintf(sub, sizeof(sub), "%s://%s@%s:%d", h->protocol ? h->protocol : "ssh", h->username, h->hostname, h->port);
-    GtkWidget *lbl_sub = gtk_label_new(sub);
+    GtkWidget *lbl_sub = gtk_label_new(NULL);
     gtk_widget_add_css_class(lbl_sub, "card-subtitle");
     gtk_widget_set_halign(lbl_sub, GTK_ALIGN_START);
     
@@ -315,131 +842,144 @@ static GtkWidget* create_host_row(Host *h, HostsViewData *data) {
     gtk_widget_set_hexpand(spacer, TRUE);
     gtk_box_append(GTK_BOX(row), spacer);
     
+    GtkWidget *badge = gtk_label_new(NULL);
+    gtk_widget_add_css_class(badge, "status-badge");
+    gtk_box_append(GTK_BOX(row), badge);
+    
     GtkWidget *btn_connect = gtk_button_new_with_label("Connect");
     gtk_widget_add_css_class(btn_connect, "connect-button");
-    Host *h_copy = g_new(Host, 1);
-    *h_copy = *h;
-    h_copy->hostname = g_strdup(h->hostname);
-    h_copy->username = g_strdup(h->username);
-    h_copy->password = h->password ? g_strdup(h->password) : NULL;
-    h_copy->key_path = h->key_path ? g_strdup(h->key_path) : NULL;
-    h_copy->protocol = h->protocol ? g_strdup(h->protocol) : NULL;
-    h_copy->proxy_host_id = h->proxy_host_id;
-    
-    g_object_set_data(G_OBJECT(btn_connect), "main_stack", data->main_stack);
-    g_signal_connect(btn_connect, "clicked", G_CALLBACK(on_connect_clicked), h_copy);
+    g_object_set_data(G_OBJECT(btn_connect), "view_data", data);
+    g_signal_connect(btn_connect, "clicked", G_CALLBACK(on_row_connect_clicked), list_item);
     gtk_box_append(GTK_BOX(row), btn_connect);
 
     GtkWidget *btn_edit = gtk_button_new_from_icon_name("document-edit-symbolic");
     gtk_widget_set_tooltip_text(btn_edit, "Edit");
     gtk_widget_add_css_class(btn_edit, "nav-button");
     g_object_set_data(G_OBJECT(btn_edit), "view_data", data);
-    g_signal_connect(btn_edit, "clicked", G_CALLBACK(on_edit_host_clicked), GINT_TO_POINTER(h->id));
+    g_signal_connect(btn_edit, "clicked", G_CALLBACK(on_row_edit_clicked), list_item);
     gtk_box_append(GTK_BOX(row), btn_edit);
     
     GtkWidget *btn_delete = gtk_button_new_from_icon_name("user-trash-symbolic");
     gtk_widget_set_tooltip_text(btn_delete, "Delete");
     gtk_widget_add_css_class(btn_delete, "destructive-action");
-    g_object_set_data(G_OBJECT(btn_delete), "view_data", data);
-    g_signal_connect(btn_delete, "clicked", G_CALLBACK(on_delete_host_clicked), GINT_TO_POINTER(h->id));
+    g_signal_connect(btn_delete, "clicked", G_CALLBACK(on_row_delete_clicked), list_item);
     gtk_box_append(GTK_BOX(row), btn_delete);
     
-    return row;
+    g_object_set_data(G_OBJECT(expander), "row", row);
+    g_object_set_data(G_OBJECT(expander), "icon", icon);
+    g_object_set_data(G_OBJECT(expander), "lbl_name", lbl_name);
+    g_object_set_data(G_OBJECT(expander), "lbl_sub", lbl_sub);
+    g_object_set_data(G_OBJECT(expander), "badge", badge);
+    g_object_set_data(G_OBJECT(expander), "btn_connect", btn_connect);
+    g_object_set_data(G_OBJECT(expander), "btn_edit", btn_edit);
+    g_object_set_data(G_OBJECT(expander), "btn_delete", btn_delete);
+    
+    gtk_tree_expander_set_child(GTK_TREE_EXPANDER(expander), row);
+    gtk_list_item_set_child(list_item, expander);
 }
 
-// Helper function for refresh_hosts_list
-static void add_group_ui(HostsViewData *data, Host **hosts, int host_count, int group_id, const char *group_name, bool is_deletable) {
-    GtkWidget *group_row = gtk_list_box_row_new();
-    gtk_list_box_row_set_selectable(GTK_LIST_BOX_ROW(group_row), FALSE);
-    
-    GtkWidget *expander = gtk_expander_new(NULL);
-    gtk_expander_set_expanded(GTK_EXPANDER(expander), TRUE);
+static void on_row_bind(GtkSignalListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    GtkWidget *expander = gtk_list_item_get_child(list_item);
+    GtkWidget *row = g_object_get_data(G_OBJECT(expander), "row");
+    GtkWidget *icon = g_object_get_data(G_OBJECT(expander), "icon");
+    GtkWidget *lbl_name = g_object_get_data(G_OBJECT(expander), "lbl_name");
+    GtkWidget *lbl_sub = g_object_get_data(G_OBJECT(expander), "lbl_sub");
+    GtkWidget *badge = g_object_get_data(G_OBJECT(expander), "badge");
+    GtkWidget *btn_connect = g_object_get_data(G_OBJECT(expander), "btn_connect");
+    GtkWidget *btn_edit = g_object_get_data(G_OBJECT(expander), "btn_edit");
+    GtkWidget *btn_delete = g_object_get_data(G_OBJECT(expander), "btn_delete");
+    HostsViewData *data = (HostsViewData *)user_data;
     
-    GtkWidget *header_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
-    GtkWidget *lbl = gtk_label_new(NULL);
-    char markup[256];
-    snprintf(markup, sizeof(markup), "<b>%s</b>", group_name);
-    gtk_label_set_markup(GTK_LABEL(lbl), markup);
-    gtk_box_append(GTK_BOX(header_box), lbl);
+    gtk_tree_expander_set_list_row(GTK_TREE_EXPANDER(expander), gtk_list_item_get_item(list_item));
+    HostsItem *item = get_row_item(list_item);
+    if (!item) return;
     
-    if (is_deletable) {
-        GtkWidget *spacer = gtk_label_new("");
-        gtk_widget_set_hexpand(spacer, TRUE);
-        gtk_box_append(GTK_BOX(header_box), spacer);
+    if (item->is_group) {
+        gtk_widget_remove_css_class(row, "host-row");
+        gtk_widget_set_visible(icon, FALSE);
+        gtk_widget_remove_css_class(lbl_name, "card-title");
+        char *markup = g_markup_printf_escaped("<b>%s</b>", item->title);
+        gtk_label_set_markup(GTK_LABEL(lbl_name), markup);
+        g_free(markup);
         
-        GtkWidget *btn_del = gtk_button_new_from_icon_name("user-trash-symbolic");
-        gtk_widget_add_css_class(btn_del, "destructive-action");
-        gtk_widget_add_css_class(btn_del, "small-button");
-        g_object_set_data(G_OBJECT(btn_del), "view_data", data);
-        g_signal_connect(btn_del, "clicked", G_CALLBACK(on_delete_group_clicked), GINT_TO_POINTER(group_id));
-        gtk_box_append(GTK_BOX(header_box), btn_del);
-    }
-    
-    gtk_expander_set_label_widget(GTK_EXPANDER(expander), header_box);
-    
-    GtkWidget *group_content = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
-    gtk_widget_add_css_class(group_content, "group-content");
-    
-    int count_in_group = 0;
-    for (int i = 0; i < host_count; i++) {
-        if (hosts[i]->group_id == group_id) {
-            gtk_box_append(GTK_BOX(group_content), create_host_row(hosts[i], data));
-            count_in_group++;
+        bool empty = g_list_model_get_n_items(G_LIST_MODEL(item->children)) == 0;
+        gtk_label_set_markup(GTK_LABEL(lbl_sub), item->id == 0 ? "<i>No servers yet, Import adds the ones of ~/.ssh/config</i>" : "<i>No servers</i>");
+        gtk_widget_set_visible(lbl_sub, empty);
+        gtk_widget_set_visible(badge, FALSE);
+        gtk_widget_set_visible(btn_connect, FALSE);
+        gtk_widget_set_visible(btn_edit, FALSE);
+        gtk_widget_set_visible(btn_delete, item->id != 0);
+    } else {
+        const Host *h = host_repo_get_host(item->id);
+        gtk_widget_add_css_class(row, "host-row");
+        gtk_widget_add_css_class(lbl_name, "card-title");
+        gtk_widget_set_visible(icon, TRUE);
+        gtk_widget_set_visible(lbl_sub, TRUE);
+        gtk_widget_set_visible(btn_connect, TRUE);
+        gtk_widget_set_visible(btn_edit, TRUE);
+        gtk_widget_set_visible(btn_delete, TRUE);
+        
+        if (h) {
+            const char *icon_name = "network-server-symbolic";
+            if (g_strcmp0(h->protocol, "ftp") == 0 || g_strcmp0(h->protocol, "sftp") == 0) {
+                icon_name = "folder-remote-symbolic";
+            } else if (g_strcmp0(h->protocol, "telnet") == 0) {
+                icon_name = "utilities-terminal-symbolic";
+            }
+            gtk_image_set_from_icon_name(GTK_IMAGE(icon), icon_name);
+            gtk_label_set_text(GTK_LABEL(lbl_name), h->name);
+            
+            char sub[256];
+            snprintf(sub, sizeof(sub), "%s://%s@%s:%d", h->protocol ? h->protocol : "ssh", h->username, h->hostname, h->port);
+            gtk_label_set_text(GTK_LABEL(lbl_sub), sub);
         }
+        
+        // Shown rows are probed at the configured pace, the others less often
+        g_hash_table_insert(data->badges, GINT_TO_POINTER(item->id), badge);
+        if (monitor) host_monitor_set_visible(monitor, item->id, true);
+        update_badge(badge, item->id);
     }
-    
-    if (count_in_group == 0) {
-        GtkWidget *empty = gtk_label_new("<i>No servers</i>");
-        gtk_label_set_use_markup(GTK_LABEL(empty), TRUE);
-        gtk_widget_set_margin_top(empty, 8);
-        gtk_widget_set_margin_bottom(empty, 8);
-        gtk_box_append(GTK_BOX(group_content), empty);
-    }
-    
-    gtk_expander_set_child(GTK_EXPANDER(expander), group_content);
-    gtk_list_box_row_set_child(GTK_LIST_BOX_ROW(group_row), expander);
-    gtk_list_box_append(GTK_LIST_BOX(data->list_box), group_row);
+    g_object_unref(item);
 }
 
-static void refresh_hosts_list(HostsViewData *data) {
-    GtkWidget *child = gtk_widget_get_first_child(data->list_box);
-    while (child != NULL) {
-        GtkWidget *next = gtk_widget_get_next_sibling(child);
-        gtk_list_box_remove(GTK_LIST_BOX(data->list_box), child);
-        child = next;
-    }
-    
-    int host_count = 0;
-    Host **hosts = db_get_all_hosts(&host_count);
+static void on_row_unbind(GtkSignalListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    HostsViewData *data = (HostsViewData *)user_data;
+    GtkWidget *expander = gtk_list_item_get_child(list_item);
+    GtkWidget *badge = g_object_get_data(G_OBJECT(expander), "badge");
     
-    int group_count = 0;
-    Group **groups = db_get_all_groups(&group_count);
-    
-    // 1. Named Groups
-    for (int g = 0; g < group_count; g++) {
-        add_group_ui(data, hosts, host_count, groups[g]->id, groups[g]->name, true);
-    }
-    
-    // 2. "Other" Group (id 0) if there are ungrouped hosts
-    int has_ungrouped = 0;
-    for (int i = 0; i < host_count; i++) {
-        if (hosts[i]->group_id == 0) {
-            has_ungrouped = 1;
-            break;
+    HostsItem *item = get_row_item(list_item);
+    if (item && !item->is_group) {
+        // The host may already be bound to another row
+        if (g_hash_table_lookup(data->badges, GINT_TO_POINTER(item->id)) == badge) {
+            g_hash_table_remove(data->badges, GINT_TO_POINTER(item->id));
+            if (monitor) host_monitor_set_visible(monitor, item->id, false);
         }
     }
-    
-    if (has_ungrouped || group_count == 0) {
-        add_group_ui(data, hosts, host_count, 0, group_count > 0 ? "Others" : "My Servers", false);
-    }
-    
-    db_free_hosts(hosts, host_count);
-    db_free_groups(groups, group_count);
+    if (item) g_object_unref(item);
+    gtk_tree_expander_set_list_row(GTK_TREE_EXPANDER(expander), NULL);
+}
+
+static void free_view_data(HostsViewData *data) {
+    host_repo_remove_listener(data->listener);
+    if (data->status_timer) g_source_remove(data->status_timer);
+    g_hash_table_destroy(data->badges);
+    g_hash_table_destroy(data->host_items);
+    g_hash_table_destroy(data->group_items);
+    g_object_unref(data->groups);
+    g_free(data);
 }
 
 GtkWidget* create_hosts_view(GtkWidget *main_stack) {
     HostsViewData *data = g_new0(HostsViewData, 1);
     data->main_stack = main_stack;
+    data->groups = g_list_store_new(HOSTS_TYPE_ITEM);
+    data->host_items = g_hash_table_new(g_direct_hash, g_direct_equal);
+    data->group_items = g_hash_table_new(g_direct_hash, g_direct_equal);
+    data->badges = g_hash_table_new(g_direct_hash, g_direct_equal);
+    
+    if (!monitor) monitor = host_monitor_start(probe_interval * 1000);
+    if (monitor && !watched_ids) watched_ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+    if (monitor) data->status_timer = g_timeout_add_seconds(1, on_status_timer, data);
     
     GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 24);
     gtk_widget_set_margin_top(box, 48);
@@ -457,6 +997,11 @@ GtkWidget* create_hosts_view(GtkWidget *main_stack) {
     gtk_widget_set_hexpand(spacer, TRUE);
     gtk_box_append(GTK_BOX(header), spacer);
     
+    GtkWidget *btn_import = gtk_menu_button_new();
+    gtk_menu_button_set_label(GTK_MENU_BUTTON(btn_import), "Import");
+    gtk_menu_button_set_popover(GTK_MENU_BUTTON(btn_import), create_import_menu(box));
+    gtk_box_append(GTK_BOX(header), btn_import);
+    
     GtkWidget *btn_add_group = gtk_button_new_with_label("New Group");
     g_signal_connect(btn_add_group, "clicked", G_CALLBACK(on_add_group_clicked), data);
     gtk_box_append(GTK_BOX(header), btn_add_group);
@@ -472,17 +1017,30 @@ GtkWidget* create_hosts_view(GtkWidget *main_stack) {
     GtkWidget *scrolled = gtk_scrolled_window_new();
     gtk_widget_set_vexpand(scrolled, TRUE);
     
-    data->list_box = gtk_list_box_new();
-    gtk_widget_add_css_class(data->list_box, "content-view");
-    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scrolled), data->list_box);
+    // Only the visible rows get widgets, recycled while scrolling
+    GtkTreeListModel *tree = gtk_tree_list_model_new(G_LIST_MODEL(g_object_ref(data->groups)), FALSE, TRUE, create_children_model, NULL, NULL);
+    GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+    g_signal_connect(factory, "setup", G_CALLBACK(on_row_setup), data);
+    g_signal_connect(factory, "bind", G_CALLBACK(on_row_bind), data);
+    g_signal_connect(factory, "unbind", G_CALLBACK(on_row_unbind), data);
+    
+    GtkWidget *list_view = gtk_list_view_new(GTK_SELECTION_MODEL(gtk_no_selection_new(G_LIST_MODEL(tree))), factory);
+    gtk_widget_add_css_class(list_view, "content-view");
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scrolled), list_view);
     
     gtk_box_append(GTK_BOX(box), scrolled);
     
-    // Initial load
-    refresh_hosts_list(data);
+    // Initial load, later changes arrive row by row
+    data->listener = host_repo_add_listener(on_repo_changed, data);
+    if (host_repo_is_loaded()) {
+        monitor_all_hosts();
+        rebuild_hosts_list(data);
+    } else {
+        host_repo_load();
+    }
     
     // Cleanup
-    g_object_set_data_full(G_OBJECT(box), "view_data", data, g_free);
+    g_object_set_data_full(G_OBJECT(box), "view_data", data, (GDestroyNotify)free_view_data);
     
     return box;
 }
@@ -0,0 +1,233 @@
+#include "quick_connect.h"
+#include "hosts_view.h"
+#include "host_repo.h"
+#include "host_search.h"
+#include "db_worker.h"
+
+#define QUICK_CONNECT_MAX_RESULTS 20
+
+typedef struct {
+    GtkWidget *window;
+    GtkWidget *entry;
+    GtkWidget *list;
+    GtkWidget *main_stack;
+    // Saved hosts matching the frecency-ranked history, shown for an empty query
+    int frequent[QUICK_CONNECT_MAX_RESULTS];
+    int frequent_count;
+} QuickConnectData;
+
+// Shared by every palette, kept in sync with the host repository
+static HostSearch *search = NULL;
+
+static void index_host(const Host *h) {
+    const Group *g = h->group_id > 0 ? host_repo_get_group(h->group_id) : NULL;
+    host_search_put(search, h->id, h->name, h->hostname, h->username, g ? g->name : NULL);
+}
+
+static void index_all_hosts() {
+    host_search_clear(search);
+    int count = 0;
+    const Host* const* hosts = host_repo_get_hosts(&count);
+    for (int i = 0; i < count; i++) {
+        index_host(hosts[i]);
+    }
+}
+
+static void on_repo_changed(HostRepoEvent event, int id, gpointer user_data) {
+    switch (event) {
+        case HOST_REPO_RELOADED:
+            index_all_hosts();
+            break;
+        case HOST_REPO_HOST_ADDED:
+        case HOST_REPO_HOST_CHANGED: {
+            const Host *h = host_repo_get_host(id);
+            if (h) index_host(h);
+            break;
+        }
+        case HOST_REPO_HOST_REMOVED:
+            host_search_remove(search, id);
+            break;
+        case HOST_REPO_GROUP_ADDED:
+        case HOST_REPO_GROUP_REMOVED:
+            // Group names only matter through their hosts, which report their own changes
+            break;
+    }
+}
+
+static void ensure_search() {
+    if (search) return;
+    search = host_search_new();
+    index_all_hosts();
+    host_repo_add_listener(on_repo_changed, NULL);
+}
+
+static GtkWidget* create_result_row(const Host *h) {
+    GtkWidget *row = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
+    gtk_widget_set_margin_top(row, 6);
+    gtk_widget_set_margin_bottom(row, 6);
+    gtk_widget_set_margin_start(row, 8);
+    gtk_widget_set_margin_end(row, 8);
+
+    GtkWidget *lbl_name = gtk_label_new(h->name);
+    gtk_widget_add_css_class(lbl_name, "card-title");
+    gtk_widget_set_halign(lbl_name, GTK_ALIGN_START);
+    gtk_box_append(GTK_BOX(row), lbl_name);
+
+    const Group *g = h->group_id > 0 ? host_repo_get_group(h->group_id) : NULL;
+    char sub[320];
+    if (g) {
+        snprintf(sub, sizeof(sub), "%s@%s:%d · %s", h->username, h->hostname, h->port, g->name);
+    } else {
+        snprintf(sub, sizeof(sub), "%s@%s:%d", h->username, h->hostname, h->port);
+    }
+    GtkWidget *lbl_sub = gtk_label_new(sub);
+    gtk_widget_add_css_class(lbl_sub, "card-subtitle");
+    gtk_widget_set_halign(lbl_sub, GTK_ALIGN_START);
+    gtk_box_append(GTK_BOX(row), lbl_sub);
+
+    GtkWidget *list_row = gtk_list_box_row_new();
+    gtk_list_box_row_set_child(GTK_LIST_BOX_ROW(list_row), row);
+    g_object_set_data(G_OBJECT(list_row), "host_id", GINT_TO_POINTER(h->id));
+    return list_row;
+}
+
+static void on_search_changed(GtkSearchEntry *entry, gpointer user_data) {
+    QuickConnectData *data = (QuickConnectData *)user_data;
+
+    GtkWidget *child = gtk_widget_get_first_child(data->list);
+    while (child != NULL) {
+        GtkWidget *next = gtk_widget_get_next_sibling(child);
+        gtk_list_box_remove(GTK_LIST_BOX(data->list), child);
+        child = next;
+    }
+
+    const char *query = gtk_editable_get_text(GTK_EDITABLE(entry));
+    if (query[0] == '\0') {
+        for (int i = 0; i < data->frequent_count; i++) {
+            const Host *h = host_repo_get_host(data->frequent[i]);
+            if (h) gtk_list_box_append(GTK_LIST_BOX(data->list), create_result_row(h));
+        }
+    } else {
+        HostSearchMatch matches[QUICK_CONNECT_MAX_RESULTS];
+        int count = host_search_query(search, query, matches, QUICK_CONNECT_MAX_RESULTS);
+        for (int i = 0; i < count; i++) {
+            const Host *h = host_repo_get_host(matches[i].id);
+            if (h) gtk_list_box_append(GTK_LIST_BOX(data->list), create_result_row(h));
+        }
+    }
+
+    gtk_list_box_select_row(GTK_LIST_BOX(data->list), gtk_list_box_get_row_at_index(GTK_LIST_BOX(data->list), 0));
+}
+
+static void on_history_loaded(HistoryEntry **entries, int count, gpointer user_data) {
+    GtkWidget *window = GTK_WIDGET(user_data);
+    QuickConnectData *data = g_object_get_data(G_OBJECT(window), "quick_connect");
+
+    // History only records the target, map it back to a saved host
+    int host_count = 0;
+    const Host* const* hosts = host_repo_get_hosts(&host_count);
+    for (int i = 0; data && i < count && data->frequent_count < QUICK_CONNECT_MAX_RESULTS; i++) {
+        for (int j = 0; j < host_count; j++) {
+            if (strcmp(hosts[j]->hostname, entries[i]->hostname) == 0 &&
+                strcmp(hosts[j]->username, entries[i]->username) == 0 &&
+                g_strcmp0(hosts[j]->protocol, entries[i]->protocol) == 0) {
+                data->frequent[data->frequent_count++] = hosts[j]->id;
+                break;
+            }
+        }
+    }
+    db_free_history(entries, count);
+
+    if (data && gtk_widget_get_visible(window)) {
+        on_search_changed(GTK_SEARCH_ENTRY(data->entry), data);
+    }
+    g_object_unref(window);
+}
+
+static void connect_row(QuickConnectData *data, GtkListBoxRow *row) {
+    if (!row) return;
+    const Host *h = host_repo_get_host(GPOINTER_TO_INT(g_object_get_data(G_OBJECT(row), "host_id")));
+    if (h) hosts_view_connect_host(data->main_stack, h);
+    gtk_window_destroy(GTK_WINDOW(data->window));
+}
+
+static void on_entry_activate(GtkSearchEntry *entry, gpointer user_data) {
+    QuickConnectData *data = (QuickConnectData *)user_data;
+    connect_row(data, gtk_list_box_get_selected_row(GTK_LIST_BOX(data->list)));
+}
+
+static void on_row_activated(GtkListBox *list, GtkListBoxRow *row, gpointer user_data) {
+    connect_row((QuickConnectData *)user_data, row);
+}
+
+static void on_stop_search(GtkSearchEntry *entry, gpointer user_data) {
+    QuickConnectData *data = (QuickConnectData *)user_data;
+    gtk_window_destroy(GTK_WINDOW(data->window));
+}
+
+// Up/Down move the selection while the focus stays in the entry
+static gboolean on_key_pressed(GtkEventControllerKey *controller, guint keyval, guint keycode, GdkModifierType state, gpointer user_data) {
+    QuickConnectData *data = (QuickConnectData *)user_data;
+    int step = 0;
+    if (keyval == GDK_KEY_Down) step = 1;
+    else if (keyval == GDK_KEY_Up) step = -1;
+    else return FALSE;
+
+    GtkListBoxRow *selected = gtk_list_box_get_selected_row(GTK_LIST_BOX(data->list));
+    int index = selected ? gtk_list_box_row_get_index(selected) + step : 0;
+    GtkListBoxRow *row = gtk_list_box_get_row_at_index(GTK_LIST_BOX(data->list), index);
+    if (row) {
+        gtk_list_box_select_row(GTK_LIST_BOX(data->list), row);
+        gtk_widget_grab_focus(data->entry);
+    }
+    return TRUE;
+}
+
+void show_quick_connect(GtkWindow *parent, GtkWidget *main_stack) {
+    ensure_search();
+
+    QuickConnectData *data = g_new0(QuickConnectData, 1);
+    data->main_stack = main_stack;
+
+    data->window = gtk_window_new();
+    gtk_window_set_transient_for(GTK_WINDOW(data->window), parent);
+    gtk_window_set_modal(GTK_WINDOW(data->window), TRUE);
+    gtk_window_set_title(GTK_WINDOW(data->window), "Quick Connect");
+    gtk_window_set_default_size(GTK_WINDOW(data->window), 560, 420);
+    g_object_set_data_full(G_OBJECT(data->window), "quick_connect", data, g_free);
+
+    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 12);
+    gtk_widget_set_margin_top(vbox, 16);
+    gtk_widget_set_margin_bottom(vbox, 16);
+    gtk_widget_set_margin_start(vbox, 16);
+    gtk_widget_set_margin_end(vbox, 16);
+    gtk_window_set_child(GTK_WINDOW(data->window), vbox);
+
+    data->entry = gtk_search_entry_new();
+    gtk_search_entry_set_placeholder_text(GTK_SEARCH_ENTRY(data->entry), "Name, hostname, user or group");
+    // Results follow every keystroke
+    gtk_search_entry_set_search_delay(GTK_SEARCH_ENTRY(data->entry), 0);
+    g_signal_connect(data->entry, "search-changed", G_CALLBACK(on_search_changed), data);
+    g_signal_connect(data->entry, "activate", G_CALLBACK(on_entry_activate), data);
+    g_signal_connect(data->entry, "stop-search", G_CALLBACK(on_stop_search), data);
+    gtk_box_append(GTK_BOX(vbox), data->entry);
+
+    GtkEventController *keys = gtk_event_controller_key_new();
+    gtk_event_controller_set_propagation_phase(keys, GTK_PHASE_CAPTURE);
+    g_signal_connect(keys, "key-pressed", G_CALLBACK(on_key_pressed), data);
+    gtk_widget_add_controller(data->window, keys);
+
+    GtkWidget *scrolled = gtk_scrolled_window_new();
+    gtk_widget_set_vexpand(scrolled, TRUE);
+    data->list = gtk_list_box_new();
+    gtk_widget_add_css_class(data->list, "content-view");
+    gtk_list_box_set_selection_mode(GTK_LIST_BOX(data->list), GTK_SELECTION_BROWSE);
+    g_signal_connect(data->list, "row-activated", G_CALLBACK(on_row_activated), data);
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scrolled), data->list);
+    gtk_box_append(GTK_BOX(vbox), scrolled);
+
+    gtk_window_present(GTK_WINDOW(data->window));
+    gtk_widget_grab_focus(data->entry);
+
+    db_async_get_recent_history(QUICK_CONNECT_MAX_RESULTS, on_history_loaded, g_object_ref(data->window));
+}
@@ -0,0 +1,247 @@
+#include "session_stats_view.h"
+#include "db_worker.h"
+#include <stdlib.h>
+
+enum {
+    ROW_UPTIME,
+    ROW_RECEIVED,
+    ROW_SENT,
+    ROW_READS,
+    ROW_FEEDS,
+    ROW_WRITES,
+    ROW_WRITE_QUEUE,
+    ROW_STALLS,
+    ROW_ECHO,
+    ROW_ECHO_PERCENTILES,
+    ROW_HOST_ECHO,
+    ROW_COUNT
+};
+
+static const char *row_names[ROW_COUNT] = {
+    "Uptime", "Received", "Sent", "Reads", "Terminal feeds", "Writes",
+    "Write queue", "Window stalls", "Echo", "Echo p50 / p90 / p99", "Past sessions"
+};
+
+typedef struct {
+    SessionStatsSource source;
+    gpointer user_data;
+    GtkWidget *button;
+    int host_id;                    // 0 for a host that isn't saved
+    int proxy_host_id;
+    LatencyHistogram *host_echo;    // NULL until fetched
+    GtkWidget *values[ROW_COUNT];
+    guint refresh_id;
+    SSHStatsSnapshot last;      // Previous refresh, for the rates
+    gint64 last_at;             // 0 before the first refresh
+} StatsPanel;
+
+static void format_latency(int64_t us, char *buf, size_t len) {
+    if (us < 0) snprintf(buf, len, "—");
+    else if (us < 10000) snprintf(buf, len, "%.2f ms", us / 1000.0);
+    else snprintf(buf, len, "%.0f ms", us / 1000.0);
+}
+
+// "p50 / p90 / p99 over n"
+static char* format_percentiles(const LatencyHistogram *h) {
+    if (h->samples == 0) return g_strdup("—");
+    char p50[32], p90[32], p99[32];
+    format_latency(latency_histogram_percentile(h, 50), p50, sizeof(p50));
+    format_latency(latency_histogram_percentile(h, 90), p90, sizeof(p90));
+    format_latency(latency_histogram_percentile(h, 99), p99, sizeof(p99));
+    return g_strdup_printf("%s / %s / %s over %" G_GUINT64_FORMAT, p50, p90, p99, h->samples);
+}
+
+static char* format_bytes(uint64_t total, uint64_t delta, double seconds) {
+    char *size = g_format_size(total);
+    char *text;
+    if (seconds > 0) {
+        char *rate = g_format_size((guint64)(delta / seconds));
+        text = g_strdup_printf("%s (%s/s)", size, rate);
+        g_free(rate);
+    } else {
+        text = g_strdup(size);
+    }
+    g_free(size);
+    return text;
+}
+
+static void set_row(StatsPanel *panel, int row, char *text) {
+    gtk_label_set_text(GTK_LABEL(panel->values[row]), text);
+    g_free(text);
+}
+
+static gboolean refresh_panel(gpointer user_data) {
+    StatsPanel *panel = (StatsPanel *)user_data;
+    SSHContext *ctx = panel->source(panel->user_data);
+    if (!ctx) {
+        for (int row = 0; row < ROW_HOST_ECHO; row++) {
+            gtk_label_set_text(GTK_LABEL(panel->values[row]), row == ROW_UPTIME ? "Not connected" : "—");
+        }
+        panel->last_at = 0;
+        return G_SOURCE_CONTINUE;
+    }
+
+    SSHStatsSnapshot s;
+    ssh_stats_snapshot(ctx, &s);
+    gint64 now = g_get_monotonic_time();
+    // A new session behind the same panel restarts the counters
+    bool has_last = panel->last_at > 0 && s.bytes_in >= panel->last.bytes_in && s.bytes_out >= panel->last.bytes_out;
+    double seconds = has_last ? (now - panel->last_at) / 1000000.0 : 0;
+
+    int64_t up = s.uptime_us / 1000000;
+    set_row(panel, ROW_UPTIME, g_strdup_printf("%d:%02d:%02d", (int)(up / 3600), (int)(up / 60 % 60), (int)(up % 60)));
+    set_row(panel, ROW_RECEIVED, format_bytes(s.bytes_in, s.bytes_in - panel->last.bytes_in, seconds));
+    set_row(panel, ROW_SENT, format_bytes(s.bytes_out, s.bytes_out - panel->last.bytes_out, seconds));
+    set_row(panel, ROW_READS, g_strdup_printf("%" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " polls", s.reads, s.polls));
+    set_row(panel, ROW_FEEDS, g_strdup_printf("%" G_GUINT64_FORMAT, s.feeds));
+    set_row(panel, ROW_WRITES, g_strdup_printf("%" G_GUINT64_FORMAT, s.writes));
+    set_row(panel, ROW_WRITE_QUEUE, g_strdup_printf("%d now, %d at most", s.write_queue, s.write_queue_max));
+    set_row(panel, ROW_STALLS, g_strdup_printf("%" G_GUINT64_FORMAT " (%.1f ms blocked)", s.window_stalls, s.stall_us / 1000.0));
+
+    char last[32], avg[32];
+    format_latency(s.echo_last_us, last, sizeof(last));
+    format_latency(s.echo_avg_us, avg, sizeof(avg));
+    set_row(panel, ROW_ECHO, g_strdup_printf("%s last, %s average over %" G_GUINT64_FORMAT, last, avg, s.echo_samples));
+
+    LatencyHistogram echo;
+    ssh_stats_echo_histogram(ctx, &echo);
+    set_row(panel, ROW_ECHO_PERCENTILES, format_percentiles(&echo));
+
+    panel->last = s;
+    panel->last_at = now;
+    return G_SOURCE_CONTINUE;
+}
+
+static void stop_refresh(StatsPanel *panel) {
+    if (panel->refresh_id > 0) {
+        g_source_remove(panel->refresh_id);
+        panel->refresh_id = 0;
+    }
+}
+
+// user_data is a reference on the button, the panel lives as long
+static void on_host_echo(const LatencyHistogram *latency, gpointer user_data) {
+    StatsPanel *panel = g_object_get_data(G_OBJECT(user_data), "stats-panel");
+    // The tab may have closed meanwhile, its labels are gone
+    if (gtk_widget_get_parent(panel->button)) {
+        if (!panel->host_echo) panel->host_echo = g_new(LatencyHistogram, 1);
+        *panel->host_echo = *latency;
+        set_row(panel, ROW_HOST_ECHO, format_percentiles(latency));
+    }
+    g_object_unref(user_data);
+}
+
+static void on_popover_show(GtkWidget *popover, gpointer user_data) {
+    StatsPanel *panel = (StatsPanel *)user_data;
+    if (panel->host_id > 0) {
+        db_async_get_echo_latency(panel->host_id, panel->proxy_host_id, on_host_echo, g_object_ref(panel->button));
+    }
+    panel->last_at = 0;
+    refresh_panel(panel);
+    if (panel->refresh_id == 0) panel->refresh_id = g_timeout_add(1000, refresh_panel, panel);
+}
+
+static void on_popover_closed(GtkPopover *popover, gpointer user_data) {
+    stop_refresh((StatsPanel *)user_data);
+}
+
+static void on_button_destroy(GtkWidget *button, gpointer user_data) {
+    stop_refresh((StatsPanel *)user_data);
+}
+
+static void free_panel(gpointer data) {
+    StatsPanel *panel = (StatsPanel *)data;
+    g_free(panel->host_echo);
+    g_free(panel);
+}
+
+// user_data is the JSON taken when Export was clicked
+static void on_export_selected(GObject *source, GAsyncResult *res, gpointer user_data) {
+    char *json = (char *)user_data;
+    GFile *file = gtk_file_dialog_save_finish(GTK_FILE_DIALOG(source), res, NULL);
+    char *path = file ? g_file_get_path(file) : NULL;
+    GError *error = NULL;
+    if (path && !g_file_set_contents(path, json, -1, &error)) {
+        g_warning("Cannot export session stats: %s", error->message);
+        g_error_free(error);
+    }
+    g_free(path);
+    if (file) g_object_unref(file);
+    g_free(json);
+}
+
+static void on_export_clicked(GtkWidget *btn, gpointer user_data) {
+    StatsPanel *panel = (StatsPanel *)user_data;
+    SSHContext *ctx = panel->source(panel->user_data);
+    if (!ctx) return;
+
+    SSHStatsSnapshot s;
+    ssh_stats_snapshot(ctx, &s);
+    LatencyHistogram echo;
+    ssh_stats_echo_histogram(ctx, &echo);
+    char *counters = ssh_stats_json(&s);
+    char *echo_json = latency_histogram_json(&echo);
+    char *host_json = panel->host_echo ? latency_histogram_json(panel->host_echo) : NULL;
+    char *json = NULL;
+    if (counters && echo_json) {
+        json = g_strdup_printf("{\"host_id\":%d,\"proxy_host_id\":%d,\"session\":%s,\"echo\":%s,\"host_echo\":%s}\n",
+                               panel->host_id, panel->proxy_host_id, counters, echo_json, host_json ? host_json : "null");
+    }
+    free(counters);
+    free(echo_json);
+    free(host_json);
+    if (!json) return;
+
+    GtkFileDialog *dialog = gtk_file_dialog_new();
+    gtk_file_dialog_set_title(dialog, "Export session stats");
+    gtk_file_dialog_set_initial_name(dialog, "session-stats.json");
+    gtk_file_dialog_save(dialog, GTK_WINDOW(gtk_widget_get_root(btn)), NULL, on_export_selected, json);
+    g_object_unref(dialog);
+}
+
+GtkWidget* session_stats_button_new(SessionStatsSource source, gpointer user_data) {
+    StatsPanel *panel = g_new0(StatsPanel, 1);
+    panel->source = source;
+    panel->user_data = user_data;
+
+    GtkWidget *grid = gtk_grid_new();
+    gtk_grid_set_row_spacing(GTK_GRID(grid), 4);
+    gtk_grid_set_column_spacing(GTK_GRID(grid), 16);
+    for (int row = 0; row < ROW_COUNT; row++) {
+        GtkWidget *name = gtk_label_new(row_names[row]);
+        gtk_widget_set_halign(name, GTK_ALIGN_START);
+        gtk_widget_add_css_class(name, "card-subtitle");
+        gtk_grid_attach(GTK_GRID(grid), name, 0, row, 1, 1);
+
+        panel->values[row] = gtk_label_new("—");
+        gtk_widget_set_halign(panel->values[row], GTK_ALIGN_START);
+        gtk_grid_attach(GTK_GRID(grid), panel->values[row], 1, row, 1, 1);
+    }
+
+    GtkWidget *btn_export = gtk_button_new_with_label("Export JSON…");
+    gtk_widget_set_halign(btn_export, GTK_ALIGN_END);
+    g_signal_connect(btn_export, "clicked", G_CALLBACK(on_export_clicked), panel);
+    gtk_grid_attach(GTK_GRID(grid), btn_export, 0, ROW_COUNT, 2, 1);
+
+    GtkWidget *popover = gtk_popover_new();
+    gtk_popover_set_child(GTK_POPOVER(popover), grid);
+    g_signal_connect(popover, "show", G_CALLBACK(on_popover_show), panel);
+    g_signal_connect(popover, "closed", G_CALLBACK(on_popover_closed), panel);
+
+    GtkWidget *button = gtk_menu_button_new();
+    gtk_menu_button_set_icon_name(GTK_MENU_BUTTON(button), "utilities-system-monitor-symbolic");
+    gtk_menu_button_set_has_frame(GTK_MENU_BUTTON(button), FALSE);
+    gtk_menu_button_set_popover(GTK_MENU_BUTTON(button), popover);
+    gtk_widget_set_focusable(button, FALSE);
+    gtk_widget_set_tooltip_text(button, "Session performance");
+    g_signal_connect(button, "destroy", G_CALLBACK(on_button_destroy), panel);
+    g_object_set_data_full(G_OBJECT(button), "stats-panel", panel, free_panel);
+    panel->button = button;
+    return button;
+}
+
+void session_stats_button_set_host(GtkWidget *button, int host_id, int proxy_host_id) {
+    StatsPanel *panel = g_object_get_data(G_OBJECT(button), "stats-panel");
+    panel->host_id = host_id;
+    panel->proxy_host_id = proxy_host_id;
+}
@@ -1,5 +1,10 @@
 #include "settings_view.h"
 #include "theme_manager.h"
+#include "hosts_view.h"
+#include "terminal_view.h"
+
+// Choices of the reachability check interval, in seconds
+static const int probe_intervals[] = { 0, 10, 30, 60, 300 };
 
 static void on_theme_changed(GtkComboBox *combo, gpointer user_data) {
     int active = gtk_combo_box_get_active(combo);
@@ -10,6 +15,16 @@ static void on_theme_changed(GtkComboBox *combo, gpointer user_data) {
     }
 }
 
+static void on_probe_interval_changed(GtkComboBox *combo, gpointer user_data) {
+    int active = gtk_combo_box_get_active(combo);
+    if (active >= 0) hosts_view_set_probe_interval(probe_intervals[active]);
+}
+
+static void on_predictive_echo_changed(GtkComboBox *combo, gpointer user_data) {
+    int active = gtk_combo_box_get_active(combo);
+    if (active >= 0) terminal_view_set_predictive_echo((LocalEchoMode)active);
+}
+
 GtkWidget* create_settings_view() {
     GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 20);
     gtk_widget_set_margin_top(box, 30);
@@ -43,6 +58,41 @@ GtkWidget* create_settings_view() {
     gtk_box_append(GTK_BOX(theme_row), theme_combo);
     gtk_box_append(GTK_BOX(content_box), theme_row);
 
+    GtkWidget *probe_row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 10);
+    GtkWidget *probe_label = gtk_label_new("Check host reachability:");
+    GtkWidget *probe_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(probe_combo), "Never");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(probe_combo), "Every 10 seconds");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(probe_combo), "Every 30 seconds");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(probe_combo), "Every minute");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(probe_combo), "Every 5 minutes");
+
+    int current = hosts_view_get_probe_interval();
+    for (int i = 0; i < (int)(sizeof(probe_intervals) / sizeof(probe_intervals[0])); i++) {
+        if (probe_intervals[i] == current) gtk_combo_box_set_active(GTK_COMBO_BOX(probe_combo), i);
+    }
+
+    g_signal_connect(probe_combo, "changed", G_CALLBACK(on_probe_interval_changed), NULL);
+
+    gtk_box_append(GTK_BOX(probe_row), probe_label);
+    gtk_box_append(GTK_BOX(probe_row), probe_combo);
+    gtk_box_append(GTK_BOX(content_box), probe_row);
+
+    // Items in LocalEchoMode order
+    GtkWidget *echo_row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 10);
+    GtkWidget *echo_label = gtk_label_new("Show typing before the server echoes it:");
+    GtkWidget *echo_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(echo_combo), "Never");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(echo_combo), "On slow connections");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(echo_combo), "Always");
+    gtk_widget_set_tooltip_text(echo_combo, "Predicted characters are underlined until the server confirms them");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(echo_combo), terminal_view_get_predictive_echo());
+    g_signal_connect(echo_combo, "changed", G_CALLBACK(on_predictive_echo_changed), NULL);
+
+    gtk_box_append(GTK_BOX(echo_row), echo_label);
+    gtk_box_append(GTK_BOX(echo_row), echo_combo);
+    gtk_box_append(GTK_BOX(content_box), echo_row);
+
     GtkWidget *about_frame = gtk_frame_new("About");
     GtkWidget *about_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
     gtk_widget_set_margin_top(about_box, 10);
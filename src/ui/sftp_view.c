@@ -1,9 +1,18 @@
 #include "sftp_view.h"
 #include "ssh_sftp.h"
 #include "ssh_backend.h"
+#include "sftp_sync.h"
+#include "sftp_index.h"
+#include "sftp_du.h"
+#include "file_preview.h"
+#include "sftp_edit.h"
+#include "db_worker.h"
+#include "host_repo.h"
+#include "session_stats_view.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <glib/gstdio.h>
 
 typedef struct {
     GtkWidget *box;
@@ -15,18 +24,89 @@ typedef struct {
     SSHContext *ssh_ctx;
     SFTPContext *sftp_ctx;
     char *current_path;
+    
+    GtkWidget *btn_sync;
+    SFTPSync *sync;
+    guint sync_timer;
+    
+    // Credentials for the extra sessions opened by edits and copies
+    Host *host;
+    GtkWidget *btn_index;
+    GtkWidget *search_entry;
+    SFTPIndex *index;
+    
+    GtkWidget *btn_size;
+    SFTPDirSize *dir_size;
+    guint dir_size_timer;
+    
+    GtkWidget *btn_edit;
+    GList *edits; // EditSession*
+    
+    GtkWidget *btn_copy;
 } SFTPViewData;
 
+// A remote file open in a local editor, uploaded back on every save
+typedef struct {
+    SFTPViewData *data; // NULL once the view let go, the last save then frees it
+    SFTPContext *ctx;
+    SFTPEditFile *edit;
+    GFileMonitor *monitor;
+    guint save_timer;
+    // Uploads run on their own thread, a change made meanwhile is saved after
+    gboolean saving;
+    gboolean save_again;
+    SFTPEditResult result;
+    uint64_t uploaded;
+} EditSession;
+
+// Opening a file for editing: login and download happen on a thread
+typedef struct {
+    SFTPViewData *data;
+    Host *host;
+    char *remote_path;
+    SFTPEditOpenMode mode;
+    SFTPContext *ctx; // Kept while the user decides about unsynced changes
+    char *local_path;
+    SFTPEditFile *edit;
+    bool reused;
+    bool pending;
+} EditOpenJob;
+
+// A file streamed to another saved host. Both logins happen on the copy thread.
+typedef struct {
+    SFTPViewData *data;
+    Host *src;
+    Host *dst;
+    char *src_path;
+    char *dst_path;
+    bool direct;
+    int rc;
+    SFTPTransferStats stats;
+} CopyJob;
+
+// Background walks share the browser's session, kept small and slow on purpose
+#define INDEX_CONCURRENCY 4
+#define INDEX_REQUESTS_PER_SEC 40
+#define SEARCH_MAX_RESULTS 200
+#define DIR_SIZE_CONCURRENCY 8
+#define DIR_SIZE_REQUESTS_PER_SEC 200
+#define DIR_SIZE_UPDATE_MS 250
+// Editors write in several steps, wait for them to settle before uploading
+#define EDIT_SAVE_DELAY_MS 300
+#define SYNC_STATUS_MS 1000
+
 enum {
     COL_ICON = 0,
     COL_NAME,
     COL_SIZE,
     COL_PERMS,
     COL_IS_DIR,
+    COL_PATH, // Full path, only set for search results
     NUM_COLS
 };
 
 static void update_file_list(SFTPViewData *data, const char *path);
+static void stop_dir_size(SFTPViewData *data);
 
 static void on_row_activated(GtkTreeView *tree_view, GtkTreePath *path, GtkTreeViewColumn *column, gpointer user_data) {
     SFTPViewData *data = (SFTPViewData *)user_data;
@@ -35,9 +115,18 @@ static void on_row_activated(GtkTreeView *tree_view, GtkTreePath *path, GtkTreeV
     if (gtk_tree_model_get_iter(GTK_TREE_MODEL(data->list_store), &iter, path)) {
         gboolean is_dir;
         char *name;
-        gtk_tree_model_get(GTK_TREE_MODEL(data->list_store), &iter, COL_IS_DIR, &is_dir, COL_NAME, &name, -1);
+        char *full_path;
+        gtk_tree_model_get(GTK_TREE_MODEL(data->list_store), &iter, COL_IS_DIR, &is_dir, COL_NAME, &name, COL_PATH, &full_path, -1);
         
-        if (is_dir) {
+        if (full_path) {
+            // Search result: open the directory, or the one containing the file
+            char *target = is_dir ? g_strdup(full_path) : g_path_get_dirname(full_path);
+            g_signal_handlers_block_matched(data->search_entry, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, data);
+            gtk_editable_set_text(GTK_EDITABLE(data->search_entry), "");
+            g_signal_handlers_unblock_matched(data->search_entry, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, data);
+            update_file_list(data, target);
+            g_free(target);
+        } else if (is_dir) {
             char new_path[1024];
             if (g_strcmp0(name, "..") == 0) {
                 if (g_strcmp0(data->current_path, "/") != 0) {
@@ -59,12 +148,20 @@ static void on_row_activated(GtkTreeView *tree_view, GtkTreePath *path, GtkTreeV
                 }
             }
             update_file_list(data, new_path);
+        } else if (data->sftp_ctx && data->current_path && data->sftp_ctx->transport == SFTP_TRANSPORT_SFTP) {
+            // Files open in a range-reading viewer sharing the browser's session
+            char *remote_path = g_build_path("/", data->current_path, name, NULL);
+            show_file_preview(GTK_WINDOW(gtk_widget_get_root(data->box)), data->sftp_ctx, remote_path);
+            g_free(remote_path);
         }
         g_free(name);
+        g_free(full_path);
     }
 }
 
 static void update_file_list(SFTPViewData *data, const char *path) {
+    // Sizes are shown on the rows of the directory they were computed for
+    stop_dir_size(data);
     gtk_list_store_clear(data->list_store);
 
     if (!data->sftp_ctx || !data->sftp_ctx->is_initialized) {
@@ -77,7 +174,9 @@ static void update_file_list(SFTPViewData *data, const char *path) {
     }
 
     int count = 0;
+    sftp_context_lock(data->sftp_ctx);
     SFTPFile **files = sftp_list_directory(data->sftp_ctx, path, &count);
+    sftp_context_unlock(data->sftp_ctx);
     
     if (!files && count == 0) {
         return;
@@ -135,6 +234,814 @@ static void on_address_activate(GtkEntry *entry, gpointer user_data) {
     update_file_list(data, path);
 }
 
+// Bytes that went over the wire, and the zero runs and holes that did not
+static void show_transfer_status(SFTPViewData *data, const char *what, uint64_t sent, uint64_t skipped) {
+    char *sent_str = g_format_size(sent);
+    char *text;
+    if (skipped > 0) {
+        char *skipped_str = g_format_size(skipped);
+        text = g_strdup_printf("%s: %s transferred, %s of zeros skipped", what, sent_str, skipped_str);
+        g_free(skipped_str);
+    } else {
+        text = g_strdup_printf("%s: %s transferred", what, sent_str);
+    }
+    gtk_label_set_text(GTK_LABEL(data->status_bar), text);
+    g_free(text);
+    g_free(sent_str);
+}
+
+static gboolean on_sync_status_tick(gpointer user_data) {
+    SFTPViewData *data = (SFTPViewData *)user_data;
+    SFTPSyncStats stats = sftp_sync_get_stats(data->sync);
+    char *what = g_strdup_printf("Sync, %llu files uploaded", (unsigned long long)stats.uploads);
+    show_transfer_status(data, what, stats.bytes_sent, stats.bytes_skipped);
+    g_free(what);
+    return G_SOURCE_CONTINUE;
+}
+
+static void stop_folder_sync(SFTPViewData *data) {
+    if (data->sync_timer) {
+        g_source_remove(data->sync_timer);
+        data->sync_timer = 0;
+    }
+    if (data->sync) {
+        sftp_sync_stop(data->sync);
+        data->sync = NULL;
+    }
+    g_signal_handlers_block_matched(data->btn_sync, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, data);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(data->btn_sync), FALSE);
+    g_signal_handlers_unblock_matched(data->btn_sync, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, data);
+    gtk_widget_set_tooltip_text(data->btn_sync, "Sync a local folder to this directory");
+}
+
+static void on_sync_folder_selected(GObject *source, GAsyncResult *res, gpointer user_data) {
+    SFTPViewData *data = (SFTPViewData *)user_data;
+    GFile *folder = gtk_file_dialog_select_folder_finish(GTK_FILE_DIALOG(source), res, NULL);
+    char *local_dir = folder ? g_file_get_path(folder) : NULL;
+    
+    if (local_dir && data->sftp_ctx && data->current_path) {
+        data->sync = sftp_sync_start(data->sftp_ctx, local_dir, data->current_path);
+    }
+    
+    if (data->sync) {
+        char *tip = g_strdup_printf("Syncing %s to %s", local_dir, data->current_path);
+        gtk_widget_set_tooltip_text(data->btn_sync, tip);
+        g_free(tip);
+        data->sync_timer = g_timeout_add(SYNC_STATUS_MS, on_sync_status_tick, data);
+    } else {
+        stop_folder_sync(data);
+    }
+    
+    g_free(local_dir);
+    if (folder) g_object_unref(folder);
+}
+
+static void on_sync_toggled(GtkToggleButton *btn, gpointer user_data) {
+    SFTPViewData *data = (SFTPViewData *)user_data;
+    
+    if (!gtk_toggle_button_get_active(btn)) {
+        stop_folder_sync(data);
+        return;
+    }
+    
+    GtkFileDialog *dialog = gtk_file_dialog_new();
+    gtk_file_dialog_set_title(dialog, "Local folder to sync");
+    gtk_file_dialog_select_folder(dialog, GTK_WINDOW(gtk_widget_get_root(GTK_WIDGET(btn))), NULL, on_sync_folder_selected, data);
+    g_object_unref(dialog);
+}
+
+static Host* copy_host(const Host *h) {
+    Host *copy = g_new0(Host, 1);
+    *copy = *h;
+    copy->name = g_strdup(h->name);
+    copy->hostname = g_strdup(h->hostname);
+    copy->username = g_strdup(h->username);
+    copy->password = g_strdup(h->password);
+    copy->key_path = g_strdup(h->key_path);
+    copy->protocol = g_strdup(h->protocol);
+    return copy;
+}
+
+static void free_host_copy(Host *h) {
+    if (!h) return;
+    g_free(h->name);
+    g_free(h->hostname);
+    g_free(h->username);
+    db_free_password(h->password);
+    g_free(h->key_path);
+    g_free(h->protocol);
+    g_free(h);
+}
+
+// A dedicated session for work that must not hold up browsing
+static SFTPContext* open_worker_session(Host *host) {
+    SSHContext *ssh_ctx = ssh_context_new();
+    if (!ssh_ctx) return NULL;
+    
+    if (ssh_connect_to_server(ssh_ctx, host->hostname, host->port, host->username, host->password, host->key_path, NULL, 0, NULL, NULL, NULL, false) != 0) {
+        ssh_context_free(ssh_ctx);
+        return NULL;
+    }
+    SFTPContext *ctx = sftp_context_new(ssh_ctx);
+    if (!ctx || sftp_init_session(ctx) != 0) {
+        sftp_context_free(ctx);
+        ssh_context_free(ssh_ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+static void close_worker_session(SFTPContext *ctx) {
+    SSHContext *ssh_ctx = ctx->ssh_ctx;
+    sftp_context_free(ctx);
+    ssh_context_free(ssh_ctx);
+}
+
+static char* index_cache_file(const Host *host) {
+    char *dir = g_build_filename(g_get_user_cache_dir(), "modern_ssh", "index", NULL);
+    g_mkdir_with_parents(dir, 0700);
+    char *name = g_strdup_printf("%s@%s-%d.idx", host->username, host->hostname, host->port);
+    char *file = g_build_filename(dir, name, NULL);
+    g_free(name);
+    g_free(dir);
+    return file;
+}
+
+static gboolean on_index_done_idle(gpointer user_data) {
+    SFTPViewData *data = (SFTPViewData *)user_data;
+    if (data->index) {
+        char *tip = g_strdup_printf("Remote index: %d paths", sftp_index_get_count(data->index));
+        gtk_widget_set_tooltip_text(data->btn_index, tip);
+        g_free(tip);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static void on_index_done(SFTPIndex *index, SFTPWalkStatus status, void *user_data) {
+    g_idle_add(on_index_done_idle, user_data);
+}
+
+static void start_index_refresh(SFTPViewData *data, const char *root) {
+    SFTPWalkConfig connection = {0};
+    connection.ctx = data->sftp_ctx;
+    connection.concurrency = INDEX_CONCURRENCY;
+    connection.max_requests_per_sec = INDEX_REQUESTS_PER_SEC;
+    
+    gtk_widget_set_tooltip_text(data->btn_index, "Indexing remote files...");
+    sftp_index_refresh(data->index, root, &connection, on_index_done, data);
+}
+
+static void close_index(SFTPViewData *data) {
+    if (data->index) {
+        sftp_index_free(data->index);
+        data->index = NULL;
+    }
+    g_signal_handlers_block_matched(data->btn_index, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, data);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(data->btn_index), FALSE);
+    g_signal_handlers_unblock_matched(data->btn_index, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, data);
+    gtk_widget_set_tooltip_text(data->btn_index, "Index this host for fuzzy search");
+    gtk_widget_set_sensitive(data->search_entry, FALSE);
+}
+
+static void on_index_toggled(GtkToggleButton *btn, gpointer user_data) {
+    SFTPViewData *data = (SFTPViewData *)user_data;
+    if (!data->host || !data->sftp_ctx) return;
+    
+    char *cache_file = index_cache_file(data->host);
+    if (!gtk_toggle_button_get_active(btn)) {
+        // Opting out forgets the host
+        close_index(data);
+        g_remove(cache_file);
+        g_free(cache_file);
+        return;
+    }
+    
+    sftp_context_lock(data->sftp_ctx);
+    char *root = sftp_canonicalize_path(data->sftp_ctx->sftp, data->current_path ? data->current_path : ".");
+    sftp_context_unlock(data->sftp_ctx);
+    
+    data->index = sftp_index_open(cache_file);
+    gtk_widget_set_sensitive(data->search_entry, TRUE);
+    start_index_refresh(data, root ? root : "/");
+    
+    ssh_string_free_char(root);
+    g_free(cache_file);
+}
+
+static void on_search_changed(GtkSearchEntry *entry, gpointer user_data) {
+    SFTPViewData *data = (SFTPViewData *)user_data;
+    const char *query = gtk_editable_get_text(GTK_EDITABLE(entry));
+    
+    if (!data->index || query[0] == '\0') {
+        if (data->current_path) {
+            char *path = g_strdup(data->current_path);
+            update_file_list(data, path);
+            g_free(path);
+        }
+        return;
+    }
+    
+    int count = 0;
+    SFTPIndexMatch *matches = sftp_index_search(data->index, query, SEARCH_MAX_RESULTS, &count);
+    
+    gtk_list_store_clear(data->list_store);
+    for (int i = 0; i < count; i++) {
+        GtkTreeIter iter;
+        gtk_list_store_append(data->list_store, &iter);
+        gtk_list_store_set(data->list_store, &iter,
+                           COL_ICON, matches[i].is_dir ? "folder-symbolic" : "text-x-generic-symbolic",
+                           COL_NAME, matches[i].path,
+                           COL_SIZE, "",
+                           COL_PERMS, "",
+                           COL_IS_DIR, matches[i].is_dir,
+                           COL_PATH, matches[i].path,
+                           -1);
+    }
+    sftp_index_free_matches(matches, count);
+}
+
+static void format_size(uint64_t bytes, char *buf, size_t len) {
+    if (bytes < 1024) snprintf(buf, len, "%lu B", (unsigned long)bytes);
+    else if (bytes < 1024*1024) snprintf(buf, len, "%.1f KB", bytes / 1024.0);
+    else if (bytes < 1024*1024*1024) snprintf(buf, len, "%.1f MB", bytes / (1024.0*1024.0));
+    else snprintf(buf, len, "%.1f GB", bytes / (1024.0*1024.0*1024.0));
+}
+
+// Writes the per-child totals into the matching directory rows
+static void show_dir_sizes(SFTPViewData *data, bool finished) {
+    int count = 0;
+    uint64_t total = 0;
+    SFTPDirSizeEntry *entries = sftp_dir_size_snapshot(data->dir_size, &count, &total);
+    
+    GHashTable *by_name = g_hash_table_new(g_str_hash, g_str_equal);
+    for (int i = 0; i < count; i++) {
+        if (entries[i].is_dir) g_hash_table_insert(by_name, entries[i].name, &entries[i]);
+    }
+    
+    GtkTreeIter iter;
+    gboolean valid = gtk_tree_model_get_iter_first(GTK_TREE_MODEL(data->list_store), &iter);
+    while (valid) {
+        gboolean is_dir;
+        char *name;
+        gtk_tree_model_get(GTK_TREE_MODEL(data->list_store), &iter, COL_IS_DIR, &is_dir, COL_NAME, &name, -1);
+        SFTPDirSizeEntry *e = is_dir ? g_hash_table_lookup(by_name, name) : NULL;
+        if (e) {
+            char size_str[48];
+            format_size(e->bytes, size_str, sizeof(size_str));
+            if (!finished) g_strlcat(size_str, "…", sizeof(size_str));
+            gtk_list_store_set(data->list_store, &iter, COL_SIZE, size_str, -1);
+        }
+        g_free(name);
+        valid = gtk_tree_model_iter_next(GTK_TREE_MODEL(data->list_store), &iter);
+    }
+    g_hash_table_destroy(by_name);
+    
+    char total_str[32];
+    format_size(total, total_str, sizeof(total_str));
+    char *tip = g_strdup_printf(finished ? "Total: %s" : "Computing... %s so far", total_str);
+    gtk_widget_set_tooltip_text(data->btn_size, tip);
+    g_free(tip);
+    
+    sftp_dir_size_free_entries(entries, count);
+}
+
+static void stop_dir_size(SFTPViewData *data) {
+    if (data->dir_size_timer) {
+        g_source_remove(data->dir_size_timer);
+        data->dir_size_timer = 0;
+    }
+    if (data->dir_size) {
+        sftp_dir_size_free(data->dir_size);
+        data->dir_size = NULL;
+    }
+    g_signal_handlers_block_matched(data->btn_size, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, data);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(data->btn_size), FALSE);
+    g_signal_handlers_unblock_matched(data->btn_size, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, data);
+}
+
+static gboolean on_dir_size_tick(gpointer user_data) {
+    SFTPViewData *data = (SFTPViewData *)user_data;
+    SFTPWalkStatus status;
+    bool finished = sftp_dir_size_is_finished(data->dir_size, &status);
+    
+    show_dir_sizes(data, finished && status == SFTP_WALK_DONE);
+    if (!finished) return G_SOURCE_CONTINUE;
+    
+    if (status == SFTP_WALK_FAILED) {
+        gtk_widget_set_tooltip_text(data->btn_size, "Could not compute sizes");
+    }
+    data->dir_size_timer = 0;
+    sftp_dir_size_free(data->dir_size);
+    data->dir_size = NULL;
+    g_signal_handlers_block_matched(data->btn_size, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, data);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(data->btn_size), FALSE);
+    g_signal_handlers_unblock_matched(data->btn_size, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, data);
+    return G_SOURCE_REMOVE;
+}
+
+static void on_size_toggled(GtkToggleButton *btn, gpointer user_data) {
+    SFTPViewData *data = (SFTPViewData *)user_data;
+    
+    if (!gtk_toggle_button_get_active(btn)) {
+        // Cancel, keeping the partial totals on screen
+        if (data->dir_size) show_dir_sizes(data, false);
+        stop_dir_size(data);
+        gtk_widget_set_tooltip_text(data->btn_size, "Compute directory sizes");
+        return;
+    }
+    if (!data->sftp_ctx || !data->current_path) {
+        stop_dir_size(data);
+        return;
+    }
+    
+    SFTPWalkConfig connection = {0};
+    connection.ctx = data->sftp_ctx;
+    connection.concurrency = DIR_SIZE_CONCURRENCY;
+    connection.max_requests_per_sec = DIR_SIZE_REQUESTS_PER_SEC;
+    
+    data->dir_size = sftp_dir_size_start(data->current_path, &connection);
+    if (!data->dir_size) {
+        stop_dir_size(data);
+        return;
+    }
+    gtk_widget_set_tooltip_text(data->btn_size, "Computing...");
+    data->dir_size_timer = g_timeout_add(DIR_SIZE_UPDATE_MS, on_dir_size_tick, data);
+}
+
+static void start_edit_save(EditSession *session);
+
+static void edit_session_destroy(EditSession *session) {
+    sftp_edit_close(session->edit);
+    close_worker_session(session->ctx);
+    g_free(session);
+}
+
+static void edit_session_free(EditSession *session) {
+    g_file_monitor_cancel(session->monitor);
+    g_object_unref(session->monitor);
+    session->data = NULL;
+    if (session->save_timer) {
+        // Do not lose a save that was still waiting
+        g_source_remove(session->save_timer);
+        session->save_timer = 0;
+        if (session->saving) session->save_again = TRUE;
+        else start_edit_save(session);
+    }
+    if (!session->saving) edit_session_destroy(session);
+}
+
+static void stop_all_edits(SFTPViewData *data) {
+    g_list_free_full(data->edits, (GDestroyNotify)edit_session_free);
+    data->edits = NULL;
+}
+
+static gboolean on_edit_saved_idle(gpointer user_data) {
+    EditSession *session = (EditSession *)user_data;
+    session->saving = FALSE;
+    
+    if (session->data) {
+        char *name = g_path_get_basename(sftp_edit_get_local_path(session->edit));
+        if (session->result == SFTP_EDIT_OK) {
+            char *size = g_format_size(session->uploaded);
+            char *tip = g_strdup_printf("Saved %s (%s sent)", name, size);
+            gtk_widget_set_tooltip_text(session->data->btn_edit, tip);
+            g_free(tip);
+            g_free(size);
+        } else if (session->result == SFTP_EDIT_CONFLICT || session->result == SFTP_EDIT_ERROR) {
+            GtkAlertDialog *alert = gtk_alert_dialog_new("Could not save %s", name);
+            gtk_alert_dialog_set_detail(alert, session->result == SFTP_EDIT_CONFLICT
+                ? "The remote file was changed by someone else since it was opened. Your changes were kept locally and not uploaded."
+                : "The upload failed. Your changes were kept locally, save again to retry.");
+            gtk_alert_dialog_show(alert, GTK_WINDOW(gtk_widget_get_root(session->data->box)));
+            g_object_unref(alert);
+        }
+        g_free(name);
+    }
+    
+    if (session->save_again) {
+        session->save_again = FALSE;
+        start_edit_save(session);
+    } else if (!session->data) {
+        // Unsaved changes stay in the cache, opening the file again offers them
+        edit_session_destroy(session);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static gpointer edit_save_thread_func(gpointer user_data) {
+    EditSession *session = (EditSession *)user_data;
+    session->result = sftp_edit_save(session->edit, &session->uploaded);
+    g_idle_add(on_edit_saved_idle, session);
+    return NULL;
+}
+
+static void start_edit_save(EditSession *session) {
+    session->saving = TRUE;
+    GThread *thread = g_thread_new("sftp-edit-save", edit_save_thread_func, session);
+    g_thread_unref(thread);
+}
+
+static gboolean on_edit_save_timeout(gpointer user_data) {
+    EditSession *session = (EditSession *)user_data;
+    session->save_timer = 0;
+    if (session->saving) session->save_again = TRUE;
+    else start_edit_save(session);
+    return G_SOURCE_REMOVE;
+}
+
+static void on_edit_file_changed(GFileMonitor *monitor, GFile *file, GFile *other, GFileMonitorEvent event, gpointer user_data) {
+    EditSession *session = (EditSession *)user_data;
+    if (event != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT && event != G_FILE_MONITOR_EVENT_CREATED) return;
+    
+    if (session->save_timer) g_source_remove(session->save_timer);
+    session->save_timer = g_timeout_add(EDIT_SAVE_DELAY_MS, on_edit_save_timeout, session);
+}
+
+static char* edit_cache_file(const Host *host, const char *remote_path) {
+    char *host_dir = g_strdup_printf("%s@%s-%d", host->username, host->hostname, host->port);
+    char *file = g_build_filename(g_get_user_cache_dir(), "modern_ssh", "edit", host_dir, remote_path, NULL);
+    char *dir = g_path_get_dirname(file);
+    g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+    g_free(host_dir);
+    return file;
+}
+
+// Remote path of the selected file, NULL when nothing or a directory is selected
+static char* selected_file_path(SFTPViewData *data) {
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(data->tree_view));
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    if (!data->host || !data->current_path || !gtk_tree_selection_get_selected(selection, &model, &iter)) return NULL;
+    
+    gboolean is_dir;
+    char *name;
+    char *full_path;
+    gtk_tree_model_get(model, &iter, COL_IS_DIR, &is_dir, COL_NAME, &name, COL_PATH, &full_path, -1);
+    char *remote_path = is_dir ? NULL : full_path ? g_strdup(full_path) : g_build_path("/", data->current_path, name, NULL);
+    g_free(name);
+    g_free(full_path);
+    return remote_path;
+}
+
+static void edit_open_job_free(EditOpenJob *job) {
+    if (job->ctx) close_worker_session(job->ctx);
+    free_host_copy(job->host);
+    g_free(job->remote_path);
+    g_free(job->local_path);
+    g_free(job);
+}
+
+static void start_edit_open_thread(EditOpenJob *job);
+
+// Keeps the unsynced cached copy next to the user's downloads before it is replaced
+static char* save_local_copy(const char *local_path) {
+    const char *dir = g_get_user_special_dir(G_USER_DIRECTORY_DOWNLOAD);
+    char *base = g_path_get_basename(local_path);
+    GDateTime *now = g_date_time_new_now_local();
+    char *stamp = g_date_time_format(now, "%Y%m%d-%H%M%S");
+    char *name = g_strdup_printf("%s.local-%s", base, stamp);
+    char *path = g_build_filename(dir ? dir : g_get_home_dir(), name, NULL);
+    g_free(name);
+    g_free(stamp);
+    g_date_time_unref(now);
+    g_free(base);
+    
+    GFile *src = g_file_new_for_path(local_path);
+    GFile *dst = g_file_new_for_path(path);
+    gboolean ok = g_file_copy(src, dst, G_FILE_COPY_NONE, NULL, NULL, NULL, NULL);
+    g_object_unref(dst);
+    g_object_unref(src);
+    if (!ok) {
+        g_free(path);
+        return NULL;
+    }
+    return path;
+}
+
+enum {
+    PENDING_KEEP = 0,
+    PENDING_DISCARD,
+    PENDING_SAVE_COPY,
+    PENDING_CANCEL
+};
+
+static void on_pending_choice(GObject *source, GAsyncResult *res, gpointer user_data) {
+    EditOpenJob *job = (EditOpenJob *)user_data;
+    int choice = gtk_alert_dialog_choose_finish(GTK_ALERT_DIALOG(source), res, NULL);
+    
+    if (choice == PENDING_KEEP) {
+        job->mode = SFTP_EDIT_OPEN_KEEP_LOCAL;
+    } else if (choice == PENDING_DISCARD) {
+        job->mode = SFTP_EDIT_OPEN_DISCARD_LOCAL;
+    } else if (choice == PENDING_SAVE_COPY) {
+        char *copy = save_local_copy(job->local_path);
+        if (!copy) {
+            gtk_label_set_text(GTK_LABEL(job->data->status_bar), "Could not save a copy of the local changes");
+            edit_open_job_free(job);
+            return;
+        }
+        char *text = g_strdup_printf("Local changes saved as %s", copy);
+        gtk_label_set_text(GTK_LABEL(job->data->status_bar), text);
+        g_free(text);
+        g_free(copy);
+        job->mode = SFTP_EDIT_OPEN_DISCARD_LOCAL;
+    } else {
+        edit_open_job_free(job);
+        return;
+    }
+    start_edit_open_thread(job);
+}
+
+static void ask_about_pending(EditOpenJob *job) {
+    char *base = g_path_get_basename(job->remote_path);
+    GtkAlertDialog *alert = gtk_alert_dialog_new("%s has changes that were never uploaded", base);
+    gtk_alert_dialog_set_detail(alert, "The last save of this file was refused or failed. "
+        "Keep editing your copy (the next save still checks for changes on the server), "
+        "discard it and download the remote file, or save your copy aside first.");
+    const char *buttons[] = { "Keep My Changes", "Discard", "Save a Copy", "Cancel", NULL };
+    gtk_alert_dialog_set_buttons(alert, buttons);
+    gtk_alert_dialog_set_cancel_button(alert, PENDING_CANCEL);
+    gtk_alert_dialog_set_default_button(alert, PENDING_KEEP);
+    gtk_alert_dialog_choose(alert, GTK_WINDOW(gtk_widget_get_root(job->data->box)), NULL, on_pending_choice, job);
+    g_object_unref(alert);
+    g_free(base);
+}
+
+static gboolean on_edit_opened_idle(gpointer user_data) {
+    EditOpenJob *job = (EditOpenJob *)user_data;
+    SFTPViewData *data = job->data;
+    
+    if (job->pending) {
+        ask_about_pending(job);
+        return G_SOURCE_REMOVE;
+    }
+    if (!job->edit) {
+        gtk_widget_set_tooltip_text(data->btn_edit, "Could not open the file for editing");
+        edit_open_job_free(job);
+        return G_SOURCE_REMOVE;
+    }
+    
+    char *base = g_path_get_basename(job->local_path);
+    if (job->reused) {
+        char *text = g_strdup_printf("Opened %s from the local cache", base);
+        gtk_label_set_text(GTK_LABEL(data->status_bar), text);
+        g_free(text);
+    } else {
+        char *what = g_strdup_printf("Downloaded %s", base);
+        show_transfer_status(data, what, job->ctx->last_transfer.transferred_bytes, job->ctx->last_transfer.skipped_bytes);
+        g_free(what);
+    }
+    g_free(base);
+    
+    // The dedicated session stays open as long as the file is watched
+    EditSession *session = g_new0(EditSession, 1);
+    session->data = data;
+    session->ctx = job->ctx;
+    session->edit = job->edit;
+    job->ctx = NULL;
+    
+    GFile *file = g_file_new_for_path(job->local_path);
+    session->monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, NULL);
+    g_signal_connect(session->monitor, "changed", G_CALLBACK(on_edit_file_changed), session);
+    data->edits = g_list_prepend(data->edits, session);
+    
+    GtkFileLauncher *launcher = gtk_file_launcher_new(file);
+    gtk_file_launcher_launch(launcher, GTK_WINDOW(gtk_widget_get_root(data->box)), NULL, NULL, NULL);
+    g_object_unref(launcher);
+    g_object_unref(file);
+    edit_open_job_free(job);
+    return G_SOURCE_REMOVE;
+}
+
+static gpointer edit_open_thread_func(gpointer user_data) {
+    EditOpenJob *job = (EditOpenJob *)user_data;
+    if (!job->ctx) job->ctx = open_worker_session(job->host);
+    
+    if (job->ctx && !job->local_path) {
+        char *canonical = sftp_canonicalize_path(job->ctx->sftp, job->remote_path);
+        if (canonical) {
+            g_free(job->remote_path);
+            job->remote_path = g_strdup(canonical);
+            job->local_path = edit_cache_file(job->host, canonical);
+            ssh_string_free_char(canonical);
+        }
+    }
+    if (job->local_path) {
+        job->edit = sftp_edit_open(job->ctx, job->remote_path, job->local_path, job->mode, &job->reused, &job->pending);
+    }
+    g_idle_add(on_edit_opened_idle, job);
+    return NULL;
+}
+
+static void start_edit_open_thread(EditOpenJob *job) {
+    GThread *thread = g_thread_new("sftp-edit-open", edit_open_thread_func, job);
+    g_thread_unref(thread);
+}
+
+static void on_edit_clicked(GtkButton *btn, gpointer user_data) {
+    SFTPViewData *data = (SFTPViewData *)user_data;
+    char *remote_path = selected_file_path(data);
+    if (!remote_path) return;
+    
+    EditOpenJob *job = g_new0(EditOpenJob, 1);
+    job->data = data;
+    job->host = copy_host(data->host);
+    job->remote_path = remote_path;
+    job->mode = SFTP_EDIT_OPEN_ASK;
+    
+    char *base = g_path_get_basename(remote_path);
+    char *text = g_strdup_printf("Opening %s...", base);
+    gtk_label_set_text(GTK_LABEL(data->status_bar), text);
+    g_free(text);
+    g_free(base);
+    start_edit_open_thread(job);
+}
+
+static void copy_job_free(CopyJob *job) {
+    free_host_copy(job->src);
+    free_host_copy(job->dst);
+    g_free(job->src_path);
+    g_free(job->dst_path);
+    g_free(job);
+}
+
+static gboolean on_copy_done_idle(gpointer user_data) {
+    CopyJob *job = (CopyJob *)user_data;
+    char *base = g_path_get_basename(job->src_path);
+    if (job->rc != 0) {
+        char *text = g_strdup_printf(job->direct ? "Could not copy %s to %s, the source host could not reach it on its own"
+                                                 : "Could not copy %s to %s", base, job->dst->name);
+        gtk_label_set_text(GTK_LABEL(job->data->status_bar), text);
+        g_free(text);
+    } else if (job->direct) {
+        char *text = g_strdup_printf("Copied %s to %s, sent by the source host", base, job->dst->name);
+        gtk_label_set_text(GTK_LABEL(job->data->status_bar), text);
+        g_free(text);
+    } else {
+        char *what = g_strdup_printf("Copied %s to %s", base, job->dst->name);
+        show_transfer_status(job->data, what, job->stats.transferred_bytes, job->stats.skipped_bytes);
+        g_free(what);
+    }
+    g_free(base);
+    copy_job_free(job);
+    return G_SOURCE_REMOVE;
+}
+
+static gpointer copy_thread_func(gpointer user_data) {
+    CopyJob *job = (CopyJob *)user_data;
+    job->rc = -1;
+    
+    SFTPContext *src = open_worker_session(job->src);
+    if (src && job->direct) {
+        job->rc = sftp_copy_remote_direct(src, job->src_path, job->dst->username, job->dst->hostname, job->dst->port, job->dst_path);
+    } else if (src) {
+        SFTPContext *dst = open_worker_session(job->dst);
+        if (dst) {
+            job->rc = sftp_copy_remote(src, job->src_path, dst, job->dst_path);
+            job->stats = dst->last_transfer;
+            close_worker_session(dst);
+        }
+    }
+    if (src) close_worker_session(src);
+    
+    g_idle_add(on_copy_done_idle, job);
+    return NULL;
+}
+
+static void start_copy_thread(CopyJob *job) {
+    GThread *thread = g_thread_new("sftp-copy", copy_thread_func, job);
+    g_thread_unref(thread);
+}
+
+static void on_copy_passwords_loaded(char *password, char *proxy_password, gpointer user_data) {
+    CopyJob *job = (CopyJob *)user_data;
+    db_free_password(proxy_password);
+    if (!password) {
+        // Saved but not given back by the keyring, a login without it would only fail
+        char *text = g_strdup_printf("Could not copy, the password for %s could not be read from the keyring", job->dst->name);
+        gtk_label_set_text(GTK_LABEL(job->data->status_bar), text);
+        g_free(text);
+        copy_job_free(job);
+        return;
+    }
+    job->dst->password = password;
+    start_copy_thread(job);
+}
+
+static void on_copy_confirmed(GtkWidget *btn, gpointer user_data) {
+    SFTPViewData *data = (SFTPViewData *)user_data;
+    GtkWidget *dialog = GTK_WIDGET(gtk_widget_get_root(btn));
+    GtkWidget *host_combo = g_object_get_data(G_OBJECT(dialog), "host_combo");
+    GtkWidget *path_entry = g_object_get_data(G_OBJECT(dialog), "path_entry");
+    GtkWidget *direct_check = g_object_get_data(G_OBJECT(dialog), "direct_check");
+    const char *src_path = g_object_get_data(G_OBJECT(dialog), "src_path");
+    
+    const char *id_str = gtk_combo_box_get_active_id(GTK_COMBO_BOX(host_combo));
+    const Host *dst = id_str ? host_repo_get_host(atoi(id_str)) : NULL;
+    const char *dst_path = gtk_editable_get_text(GTK_EDITABLE(path_entry));
+    if (!dst || dst_path[0] == '\0' || !data->host) return;
+    
+    CopyJob *job = g_new0(CopyJob, 1);
+    job->data = data;
+    job->src = copy_host(data->host);
+    job->dst = copy_host(dst);
+    job->src_path = g_strdup(src_path);
+    job->dst_path = g_strdup(dst_path);
+    job->direct = gtk_widget_get_sensitive(direct_check) && gtk_check_button_get_active(GTK_CHECK_BUTTON(direct_check));
+    
+    char *base = g_path_get_basename(src_path);
+    char *text = g_strdup_printf("Copying %s to %s...", base, dst->name);
+    gtk_label_set_text(GTK_LABEL(data->status_bar), text);
+    g_free(text);
+    g_free(base);
+    
+    // The source password is already in data->host, the destination one is looked up
+    if (dst->has_password && !job->direct) {
+        db_async_get_passwords(dst->id, 0, on_copy_passwords_loaded, job);
+    } else {
+        start_copy_thread(job);
+    }
+    gtk_window_destroy(GTK_WINDOW(dialog));
+}
+
+// Direct mode runs scp on the source host, which has no jump host to go through
+static gboolean host_is_proxied(const Host *host) {
+    return host->proxy_host_id > 0 || ssh_config_has_proxy(host->hostname);
+}
+
+static void update_direct_check(GtkComboBox *combo, gpointer user_data) {
+    GtkWidget *direct_check = GTK_WIDGET(user_data);
+    gboolean src_proxied = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(direct_check), "src_proxied"));
+    const char *id_str = gtk_combo_box_get_active_id(combo);
+    const Host *dst = id_str ? host_repo_get_host(atoi(id_str)) : NULL;
+    
+    gboolean possible = !src_proxied && !(dst && host_is_proxied(dst));
+    gtk_widget_set_sensitive(direct_check, possible);
+    gtk_widget_set_tooltip_text(direct_check, possible ? NULL : "Not available when either host is reached through a jump host");
+}
+
+static void on_copy_clicked(GtkButton *btn, gpointer user_data) {
+    SFTPViewData *data = (SFTPViewData *)user_data;
+    char *remote_path = selected_file_path(data);
+    if (!remote_path) return;
+    
+    GtkWidget *dialog = gtk_window_new();
+    gtk_window_set_transient_for(GTK_WINDOW(dialog), GTK_WINDOW(gtk_widget_get_root(data->box)));
+    gtk_window_set_modal(GTK_WINDOW(dialog), TRUE);
+    gtk_window_set_title(GTK_WINDOW(dialog), "Copy to Another Host");
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 400, 250);
+    
+    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 12);
+    gtk_widget_set_margin_top(vbox, 24);
+    gtk_widget_set_margin_bottom(vbox, 24);
+    gtk_widget_set_margin_start(vbox, 24);
+    gtk_widget_set_margin_end(vbox, 24);
+    gtk_window_set_child(GTK_WINDOW(dialog), vbox);
+    
+    gtk_box_append(GTK_BOX(vbox), gtk_label_new("Destination host"));
+    GtkWidget *host_combo = gtk_combo_box_text_new();
+    int host_count = 0;
+    const Host* const* hosts = host_repo_get_hosts(&host_count);
+    for (int i = 0; i < host_count; i++) {
+        // Worker sessions connect directly, hosts behind a jump host are left out
+        if (hosts[i]->proxy_host_id > 0) continue;
+        char id_str[32];
+        sprintf(id_str, "%d", hosts[i]->id);
+        gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(host_combo), id_str, hosts[i]->name);
+    }
+    gtk_combo_box_set_active(GTK_COMBO_BOX(host_combo), 0);
+    gtk_box_append(GTK_BOX(vbox), host_combo);
+    
+    gtk_box_append(GTK_BOX(vbox), gtk_label_new("Destination file"));
+    GtkWidget *path_entry = gtk_entry_new();
+    gtk_editable_set_text(GTK_EDITABLE(path_entry), remote_path);
+    gtk_box_append(GTK_BOX(vbox), path_entry);
+    
+    GtkWidget *direct_check = gtk_check_button_new_with_label("Let the source host send it directly (needs its own key for the destination)");
+    gtk_box_append(GTK_BOX(vbox), direct_check);
+    g_object_set_data(G_OBJECT(direct_check), "src_proxied", GINT_TO_POINTER(data->host && host_is_proxied(data->host)));
+    g_signal_connect(host_combo, "changed", G_CALLBACK(update_direct_check), direct_check);
+    update_direct_check(GTK_COMBO_BOX(host_combo), direct_check);
+    
+    g_object_set_data(G_OBJECT(dialog), "host_combo", host_combo);
+    g_object_set_data(G_OBJECT(dialog), "path_entry", path_entry);
+    g_object_set_data(G_OBJECT(dialog), "direct_check", direct_check);
+    g_object_set_data_full(G_OBJECT(dialog), "src_path", remote_path, g_free);
+    
+    GtkWidget *btn_confirm = gtk_button_new_with_label("Copy");
+    gtk_widget_add_css_class(btn_confirm, "suggested-action");
+    g_signal_connect(btn_confirm, "clicked", G_CALLBACK(on_copy_confirmed), data);
+    gtk_box_append(GTK_BOX(vbox), btn_confirm);
+    
+    gtk_window_present(GTK_WINDOW(dialog));
+}
+
+static SSHContext* view_stats_source(gpointer user_data) {
+    SFTPViewData *data = (SFTPViewData *)user_data;
+    return data->ssh_ctx;
+}
+
 GtkWidget* create_sftp_view() {
     SFTPViewData *data = g_new0(SFTPViewData, 1);
     
@@ -160,12 +1067,52 @@ GtkWidget* create_sftp_view() {
     gtk_widget_set_sensitive(btn_go, FALSE);
     gtk_box_append(GTK_BOX(toolbar), btn_go);
     
+    data->btn_sync = gtk_toggle_button_new();
+    gtk_button_set_icon_name(GTK_BUTTON(data->btn_sync), "emblem-synchronizing-symbolic");
+    gtk_widget_set_tooltip_text(data->btn_sync, "Sync a local folder to this directory");
+    gtk_widget_set_sensitive(data->btn_sync, FALSE);
+    g_signal_connect(data->btn_sync, "toggled", G_CALLBACK(on_sync_toggled), data);
+    gtk_box_append(GTK_BOX(toolbar), data->btn_sync);
+    
+    data->btn_edit = gtk_button_new_from_icon_name("document-edit-symbolic");
+    gtk_widget_set_tooltip_text(data->btn_edit, "Open the selected file in a local editor");
+    gtk_widget_set_sensitive(data->btn_edit, FALSE);
+    g_signal_connect(data->btn_edit, "clicked", G_CALLBACK(on_edit_clicked), data);
+    gtk_box_append(GTK_BOX(toolbar), data->btn_edit);
+    
+    data->btn_copy = gtk_button_new_from_icon_name("send-to-symbolic");
+    gtk_widget_set_tooltip_text(data->btn_copy, "Copy the selected file to another host");
+    gtk_widget_set_sensitive(data->btn_copy, FALSE);
+    g_signal_connect(data->btn_copy, "clicked", G_CALLBACK(on_copy_clicked), data);
+    gtk_box_append(GTK_BOX(toolbar), data->btn_copy);
+    
+    data->btn_size = gtk_toggle_button_new();
+    gtk_button_set_icon_name(GTK_BUTTON(data->btn_size), "drive-harddisk-symbolic");
+    gtk_widget_set_tooltip_text(data->btn_size, "Compute directory sizes");
+    gtk_widget_set_sensitive(data->btn_size, FALSE);
+    g_signal_connect(data->btn_size, "toggled", G_CALLBACK(on_size_toggled), data);
+    gtk_box_append(GTK_BOX(toolbar), data->btn_size);
+    
+    data->search_entry = gtk_search_entry_new();
+    gtk_search_entry_set_placeholder_text(GTK_SEARCH_ENTRY(data->search_entry), "Find file...");
+    gtk_widget_set_sensitive(data->search_entry, FALSE);
+    g_signal_connect(data->search_entry, "search-changed", G_CALLBACK(on_search_changed), data);
+    gtk_box_append(GTK_BOX(toolbar), data->search_entry);
+    
+    data->btn_index = gtk_toggle_button_new();
+    gtk_button_set_icon_name(GTK_BUTTON(data->btn_index), "system-search-symbolic");
+    gtk_widget_set_tooltip_text(data->btn_index, "Index this host for fuzzy search");
+    gtk_widget_set_sensitive(data->btn_index, FALSE);
+    g_signal_connect(data->btn_index, "toggled", G_CALLBACK(on_index_toggled), data);
+    gtk_box_append(GTK_BOX(toolbar), data->btn_index);
+    gtk_box_append(GTK_BOX(toolbar), session_stats_button_new(view_stats_source, data));
+    
     gtk_box_append(GTK_BOX(data->box), toolbar);
     
     GtkWidget *scrolled = gtk_scrolled_window_new();
     gtk_widget_set_vexpand(scrolled, TRUE);
     
-    data->list_store = gtk_list_store_new(NUM_COLS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_BOOLEAN);
+    data->list_store = gtk_list_store_new(NUM_COLS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_BOOLEAN, G_TYPE_STRING);
     data->tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(data->list_store));
     
     GtkCellRenderer *renderer_icon = gtk_cell_renderer_pixbuf_new();
@@ -190,27 +1137,51 @@ GtkWidget* create_sftp_view() {
     gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scrolled), data->tree_view);
     gtk_box_append(GTK_BOX(data->box), scrolled);
     
+    data->status_bar = gtk_label_new("");
+    gtk_label_set_xalign(GTK_LABEL(data->status_bar), 0);
+    gtk_label_set_ellipsize(GTK_LABEL(data->status_bar), PANGO_ELLIPSIZE_END);
+    gtk_widget_add_css_class(data->status_bar, "dim-label");
+    gtk_widget_set_margin_start(data->status_bar, 10);
+    gtk_widget_set_margin_end(data->status_bar, 10);
+    gtk_widget_set_margin_top(data->status_bar, 4);
+    gtk_widget_set_margin_bottom(data->status_bar, 4);
+    gtk_box_append(GTK_BOX(data->box), data->status_bar);
+    
     g_object_set_data(G_OBJECT(data->box), "view_data", data);
     g_object_set_data(G_OBJECT(data->box), "btn_go", btn_go); // Save for later
     
     return data->box;
 }
 
-void sftp_view_connect(GtkWidget *view, Host *host) {
+void sftp_view_connect(GtkWidget *view, const Host *host) {
     SFTPViewData *data = g_object_get_data(G_OBJECT(view), "view_data");
     GtkWidget *btn_go = g_object_get_data(G_OBJECT(view), "btn_go");
     
+    stop_folder_sync(data);
+    gtk_widget_set_sensitive(data->btn_sync, FALSE);
+    close_index(data);
+    gtk_widget_set_sensitive(data->btn_index, FALSE);
+    stop_dir_size(data);
+    gtk_widget_set_sensitive(data->btn_size, FALSE);
+    stop_all_edits(data);
+    gtk_widget_set_sensitive(data->btn_edit, FALSE);
+    gtk_widget_set_sensitive(data->btn_copy, FALSE);
+    free_host_copy(data->host);
+    data->host = NULL;
+    
     if (data->sftp_ctx) {
-        sftp_context_free(data->sftp_ctx);
-        data->sftp_ctx = NULL;
-    }
-    if (data->ssh_ctx) {
+        // A stopped folder sync may still be sending its last batch, the last
+        // reference closes the session
+        sftp_context_unref(data->sftp_ctx);
+    } else if (data->ssh_ctx) {
         ssh_context_free(data->ssh_ctx);
-        data->ssh_ctx = NULL;
     }
+    data->sftp_ctx = NULL;
+    data->ssh_ctx = NULL;
     
     // Reset UI
     gtk_list_store_clear(data->list_store);
+    gtk_label_set_text(GTK_LABEL(data->status_bar), "");
     gtk_editable_set_text(GTK_EDITABLE(data->address_bar), "");
     gtk_widget_set_sensitive(data->address_bar, FALSE);
     if (btn_go) gtk_widget_set_sensitive(btn_go, FALSE);
@@ -220,12 +1191,42 @@ void sftp_view_connect(GtkWidget *view, Host *host) {
     data->ssh_ctx = ssh_context_new();
     
     // Note: We use 0 for proxy fields as placeholders
-    if (ssh_connect_to_server(data->ssh_ctx, host->hostname, host->port, host->username, host->password, host->key_path, NULL, 0, NULL, NULL, NULL, false) == 0) {
+    int rc = ssh_connect_to_server(data->ssh_ctx, host->hostname, host->port, host->username, host->password, host->key_path, NULL, 0, NULL, NULL, NULL, false);
+    if (data->ssh_ctx && host->id > 0) db_async_add_connection_stats(host->id, 0, &data->ssh_ctx->timing);
+    if (rc == 0) {
         data->sftp_ctx = sftp_context_new(data->ssh_ctx);
         if (sftp_init_session(data->sftp_ctx) == 0) {
             gtk_widget_set_sensitive(data->address_bar, TRUE);
             if (btn_go) gtk_widget_set_sensitive(btn_go, TRUE);
+            // SCP/exec fallbacks can list and transfer, but have no random access
+            gboolean full_sftp = data->sftp_ctx->transport == SFTP_TRANSPORT_SFTP;
+            gtk_widget_set_sensitive(data->btn_sync, full_sftp);
+            gtk_widget_set_sensitive(data->btn_index, full_sftp);
+            gtk_widget_set_sensitive(data->btn_size, TRUE);
+            gtk_widget_set_sensitive(data->btn_edit, full_sftp);
+            gtk_widget_set_sensitive(data->btn_copy, full_sftp);
+            gtk_widget_set_tooltip_text(data->address_bar, full_sftp ? NULL :
+                data->sftp_ctx->transport == SFTP_TRANSPORT_SCP ? "No SFTP on this server, using SCP" : "No SFTP on this server, using shell commands");
+            data->host = copy_host(host);
             update_file_list(data, "."); // Start at home (often .) or get cwd
+            
+            // Hosts indexed before are refreshed incrementally in the background
+            char *cache_file = index_cache_file(host);
+            if (full_sftp && g_file_test(cache_file, G_FILE_TEST_EXISTS)) {
+                data->index = sftp_index_open(cache_file);
+                char *root = sftp_index_get_root(data->index);
+                if (root) {
+                    g_signal_handlers_block_matched(data->btn_index, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, data);
+                    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(data->btn_index), TRUE);
+                    g_signal_handlers_unblock_matched(data->btn_index, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, data);
+                    gtk_widget_set_sensitive(data->search_entry, TRUE);
+                    start_index_refresh(data, root);
+                    free(root);
+                } else {
+                    close_index(data);
+                }
+            }
+            g_free(cache_file);
         } else {
              // Error init SFTP
         }
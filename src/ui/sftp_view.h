@@ -8,6 +8,6 @@
 GtkWidget* create_sftp_view();
 
 // Connect SFTP view to a host
-void sftp_view_connect(GtkWidget *view, Host *host);
+void sftp_view_connect(GtkWidget *view, const Host *host);
 
 #endif
@@ -1,7 +1,13 @@
 #include "terminal_view.h"
 #include "ssh_backend.h"
-#include "db.h"
+#include "db_worker.h"
+#include "session_stats_view.h"
+#include "trace.h"
 #include <vte/vte.h>
+#include <stdlib.h>
+
+// Past connections the timing popover compares against
+#define TIMING_HISTORY 20
 
 typedef struct {
     GtkWidget *terminal;
@@ -9,15 +15,43 @@ typedef struct {
     guint poll_id;
     GtkWidget *box;
     GtkWidget *notebook;
+    int host_id;        // 0 for a host that isn't saved
+    int proxy_host_id;
+    LocalEcho *echo;
+    uint64_t echo_samples;  // Of the session stats, the last fed to echo
 } TerminalTab;
 
+static LocalEchoMode predictive_echo = LOCAL_ECHO_OFF;
+
+void terminal_view_set_predictive_echo(LocalEchoMode mode) {
+    predictive_echo = mode;
+}
+
+LocalEchoMode terminal_view_get_predictive_echo() {
+    return predictive_echo;
+}
+
 static void on_terminal_commit(VteTerminal *terminal, gchar *text, guint size, gpointer data) {
     TerminalTab *tab = (TerminalTab *)data;
     if (tab->ssh_ctx && tab->ssh_ctx->is_connected) {
+        if (tab->echo) {
+            glong col, row;
+            vte_terminal_get_cursor_position(terminal, &col, &row);
+            char drawn[LOCAL_ECHO_OVERHEAD];
+            size_t n = local_echo_keys(tab->echo, text, size, (int)col, (int)vte_terminal_get_column_count(terminal),
+                                       g_get_monotonic_time(), drawn, sizeof(drawn));
+            if (n > 0) vte_terminal_feed(terminal, drawn, n);
+        }
+        ssh_stats_keystroke(tab->ssh_ctx);
         ssh_write_data(tab->ssh_ctx, text, size);
     }
 }
 
+static SSHContext* tab_stats_source(gpointer data) {
+    TerminalTab *tab = (TerminalTab *)data;
+    return tab->ssh_ctx;
+}
+
 static gboolean on_ssh_poll(gpointer data) {
     TerminalTab *tab = (TerminalTab *)data;
     
@@ -37,9 +71,28 @@ static gboolean on_ssh_poll(gpointer data) {
     }
 
     char buffer[4096];
+    char shown[sizeof(buffer) + LOCAL_ECHO_OVERHEAD];
     int nbytes = ssh_read_nonblocking(tab->ssh_ctx, buffer, sizeof(buffer));
+    if (tab->echo) local_echo_set_mode(tab->echo, predictive_echo);
     if (nbytes > 0) {
-        vte_terminal_feed(VTE_TERMINAL(tab->terminal), buffer, nbytes);
+        TraceSpan span = trace_span_begin("render", "feed");
+        if (tab->echo) {
+            // Predictions follow the echo times measured by the session
+            uint64_t samples = atomic_load_explicit(&tab->ssh_ctx->stats.echo_samples, memory_order_relaxed);
+            if (samples != tab->echo_samples) {
+                tab->echo_samples = samples;
+                local_echo_add_rtt(tab->echo, atomic_load_explicit(&tab->ssh_ctx->stats.echo_last_us, memory_order_relaxed));
+            }
+            size_t n = local_echo_server(tab->echo, buffer, nbytes, shown, sizeof(shown));
+            vte_terminal_feed(VTE_TERMINAL(tab->terminal), shown, n);
+        } else {
+            vte_terminal_feed(VTE_TERMINAL(tab->terminal), buffer, nbytes);
+        }
+        ssh_stats_add(&tab->ssh_ctx->stats.feeds, 1);
+        trace_span_end_detail(&span, "%d bytes", nbytes);
+    } else if (tab->echo) {
+        size_t n = local_echo_expire(tab->echo, g_get_monotonic_time(), shown, sizeof(shown));
+        if (n > 0) vte_terminal_feed(VTE_TERMINAL(tab->terminal), shown, n);
     }
     return TRUE;
 }
@@ -50,8 +103,15 @@ static void on_tab_destroy(GtkWidget *widget, gpointer data) {
         g_source_remove(tab->poll_id);
     }
     if (tab->ssh_ctx) {
+        // The session's echoes join the host's history
+        if (tab->host_id > 0) {
+            LatencyHistogram echo;
+            ssh_stats_echo_histogram(tab->ssh_ctx, &echo);
+            db_async_merge_echo_latency(tab->host_id, tab->proxy_host_id, &echo);
+        }
         ssh_context_free(tab->ssh_ctx);
     }
+    local_echo_free(tab->echo);
     g_free(tab);
 }
 
@@ -65,6 +125,115 @@ static void on_close_tab_clicked(GtkWidget *btn, gpointer user_data) {
     }
 }
 
+static void format_duration(int64_t us, char *buf, size_t len) {
+    if (us < 0) snprintf(buf, len, "—");
+    else if (us < 10000000) snprintf(buf, len, "%.1f ms", us / 1000.0);
+    else snprintf(buf, len, "%.1f s", us / 1000000.0);
+}
+
+// Row CONNECT_PHASE_COUNT of the timing grid is the total
+static int64_t timing_row_value(const ConnectTiming *t, int row) {
+    return row < CONNECT_PHASE_COUNT ? t->phase_us[row] : t->total_us;
+}
+
+static int compare_duration(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Fills the "Usual" column with the median of the successful connections
+static void on_timing_history(ConnectTiming *stats, int count, gpointer user_data) {
+    GtkWidget *grid = GTK_WIDGET(user_data);
+    int64_t values[TIMING_HISTORY];
+
+    for (int row = 0; row <= CONNECT_PHASE_COUNT; row++) {
+        char key[16];
+        snprintf(key, sizeof(key), "usual-%d", row);
+        GtkWidget *label = g_object_get_data(G_OBJECT(grid), key);
+        if (!label) continue;
+
+        int n = 0;
+        for (int i = 0; i < count && n < TIMING_HISTORY; i++) {
+            int64_t v = timing_row_value(&stats[i], row);
+            if (stats[i].failed_phase < 0 && v >= 0) values[n++] = v;
+        }
+        char text[32];
+        if (n > 0) {
+            qsort(values, n, sizeof(values[0]), compare_duration);
+            format_duration(values[n / 2], text, sizeof(text));
+        } else {
+            format_duration(-1, text, sizeof(text));
+        }
+        gtk_label_set_text(GTK_LABEL(label), text);
+    }
+    free(stats);
+    g_object_unref(grid);
+}
+
+static GtkWidget* timing_label(const char *text, const char *css_class) {
+    GtkWidget *label = gtk_label_new(text);
+    gtk_widget_set_halign(label, GTK_ALIGN_START);
+    if (css_class) gtk_widget_add_css_class(label, css_class);
+    return label;
+}
+
+// Built each time it opens, the connection may have finished in between
+static void on_timing_popover_show(GtkWidget *popover, gpointer data) {
+    TerminalTab *tab = (TerminalTab *)data;
+
+    if (!tab->ssh_ctx) {
+        gtk_popover_set_child(GTK_POPOVER(popover), timing_label("Still connecting…", NULL));
+        return;
+    }
+    const ConnectTiming *t = &tab->ssh_ctx->timing;
+
+    GtkWidget *grid = gtk_grid_new();
+    gtk_grid_set_row_spacing(GTK_GRID(grid), 4);
+    gtk_grid_set_column_spacing(GTK_GRID(grid), 16);
+    gtk_widget_set_margin_top(grid, 8);
+    gtk_widget_set_margin_bottom(grid, 8);
+    gtk_widget_set_margin_start(grid, 8);
+    gtk_widget_set_margin_end(grid, 8);
+
+    gtk_grid_attach(GTK_GRID(grid), timing_label("This connection", "card-subtitle"), 1, 0, 1, 1);
+    if (tab->host_id > 0) {
+        GtkWidget *usual = timing_label("Usual", "card-subtitle");
+        char tooltip[96];
+        snprintf(tooltip, sizeof(tooltip), "Median of the last %d successful connections to this host", TIMING_HISTORY);
+        gtk_widget_set_tooltip_text(usual, tooltip);
+        gtk_grid_attach(GTK_GRID(grid), usual, 2, 0, 1, 1);
+    }
+
+    for (int row = 0; row <= CONNECT_PHASE_COUNT; row++) {
+        const char *name = row < CONNECT_PHASE_COUNT ? connect_phase_name(row) : "total";
+        GtkWidget *lbl_name = timing_label(name, row == t->failed_phase ? "error" : NULL);
+        char value[32];
+        format_duration(timing_row_value(t, row), value, sizeof(value));
+        gtk_grid_attach(GTK_GRID(grid), lbl_name, 0, row + 1, 1, 1);
+        gtk_grid_attach(GTK_GRID(grid), timing_label(value, NULL), 1, row + 1, 1, 1);
+
+        if (tab->host_id > 0) {
+            GtkWidget *usual = timing_label("…", NULL);
+            char key[16];
+            snprintf(key, sizeof(key), "usual-%d", row);
+            g_object_set_data(G_OBJECT(grid), key, usual);
+            gtk_grid_attach(GTK_GRID(grid), usual, 2, row + 1, 1, 1);
+        }
+    }
+
+    if (t->auth_method[0] != '\0' || t->publickey_us >= 0) {
+        char keys[32], note[96];
+        format_duration(t->publickey_us, keys, sizeof(keys));
+        snprintf(note, sizeof(note), "Auth by %s, %s trying keys", t->auth_method[0] ? t->auth_method : "nothing", keys);
+        gtk_grid_attach(GTK_GRID(grid), timing_label(note, "card-subtitle"), 0, CONNECT_PHASE_COUNT + 2, 3, 1);
+    }
+
+    gtk_popover_set_child(GTK_POPOVER(popover), grid);
+    if (tab->host_id > 0) {
+        db_async_get_connection_stats(tab->host_id, TIMING_HISTORY, on_timing_history, g_object_ref(grid));
+    }
+}
+
 GtkWidget* create_terminal_view() {
     GtkWidget *notebook = gtk_notebook_new();
     gtk_notebook_set_scrollable(GTK_NOTEBOOK(notebook), TRUE);
@@ -86,11 +255,17 @@ typedef struct {
     char *proxy_user;
     char *proxy_password;
     char *proxy_key_path;
+    int host_id;
+    int proxy_host_id;
     int result;
 } ConnectionData;
 
 static gboolean on_connection_complete(gpointer data) {
     ConnectionData *cd = (ConnectionData *)data;
+
+    if (cd->ssh_ctx && cd->host_id > 0) {
+        db_async_add_connection_stats(cd->host_id, cd->proxy_host_id, &cd->ssh_ctx->timing);
+    }
     
     if (cd->box_ptr == NULL) {
         if (cd->ssh_ctx) {
@@ -103,22 +278,29 @@ static gboolean on_connection_complete(gpointer data) {
 
         if (cd->result == 0) {
             vte_terminal_feed(VTE_TERMINAL(tab->terminal), "Connected.\r\n", -1);
+            tab->echo = local_echo_new();
             tab->poll_id = g_timeout_add(10, on_ssh_poll, tab);
             gtk_widget_grab_focus(tab->terminal);
         } else {
             char msg[512];
-            snprintf(msg, sizeof(msg), "Connection failed: %s\r\n", ssh_get_error_msg(tab->ssh_ctx));
+            const ConnectTiming *t = &tab->ssh_ctx->timing;
+            if (t->failed_phase >= 0) {
+                snprintf(msg, sizeof(msg), "Connection failed during %s after %.0f ms: %s\r\n",
+                         connect_phase_name(t->failed_phase), t->total_us / 1000.0, ssh_get_error_msg(tab->ssh_ctx));
+            } else {
+                snprintf(msg, sizeof(msg), "Connection failed: %s\r\n", ssh_get_error_msg(tab->ssh_ctx));
+            }
             vte_terminal_feed(VTE_TERMINAL(tab->terminal), msg, -1);
         }
     }
 
     g_free(cd->hostname);
     g_free(cd->username);
-    g_free(cd->password);
+    db_free_password(cd->password);
     g_free(cd->key_path);
     g_free(cd->proxy_hostname);
     g_free(cd->proxy_user);
-    g_free(cd->proxy_password);
+    db_free_password(cd->proxy_password);
     g_free(cd->proxy_key_path);
     g_free(cd);
     
@@ -127,6 +309,7 @@ static gboolean on_connection_complete(gpointer data) {
 
 static gpointer connection_thread_func(gpointer data) {
     ConnectionData *cd = (ConnectionData *)data;
+    trace_set_thread_name("ssh-connect");
     
     cd->result = ssh_connect_to_server(cd->ssh_ctx, 
         cd->hostname, cd->port, cd->username, cd->password, cd->key_path,
@@ -137,11 +320,17 @@ static gpointer connection_thread_func(gpointer data) {
     return NULL;
 }
 
-void terminal_view_connect(GtkWidget *view, const char *hostname, int port, const char *username, const char *password, const char *key_path, const char *protocol, Host *proxy_host) {
+void terminal_view_connect(GtkWidget *view, const Host *host, const Host *proxy_host) {
     GtkNotebook *notebook = GTK_NOTEBOOK(view);
+    const char *hostname = host->hostname;
+    const char *username = host->username;
+    const char *protocol = host->protocol;
+    int port = host->port;
     
     TerminalTab *tab = g_new0(TerminalTab, 1);
     tab->notebook = view;
+    tab->host_id = host->id;
+    tab->proxy_host_id = proxy_host ? proxy_host->id : 0;
     
     GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
     tab->box = box;
@@ -172,6 +361,22 @@ void terminal_view_connect(GtkWidget *view, const char *hostname, int port, cons
     gtk_button_set_has_frame(GTK_BUTTON(close_btn), FALSE);
     
     gtk_box_append(GTK_BOX(label_box), label);
+
+    bool is_ssh = !(g_strcmp0(protocol, "telnet") == 0 || g_strcmp0(protocol, "ftp") == 0 || g_strcmp0(protocol, "sftp") == 0);
+    if (is_ssh) {
+        GtkWidget *timing_popover = gtk_popover_new();
+        g_signal_connect(timing_popover, "show", G_CALLBACK(on_timing_popover_show), tab);
+        GtkWidget *timing_btn = gtk_menu_button_new();
+        gtk_menu_button_set_icon_name(GTK_MENU_BUTTON(timing_btn), "dialog-information-symbolic");
+        gtk_menu_button_set_has_frame(GTK_MENU_BUTTON(timing_btn), FALSE);
+        gtk_menu_button_set_popover(GTK_MENU_BUTTON(timing_btn), timing_popover);
+        gtk_widget_set_focusable(timing_btn, FALSE);
+        gtk_widget_set_tooltip_text(timing_btn, "Connection timing");
+        gtk_box_append(GTK_BOX(label_box), timing_btn);
+        GtkWidget *stats_btn = session_stats_button_new(tab_stats_source, tab);
+        session_stats_button_set_host(stats_btn, tab->host_id, tab->proxy_host_id);
+        gtk_box_append(GTK_BOX(label_box), stats_btn);
+    }
     gtk_box_append(GTK_BOX(label_box), close_btn);
     
     g_object_set_data(G_OBJECT(close_btn), "page_widget", box);
@@ -182,9 +387,9 @@ void terminal_view_connect(GtkWidget *view, const char *hostname, int port, cons
     gtk_notebook_set_tab_reorderable(notebook, box, TRUE);
     gtk_notebook_set_current_page(notebook, page_num);
 
-    db_add_history(hostname, username, protocol ? protocol : "ssh");
+    db_async_add_history(hostname, username, protocol ? protocol : "ssh");
 
-    if (g_strcmp0(protocol, "telnet") == 0 || g_strcmp0(protocol, "ftp") == 0 || g_strcmp0(protocol, "sftp") == 0) {
+    if (!is_ssh) {
         char *argv[10] = {NULL};
         int arg_idx = 0;
         
@@ -253,8 +458,9 @@ void terminal_view_connect(GtkWidget *view, const char *hostname, int port, cons
         cd->hostname = g_strdup(hostname);
         cd->port = port;
         cd->username = g_strdup(username);
-        cd->password = g_strdup(password);
-        cd->key_path = g_strdup(key_path);
+        cd->password = g_strdup(host->password);
+        cd->key_path = g_strdup(host->key_path);
+        cd->host_id = host->id;
         
         if (proxy_host) {
             cd->proxy_hostname = g_strdup(proxy_host->hostname);
@@ -262,6 +468,7 @@ void terminal_view_connect(GtkWidget *view, const char *hostname, int port, cons
             cd->proxy_user = g_strdup(proxy_host->username);
             cd->proxy_password = g_strdup(proxy_host->password);
             cd->proxy_key_path = g_strdup(proxy_host->key_path);
+            cd->proxy_host_id = proxy_host->id;
         }
 
         // Start connection thread
@@ -4,6 +4,7 @@
 #include "terminal_view.h"
 #include "sftp_view.h"
 #include "settings_view.h"
+#include "quick_connect.h"
 
 static GtkWidget *home_btn;
 static GtkWidget *hosts_btn;
@@ -56,6 +57,11 @@ static void on_fullscreen_clicked(GtkWidget *btn, gpointer user_data) {
     }
 }
 
+static gboolean on_quick_connect(GtkWidget *widget, GVariant *args, gpointer user_data) {
+    show_quick_connect(GTK_WINDOW(widget), GTK_WIDGET(user_data));
+    return TRUE;
+}
+
 static GtkWidget* create_nav_btn(const char* label, const char* icon_name) {
     GtkWidget *btn = gtk_button_new();
     GtkWidget *box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 12);
@@ -152,6 +158,14 @@ GtkWidget* create_main_window(GtkApplication *app) {
     g_signal_connect(term_btn, "clicked", G_CALLBACK(on_nav_button_clicked), stack);
     g_signal_connect(settings_btn, "clicked", G_CALLBACK(on_nav_button_clicked), stack);
 
+    // Ctrl+Shift+K opens the quick-connect palette from any view. Plain Ctrl+K
+    // belongs to the shell (kill to end of line), so the terminal keeps it.
+    GtkEventController *shortcuts = gtk_shortcut_controller_new();
+    gtk_event_controller_set_propagation_phase(shortcuts, GTK_PHASE_CAPTURE);
+    gtk_shortcut_controller_add_shortcut(GTK_SHORTCUT_CONTROLLER(shortcuts),
+        gtk_shortcut_new(gtk_shortcut_trigger_parse_string("<Control><Shift>k"), gtk_callback_action_new(on_quick_connect, stack, NULL)));
+    gtk_widget_add_controller(window, shortcuts);
+
     // Init active state
     update_button_active_state(home_btn);
 